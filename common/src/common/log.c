@@ -71,7 +71,6 @@ void log_handle_error( const int line, const char* file, const char* msg, ... )
 {
     FILE* fp = NULL;
     va_list argptr;
-    va_start( argptr, msg );
 
     if (msg == nullptr){
         return;
@@ -82,7 +81,9 @@ void log_handle_error( const int line, const char* file, const char* msg, ... )
     }
     else{
         fprintf( stdout, "!!! " );
+        va_start( argptr, msg );
         vfprintf( stdout, msg, argptr );
+        va_end( argptr );
         fprintf( stdout, "   line: %i   file: %s", line, file );
         fprintf( stdout, "\n" );
 
@@ -92,7 +93,9 @@ void log_handle_error( const int line, const char* file, const char* msg, ... )
             fp = open_log_file();
             if (fp != NULL){
                 fprintf( fp, "!!! " );
+                va_start( argptr, msg );
                 vfprintf( fp, msg, argptr );
+                va_end( argptr );
                 fprintf( fp, "   line: %i   file: %s", line, file );
                 fprintf( fp, "\n" );
 
@@ -109,7 +112,6 @@ void log_handle_warning( const int line, const char* file, const char* msg, ...
 {
     FILE* fp = NULL;
     va_list argptr;
-    va_start( argptr, msg );
 
     if (msg == nullptr){
         return;
@@ -120,7 +122,9 @@ void log_handle_warning( const int line, const char* file, const char* msg, ...
     }
     else{
         fprintf( stdout, "Warning! " );
+        va_start( argptr, msg );
         vfprintf( stdout, msg, argptr );
+        va_end( argptr );
         fprintf( stdout, "   line: %i   file: %s", line, file );
         fprintf( stdout, "\n" );
 
@@ -130,7 +134,9 @@ void log_handle_warning( const int line, const char* file, const char* msg, ...
             fp = open_log_file();
             if (fp != NULL){
                 fprintf( fp, "Warning! " );
+                va_start( argptr, msg );
                 vfprintf( fp, msg, argptr );
+                va_end( argptr );
                 fprintf( fp, "   line: %i   file: %s", line, file );
                 fprintf( fp, "\n" );
 
@@ -148,7 +154,6 @@ void log_trace( const int line, const char* file, const char* msg, ... )
 {
     FILE* fp = NULL;
     va_list argptr;
-    va_start( argptr, msg );
 
     if (msg == nullptr){
         return;
@@ -159,20 +164,26 @@ void log_trace( const int line, const char* file, const char* msg, ... )
     }
     else{
         if (show_trace_msg_flag){
+            va_start( argptr, msg );
             vfprintf( stdout, msg, argptr );
+            va_end( argptr );
         }
         if (trace_log_is_bussy == 0)
         {
             trace_log_is_bussy = 1;
             fp = open_log_file();
             if (fp != NULL){
+                va_start( argptr, msg );
                 vfprintf( fp, msg, argptr );
+                va_end( argptr );
                 fclose( fp );
             }
             trace_log_is_bussy = 0;
         }
 #ifdef _DEBUG
+        va_start( argptr, msg );
         vfprintf( stdout, msg, argptr );
+        va_end( argptr );
 #endif
     }
 }
@@ -183,7 +194,6 @@ void log_info( const int line, const char* file, const char* msg, ... )
 {
     FILE* fp = NULL;
     va_list argptr;
-    va_start( argptr, msg );
 
     if (msg == nullptr){
         return;
@@ -193,14 +203,18 @@ void log_info( const int line, const char* file, const char* msg, ... )
         f_info_callback( msg, line, file, LOG_MSG_INFO );
     }
     else{
+        va_start( argptr, msg );
         vfprintf( stdout, msg, argptr );
+        va_end( argptr );
 
         if (trace_log_is_bussy == 0)
         {
             trace_log_is_bussy = 1;
             fp = open_log_file();
             if (fp != NULL){
+                va_start( argptr, msg );
                 vfprintf( fp, msg, argptr );
+                va_end( argptr );
                 fclose( fp );
             }
             trace_log_is_bussy = 0;
@@ -215,7 +229,6 @@ void log_trail( const int line, const char* file, const char* msg, ... )
 #if _DEBUG
     FILE* fp = NULL;
     va_list argptr;
-    va_start( argptr, msg );
 
     if (msg == nullptr){
         return;
@@ -225,7 +238,9 @@ void log_trail( const int line, const char* file, const char* msg, ... )
         f_info_callback( msg, line, file, LOG_MSG_DEBUG );
     }
     else{
+        va_start( argptr, msg );
         vfprintf( stdout, msg, argptr );
+        va_end( argptr );
         fprintf( stdout, "   line: %i   file: %s", line, file );
         fprintf( stdout, "\n" );
 
@@ -240,7 +255,9 @@ void log_trail( const int line, const char* file, const char* msg, ... )
             else{
                 fp = fopen( "debug.txt", "at" );
             }
+            va_start( argptr, msg );
             vfprintf( fp, msg, argptr );
+            va_end( argptr );
             fprintf( fp, "   line: %i   file: %s", line, file );
             fprintf( fp, "\n" );
             fclose( fp );
@@ -258,13 +275,14 @@ void log_debug( const char* msg, ... )
 #if _DEBUG
     FILE* fp = NULL;
     va_list argptr;
-    va_start( argptr, msg );
 
     if (msg == nullptr){
         return;
     }
 
+    va_start( argptr, msg );
     vfprintf( stdout, msg, argptr );
+    va_end( argptr );
 
     if (trace_debug_is_bussy == 0)
     {
@@ -277,7 +295,9 @@ void log_debug( const char* msg, ... )
         else{
             fp = fopen( "debug.txt", "at" );
         }
+        va_start( argptr, msg );
         vfprintf( fp, msg, argptr );
+        va_end( argptr );
         fclose( fp );
         trace_debug_is_bussy = 0;
     }
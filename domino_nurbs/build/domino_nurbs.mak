@@ -4,7 +4,7 @@ DOMINO_NURBS_INC = -I$(PROJECTS_HOME)$/domino_nurbs$/src
 PY_DOMINO_NURBS_DIR = $(PROJECTS_HOME)$/domino_nurbs$/src$/domino_nurbs_py$/
 
 #### Source files #####
-DOMINO_NURBS_C = nurbs_ascii_io.c nurbs_basis.c nurbs_controlbox.c nurbs_curve.c nurbs_iges_io.c nurbs_surface.c nurbs_surface_inversion.c nurbs_surface_intersection.c
+DOMINO_NURBS_C = nurbs_ascii_io.c nurbs_basis.c nurbs_binary_io.c nurbs_controlbox.c nurbs_controlbox_index.c nurbs_controlbox_weights.c nurbs_curve.c nurbs_curve_arclength.c nurbs_curve_projection.c nurbs_iges_io.c nurbs_mesh_cache.c nurbs_precision.c nurbs_surface.c nurbs_surface_batch.c nurbs_surface_bezier.c nurbs_surface_bvh.c nurbs_surface_inversion.c nurbs_surface_intersection.c nurbs_surface_layout.c nurbs_surface_tessellation.c nurbs_text.c
 DOMINO_NURBS_SRC := $(addprefix $(DOMINO_NURBS_DIR), $(DOMINO_NURBS_C))
 DOMINO_NURBS_OBJ = $(DOMINO_NURBS_C:.c=.o)
 
@@ -16,7 +16,7 @@ domino_nurbs_obj:
 	@echo ________________________________________________
 	@echo Compiling domino_nurbs...  SYSTEM configured for $(SYSTEM)
 	@echo ________________________________________________
-	$(CC) -O2 -x c -c $(PIC)  \
+	$(CC) ${CCFLAGS} -x c -c  \
 	$(COMMON_INC) $(DOMINO_NURBS_INC) $(DOMINO_NURBS_SRC)
 	
 	@echo Done!!
@@ -1,4 +1,6 @@
 
+#include <stdio.h>
+#include <string.h>
 #include <malloc.h>
 #include <memory.h>
 #include <math.h>
@@ -1372,8 +1374,114 @@ void check_nurbs_basis()
 }
 
 
+/* The basis of the stack buffers (only the non zero values) are the same as
+ * the full arrays, and the evaluation of the box is the same as the sum 
+ * with the full arrays, also from several threads */
+int check_local_basis()
+{
+    const int num_cp = 7;
+    const int n = 257;
+    NurbsFloat full[num_cp], d_full[num_cp];
+    NurbsFloat local[NURBS_MAX_DEGREE + 2], d_local[NURBS_MAX_DEGREE + 2];
+    NurbsFloat bu[num_cp], bv[num_cp], bw[num_cp];
+    NurbsVector3 serial[n], parallel[n];
+    NurbsControlBox cb;
+    int errors = 0;
+
+    for (int equation = 0; equation <= 1; equation++){
+        for (int order = 0; order <= 5; order++){
+            /* The Bezier basis are piecewise cubic, with 4 non zero values */
+            const int width = (equation == 1) ? 4 : order + 1;
+
+            for (int i = 0; i < n; i++){
+                const NurbsFloat t = -0.05 + 1.1 * (NurbsFloat)i / (n - 1);
+
+                nurbs_controlbox_basis_function( full, t, num_cp, order, equation );
+                int iknot = nurbs_controlbox_local_basis_function
+                    ( local, t, num_cp, order, equation );
+                for (int k = 0; k < num_cp; k++){
+                    const int j = k - iknot;
+                    const NurbsFloat b = (j >= 0 && j < width) ? local[j] : 0;
+                    errors += (memcmp( &b, &full[k], sizeof(NurbsFloat) ) != 0);
+                }
+
+                nurbs_controlbox_d_basis_function( d_full, full, t, num_cp, order, equation );
+                iknot = nurbs_controlbox_local_d_basis_function
+                    ( d_local, local, t, num_cp, order, equation );
+                for (int k = 0; k < num_cp; k++){
+                    const int j = k - iknot;
+                    const NurbsFloat d = (j >= 0 && j < width) ? d_local[j] : 0;
+                    errors += (memcmp( &d, &d_full[k], sizeof(NurbsFloat) ) != 0);
+                }
+            }
+        }
+    }
+    printf( "\ncheck_local_basis: basis %i errors", errors );
+
+    nurbs_controlbox_alloc( &cb, num_cp, 5, 4 );
+    for (int i = 0; i < cb.cp_length_u; i++){
+        for (int j = 0; j < cb.cp_length_v; j++){
+            for (int k = 0; k < cb.cp_length_w; k++){
+                cb.cp[i][j][k].x = (NurbsFloat)i + 0.1 * sin( (double)(j + k) );
+                cb.cp[i][j][k].y = (NurbsFloat)j + 0.1 * cos( (double)(i * k) );
+                cb.cp[i][j][k].z = (NurbsFloat)k + 0.1 * sin( (double)(i - j) );
+            }
+        }
+    }
+
+    NurbsFloat max_error = 0;
+    for (int equation = 0; equation <= 1; equation++){
+        cb.basis_equation = equation;
+        cb.order_u = 3;
+        cb.order_v = 2;
+        cb.order_w = 1;
+
+        #pragma omp parallel for
+        for (int i = 0; i < n; i++){
+            const NurbsFloat t = (NurbsFloat)i / (n - 1);
+            parallel[i] = nurbs_controlbox_get_point( &cb, t, 1 - t, t * t );
+        }
+
+        for (int i = 0; i < n; i++){
+            const NurbsFloat t = (NurbsFloat)i / (n - 1);
+            NurbsVector3 p = { 0, 0, 0 };
+
+            serial[i] = nurbs_controlbox_get_point( &cb, t, 1 - t, t * t );
+            errors += (memcmp( &serial[i], &parallel[i], sizeof(NurbsVector3) ) != 0);
+
+            nurbs_controlbox_basis_function( bu, t, cb.cp_length_u, cb.order_u, equation );
+            nurbs_controlbox_basis_function( bv, 1 - t, cb.cp_length_v, cb.order_v, equation );
+            nurbs_controlbox_basis_function( bw, t * t, cb.cp_length_w, cb.order_w, equation );
+            for (int iu = 0; iu < cb.cp_length_u; iu++){
+                for (int iv = 0; iv < cb.cp_length_v; iv++){
+                    for (int iw = 0; iw < cb.cp_length_w; iw++){
+                        const NurbsFloat b = bu[iu] * bv[iv] * bw[iw];
+                        p.x += b * cb.cp[iu][iv][iw].x;
+                        p.y += b * cb.cp[iu][iv][iw].y;
+                        p.z += b * cb.cp[iu][iv][iw].z;
+                    }
+                }
+            }
+            max_error = fmax( max_error, fabs( p.x - serial[i].x ) );
+            max_error = fmax( max_error, fabs( p.y - serial[i].y ) );
+            max_error = fmax( max_error, fabs( p.z - serial[i].z ) );
+        }
+    }
+    if (max_error > 1e-12){
+        errors++;
+    }
+
+    nurbs_controlbox_dispose( &cb );
+
+    printf( "\ncheck_local_basis: point error %g, %i errors\n", max_error, errors );
+
+    return errors;
+}
+
+
 void main()
 {
+    check_local_basis();
     calculate_basis2_11();
     calculate_basis3_11();
     calculate_basis4_11();
@@ -1,11 +1,15 @@
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <memory.h>
 #include <malloc.h>
 #include <math.h>
+#include <time.h>
 
 #include "common/log.h"
 #include "common/check_malloc.h"
 #include "domino_nurbs/nurbs_curve.h"
+#include "domino_nurbs/nurbs_controlbox.h"
 
 static int fac( const int n ){
     if (n <= 0){
@@ -219,6 +223,111 @@ void compare_nurbs_ffd_basis()
     }
 }
 
+/* Moves a few control points at a time, updates the deformed points 
+ * incrementally, and compares them with a full deformation */
+int check_weights_update()
+{
+    const int num_points = 20000;
+    const int num_steps = 50;
+    const int num_moved = 3;
+    NurbsControlBox cb;
+    NurbsControlBoxWeights weights;
+    int errors = 0;
+
+    srand(4321);
+
+    nurbs_controlbox_alloc(&cb, 6, 5, 4);
+    cb.order_u = 2;
+    cb.order_v = 2;
+    cb.order_w = 2;
+    for (int i = 0; i < cb.cp_length_u; i++){
+        for (int j = 0; j < cb.cp_length_v; j++){
+            for (int k = 0; k < cb.cp_length_w; k++){
+                cb.cp[i][j][k].x = (NurbsFloat)i + 0.1 * sin(j + k);
+                cb.cp[i][j][k].y = (NurbsFloat)j + 0.1 * cos(i * k);
+                cb.cp[i][j][k].z = (NurbsFloat)k + 0.1 * sin(i - j);
+            }
+        }
+    }
+    const int num_cp = cb.cp_length_u * cb.cp_length_v * cb.cp_length_w;
+
+    NurbsVector3* param = (NurbsVector3*)malloc(sizeof(NurbsVector3) * num_points);
+    NurbsVector3* points = (NurbsVector3*)malloc(sizeof(NurbsVector3) * num_points);
+    NurbsVector3* full = (NurbsVector3*)malloc(sizeof(NurbsVector3) * num_points);
+    for (int i = 0; i < num_points; i++){
+        param[i].x = (NurbsFloat)rand() / RAND_MAX;
+        param[i].y = (NurbsFloat)rand() / RAND_MAX;
+        param[i].z = (NurbsFloat)rand() / RAND_MAX;
+    }
+
+    nurbs_controlbox_weights_init(&weights);
+    if (!nurbs_controlbox_weights_compute(&weights, &cb, param, num_points)
+        || !nurbs_controlbox_weights_set_support(&weights)
+        || !nurbs_controlbox_weights_deform(points, &weights, &cb))
+    {
+        _debug_("Weights update: cannot compute the weights\n");
+        errors++;
+    }
+
+    clock_t clocks_update = 0, clocks_full = 0;
+    NurbsFloat max_error = 0;
+
+    for (int step = 0; step < num_steps && errors == 0; step++){
+        int cp_index[num_moved];
+        NurbsVector3 delta[num_moved];
+
+        for (int m = 0; m < num_moved; m++){
+            cp_index[m] = rand() % num_cp;
+            delta[m].x = ((NurbsFloat)rand() / RAND_MAX - 0.5) * 0.2;
+            delta[m].y = ((NurbsFloat)rand() / RAND_MAX - 0.5) * 0.2;
+            delta[m].z = ((NurbsFloat)rand() / RAND_MAX - 0.5) * 0.2;
+            cb.cp_stream[cp_index[m]].x += delta[m].x;
+            cb.cp_stream[cp_index[m]].y += delta[m].y;
+            cb.cp_stream[cp_index[m]].z += delta[m].z;
+        }
+
+        clock_t t0 = clock();
+        if (!nurbs_controlbox_weights_update(points, &weights, cp_index, delta, num_moved)){
+            errors++;
+        }
+        clock_t t1 = clock();
+        nurbs_controlbox_weights_deform(full, &weights, &cb);
+        clock_t t2 = clock();
+        clocks_update += t1 - t0;
+        clocks_full += t2 - t1;
+
+        for (int i = 0; i < num_points; i++){
+            max_error = fmax(max_error, fabs(points[i].x - full[i].x));
+            max_error = fmax(max_error, fabs(points[i].y - full[i].y));
+            max_error = fmax(max_error, fabs(points[i].z - full[i].z));
+        }
+    }
+
+    /* The full deformation is also the point of the box */
+    for (int i = 0; i < num_points && errors == 0; i += 97){
+        NurbsVector3 p = nurbs_controlbox_get_point(&cb, param[i].x, param[i].y, param[i].z);
+        max_error = fmax(max_error, fabs(p.x - full[i].x));
+        max_error = fmax(max_error, fabs(p.y - full[i].y));
+        max_error = fmax(max_error, fabs(p.z - full[i].z));
+    }
+
+    if (max_error > 1e-12){
+        errors++;
+    }
+
+    _debug_("Weights update: max error %g, update %i clocks, full deformation %i clocks\n"
+        , max_error, (int)clocks_update, (int)clocks_full);
+
+    nurbs_controlbox_weights_dispose(&weights);
+    nurbs_controlbox_dispose(&cb);
+    free(param);
+    free(points);
+    free(full);
+
+    return errors;
+}
+
+
 //void check_derivatives()
 //{
 //    NurbsFloat berns[3];
@@ -575,6 +684,10 @@ int main()
     //check_basis_01();
     compare_nurbs_ffd_basis();
 
+    if (check_weights_update() != 0){
+        _debug_("check_weights_update failed\n");
+    }
+
     //check_get_point();
     //check_derivatives();
     //check_get_inversion();
@@ -1,17 +1,404 @@
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+#include "common/log.h"
+
 #include "domino_nurbs/domino_nurbs.h"
+#include "domino_nurbs/nurbs_text.h"
+
+/* Random value with all the digits of a double */
+static NurbsFloat random_value()
+{
+    double r = (double)rand() / RAND_MAX + (double)rand() / RAND_MAX / RAND_MAX;
+    return (NurbsFloat)((r - 0.5) * 2000.0 / (1 + rand() % 1000));
+}
+
+static int compare_values(const NurbsFloat* a, const NurbsFloat* b, const int length)
+{
+    int errors = 0;
+    for (int i = 0; i < length; i++){
+        if (memcmp(&a[i], &b[i], sizeof(NurbsFloat)) != 0){
+            errors++;
+        }
+    }
+    return errors;
+}
+
+/* Writes random entities to ASCII and IGES files, reads them back and checks
+ * that all values are exactly the same */
+int check_round_trip()
+{
+    const int num_curves = 4;
+    const int num_surfaces = 16;
+    const int num_cb = 64;
+    int errors = 0;
+
+    srand(1234);
+
+    NurbsCurve* curves = (NurbsCurve*)calloc(num_curves, sizeof(NurbsCurve));
+    for (int k = 0; k < num_curves; k++){
+        NurbsCurve* c = &curves[k];
+        nurbs_curve_alloc(c, 9, 3);
+        c->id = 10 + k;
+        c->label = (char*)calloc(DOMINO_NURBS_LABEL_LEN, 1);
+        sprintf(c->label, "curve%i", k);
+        for (int i = 0; i < c->knot_length; i++){
+            c->knot[i] = (i < 4) ? 0 : ((i > 8) ? 1 : (NurbsFloat)(i - 3) / 6);
+        }
+        for (int i = 0; i < c->cp_length; i++){
+            c->cp[i].x = random_value();
+            c->cp[i].y = random_value();
+            c->cp[i].z = random_value();
+            c->cp[i].w = 1 + random_value() / 2000;
+        }
+    }
+
+    NurbsSurface* surfaces = (NurbsSurface*)calloc(num_surfaces, sizeof(NurbsSurface));
+    for (int k = 0; k < num_surfaces; k++){
+        NurbsSurface* s = &surfaces[k];
+        nurbs_surface_init(s);
+        nurbs_surface_alloc(s, 12, 7, 3, 2);
+        s->id = 100 + k;
+        sprintf(s->label, "surf%i", k);
+        for (int i = 0; i < s->knot_length_u; i++){
+            s->knot_u[i] = (i < 4) ? 0 : ((i > 11) ? 1 : (NurbsFloat)(i - 3) / 9);
+        }
+        for (int i = 0; i < s->knot_length_v; i++){
+            s->knot_v[i] = (i < 3) ? 0 : ((i > 6) ? 1 : (NurbsFloat)(i - 2) / 5);
+        }
+        for (int i = 0; i < s->cp_length_u; i++){
+            for (int j = 0; j < s->cp_length_v; j++){
+                s->cp[i][j].x = random_value();
+                s->cp[i][j].y = random_value();
+                s->cp[i][j].z = random_value();
+                s->cp[i][j].w = 1 + random_value() / 2000;
+            }
+        }
+    }
+
+    NurbsControlBox* cbs = (NurbsControlBox*)calloc(num_cb, sizeof(NurbsControlBox));
+    for (int k = 0; k < num_cb; k++){
+        NurbsControlBox* cb = &cbs[k];
+        nurbs_controlbox_alloc(cb, 5, 4, 3);
+        cb->id = 1000 + k;
+        sprintf(cb->label, "cb%i", k);
+        for (int i = 0; i < 5 * 4 * 3; i++){
+            cb->cp_stream[i].x = random_value();
+            cb->cp_stream[i].y = random_value();
+            cb->cp_stream[i].z = random_value();
+        }
+    }
+
+    /* ASCII */
+    clock_t t0 = clock();
+    nurbs_export_ascii("round_trip.NURBS", curves, num_curves, surfaces, num_surfaces, cbs, num_cb);
+    clock_t t1 = clock();
+    _debug_("ASCII export: %i clocks\n", (int)(t1 - t0));
+
+    NurbsCurve* curves2 = nullptr;
+    NurbsSurface* surfaces2 = nullptr;
+    NurbsControlBox* cbs2 = nullptr;
+    int nc = 0, ns = 0, ncb = 0;
+    nurbs_import_ascii("round_trip.NURBS", &curves2, &nc, &surfaces2, &ns, &cbs2, &ncb);
+
+    if (nc != num_curves || ns != num_surfaces || ncb != num_cb){
+        _debug_("ASCII: wrong number of entities\n");
+        errors++;
+    }
+    for (int k = 0; k < nc && k < num_curves; k++){
+        errors += compare_values(&curves[k].cp[0].x, &curves2[k].cp[0].x, 4 * curves[k].cp_length);
+        errors += compare_values(curves[k].knot, curves2[k].knot, curves[k].knot_length);
+    }
+    for (int k = 0; k < ns && k < num_surfaces; k++){
+        errors += compare_values(&surfaces[k].cp_stream[0].x, &surfaces2[k].cp_stream[0].x
+            , 4 * surfaces[k].cp_length_u * surfaces[k].cp_length_v);
+        errors += compare_values(surfaces[k].knot_u, surfaces2[k].knot_u, surfaces[k].knot_length_u);
+        errors += compare_values(surfaces[k].knot_v, surfaces2[k].knot_v, surfaces[k].knot_length_v);
+    }
+    for (int k = 0; k < ncb && k < num_cb; k++){
+        for (int i = 0; i < 5 * 4 * 3; i++){
+            errors += compare_values(&cbs[k].cp_stream[i].x, &cbs2[k].cp_stream[i].x, 3);
+        }
+    }
+    _debug_("ASCII round trip: %i errors\n", errors);
+
+    nurbs_curve_free(curves2, nc);
+    nurbs_surface_free(surfaces2, ns);
+    nurbs_controlbox_free(cbs2, ncb);
+
+    /* IGES */
+    t0 = clock();
+    nurbs_export_iges("round_trip.igs", curves, num_curves, surfaces, num_surfaces);
+    t1 = clock();
+    _debug_("IGES export: %i clocks\n", (int)(t1 - t0));
+
+    nurbs_import_iges("round_trip.igs", &curves2, &nc, &surfaces2, &ns);
+
+    if (nc != num_curves || ns != num_surfaces){
+        _debug_("IGES: wrong number of entities\n");
+        errors++;
+    }
+    for (int k = 0; k < nc && k < num_curves; k++){
+        errors += compare_values(&curves[k].cp[0].x, &curves2[k].cp[0].x, 4 * curves[k].cp_length);
+        errors += compare_values(curves[k].knot, curves2[k].knot, curves[k].knot_length);
+    }
+    for (int k = 0; k < ns && k < num_surfaces; k++){
+        errors += compare_values(&surfaces[k].cp_stream[0].x, &surfaces2[k].cp_stream[0].x
+            , 4 * surfaces[k].cp_length_u * surfaces[k].cp_length_v);
+        errors += compare_values(surfaces[k].knot_u, surfaces2[k].knot_u, surfaces[k].knot_length_u);
+        errors += compare_values(surfaces[k].knot_v, surfaces2[k].knot_v, surfaces[k].knot_length_v);
+    }
+    _debug_("ASCII and IGES round trip: %i errors\n", errors);
+
+    nurbs_curve_free(curves2, nc);
+    nurbs_surface_free(surfaces2, ns);
+
+    /* Binary */
+    t0 = clock();
+    if (!nurbs_export_binary("round_trip.nurbsb", curves, num_curves
+        , surfaces, num_surfaces, cbs, num_cb))
+    {
+        _debug_("Binary: export failed\n");
+        errors++;
+    }
+    t1 = clock();
+    _debug_("Binary export: %i clocks\n", (int)(t1 - t0));
+
+    NurbsModel model;
+    nurbs_model_init(&model);
+    if (!nurbs_model_load(&model, "round_trip.nurbsb")
+        || model.num_curves != num_curves || model.num_surfaces != num_surfaces
+        || model.num_controlboxes != num_cb)
+    {
+        _debug_("Binary: wrong number of entities\n");
+        errors++;
+    }
+    for (int k = 0; k < model.num_curves && k < num_curves; k++){
+        errors += compare_values(&curves[k].cp[0].x, &model.curve[k].cp[0].x, 4 * curves[k].cp_length);
+        errors += compare_values(curves[k].knot, model.curve[k].knot, curves[k].knot_length);
+        errors += (strcmp(curves[k].label, model.curve[k].label) != 0);
+    }
+    for (int k = 0; k < model.num_surfaces && k < num_surfaces; k++){
+        errors += compare_values(&surfaces[k].cp_stream[0].x, &model.surface[k].cp_stream[0].x
+            , 4 * surfaces[k].cp_length_u * surfaces[k].cp_length_v);
+        errors += compare_values(surfaces[k].knot_u, model.surface[k].knot_u, surfaces[k].knot_length_u);
+        errors += compare_values(surfaces[k].knot_v, model.surface[k].knot_v, surfaces[k].knot_length_v);
+        errors += (model.surface[k].id != surfaces[k].id);
+    }
+    for (int k = 0; k < model.num_controlboxes && k < num_cb; k++){
+        for (int i = 0; i < 5 * 4 * 3; i++){
+            errors += compare_values(&cbs[k].cp_stream[i].x, &model.controlbox[k].cp_stream[i].x, 3);
+        }
+    }
+    nurbs_model_dispose(&model);
+
+    /* Headers whose counts add up to a small (or zero) number of records
+     * in 32 bits must be rejected */
+    {
+        const int counts[2][3] = { { 0x7fffffff, 0x7fffffff, 2 }, { -1, 1, 0 } };
+        FILE* in = fopen("round_trip.nurbsb", "rb");
+        char* image = nullptr;
+        long size = 0;
+
+        if (in != nullptr){
+            fseek(in, 0, SEEK_END);
+            size = ftell(in);
+            fseek(in, 0, SEEK_SET);
+            image = new char[size];
+            size = (long)fread(image, 1, size, in);
+            fclose(in);
+        }
+        for (int c = 0; c < 2 && image != nullptr; c++){
+            /* The counts follow the signature and three integers */
+            memcpy(image + 20, counts[c], sizeof(counts[c]));
+            FILE* out = fopen("round_trip_corrupted.nurbsb", "wb");
+            fwrite(image, 1, size, out);
+            fclose(out);
+
+            nurbs_model_init(&model);
+            if (nurbs_model_load(&model, "round_trip_corrupted.nurbsb")){
+                _debug_("Binary: corrupted header %i accepted\n", c);
+                errors++;
+            }
+            nurbs_model_dispose(&model);
+        }
+        delete[] image;
+    }
+
+    /* The conversion reports the status of the export */
+    if (!nurbs_convert_binary_to_ascii("round_trip.nurbsb", "round_trip_binary.NURBS")){
+        _debug_("Binary: conversion to ASCII failed\n");
+        errors++;
+    }
+    if (nurbs_convert_binary_to_ascii("round_trip.nurbsb", "no_such_dir/round_trip.NURBS")){
+        _debug_("Binary: conversion to a wrong path did not fail\n");
+        errors++;
+    }
+    _debug_("ASCII, IGES and binary round trip: %i errors\n", errors);
+
+    nurbs_curve_free(curves, num_curves);
+    nurbs_surface_free(surfaces, num_surfaces);
+    nurbs_controlbox_free(cbs, num_cb);
+
+    return errors;
+}
+
+/* Reads the entities of an IGES file on demand, in reverse order, and 
+ * compares them with the ones read at once */
+static int compare_iges_on_demand(const char* filename)
+{
+    NurbsCurve* curves = nullptr;
+    NurbsSurface* surfaces = nullptr;
+    NurbsIges iges;
+    int nc = 0, ns = 0, errors = 0;
+
+    nurbs_import_iges(filename, &curves, &nc, &surfaces, &ns);
+
+    nurbs_iges_init(&iges);
+    if (!nurbs_iges_open(&iges, filename) || iges.num_entities != nc + ns){
+        _debug_("IGES on demand: cannot open %s\n", filename);
+        nurbs_curve_free(curves, nc);
+        nurbs_surface_free(surfaces, ns);
+        return 1;
+    }
+
+    for (int k = iges.num_entities - 1; k >= 0; k--){
+        if (k >= nc){
+            const NurbsSurface* a = &surfaces[k - nc];
+            const NurbsSurface* b = nurbs_iges_get_surface(&iges, k);
+            if (b == nullptr){
+                errors++;
+                continue;
+            }
+            errors += compare_values(&a->cp_stream[0].x, &b->cp_stream[0].x
+                , 4 * a->cp_length_u * a->cp_length_v);
+            errors += compare_values(a->knot_u, b->knot_u, a->knot_length_u);
+            errors += compare_values(a->knot_v, b->knot_v, a->knot_length_v);
+        }
+        else{
+            const NurbsCurve* a = &curves[k];
+            const NurbsCurve* b = nurbs_iges_get_curve(&iges, k);
+            if (b == nullptr){
+                errors++;
+                continue;
+            }
+            errors += compare_values(&a->cp[0].x, &b->cp[0].x, 4 * a->cp_length);
+            errors += compare_values(a->knot, b->knot, a->knot_length);
+        }
+    }
+
+    nurbs_iges_close(&iges);
+    nurbs_curve_free(curves, nc);
+    nurbs_surface_free(surfaces, ns);
+
+    return errors;
+}
+
+
+/* Reads the IGES file of the round trip on demand: once with lines of the 
+ * same size, where the positions are calculated, and once with mixed line
+ * endings, where the position of each line is stored */
+int check_iges_on_demand()
+{
+    int errors = compare_iges_on_demand("round_trip.igs");
+
+    FILE* in = fopen("round_trip.igs", "rb");
+    FILE* out = fopen("round_trip_crlf.igs", "wb");
+    if (in == NULL || out == NULL){
+        _debug_("IGES on demand: cannot copy the file\n");
+        return 1;
+    }
+    char line[256];
+    for (int i = 0; fgets(line, sizeof(line), in) != NULL; i++){
+        const size_t length = strlen(line);
+        if (i % 2 == 1 && length > 0 && line[length - 1] == '\n'){
+            strcpy(&line[length - 1], "\r\n");
+        }
+        fputs(line, out);
+    }
+    fclose(in);
+    fclose(out);
+
+    errors += compare_iges_on_demand("round_trip_crlf.igs");
+
+    _debug_("IGES on demand: %i errors\n", errors);
+
+    return errors;
+}
+
+
+/* Numbers with more characters than the buffer of strtod() in the slow 
+ * path are read completely, not truncated */
+int check_long_numbers()
+{
+    char text[256];
+    const char* end;
+    int errors = 0;
+
+    /* 0.1 with 100 zeros after the last digit: still exactly 0.1 */
+    strcpy(text, "0.1");
+    for (int i = 0; i < 100; i++){
+        strcat(text, "0");
+    }
+    strcat(text, "1E-5");
+    NurbsFloat value = nurbs_text_to_float(text, &end);
+    if (value != 1e-6 || *end != '\0'){
+        _debug_("Long number: %.17g\n", value);
+        errors++;
+    }
+
+    /* 80 significant digits with the exponent at the end */
+    strcpy(text, "-1.");
+    for (int i = 0; i < 80; i++){
+        text[3 + i] = '0' + (char)(i % 10);
+    }
+    strcpy(text + 83, "D+3");
+    value = nurbs_text_to_float(text, &end);
+    if (fabs(value + 1012.3456789012345) > 1e-12 || *end != '\0'){
+        _debug_("Long number with D exponent: %.17g\n", value);
+        errors++;
+    }
+
+    _debug_("Long numbers: %i errors\n", errors);
+
+    return errors;
+}
 
 int main(int argc, char *argv[])
 {
-    int num_nurbs;
+    /* The checks do not need any file */
+    if (check_round_trip() != 0){
+        return 1;
+    }
+
+    if (check_iges_on_demand() != 0){
+        return 1;
+    }
+
+    if (check_long_numbers() != 0){
+        return 1;
+    }
+
+    /* Conversion of the old files to the current version, if they are there */
+    int num_nurbs = 0;
     NurbsSurface* nurbs_f6_array = nurbs_surface_import_ascii( "../test/f6.NURBS", &num_nurbs );
-    nurbs_surface_export_ascii( "f6_v21.NURBS", nurbs_f6_array, num_nurbs );
+    if (nurbs_f6_array != nullptr){
+        nurbs_surface_export_ascii( "f6_v21.NURBS", nurbs_f6_array, num_nurbs );
+    }
 
     NurbsSurface* nurbs_naca_array = nurbs_surface_import_ascii( "../test/naca0012_cp9_2nurbs.NURBS", &num_nurbs );
-    nurbs_surface_export_ascii( "naca0012_cp9_2nurbs_v21.NURBS", nurbs_naca_array, num_nurbs );
+    if (nurbs_naca_array != nullptr){
+        nurbs_surface_export_ascii( "naca0012_cp9_2nurbs_v21.NURBS", nurbs_naca_array, num_nurbs );
+    }
 
     NurbsControlBox* cb = nurbs_controlbox_import_ascii( "../test/controlbox_1.nurbs", &num_nurbs );
-    nurbs_controlbox_export_ascii( "cb_v21.NURBS", cb, num_nurbs );
+    if (cb != nullptr){
+        nurbs_controlbox_export_ascii( "cb_v21.NURBS", cb, num_nurbs );
+    }
 
     return 0;
 }
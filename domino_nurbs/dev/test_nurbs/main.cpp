@@ -6,6 +6,7 @@ How the Bernstein basis coefficients are calculated
 *******************************************************************************/
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include <time.h>
@@ -150,12 +151,1434 @@ void draw_basis()
 }
 
 
+/* Checks that the kernels specialized for degree 1, 2 and 3 give exactly 
+ * the same values, bit by bit, as the generic recursion */
+int check_basis_kernels()
+{
+    const int max_length = 16;
+    NurbsFloat knots[4][max_length];
+    NurbsFloat fast[max_length], fast_d[max_length];
+    NurbsFloat generic[max_length], generic_d[max_length];
+    NurbsFloat local[NURBS_MAX_DEGREE + 2], local_d[NURBS_MAX_DEGREE + 2];
+    int errors = 0;
+    int count = 0;
+
+    for (int degree = 0; degree <= 4; degree++){
+        const int num_cp = 8;
+        const int knot_length = num_cp + degree + 1;
+
+        /* Clamped uniform, clamped with different intervals, 
+         * with a repeated knot and not clamped */
+        for (int i = 0; i < knot_length; i++){
+            int j = i - degree;
+            if (j < 0) j = 0;
+            if (j > num_cp - degree) j = num_cp - degree;
+            knots[0][i] = j;
+            knots[1][i] = j*j*0.37 + j;
+            knots[2][i] = (j == 2) ? 1 : j;
+            knots[3][i] = (i - degree)*0.5;
+        }
+
+        for (int k = 0; k < 4; k++){
+            const NurbsFloat t0 = knots[k][0];
+            const NurbsFloat t1 = knots[k][knot_length - 1];
+
+            for (int it = -10; it <= 1010; it++){
+                const NurbsFloat t = t0 + (t1 - t0)*it / 1000;
+                int iknot = nurbs_basis_function
+                    ( fast, t, degree, knots[k], knot_length );
+                int iknot_g = nurbs_basis_generic_function
+                    ( generic, t, degree, knots[k], knot_length );
+                if (iknot != iknot_g 
+                    || memcmp( fast, generic, sizeof( NurbsFloat )*knot_length ) != 0){
+                    printf( "\nbasis degree %i knots %i t=%a", degree, k, t );
+                    errors++;
+                }
+
+                nurbs_basis_derivate_function
+                    ( fast_d, fast, t, degree, knots[k], knot_length );
+                nurbs_basis_generic_derivate_function
+                    ( generic_d, generic, t, degree, knots[k], knot_length );
+                if (memcmp( fast, generic, sizeof( NurbsFloat )*knot_length ) != 0
+                    || memcmp( fast_d, generic_d, sizeof( NurbsFloat )*knot_length ) != 0){
+                    printf( "\nd_basis degree %i knots %i t=%a", degree, k, t );
+                    errors++;
+                }
+
+                /* The local basis are the non zero terms of the full array */
+                int first = nurbs_basis_local_derivate_function
+                    ( local_d, local, t, degree, knots[k], knot_length );
+                for (int j = 0; j <= degree; j++){
+                    if (first + j < 0 || first + j >= knot_length){
+                        continue;
+                    }
+                    if (memcmp( &local[j], &generic[first + j], sizeof( NurbsFloat ) ) != 0
+                        || memcmp( &local_d[j], &generic_d[first + j], sizeof( NurbsFloat ) ) != 0){
+                        printf( "\nlocal basis degree %i knots %i t=%a", degree, k, t );
+                        errors++;
+                        break;
+                    }
+                }
+                count++;
+            }
+        }
+    }
+
+    /* Control box basis, b-spline and bezier */
+    for (int basis_equation = 0; basis_equation <= 1; basis_equation++){
+        for (int num_cp = 2; num_cp <= 9; num_cp++){
+            for (int order = 0; order <= 4 && order < num_cp; order++){
+                for (int it = -10; it <= 1010; it++){
+                    const NurbsFloat t = (NurbsFloat)it / 1000;
+                    int iknot = nurbs_controlbox_basis_function
+                        ( fast, t, num_cp, order, basis_equation );
+                    int iknot_g = nurbs_controlbox_generic_basis_function
+                        ( generic, t, num_cp, order, basis_equation );
+                    if (iknot != iknot_g 
+                        || memcmp( fast, generic, sizeof( NurbsFloat )*num_cp ) != 0){
+                        printf( "\ncontrol box basis %i num_cp %i order %i t=%a"
+                            , basis_equation, num_cp, order, t );
+                        errors++;
+                    }
+                    count++;
+                }
+            }
+        }
+    }
+
+    printf( "\ncheck_basis_kernels: %i evaluations, %i errors\n", count, errors );
+
+    return errors;
+}
+
+/* Checks that the cache of tessellations finds the same surface, 
+ * tessellates it again after editing a control point, releases the 
+ * meshes when invalidated, and misses a new surface at the same address */
+int check_mesh_cache()
+{
+    NurbsSurface surface;
+    NurbsMeshCache cache;
+    int errors = 0;
+
+    nurbs_surface_init( &surface );
+    nurbs_surface_alloc( &surface, 4, 4, 3, 3 );
+    for (int i = 0; i < 8; i++){
+        surface.knot_u[i] = (i < 4) ? 0 : 1;
+        surface.knot_v[i] = (i < 4) ? 0 : 1;
+    }
+    for (int i = 0; i < 4; i++){
+        for (int j = 0; j < 4; j++){
+            NurbsVector4 cp = { (NurbsFloat)i, (NurbsFloat)j, (NurbsFloat)((i + j) % 2), 1 };
+            surface.cp[i][j] = cp;
+        }
+    }
+
+    nurbs_mesh_cache_init( &cache, 0 );
+
+    const NurbsMesh* m0 = nurbs_mesh_cache_get( &cache, &surface, 0.01f, 0.2f, 4 );
+    if (m0 == nullptr || cache.misses != 1 || cache.hits != 0){
+        printf( "\nmesh cache: first look up is not a miss" );
+        errors++;
+    }
+    NurbsFloat z = (m0 != nullptr) ? m0->vertex[m0->num_vertices / 2].z : 0;
+
+    const NurbsMesh* m1 = nurbs_mesh_cache_get( &cache, &surface, 0.01f, 0.2f, 4 );
+    if (m1 != m0 || cache.misses != 1 || cache.hits != 1){
+        printf( "\nmesh cache: same surface is not a hit" );
+        errors++;
+    }
+
+    /* Edited in place */
+    surface.cp[1][1].z += 5;
+    surface.cp[1][2].z += 5;
+    surface.cp[2][1].z += 5;
+    surface.cp[2][2].z += 5;
+    nurbs_surface_modified( &surface );
+    const NurbsMesh* m2 = nurbs_mesh_cache_get( &cache, &surface, 0.01f, 0.2f, 4 );
+    if (m2 == nullptr || cache.misses != 2 || cache.num_entries != 1
+        || m2->vertex[m2->num_vertices / 2].z == z)
+    {
+        printf( "\nmesh cache: edited surface is not tessellated again" );
+        errors++;
+    }
+
+    nurbs_mesh_cache_invalidate( &cache, &surface );
+    if (cache.num_entries != 0 || cache.size != 0){
+        printf( "\nmesh cache: invalidated meshes are not released" );
+        errors++;
+    }
+    nurbs_mesh_cache_get( &cache, &surface, 0.01f, 0.2f, 4 );
+    if (cache.misses != 3 || cache.num_entries != 1){
+        printf( "\nmesh cache: invalidated surface is not a miss" );
+        errors++;
+    }
+
+    /* A new surface at the same address, with the same id */
+    const int id = surface.id;
+    nurbs_surface_dispose( &surface );
+    nurbs_surface_init( &surface );
+    nurbs_surface_alloc( &surface, 4, 4, 3, 3 );
+    surface.id = id;
+    for (int i = 0; i < 8; i++){
+        surface.knot_u[i] = (i < 4) ? 0 : 1;
+        surface.knot_v[i] = (i < 4) ? 0 : 1;
+    }
+    for (int i = 0; i < 4; i++){
+        for (int j = 0; j < 4; j++){
+            NurbsVector4 cp = { (NurbsFloat)i, (NurbsFloat)j, 0, 1 };
+            surface.cp[i][j] = cp;
+        }
+    }
+    const NurbsMesh* m3 = nurbs_mesh_cache_get( &cache, &surface, 0.01f, 0.2f, 4 );
+    if (m3 == nullptr || cache.misses != 4 || m3->vertex[m3->num_vertices / 2].z != 0){
+        printf( "\nmesh cache: a new surface gets an old mesh" );
+        errors++;
+    }
+
+    nurbs_mesh_cache_dispose( &cache );
+    nurbs_surface_dispose( &surface );
+
+    printf( "\ncheck_mesh_cache: %i errors\n", errors );
+
+    return errors;
+}
+
+/* Checks that the Bezier extraction, the homogeneous layout and the 
+ * inversion follow the control points after editing them in place */
+int check_edit_surface()
+{
+    NurbsSurface surface;
+    NurbsSurfaceBezier bezier;
+    int errors = 0;
+
+    nurbs_surface_init( &surface );
+    nurbs_surface_alloc( &surface, 5, 5, 3, 3 );
+    for (int i = 0; i < 9; i++){
+        surface.knot_u[i] = (i < 4) ? 0 : ((i > 4) ? 1 : (NurbsFloat)0.5);
+        surface.knot_v[i] = (i < 4) ? 0 : ((i > 4) ? 1 : (NurbsFloat)0.5);
+    }
+    for (int i = 0; i < 5; i++){
+        for (int j = 0; j < 5; j++){
+            NurbsVector4 cp = { (NurbsFloat)i, (NurbsFloat)j, 0, 1 };
+            surface.cp[i][j] = cp;
+        }
+    }
+
+    nurbs_surface_bezier_init( &bezier );
+    nurbs_surface_set_layout( &surface, NURBS_LAYOUT_HOMOGENEOUS );
+    const unsigned int version = surface.version;
+
+    for (int edit = 0; edit < 2; edit++){
+        if (edit == 1){
+            surface.cp[2][2].z = 4;
+            surface.cp[2][2].w = 2;
+            nurbs_surface_modified( &surface );
+        }
+        nurbs_surface_bezier_build( &bezier, &surface );
+
+        NurbsVector3 p = nurbs_surface_get_point( &surface, 0.5f, 0.5f );
+        NurbsVector3 pb = nurbs_surface_get_point_bezier( &bezier, &surface, 0.5f, 0.5f );
+        if (fabs( p.x - pb.x ) + fabs( p.y - pb.y ) + fabs( p.z - pb.z ) > 1e-5){
+            printf( "\nedit %i: Bezier point {%g %g %g} instead of {%g %g %g}"
+                , edit, pb.x, pb.y, pb.z, p.x, p.y, p.z );
+            errors++;
+        }
+        pb = nurbs_surface_get_point_bezier
+            ( nurbs_surface_get_bezier( &surface ), &surface, 0.5f, 0.5f );
+        if (fabs( p.x - pb.x ) + fabs( p.y - pb.y ) + fabs( p.z - pb.z ) > 1e-5){
+            printf( "\nedit %i: cached Bezier point {%g %g %g} instead of {%g %g %g}"
+                , edit, pb.x, pb.y, pb.z, p.x, p.y, p.z );
+            errors++;
+        }
+
+        /* The threads share the same second order surface, built once */
+        const NurbsSurface* order2 = nurbs_surface_get_order2( &surface );
+        int shared = 1;
+        #pragma omp parallel for reduction(&:shared)
+        for (int k = 0; k < 64; k++){
+            shared &= (nurbs_surface_get_order2( &surface ) == order2);
+        }
+        if (order2 == nullptr || !shared){
+            printf( "\nedit %i: the second order surface is not kept", edit );
+            errors++;
+        }
+        NurbsVector3 ph;
+        NurbsFloat uh = 0.5f, vh = 0.5f;
+        nurbs_surface_get_points( &ph, &surface, &uh, &vh, 1 );
+        if (fabs( p.x - ph.x ) + fabs( p.y - ph.y ) + fabs( p.z - ph.z ) > 1e-5){
+            printf( "\nedit %i: homogeneous point {%g %g %g} instead of {%g %g %g}"
+                , edit, ph.x, ph.y, ph.z, p.x, p.y, p.z );
+            errors++;
+        }
+        if ((edit == 0 && p.z != 0) || (edit == 1 && !(p.z > 1))){
+            printf( "\nedit %i: the point does not follow the control points", edit );
+            errors++;
+        }
+
+        /* The second order surface follows the current data */
+        NurbsFloat u = -1, v = -1;
+        nurbs_surface_inversion_min_distance( &u, &v, &surface, nullptr, &p, 1e-6f, 0.25f );
+        NurbsVector3 q = nurbs_surface_get_point( &surface, u, v );
+        if (fabs( p.x - q.x ) + fabs( p.y - q.y ) + fabs( p.z - q.z ) > 1e-3){
+            printf( "\nedit %i: inversion at {%g %g} {%g %g %g}", edit, u, v, q.x, q.y, q.z );
+            errors++;
+        }
+    }
+    if (surface.version == version){
+        printf( "\nthe version does not change" );
+        errors++;
+    }
+
+    nurbs_surface_bezier_dispose( &bezier );
+    nurbs_surface_dispose( &surface );
+
+    printf( "\ncheck_edit_surface: %i errors\n", errors );
+
+    return errors;
+}
+
+/* Surface of degree {3, 2} with inner knots and different weights */
+static void make_weighted_surface( NurbsSurface* surface )
+{
+    nurbs_surface_init( surface );
+    nurbs_surface_alloc( surface, 6, 5, 3, 2 );
+    for (int i = 0; i < surface->knot_length_u; i++){
+        surface->knot_u[i] = (i < 4) ? 0 : ((i > 5) ? 1 : (NurbsFloat)(i - 3) / 3);
+    }
+    for (int i = 0; i < surface->knot_length_v; i++){
+        surface->knot_v[i] = (i < 3) ? 0 : ((i > 4) ? 1 : (NurbsFloat)(i - 2) / 3);
+    }
+    for (int i = 0; i < 6; i++){
+        for (int j = 0; j < 5; j++){
+            NurbsVector4 cp = { (NurbsFloat)i, (NurbsFloat)j
+                , (NurbsFloat)sin( i * 0.7 + j ), (NurbsFloat)(1 + 0.25 * ((i + j) % 3)) };
+            surface->cp[i][j] = cp;
+        }
+    }
+}
+
+/* Difference between two points */
+static double point_diff( const NurbsVector3& a, const NurbsVector3& b )
+{
+    return fabs( a.x - b.x ) + fabs( a.y - b.y ) + fabs( a.z - b.z );
+}
+
+/* Checks that the layouts NURBS_LAYOUT_CP and NURBS_LAYOUT_HOMOGENEOUS
+ * give the same points and derivatives, and that the homogeneous copy 
+ * kept in the surface follows the edited control points */
+int check_layouts()
+{
+    const int n = 200;
+    NurbsSurface surface;
+    NurbsFloat u[n], v[n];
+    NurbsVector3 p[2][n], du[2][n], dv[2][n], q[2][n], qu[2][n], qv[2][n];
+    NurbsVector3 d[2][6];
+    NurbsVector3 grid[2][n];
+    double err = 0;
+    int errors = 0;
+
+    make_weighted_surface( &surface );
+
+    srand( 3 );
+    for (int k = 0; k < n; k++){
+        u[k] = (NurbsFloat)rand() / RAND_MAX;
+        v[k] = (NurbsFloat)rand() / RAND_MAX;
+    }
+    /* Both ends of the knot vectors */
+    u[0] = 0; v[0] = 0;
+    u[1] = 1; v[1] = 1;
+    u[2] = 1; v[2] = 0;
+
+    for (int edit = 0; edit < 2; edit++){
+        if (edit == 1){
+            surface.cp[3][2].z = 2;
+            surface.cp[3][2].w = 3;
+            nurbs_surface_modified( &surface );
+        }
+
+        for (int layout = 0; layout < 2; layout++){
+            nurbs_surface_set_layout( &surface
+                , (layout == 0) ? NURBS_LAYOUT_CP : NURBS_LAYOUT_HOMOGENEOUS );
+
+            for (int k = 0; k < n; k++){
+                p[layout][k] = nurbs_surface_get_point( &surface, u[k], v[k] );
+                nurbs_surface_get_derivatives
+                    ( &du[layout][k], &dv[layout][k], &q[layout][k], &surface, u[k], v[k] );
+            }
+            nurbs_surface_get_second_derivatives( &d[layout][0], &d[layout][1]
+                , &d[layout][2], &d[layout][3], &d[layout][4], &d[layout][5]
+                , &surface, (NurbsFloat)0.3, (NurbsFloat)0.6 );
+            nurbs_surface_get_points_derivatives
+                ( qu[layout], qv[layout], q[layout], &surface, u, v, n );
+            nurbs_surface_get_grid( grid[layout], nullptr, &surface, u, 10, v, n / 10 );
+        }
+
+        for (int k = 0; k < n; k++){
+            double e = point_diff( p[0][k], p[1][k] ) + point_diff( du[0][k], du[1][k] )
+                + point_diff( dv[0][k], dv[1][k] ) + point_diff( q[0][k], q[1][k] ) 
+                + point_diff( qu[0][k], qu[1][k] ) + point_diff( qv[0][k], qv[1][k] )
+                + point_diff( grid[0][k], grid[1][k] );
+            if (e > err) err = e;
+        }
+        for (int k = 0; k < 6; k++){
+            double e = point_diff( d[0][k], d[1][k] );
+            if (e > err) err = e;
+        }
+        if (err > 1e-12){
+            printf( "\nedit %i: the layouts differ by %g", edit, err );
+            errors++;
+        }
+    }
+
+    /* The copy is made once and kept */
+    const NurbsSurfaceHomogeneous* h = nurbs_surface_get_homogeneous( &surface );
+    if (h == nullptr || nurbs_surface_get_homogeneous( &surface ) != h
+        || h->wz[3 * h->stride + 2] != 6 || h->w[3 * h->stride + 2] != 3
+        || ((size_t)h->wx & 31) != 0 || ((size_t)h->w & 31) != 0)
+    {
+        printf( "\nthe homogeneous copy is not kept or not aligned" );
+        errors++;
+    }
+
+    nurbs_surface_dispose( &surface );
+
+    printf( "\ncheck_layouts: %g, %i errors\n", err, errors );
+
+    return errors;
+}
+
+/* Checks the batch evaluation of points and derivatives against the single
+ * point routines on random parameters, including the last knot */
+int check_batch_points()
+{
+    const int n = 1000;
+    NurbsSurface surface;
+    NurbsFloat* u = (NurbsFloat*)malloc( n * sizeof( NurbsFloat ) );
+    NurbsFloat* v = (NurbsFloat*)malloc( n * sizeof( NurbsFloat ) );
+    NurbsVector3* points = (NurbsVector3*)malloc( 4 * n * sizeof( NurbsVector3 ) );
+    NurbsVector3* q = points + n;
+    NurbsVector3* qu = points + 2 * n;
+    NurbsVector3* qv = points + 3 * n;
+    double err = 0;
+    int errors = 0;
+
+    make_weighted_surface( &surface );
+
+    srand( 5 );
+    for (int k = 0; k < n; k++){
+        u[k] = (NurbsFloat)rand() / RAND_MAX;
+        v[k] = (NurbsFloat)rand() / RAND_MAX;
+    }
+    /* Corners, inner knots and the last knot */
+    u[0] = 0; v[0] = 0;
+    u[1] = 1; v[1] = 1;
+    u[2] = 1; v[2] = 0;
+    u[3] = 0; v[3] = 1;
+    u[4] = (NurbsFloat)1 / 3; v[4] = 1;
+    u[5] = 1; v[5] = (NurbsFloat)2 / 3;
+
+    if (!nurbs_surface_get_points( points, &surface, u, v, n )
+        || !nurbs_surface_get_points_derivatives( qu, qv, q, &surface, u, v, n ))
+    {
+        printf( "\nbatch evaluation failed" );
+        errors++;
+    }
+
+    for (int k = 0; k < n; k++){
+        NurbsVector3 p, du, dv;
+        nurbs_surface_get_derivatives( &du, &dv, &p, &surface, u[k], v[k] );
+        double e = point_diff( nurbs_surface_get_point( &surface, u[k], v[k] ), points[k] )
+            + point_diff( p, q[k] ) + point_diff( du, qu[k] ) + point_diff( dv, qv[k] );
+        if (e > err) err = e;
+    }
+    if (err > 1e-12){
+        printf( "\nthe batch differs by %g", err );
+        errors++;
+    }
+
+    nurbs_surface_dispose( &surface );
+    free( points );
+    free( v );
+    free( u );
+
+    printf( "\ncheck_batch_points: %g, %i errors\n", err, errors );
+
+    return errors;
+}
+
+
+/* Checks the structured grid of points and normals against the single 
+ * point routines, with the knots and the ends of the knot vectors */
+int check_grid()
+{
+    const int nu = 23, nv = 17;
+    NurbsSurface surface;
+    NurbsFloat u[nu], v[nv];
+    NurbsVector3 points[nu * nv], normals[nu * nv];
+    double err_points = 0, err_normals = 0;
+    int errors = 0;
+
+    make_weighted_surface( &surface );
+
+    for (int i = 0; i < nu; i++){
+        u[i] = (NurbsFloat)i / (nu - 1);
+    }
+    srand( 7 );
+    for (int j = 0; j < nv; j++){
+        v[j] = (NurbsFloat)rand() / RAND_MAX;
+    }
+    v[0] = 0;
+    v[1] = (NurbsFloat)1 / 3;
+    v[nv - 1] = 1;
+
+    if (!nurbs_surface_get_grid( points, normals, &surface, u, nu, v, nv )){
+        printf( "\ngrid evaluation failed" );
+        errors++;
+    }
+
+    for (int i = 0; i < nu; i++){
+        for (int j = 0; j < nv; j++){
+            NurbsVector3 p = nurbs_surface_get_point( &surface, u[i], v[j] );
+            NurbsVector3 n = nurbs_surface_get_normal( &surface, u[i], v[j] );
+            double e = point_diff( p, points[i * nv + j] );
+            if (e > err_points) err_points = e;
+            e = point_diff( n, normals[i * nv + j] );
+            if (e > err_normals) err_normals = e;
+        }
+    }
+    if (err_points > 1e-12 || err_normals > 1e-12){
+        printf( "\nthe grid differs by %g and %g", err_points, err_normals );
+        errors++;
+    }
+
+    nurbs_surface_dispose( &surface );
+
+    printf( "\ncheck_grid: points %g, normals %g, %i errors\n"
+        , err_points, err_normals, errors );
+
+    return errors;
+}
+
+
+/* Checks the points and normals in single and double precision against
+ * nurbs_surface_get_point and nurbs_surface_get_derivatives */
+int check_precision()
+{
+    const int n = 21;
+    NurbsSurface surface;
+    NurbsSurfaceSingle single;
+    NurbsSurfaceDouble dbl;
+    float su[n*n], sv[n*n], sp[3*n*n], sn[3*n*n];
+    double du[n*n], dv[n*n], dp[3*n*n], dn[3*n*n];
+    double err_single = 0, err_double = 0;
+    int errors = 0;
+
+    make_weighted_surface( &surface );
+
+    for (int i = 0; i < n; i++){
+        for (int j = 0; j < n; j++){
+            du[i*n + j] = (double)i / (n - 1);
+            dv[i*n + j] = (double)j / (n - 1);
+            su[i*n + j] = (float)du[i*n + j];
+            sv[i*n + j] = (float)dv[i*n + j];
+        }
+    }
+
+    nurbs_surface_single_init( &single );
+    nurbs_surface_double_init( &dbl );
+    nurbs_surface_single_create( &single, &surface );
+    nurbs_surface_double_create( &dbl, &surface );
+    nurbs_surface_single_get_points( sp, sn, &single, su, sv, n*n );
+    nurbs_surface_double_get_points( dp, dn, &dbl, du, dv, n*n );
+
+    for (int k = 0; k < n*n; k++){
+        NurbsVector3 p = nurbs_surface_get_point( &surface, du[k], dv[k] );
+        NurbsVector3 q, d_u, d_v, nr;
+        nurbs_surface_get_derivatives( &d_u, &d_v, &q, &surface, du[k], dv[k] );
+        nr.x = d_u.y * d_v.z - d_u.z * d_v.y;
+        nr.y = d_u.z * d_v.x - d_u.x * d_v.z;
+        nr.z = d_u.x * d_v.y - d_u.y * d_v.x;
+        double mod = sqrt( nr.x*nr.x + nr.y*nr.y + nr.z*nr.z );
+
+        double e = fabs( sp[3*k] - p.x ) + fabs( sp[3*k+1] - p.y ) + fabs( sp[3*k+2] - p.z )
+            + fabs( sn[3*k] - nr.x / mod ) + fabs( sn[3*k+1] - nr.y / mod ) 
+            + fabs( sn[3*k+2] - nr.z / mod );
+        if (e > err_single) err_single = e;
+
+        e = fabs( dp[3*k] - p.x ) + fabs( dp[3*k+1] - p.y ) + fabs( dp[3*k+2] - p.z )
+            + fabs( dn[3*k] - nr.x / mod ) + fabs( dn[3*k+1] - nr.y / mod ) 
+            + fabs( dn[3*k+2] - nr.z / mod );
+        if (e > err_double) err_double = e;
+    }
+
+    if (err_single > 1e-4){
+        printf( "\nsingle precision error %g", err_single );
+        errors++;
+    }
+    if (err_double > 1e-9){
+        printf( "\ndouble precision error %g", err_double );
+        errors++;
+    }
+
+    nurbs_surface_single_dispose( &single );
+    nurbs_surface_double_dispose( &dbl );
+    nurbs_surface_dispose( &surface );
+
+    printf( "\ncheck_precision: single %g, double %g, %i errors\n"
+        , err_single, err_double, errors );
+
+    return errors;
+}
+
+/* Quarter of a cylinder: a circle in u (degree 2, exact with the weights) 
+ * times a line of the given height in v; the normal Su x Sv points out */
+static void make_quarter_cylinder( NurbsSurface* cylinder, const NurbsFloat radius
+    , const NurbsFloat height )
+{
+    nurbs_surface_init( cylinder );
+    nurbs_surface_alloc( cylinder, 3, 2, 2, 1 );
+    for (int i = 0; i < 6; i++){
+        cylinder->knot_u[i] = (i < 3) ? 0 : (NurbsFloat)1;
+    }
+    for (int i = 0; i < 4; i++){
+        cylinder->knot_v[i] = (i < 2) ? 0 : (NurbsFloat)1;
+    }
+    for (int j = 0; j < 2; j++){
+        NurbsVector4 c0 = { radius, 0, height * j, 1 };
+        NurbsVector4 c1 = { radius, radius, height * j, (NurbsFloat)(sqrt( 2.0 ) / 2) };
+        NurbsVector4 c2 = { 0, radius, height * j, 1 };
+        cylinder->cp[0][j] = c0;
+        cylinder->cp[1][j] = c1;
+        cylinder->cp[2][j] = c2;
+    }
+}
+
+/* Checks the batched curvatures on a quarter of a cylinder, where they are
+ * exact, and against the fundamental forms of the single point second 
+ * derivatives on a general rational surface */
+int check_curvatures()
+{
+    const int n = 17;
+    const NurbsFloat radius = 2;
+    NurbsSurface cylinder, surface;
+    NurbsFloat u[n*n], v[n*n], k1[n*n], k2[n*n];
+    NurbsVector3 normals[n*n], points[n*n];
+    double err_cylinder = 0, err_surface = 0;
+    int errors = 0;
+
+    make_quarter_cylinder( &cylinder, radius, 3 );
+
+    for (int i = 0; i < n; i++){
+        for (int j = 0; j < n; j++){
+            u[i*n + j] = (NurbsFloat)i / (n - 1);
+            v[i*n + j] = (NurbsFloat)j / (n - 1);
+        }
+    }
+
+    if (!nurbs_surface_get_points_curvatures( k1, k2, normals, points, &cylinder, u, v, n*n )){
+        errors++;
+    }
+    for (int k = 0; k < n*n; k++){
+        /* Bends away from the outward normal: k1 = 0, k2 = -1/R */
+        const NurbsFloat r = sqrt( points[k].x * points[k].x + points[k].y * points[k].y );
+        double e = fabs( k1[k] ) + fabs( k2[k] + 1 / radius ) + fabs( r - radius )
+            + fabs( normals[k].x - points[k].x / r ) + fabs( normals[k].y - points[k].y / r )
+            + fabs( normals[k].z );
+        if (e > err_cylinder) err_cylinder = e;
+    }
+
+    /* General rational surface, also with the homogeneous layout */
+    nurbs_surface_init( &surface );
+    nurbs_surface_alloc( &surface, 6, 5, 3, 2 );
+    for (int i = 0; i < surface.knot_length_u; i++){
+        surface.knot_u[i] = (i < 4) ? 0 : ((i > 5) ? 1 : (NurbsFloat)(i - 3) / 3);
+    }
+    for (int i = 0; i < surface.knot_length_v; i++){
+        surface.knot_v[i] = (i < 3) ? 0 : ((i > 4) ? 1 : (NurbsFloat)(i - 2) / 3);
+    }
+    for (int i = 0; i < 6; i++){
+        for (int j = 0; j < 5; j++){
+            NurbsVector4 cp = { (NurbsFloat)i, (NurbsFloat)j
+                , (NurbsFloat)sin( i * 0.7 + j ), (NurbsFloat)(1 + 0.25 * ((i + j) % 3)) };
+            surface.cp[i][j] = cp;
+        }
+    }
+
+    for (int layout = 0; layout < 2; layout++){
+        nurbs_surface_set_layout( &surface
+            , (layout == 0) ? NURBS_LAYOUT_CP : NURBS_LAYOUT_HOMOGENEOUS );
+        if (!nurbs_surface_get_points_curvatures( k1, k2, normals, nullptr, &surface, u, v, n*n )){
+            errors++;
+        }
+
+        for (int k = 0; k < n*n; k++){
+            NurbsVector3 suu, suv, svv, su, sv, p, nr;
+            nurbs_surface_get_second_derivatives( &suu, &suv, &svv, &su, &sv, &p, &surface, u[k], v[k] );
+            nr.x = su.y * sv.z - su.z * sv.y;
+            nr.y = su.z * sv.x - su.x * sv.z;
+            nr.z = su.x * sv.y - su.y * sv.x;
+            const double mod = sqrt( nr.x*nr.x + nr.y*nr.y + nr.z*nr.z );
+            nr.x /= mod;
+            nr.y /= mod;
+            nr.z /= mod;
+
+            const double e1 = su.x*su.x + su.y*su.y + su.z*su.z;
+            const double f1 = su.x*sv.x + su.y*sv.y + su.z*sv.z;
+            const double g1 = sv.x*sv.x + sv.y*sv.y + sv.z*sv.z;
+            const double e2 = suu.x*nr.x + suu.y*nr.y + suu.z*nr.z;
+            const double f2 = suv.x*nr.x + suv.y*nr.y + suv.z*nr.z;
+            const double g2 = svv.x*nr.x + svv.y*nr.y + svv.z*nr.z;
+            const double det = e1 * g1 - f1 * f1;
+            const double gauss = (e2 * g2 - f2 * f2) / det;
+            const double mean = (e1 * g2 - 2 * f1 * f2 + g1 * e2) / (2 * det);
+            const double disc = sqrt( fmax( mean * mean - gauss, 0.0 ) );
+
+            double e = fabs( k1[k] - (mean + disc) ) + fabs( k2[k] - (mean - disc) )
+                + fabs( normals[k].x - nr.x ) + fabs( normals[k].y - nr.y )
+                + fabs( normals[k].z - nr.z );
+            if (e > err_surface) err_surface = e;
+        }
+    }
+
+    if (err_cylinder > 1e-9){
+        printf( "\ncylinder curvature error %g", err_cylinder );
+        errors++;
+    }
+    if (err_surface > 1e-9){
+        printf( "\nsurface curvature error %g", err_surface );
+        errors++;
+    }
+
+    nurbs_surface_dispose( &cylinder );
+    nurbs_surface_dispose( &surface );
+
+    printf( "\ncheck_curvatures: cylinder %g, surface %g, %i errors\n"
+        , err_cylinder, err_surface, errors );
+
+    return errors;
+}
+
+static int compare_edges( const void* a, const void* b )
+{
+    const long long ea = *(const long long*)a;
+    const long long eb = *(const long long*)b;
+    return (ea < eb) ? -1 : ((ea > eb) ? 1 : 0);
+}
+
+/* Checks the mesh of two quarters of a cylinder: the vertices are on the 
+ * surface at their parameters, the centers of the triangles are within the
+ * chord height, each edge has two triangles except on the parametric 
+ * boundary (no cracks between cells of different size), and a smaller 
+ * tolerance gives more triangles */
+int check_tessellation()
+{
+    const NurbsFloat radius = 2;
+    NurbsSurface cylinders[2];
+    NurbsMesh mesh;
+    int num_triangles[2] = { 0, 0 };
+    double err_vertex = 0, err_chord = 0;
+    int errors = 0;
+
+    make_quarter_cylinder( &cylinders[0], radius, 3 );
+    make_quarter_cylinder( &cylinders[1], radius, 1 );
+
+    for (int pass = 0; pass < 2; pass++){
+        const NurbsFloat chord_height = (pass == 0) ? 1e-2 : 1e-4;
+
+        nurbs_mesh_init( &mesh );
+        if (!nurbs_surface_tessellate( &mesh, cylinders, 2, chord_height, 0.5, 10 )){
+            errors++;
+            continue;
+        }
+        num_triangles[pass] = mesh.num_triangles;
+
+        for (int i = 0; i < mesh.num_vertices; i++){
+            const int is = mesh.vertex_surface[i];
+            NurbsVector3 p = nurbs_surface_get_point( &cylinders[is]
+                , mesh.param[2*i], mesh.param[2*i + 1] );
+            const NurbsVector3 q = mesh.vertex[i];
+            const NurbsFloat r = sqrt( q.x * q.x + q.y * q.y );
+            double e = fabs( p.x - q.x ) + fabs( p.y - q.y ) + fabs( p.z - q.z )
+                + fabs( r - radius );
+            if (e > err_vertex) err_vertex = e;
+        }
+
+        long long* edges = (long long*)malloc( sizeof(long long) * 3 * mesh.num_triangles );
+        for (int t = 0; t < mesh.num_triangles; t++){
+            const int* tri = &mesh.triangle[3*t];
+            NurbsVector3 c = { 0, 0, 0 };
+
+            for (int k = 0; k < 3; k++){
+                const int a = tri[k], b = tri[(k + 1) % 3];
+                c.x += mesh.vertex[a].x / 3;
+                c.y += mesh.vertex[a].y / 3;
+                c.z += mesh.vertex[a].z / 3;
+                edges[3*t + k] = (a < b) ? (long long)a * mesh.num_vertices + b
+                    : (long long)b * mesh.num_vertices + a;
+                if (mesh.vertex_surface[a] != mesh.triangle_surface[t]){
+                    errors++;
+                }
+            }
+
+            const double e = radius - sqrt( c.x * c.x + c.y * c.y ) - chord_height;
+            if (e > err_chord) err_chord = e;
+        }
+
+        qsort( edges, 3 * mesh.num_triangles, sizeof(long long), compare_edges );
+        for (int k = 0; k < 3 * mesh.num_triangles; ){
+            int count = 1;
+            while (k + count < 3 * mesh.num_triangles && edges[k + count] == edges[k]){
+                count++;
+            }
+            if (count == 1){
+                /* Only on the boundary of the parametric space */
+                const int a = (int)(edges[k] / mesh.num_vertices);
+                const int b = (int)(edges[k] % mesh.num_vertices);
+                const NurbsFloat* pa = &mesh.param[2*a];
+                const NurbsFloat* pb = &mesh.param[2*b];
+                if (!((pa[0] == pb[0] && (pa[0] == 0 || pa[0] == 1))
+                    || (pa[1] == pb[1] && (pa[1] == 0 || pa[1] == 1))))
+                {
+                    errors++;
+                }
+            }
+            else if (count > 2){
+                errors++;
+            }
+            k += count;
+        }
+        free( edges );
+
+        nurbs_mesh_dispose( &mesh );
+    }
+
+    if (err_vertex > 1e-12){
+        printf( "\nvertex error %g", err_vertex );
+        errors++;
+    }
+    if (err_chord > 0){
+        printf( "\nchord height exceeded by %g", err_chord );
+        errors++;
+    }
+    if (num_triangles[1] <= num_triangles[0]){
+        printf( "\n%i triangles with the smaller tolerance, %i with the larger"
+            , num_triangles[1], num_triangles[0] );
+        errors++;
+    }
+
+    nurbs_surface_dispose( &cylinders[0] );
+    nurbs_surface_dispose( &cylinders[1] );
+
+    printf( "\ncheck_tessellation: %i and %i triangles, %i errors\n"
+        , num_triangles[0], num_triangles[1], errors );
+
+    return errors;
+}
+
+/* Checks the batch evaluation, the arc length table and the projection on
+ * a quarter of a circle, where the length and the points are exact */
+int check_curve_arclength()
+{
+    const int n = 65;
+    const double pi = 4 * atan( 1.0 );
+    const NurbsFloat radius = 3;
+    NurbsCurve curve;
+    NurbsCurveArcLength table;
+    NurbsFloat t[n], t2[n], s[n], distance[n];
+    NurbsVector3 points[n], deriv[n];
+    double err_batch = 0, err_length = 0, err_projection = 0;
+    int errors = 0;
+
+    nurbs_curve_init( &curve );
+    nurbs_curve_alloc( &curve, 3, 2 );
+    for (int i = 0; i < 6; i++){
+        curve.knot[i] = (i < 3) ? 0 : (NurbsFloat)1;
+    }
+    NurbsVector4 c0 = { radius, 0, 0, 1 };
+    NurbsVector4 c1 = { radius, radius, 0, (NurbsFloat)(sqrt( 2.0 ) / 2) };
+    NurbsVector4 c2 = { 0, radius, 0, 1 };
+    curve.cp[0] = c0;
+    curve.cp[1] = c1;
+    curve.cp[2] = c2;
+
+    /* Batch evaluation, with the derivative up to the last knot */
+    for (int i = 0; i < n; i++){
+        t[i] = (NurbsFloat)i / (n - 1);
+    }
+    nurbs_curve_get_points_derivatives( deriv, points, &curve, t, n );
+    for (int i = 0; i < n; i++){
+        NurbsVector3 p = nurbs_curve_get_point( &curve, t[i] );
+        const double speed = sqrt( deriv[i].x * deriv[i].x + deriv[i].y * deriv[i].y );
+        double e = fabs( p.x - points[i].x ) + fabs( p.y - points[i].y ) + fabs( p.z - points[i].z )
+            + fabs( deriv[i].x * points[i].x + deriv[i].y * points[i].y ) / radius;
+        if (e > err_batch) err_batch = e;
+        if (!(speed > 0)){
+            printf( "\nzero derivative at t = %g", t[i] );
+            errors++;
+        }
+    }
+
+    /* Arc length: the angle of the point is s / R */
+    nurbs_curve_arclength_init( &table );
+    if (!nurbs_curve_arclength_build( &table, &curve, 1e-12 )){
+        errors++;
+    }
+    err_length = fabs( table.total - pi * radius / 2 );
+    for (int i = 0; i < n; i++){
+        s[i] = table.total * i / (n - 1);
+    }
+    nurbs_curve_arclength_parameters( t2, &table, &curve, s, n );
+    for (int i = 0; i < n; i++){
+        NurbsVector3 p = nurbs_curve_get_point( &curve, t2[i] );
+        const double angle = s[i] / radius;
+        double e = fabs( p.x - radius * cos( angle ) ) + fabs( p.y - radius * sin( angle ) );
+        if (e > err_length) err_length = e;
+    }
+    nurbs_curve_get_uniform_points( points, t, &table, &curve, n );
+    for (int i = 0; i < n; i++){
+        const double angle = pi / 2 * i / (n - 1);
+        double e = fabs( points[i].x - radius * cos( angle ) ) 
+            + fabs( points[i].y - radius * sin( angle ) ) + fabs( t[i] - t2[i] );
+        if (e > err_length) err_length = e;
+    }
+
+    /* Projection of points off the curve, along the radius */
+    for (int i = 0; i < n; i++){
+        const double angle = pi / 2 * i / (n - 1);
+        const double r = radius * ((i % 2 == 0) ? 1.5 : 0.5);
+        points[i].x = (NurbsFloat)(r * cos( angle ));
+        points[i].y = (NurbsFloat)(r * sin( angle ));
+        points[i].z = 0;
+    }
+    if (!nurbs_curve_projection( t2, distance, &curve, points, n )){
+        errors++;
+    }
+    for (int i = 0; i < n; i++){
+        double e = fabs( t2[i] - t[i] ) + fabs( distance[i] - radius * 0.5 );
+        if (e > err_projection) err_projection = e;
+    }
+
+    /* At the last knot the batch is evaluated a tiny bit before it */
+    if (err_batch > 1e-10){
+        printf( "\nbatch curve error %g", err_batch );
+        errors++;
+    }
+    if (err_length > 1e-9){
+        printf( "\narc length error %g", err_length );
+        errors++;
+    }
+    if (err_projection > 1e-9){
+        printf( "\nprojection error %g", err_projection );
+        errors++;
+    }
+
+    nurbs_curve_arclength_dispose( &table );
+    nurbs_curve_dispose( &curve );
+
+    printf( "\ncheck_curve_arclength: batch %g, length %g, projection %g, %i errors\n"
+        , err_batch, err_length, err_projection, errors );
+
+    return errors;
+}
+
+/* Plane x = x0 crossing the weighted surface, with inner knots */
+static void make_crossing_plane( NurbsSurface* plane, const NurbsFloat x0 )
+{
+    nurbs_surface_init( plane );
+    nurbs_surface_alloc( plane, 4, 4, 2, 2 );
+    for (int i = 0; i < plane->knot_length_u; i++){
+        plane->knot_u[i] = (i < 3) ? 0 : ((i > 3) ? 1 : (NurbsFloat)0.4);
+        plane->knot_v[i] = (i < 3) ? 0 : ((i > 3) ? 1 : (NurbsFloat)0.6);
+    }
+    for (int i = 0; i < 4; i++){
+        for (int j = 0; j < 4; j++){
+            NurbsVector4 cp = { x0 + (NurbsFloat)0.1 * (j - i), (NurbsFloat)(-1 + 2 * i)
+                , (NurbsFloat)(-2 + 1.4 * j), 1 };
+            plane->cp[i][j] = cp;
+        }
+    }
+}
+
+/* Checks that the pruned and parallel intersection finds the solutions of
+ * the serial loop through all the pairs of segments, in the same order. 
+ * With a small relaxation only the pairs that do not overlap are dropped;
+ * with a large one every pair overlaps and the results are the same */
+int check_intersection_fast()
+{
+    const size_t max_sol = 4096;
+    const NurbsFloat relaxation[2] = { (NurbsFloat)0.1, (NurbsFloat)4 };
+    NurbsSurface surface, plane;
+    NurbsIntersection* fast = (NurbsIntersection*)malloc( max_sol * sizeof( NurbsIntersection ) );
+    NurbsIntersection* ref = (NurbsIntersection*)malloc( max_sol * sizeof( NurbsIntersection ) );
+    size_t num_fast[2] = { 0, 0 }, num_ref[2] = { 0, 0 };
+    int errors = 0;
+
+    make_weighted_surface( &surface );
+    make_crossing_plane( &plane, (NurbsFloat)2.3 );
+
+    for (int r = 0; r < 2; r++){
+        int status_fast = nurbs_surface_intersection_fast( fast, &num_fast[r], max_sol
+            , &surface, &plane, nullptr, nullptr, relaxation[r] );
+        int status_ref = nurbs_surface_intersection_fast_all_pairs( ref, &num_ref[r], max_sol
+            , &surface, &plane, nullptr, nullptr, relaxation[r] );
+
+        if (status_fast != 1 || status_ref != 1){
+            printf( "\nintersection status %i and %i", status_fast, status_ref );
+            errors++;
+        }
+        if (r == 1 && num_fast[r] != num_ref[r]){
+            printf( "\n%i and %i solutions without pruning", (int)num_fast[r], (int)num_ref[r] );
+            errors++;
+        }
+
+        /* Each pruned solution is the next equal one in the reference */
+        size_t k = 0;
+        for (size_t i = 0; i < num_fast[r]; i++){
+            while (k < num_ref[r] && (fast[i].u != ref[k].u || fast[i].v != ref[k].v
+                || fast[i].m != ref[k].m || fast[i].n != ref[k].n))
+            {
+                k++;
+            }
+            if (k == num_ref[r]){
+                printf( "\nsolution %i (%g, %g, %g, %g) is not in the reference"
+                    , (int)i, fast[i].u, fast[i].v, fast[i].m, fast[i].n );
+                errors++;
+                break;
+            }
+            k++;
+        }
+    }
+
+    nurbs_surface_dispose( &plane );
+    nurbs_surface_dispose( &surface );
+    free( ref );
+    free( fast );
+
+    printf( "\ncheck_intersection_fast: %i of %i and %i of %i solutions, %i errors\n"
+        , (int)num_fast[0], (int)num_ref[0], (int)num_fast[1], (int)num_ref[1], errors );
+
+    return errors;
+}
+
+/* Closest point of the surface by brute force: the closest point of a 
+ * dense grid refined with the iterative method. Returns the distance */
+static double brute_force_projection( NurbsFloat* pu, NurbsFloat* pv
+    , const NurbsSurface* surface, const NurbsVector3* point )
+{
+    const int n = 64;
+    double best = -1;
+
+    for (int i = 0; i <= n; i++){
+        for (int j = 0; j <= n; j++){
+            NurbsFloat u = (NurbsFloat)i / n, v = (NurbsFloat)j / n;
+            NurbsVector3 q = nurbs_surface_get_point( surface, u, v );
+            double d = (q.x - point->x) * (q.x - point->x) 
+                + (q.y - point->y) * (q.y - point->y) + (q.z - point->z) * (q.z - point->z);
+            if (best < 0 || d < best){
+                best = d;
+                *pu = u;
+                *pv = v;
+            }
+        }
+    }
+
+    nurbs_surface_inversion_proj( pu, pv, point, surface, (NurbsFloat)1e-12 );
+    NurbsVector3 q = nurbs_surface_get_point( surface, *pu, *pv );
+
+    return sqrt( (q.x - point->x) * (q.x - point->x) 
+        + (q.y - point->y) * (q.y - point->y) + (q.z - point->z) * (q.z - point->z) );
+}
+
+/* Checks the inversions with the hierarchy of patches against the same
+ * inversions over all the cells, and against the brute force projection
+ * (subgrid and min distance) or the base point along the normal (normal) */
+int check_bvh_inversion()
+{
+    const int n = 200;
+    const NurbsFloat epsilon = (NurbsFloat)1e-10;
+    NurbsSurface surface;
+    NurbsSurfaceBVH bvh;
+    double err_subgrid = 0, err_min_distance = 0, err_normal = 0;
+    int status[2], num_failed = 0, errors = 0;
+
+    make_weighted_surface( &surface );
+    nurbs_surface_bvh_init( &bvh );
+    if (!nurbs_surface_bvh_build( &bvh, &surface )){
+        errors++;
+    }
+
+    srand( 17 );
+    for (int k = 0; k < n; k++){
+        const NurbsFloat u0 = (NurbsFloat)(0.05 + 0.9 * rand() / RAND_MAX);
+        const NurbsFloat v0 = (NurbsFloat)(0.05 + 0.9 * rand() / RAND_MAX);
+        const NurbsFloat h = (NurbsFloat)(-0.3 + 0.6 * rand() / RAND_MAX);
+        NurbsVector3 normal = nurbs_surface_get_normal( &surface, u0, v0 );
+        NurbsVector3 p = nurbs_surface_get_point( &surface, u0, v0 );
+        NurbsFloat ub, vb, u, v, uc, vc;
+        double db, e;
+
+        p.x += h * normal.x;
+        p.y += h * normal.y;
+        p.z += h * normal.z;
+        db = brute_force_projection( &ub, &vb, &surface, &p );
+
+        nurbs_surface_bvh_inversion( &u, &v, &bvh, &surface, &p, epsilon, 10 );
+        nurbs_surface_inversion_subgrid( &uc, &vc, &surface, &p, epsilon, 10 );
+        e = fabs( u - ub ) + fabs( v - vb ) + fabs( u - uc ) + fabs( v - vc )
+            + fabs( point_diff( nurbs_surface_get_point( &surface, u, v ), p ) 
+            - point_diff( nurbs_surface_get_point( &surface, ub, vb ), p ) );
+        if (e > err_subgrid) err_subgrid = e;
+
+        /* Both fail on the same points (a few on the concave side) */
+        status[0] = nurbs_surface_bvh_inversion_min_distance
+            ( &u, &v, &bvh, &surface, nullptr, &p, epsilon, (NurbsFloat)0.25 );
+        status[1] = nurbs_surface_inversion_min_distance
+            ( &uc, &vc, &surface, nullptr, &p, epsilon, (NurbsFloat)0.25 );
+        e = fabs( u - uc ) + fabs( v - vc );
+        if (status[0] != 0){
+            num_failed++;
+        }
+        else{
+            e += fabs( u - ub ) + fabs( v - vb );
+        }
+        if (status[0] != status[1]) e = 1;
+        if (e > err_min_distance) err_min_distance = e;
+
+        nurbs_surface_bvh_inversion_normal
+            ( &u, &v, &bvh, &surface, nullptr, &p, &normal, epsilon, (NurbsFloat)0.25 );
+        nurbs_surface_inversion_normal
+            ( &uc, &vc, &surface, nullptr, &p, &normal, epsilon, (NurbsFloat)0.25 );
+        e = fabs( u - u0 ) + fabs( v - v0 ) + fabs( u - uc ) + fabs( v - vc );
+        if (e > err_normal) err_normal = e;
+
+        /* The brute force is not farther than the base point */
+        if (db > fabs( h ) + 1e-12){
+            errors++;
+        }
+    }
+
+    if (err_subgrid > 1e-8 || err_min_distance > 1e-8 || err_normal > 1e-8
+        || num_failed > n / 20)
+    {
+        printf( "\nthe inversions differ by %g, %g and %g (%i failed)"
+            , err_subgrid, err_min_distance, err_normal, num_failed );
+        errors++;
+    }
+
+    nurbs_surface_bvh_dispose( &bvh );
+    nurbs_surface_dispose( &surface );
+
+    printf( "\ncheck_bvh_inversion: subgrid %g, min distance %g (%i failed), normal %g, %i errors\n"
+        , err_subgrid, err_min_distance, num_failed, err_normal, errors );
+
+    return errors;
+}
+
+
+/* Checks the projection onto a model of several surfaces against the brute
+ * force projection onto each surface, and that the warm start from the 
+ * cache gives the same solutions as a cold projection */
+int check_model_projection()
+{
+    const int num_surfaces = 3, n = 300;
+    const NurbsFloat epsilon = (NurbsFloat)1e-10;
+    NurbsSurface surfaces[num_surfaces];
+    NurbsModelProjection model;
+    NurbsVector3* points = (NurbsVector3*)malloc( n * sizeof( NurbsVector3 ) );
+    NurbsModelProjectionPoint* result = (NurbsModelProjectionPoint*)malloc
+        ( 2 * n * sizeof( NurbsModelProjectionPoint ) );
+    NurbsModelProjectionPoint* cold = result + n;
+    double err_brute = 0, err_warm = 0;
+    int errors = 0;
+
+    make_weighted_surface( &surfaces[0] );
+    make_quarter_cylinder( &surfaces[1], 2, 3 );
+    make_crossing_plane( &surfaces[2], (NurbsFloat)2.3 );
+
+    nurbs_model_projection_init( &model );
+    if (!nurbs_model_projection_build( &model, surfaces, num_surfaces )){
+        errors++;
+    }
+
+    /* Points close to the surfaces, away from the edges (there the closest
+     * point is on the edge and the iterative methods are less accurate) */
+    srand( 13 );
+    for (int k = 0; k < n; k++){
+        const NurbsFloat u = (NurbsFloat)(0.05 + 0.9 * rand() / RAND_MAX);
+        const NurbsFloat v = (NurbsFloat)(0.05 + 0.9 * rand() / RAND_MAX);
+        const NurbsFloat h = (NurbsFloat)(-0.2 + 0.4 * rand() / RAND_MAX);
+        NurbsVector3 p = nurbs_surface_get_point( &surfaces[k % num_surfaces], u, v );
+        NurbsVector3 normal = nurbs_surface_get_normal( &surfaces[k % num_surfaces], u, v );
+        points[k].x = p.x + h * normal.x;
+        points[k].y = p.y + h * normal.y;
+        points[k].z = p.z + h * normal.z;
+    }
+
+    if (!nurbs_model_projection_points( result, &model, points, n, epsilon, 10, 0 )){
+        errors++;
+    }
+    for (int k = 0; k < n; k++){
+        double best = -1;
+        for (int s = 0; s < num_surfaces; s++){
+            NurbsFloat u, v;
+            double d = brute_force_projection( &u, &v, &surfaces[s], &points[k] );
+            if (best < 0 || d < best) best = d;
+        }
+        double e = fabs( result[k].dist - best );
+        if (result[k].surface < 0 || result[k].surface >= num_surfaces) e = 1;
+        if (e > err_brute) err_brute = e;
+    }
+
+    /* Move the points a bit and start from the previous solutions */
+    if (model.num_cache != n){
+        printf( "\nthe solutions are not kept" );
+        errors++;
+    }
+    for (int k = 0; k < n; k++){
+        points[k].x += (NurbsFloat)1e-3;
+        points[k].z -= (NurbsFloat)2e-3;
+    }
+    if (!nurbs_model_projection_points( result, &model, points, n, epsilon, 10, 1 )
+        || !nurbs_model_projection_points( cold, &model, points, n, epsilon, 10, 0 ))
+    {
+        errors++;
+    }
+    for (int k = 0; k < n; k++){
+        double e = fabs( result[k].dist - cold[k].dist );
+        if (result[k].surface != cold[k].surface && e > 1e-9) e = 1;
+        if (e > err_warm) err_warm = e;
+    }
+
+    if (err_brute > 1e-8 || err_warm > 1e-8){
+        printf( "\nthe projections differ by %g and %g", err_brute, err_warm );
+        errors++;
+    }
+
+    nurbs_model_projection_dispose( &model );
+    for (int s = 0; s < num_surfaces; s++){
+        nurbs_surface_dispose( &surfaces[s] );
+    }
+    free( result );
+    free( points );
+
+    printf( "\ncheck_model_projection: brute force %g, warm %g, %i errors\n"
+        , err_brute, err_warm, errors );
+
+    return errors;
+}
+
+
+/* Control box with slightly distorted cells of size {1, 1, dz} */
+static void make_control_box( NurbsControlBox* cb, const int nu, const int nv
+    , const int nw, const NurbsFloat dz )
+{
+    nurbs_controlbox_init( cb );
+    nurbs_controlbox_alloc( cb, nu, nv, nw );
+    for (int iu = 0; iu < nu; iu++){
+        for (int iv = 0; iv < nv; iv++){
+            for (int iw = 0; iw < nw; iw++){
+                cb->cp[iu][iv][iw].x = (NurbsFloat)(iu + 0.1 * sin( iv + dz * iw ));
+                cb->cp[iu][iv][iw].y = (NurbsFloat)(iv + 0.1 * cos( (double)iu ));
+                cb->cp[iu][iv][iw].z = (NurbsFloat)(dz * (iw + 0.05 * sin( (double)(iu + iv) )));
+            }
+        }
+    }
+}
+
+/* Inverts random points with and without the index; returns the largest 
+ * difference of the parameters, or one if any inversion does not converge
+ * (the error is a bit above epsilon when the last step is small enough) */
+static double compare_index_inversion( const NurbsControlBoxIndex* index
+    , const NurbsControlBox* cb, const int n, const NurbsFloat epsilon )
+{
+    double diff = 0;
+
+    for (int k = 0; k < n; k++){
+        NurbsFloat err0, err1;
+        NurbsVector3 p = nurbs_controlbox_get_point( cb, (NurbsFloat)rand() / RAND_MAX
+            , (NurbsFloat)rand() / RAND_MAX, (NurbsFloat)rand() / RAND_MAX );
+        NurbsVector3 t0 = nurbs_controlbox_inversion( cb, p.x, p.y, p.z, epsilon, &err0 );
+        NurbsVector3 t1 = nurbs_controlbox_index_inversion( index, cb, p, epsilon, &err1 );
+        double e = point_diff( t0, t1 );
+        if (!(err0 < 10 * epsilon) || !(err1 < 10 * epsilon)){
+            e = 1;
+        }
+        if (e > diff) diff = e;
+    }
+
+    return diff;
+}
+
+/* Checks that the inversion seeded with the spatial index gives the same 
+ * parameters as nurbs_controlbox_inversion, before and after moving some 
+ * control points, and in a thin box where a point is in many cells */
+int check_controlbox_index()
+{
+    const NurbsFloat epsilon = (NurbsFloat)1e-8;
+    const int n = 200;
+    NurbsControlBox cb, thin;
+    NurbsControlBoxIndex index, rebuilt;
+    int cells[1];
+    double diff[3];
+    int crowded, errors = 0;
+
+    make_control_box( &cb, 6, 5, 4, 1 );
+    nurbs_controlbox_index_init( &index );
+    nurbs_controlbox_index_init( &rebuilt );
+    if (!nurbs_controlbox_index_build( &index, &cb )){
+        errors++;
+    }
+
+    srand( 11 );
+    diff[0] = compare_index_inversion( &index, &cb, n, epsilon );
+
+    /* Move a block of control points and refit only around them */
+    for (int iu = 2; iu <= 3; iu++){
+        for (int iv = 1; iv <= 3; iv++){
+            cb.cp[iu][iv][2].x += (NurbsFloat)0.3;
+            cb.cp[iu][iv][2].z += (NurbsFloat)0.4;
+        }
+    }
+    if (!nurbs_controlbox_index_refit( &index, &cb, 2, 3, 1, 3, 2, 2 )
+        || !nurbs_controlbox_index_build( &rebuilt, &cb ))
+    {
+        errors++;
+    }
+    diff[1] = compare_index_inversion( &index, &cb, n, epsilon );
+
+    /* The refitted boxes are the ones of a new index */
+    for (int i = 0; i < index.num_nodes && i < rebuilt.num_nodes; i++){
+        if (point_diff( index.node[i].pmin, rebuilt.node[i].pmin ) 
+            + point_diff( index.node[i].pmax, rebuilt.node[i].pmax ) != 0)
+        {
+            printf( "\nnode %i is not refitted", i );
+            errors++;
+            break;
+        }
+    }
+
+    /* Thin cells: the margins of each cell overlap many layers in w */
+    make_control_box( &thin, 3, 3, 120, (NurbsFloat)1e-4 );
+    nurbs_controlbox_index_build( &rebuilt, &thin );
+    crowded = nurbs_controlbox_index_query
+        ( cells, 1, &rebuilt, nurbs_controlbox_get_point( &thin, 0.5, 0.5, 0.5 ) );
+    diff[2] = compare_index_inversion( &rebuilt, &thin, n, epsilon );
+
+    for (int i = 0; i < 3; i++){
+        if (diff[i] > 1e-6){
+            printf( "\ncase %i: the inversions differ by %g", i, diff[i] );
+            errors++;
+        }
+    }
+    if (crowded <= 64){
+        printf( "\nonly %i cells in the thin box", crowded );
+        errors++;
+    }
+
+    nurbs_controlbox_index_dispose( &rebuilt );
+    nurbs_controlbox_index_dispose( &index );
+    nurbs_controlbox_dispose( &thin );
+    nurbs_controlbox_dispose( &cb );
+
+    printf( "\ncheck_controlbox_index: %g, %g, %g (%i cells), %i errors\n"
+        , diff[0], diff[1], diff[2], crowded, errors );
+
+    return errors;
+}
+
+
+/* Checks the batch inversion of a dense grid of points against the single
+ * point inversion: the parameters, the errors and the Newton iterations.
+ * The warm start from a neighbour saves the estimation of the cells, but
+ * the damped Newton needs a few more iterations than from the estimation */
+int check_controlbox_batch()
+{
+    const NurbsFloat epsilon = (NurbsFloat)1e-8;
+    const int m = 21, n = m * m * m;
+    NurbsControlBox cb;
+    NurbsVector3* points = (NurbsVector3*)malloc( 2 * n * sizeof( NurbsVector3 ) );
+    NurbsVector3* param = points + n;
+    NurbsFloat* err = (NurbsFloat*)malloc( n * sizeof( NurbsFloat ) );
+    int* iterations = (int*)malloc( n * sizeof( int ) );
+    long total_batch = 0, total_single = 0;
+    double diff = 0, max_err = 0;
+    int errors = 0;
+
+    make_control_box( &cb, 6, 5, 4, 1 );
+
+    for (int i = 0; i < n; i++){
+        points[i] = nurbs_controlbox_get_point( &cb, (NurbsFloat)(i / (m * m)) / (m - 1)
+            , (NurbsFloat)((i / m) % m) / (m - 1), (NurbsFloat)(i % m) / (m - 1) );
+    }
+
+    if (!nurbs_controlbox_inversion_batch( param, err, iterations, &cb, points, n, epsilon )){
+        printf( "\nbatch inversion failed" );
+        errors++;
+    }
+
+    for (int i = 0; i < n; i++){
+        NurbsFloat e0, e1;
+        NurbsVector3 t0 = nurbs_controlbox_inversion
+            ( &cb, points[i].x, points[i].y, points[i].z, epsilon, &e0 );
+        NurbsVector3 t1;
+        int it;
+
+        /* A single point has no previous one, so it is inverted from scratch */
+        nurbs_controlbox_inversion_batch( &t1, &e1, &it, &cb, &points[i], 1, epsilon );
+        total_single += it;
+        total_batch += iterations[i];
+        if (iterations[i] < 1 || it < 1){
+            errors++;
+        }
+
+        double e = point_diff( t0, param[i] ) + point_diff( t1, param[i] );
+        if (e > diff) diff = e;
+        if (err[i] > max_err) max_err = err[i];
+        if (e0 > max_err) max_err = e0;
+    }
+
+    if (diff > 1e-6 || !(max_err < 10 * epsilon)){
+        printf( "\nthe inversions differ by %g, error %g", diff, max_err );
+        errors++;
+    }
+    if (total_batch > 2 * total_single){
+        printf( "\n%li iterations in the batch and %li alone", total_batch, total_single );
+        errors++;
+    }
+
+    nurbs_controlbox_dispose( &cb );
+    free( iterations );
+    free( err );
+    free( points );
+
+    printf( "\ncheck_controlbox_batch: %g, %li and %li iterations, %i errors\n"
+        , diff, total_batch, total_single, errors );
+
+    return errors;
+}
+
+
 int main(int argc, char *argv[])
 {
     //check_nurbs_cilinder();
     //check_nurbs_sphere();
     //check_basis_recursive();
     //draw_basis();
+    check_basis_kernels();
+    check_mesh_cache();
+    check_edit_surface();
+    check_layouts();
+    check_batch_points();
+    check_grid();
+    check_precision();
+    check_curvatures();
+    check_tessellation();
+    check_curve_arclength();
+    check_intersection_fast();
+    check_bvh_inversion();
+    check_model_projection();
+    check_controlbox_index();
+    check_controlbox_batch();
 
     getchar();
 
@@ -596,9 +596,30 @@ static void bezier_d2_basis3R
 }
 
 
-/* Calculates the basis functions. */
-static int bezier_basis
-    ( NurbsFloat basis[]        /* (out) Basis functions */
+/* Copies the non zero basis of a control point window to the array of
+ * basis of all the control points (that must be already zero) */
+static inline void bezier_window_copy
+    ( NurbsFloat basis[]        /* (out) Basis of all the control points */
+    , const NurbsFloat window[] /* Basis of the control points first + j */
+    , const int first           /* Index of the first control point */
+    , const int length          /* Length of the window */
+    , const int num_cp          /* Number of control points */
+    )
+{
+    int j;
+
+    for (j = 0; j < length; j++){
+        if (first + j >= 0 && first + j < num_cp){
+            basis[first + j] = window[j];
+        }
+    }
+}
+
+
+/* Calculates the basis functions that are not zero. basis[j] is the basis
+ * of the control point iknot + j, j = 0..3. Returns iknot. */
+static int bezier_local_basis
+    ( NurbsFloat basis[4]       /* (out) Non zero basis functions */
     , const NurbsFloat t        /* Parameter value */
     , const int num_cp          /* Number of control points */
     , const int order           /* Order */
@@ -609,7 +630,10 @@ static int bezier_basis
     int icp = (int)floor( tn );
     NurbsFloat t01 = tn - icp;
 
-    memset( basis, 0, sizeof(NurbsFloat)*num_cp );
+    basis[0] = 0;
+    basis[1] = 0;
+    basis[2] = 0;
+    basis[3] = 0;
 
     if (t < 0){
         t01 = 0;
@@ -627,15 +651,15 @@ static int bezier_basis
         if (icp < 0){
             icp = 0;
         }
-        basis[icp] = 1;
+        basis[0] = 1;
         iknot = icp;
     }
     else if (order == 1){
         if (icp > num_cp - 2){
             icp = num_cp - 2;
         }
-        basis[icp] = 1 - t01;
-        basis[icp+1] = t01;
+        basis[0] = 1 - t01;
+        basis[1] = t01;
         iknot = icp;
     }
     else if (order == 2){
@@ -644,13 +668,11 @@ static int bezier_basis
             iknot = 0;
         }
         else if (icp >= num_cp - 2){
-            bezier_basis2R
-                ( &basis[num_cp-3], &basis[num_cp-2], &basis[num_cp-1], t01 );
+            bezier_basis2R( &basis[1], &basis[2], &basis[3], t01 );
             iknot = num_cp - 4;
         }
         else{
-            bezier_basis2C
-                ( &basis[icp-1], &basis[icp], &basis[icp+1], &basis[icp+2], t01 );
+            bezier_basis2C( &basis[0], &basis[1], &basis[2], &basis[3], t01 );
             iknot = icp - 1;
         }
     }
@@ -660,13 +682,11 @@ static int bezier_basis
             iknot = icp;
         }
         else if (icp >= num_cp - 2){
-            bezier_basis3R
-                ( &basis[num_cp-3], &basis[num_cp-2], &basis[num_cp-1], t01 );
+            bezier_basis3R( &basis[1], &basis[2], &basis[3], t01 );
             iknot = num_cp - 4;
         }
         else{
-            bezier_basis3C
-                ( &basis[icp-1], &basis[icp], &basis[icp+1], &basis[icp+2], t01 );
+            bezier_basis3C( &basis[0], &basis[1], &basis[2], &basis[3], t01 );
             iknot = icp - 1;
         }
     }
@@ -675,9 +695,29 @@ static int bezier_basis
 }
 
 
-/* Calculates the derivative of the basis. */
-static int bezier_d_basis
-    ( NurbsFloat d_basis[]        /* (out) Derivative of the basis functions */
+/* Calculates the basis functions. */
+static int bezier_basis
+    ( NurbsFloat basis[]        /* (out) Basis functions */
+    , const NurbsFloat t        /* Parameter value */
+    , const int num_cp          /* Number of control points */
+    , const int order           /* Order */
+    )
+{
+    NurbsFloat window[4];
+    const int iknot = bezier_local_basis( window, t, num_cp, order );
+
+    memset( basis, 0, sizeof(NurbsFloat)*num_cp );
+    bezier_window_copy( basis, window, iknot, 4, num_cp );
+
+    return iknot;
+}
+
+
+/* Calculates the derivative of the basis that are not zero. d_basis[j] is
+ * the derivative of the control point iknot + j, j = 0..3. Returns iknot,
+ * that it may not be the same than in bezier_local_basis() out of {0,1}. */
+static int bezier_local_d_basis
+    ( NurbsFloat d_basis[4]     /* (out) Derivative of the basis functions */
     , const NurbsFloat t        /* Parameter value */
     , const int num_cp          /* Number of control points */
     , const int order           /* Order */
@@ -689,9 +729,10 @@ static int bezier_d_basis
     int icp = (int)floor( tn );
     NurbsFloat t01 = tn - icp;
 
-    for (i = 0; i < num_cp; i++){
-        d_basis[i] = 0;
-    }
+    d_basis[0] = 0;
+    d_basis[1] = 0;
+    d_basis[2] = 0;
+    d_basis[3] = 0;
 
     if (t < 0){
         return 0;
@@ -721,71 +762,65 @@ static int bezier_d_basis
         if (icp > num_cp - 2){
             icp = num_cp - 2;
         }
-        d_basis[icp] = -ncp_1;
-        d_basis[icp+1] = ncp_1;
+        d_basis[0] = -ncp_1;
+        d_basis[1] = ncp_1;
         iknot = icp;
     }
     else if (order == 2){
         if (icp == 0){
             bezier_d_basis2L( &d_basis[0], &d_basis[1], &d_basis[2], t01 );
-            d_basis[0] *= ncp_1;
-            d_basis[1] *= ncp_1;
-            d_basis[2] *= ncp_1;
-
             iknot = 0;
         }
         else if (icp >= num_cp - 2){
-            bezier_d_basis2R
-                ( &d_basis[num_cp-3], &d_basis[num_cp-2], &d_basis[num_cp-1], t01 );
-
-            d_basis[num_cp-3] *= ncp_1;
-            d_basis[num_cp-2] *= ncp_1;
-            d_basis[num_cp-1] *= ncp_1;
-
+            bezier_d_basis2R( &d_basis[1], &d_basis[2], &d_basis[3], t01 );
             iknot = num_cp - 4;
         }
         else{
             bezier_d_basis2C
-                ( &d_basis[icp-1], &d_basis[icp], &d_basis[icp+1], &d_basis[icp+2], t01 );
-
-            d_basis[icp-1] *= ncp_1;
-            d_basis[icp] *= ncp_1;
-            d_basis[icp+1] *= ncp_1;
-            d_basis[icp+2] *= ncp_1;
-
+                ( &d_basis[0], &d_basis[1], &d_basis[2], &d_basis[3], t01 );
             iknot = icp - 1;
         }
     }
     else if (order == 3){
         if (icp == 0){
             bezier_d_basis3L( &d_basis[0], &d_basis[1], &d_basis[2], t01 );
-            d_basis[0] *= ncp_1;
-            d_basis[1] *= ncp_1;
-            d_basis[2] *= ncp_1;
-
             iknot = icp;
         }
         else if (icp >= num_cp - 2){
-            bezier_d_basis3R
-                ( &d_basis[num_cp-3], &d_basis[num_cp-2], &d_basis[num_cp-1], t01 );
-            d_basis[num_cp-3] *= ncp_1;
-            d_basis[num_cp-2] *= ncp_1;
-            d_basis[num_cp-1] *= ncp_1;
-
+            bezier_d_basis3R( &d_basis[1], &d_basis[2], &d_basis[3], t01 );
             iknot = num_cp - 4;
         }
         else{
             bezier_d_basis3C
-                ( &d_basis[icp-1], &d_basis[icp], &d_basis[icp+1], &d_basis[icp+2], t01 );
-            d_basis[icp-1] *= ncp_1;
-            d_basis[icp] *= ncp_1;
-            d_basis[icp+1] *= ncp_1;
-            d_basis[icp+2] *= ncp_1;
-
+                ( &d_basis[0], &d_basis[1], &d_basis[2], &d_basis[3], t01 );
             iknot = icp - 1;
         }
     }
 
+    if (order == 2 || order == 3){
+        for (i = 0; i < 4; i++){
+            d_basis[i] *= ncp_1;
+        }
+    }
+
+    return iknot;
+}
+
+
+/* Calculates the derivative of the basis. */
+static int bezier_d_basis
+    ( NurbsFloat d_basis[]        /* (out) Derivative of the basis functions */
+    , const NurbsFloat t        /* Parameter value */
+    , const int num_cp          /* Number of control points */
+    , const int order           /* Order */
+    )
+{
+    NurbsFloat window[4];
+    const int iknot = bezier_local_d_basis( window, t, num_cp, order );
+
+    memset( d_basis, 0, sizeof(NurbsFloat)*num_cp );
+    bezier_window_copy( d_basis, window, iknot, 4, num_cp );
+
     return iknot;
 }
 
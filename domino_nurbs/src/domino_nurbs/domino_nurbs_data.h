@@ -7,11 +7,76 @@
 #ifndef _DOMINO_NURBS_DATA_H
 #define _DOMINO_NURBS_DATA_H
 
+#include <stddef.h>
+#include <stdio.h>
+
 #include "nurbs_definitions.h"
 #include "nurbs_curve_data.h"
 #include "nurbs_surface_data.h"
 #include "nurbs_controlbox_data.h"
 
+/** All the entities of a binary model file (see nurbs_model_load).
+  * The knots and the control points are not copied: they point to the image
+  * of the file in memory (usually a private mapping of the file, so the
+  * changes are not written back). Only the tables of pointers are 
+  * allocated. The entities must be released with nurbs_model_dispose(), 
+  * never with nurbs_curve_dispose() and friends, and they cannot be 
+  * resized; a copy is needed for that.
+  */
+typedef struct NurbsModel_
+{
+    int num_curves;             /**< Number of curves. */
+    NurbsCurve* curve;          /**< Array of curves. */
+
+    int num_surfaces;           /**< Number of surfaces. */
+    NurbsSurface* surface;      /**< Array of surfaces. */
+
+    int num_controlboxes;       /**< Number of control boxes. */
+    NurbsControlBox* controlbox;/**< Array of control boxes. */
+
+    void* memory;               /**< Image of the file. */
+    size_t memory_size;         /**< Size of the image in bytes. */
+    int mapped;                 /**< 1 if the image is a mapping of the file;
+                                  * 0 if it was read in allocated memory. */
+}NurbsModel;
+
+/** Directory entry of an IGES file (see nurbs_iges_open). */
+typedef struct NurbsIgesEntity_
+{
+    int type;                   /**< Entity type number (126 curve, 
+                                  * 128 surface...) */
+    int form;                   /**< Form number. */
+    int id;                     /**< Entity subscript number. */
+    char label[9];              /**< Entity label. */
+
+    int directory_line;         /**< Sequence number of the entry. */
+    int data_line;              /**< First line of the parameter data. */
+    int data_count;             /**< Number of lines of the parameter data.*/
+
+    NurbsCurve* curve;          /**< The curve, once it has been read. */
+    NurbsSurface* surface;      /**< The surface, once it has been read. */
+}NurbsIgesEntity;
+
+/** IGES file opened for reading on demand. Only the directory is read when
+  * the file is opened; the curves and surfaces are read when they are 
+  * requested, and they are kept until the file is closed. */
+typedef struct NurbsIges_
+{
+    int num_entities;           /**< Number of directory entries. */
+    NurbsIgesEntity* entity;    /**< Array of directory entries. */
+
+    FILE* fd;                   /**< The file, which is kept open. */
+    long long parameter_offset; /**< Position of the Parameter Data section.*/
+    int line_size;              /**< Size of the lines in bytes, if all the
+                                  * lines have the same size; 0 otherwise. */
+    long long* parameter_line;  /**< Position of each line of the Parameter 
+                                  * Data section, if line_size is 0. */
+    int num_parameter_lines;    /**< Lines of the Parameter Data section. */
+
+    char parameter_delimiter;   /**< Parameter delimiter character. */
+    char record_delimiter;      /**< Record delimiter character. */
+}NurbsIges;
+
 #endif /* _DOMINO_NURBS_DATA_H */
 
 /**/
\ No newline at end of file
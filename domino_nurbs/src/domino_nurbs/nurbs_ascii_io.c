@@ -19,6 +19,7 @@
 #include "nurbs_surface.h"
 #include "nurbs_controlbox.h"
 #include "nurbs_io.h"
+#include "nurbs_text.h"
 
 #define NURBS_FILE_MAX_LINE_LEN 255
 #define BLOCK_SEPARATOR         "---"
@@ -30,6 +31,9 @@
 #define NURBS_END_OF_FILE       4
 #define CURRENT_FILE_VERSION    "ow_1.0"    /* Same signature as Overview */
 
+/* Number of entities converted to text in parallel when exporting */
+#define ASCII_EXPORT_CHUNK      64
+
 /* Checks if the line has the specified keyname. The check is case insensitive.
  * Return 1 if the line match with the keyname or 0 if not. */
 static int check_keyname( const char* line, const char* keyname )
@@ -210,11 +214,30 @@ static void extract_number_of_entities
 }
 
 
+/* Reads up to n real numbers from the line. Returns the number of values
+ * read. */
+static int read_values( const char* line, NurbsFloat values[], const int n )
+{
+    const char* end;
+    int i;
+
+    for (i = 0; i < n; i++){
+        values[i] = nurbs_text_to_float( line, &end );
+        if (end == line){
+            break;
+        }
+        line = end;
+    }
+
+    return i;
+}
+
+
 /* Read one NURBS surface */
 static void read_nurbs_curve( FILE* fh, NurbsCurve* curve )
 {
     int i;
-    float x, y, z, w, kn;
+    NurbsFloat v[4];
     char* value;
     char buffer[NURBS_FILE_MAX_LINE_LEN + 1];
     int keytype;
@@ -227,8 +250,11 @@ static void read_nurbs_curve( FILE* fh, NurbsCurve* curve )
     keytype = 0;
     while( keytype != NURBS_END_OF_FILE && keytype != NURBS_GROUP_SEPARATOR){
         if (cp_length > 0 && degree > 0 && init == 0){
-            /* Create the nurbs */
+            /* Create the nurbs (the label may be already read) */
+            char* label = curve->label;
             nurbs_curve_alloc( curve, cp_length, degree );
+            curve->label = label;
+            init = 1;
         }
         value = get_keyname( buffer, fh, &keytype );
         if ( check_keyname( buffer, "cp length" ) == 1 ){
@@ -248,7 +274,12 @@ static void read_nurbs_curve( FILE* fh, NurbsCurve* curve )
             }
         }
         else if ( check_keyname( buffer, "label" ) == 1 ){
-            read_label_safe( curve->label, value );
+            if (curve->label == nullptr){
+                _check_(curve->label = (char*)_malloc_(DOMINO_NURBS_LABEL_LEN));
+            }
+            if (curve->label != nullptr){
+                read_label_safe( curve->label, value );
+            }
         }
         else if ( check_keyname( buffer, "id" ) == 1 ){
             sscanf( value, "%i", &curve->id );
@@ -275,11 +306,11 @@ static void read_nurbs_curve( FILE* fh, NurbsCurve* curve )
                 }
 
                 /* Read the control point coordinates */
-                if (sscanf( buffer, "%f %f %f %f", &x, &y, &z, &w ) == 4){
-                    curve->cp[i].x = (NurbsFloat)x;
-                    curve->cp[i].y = (NurbsFloat)y;
-                    curve->cp[i].z = (NurbsFloat)z;
-                    curve->cp[i].w = (NurbsFloat)w;
+                if (read_values( buffer, v, 4 ) == 4){
+                    curve->cp[i].x = v[0];
+                    curve->cp[i].y = v[1];
+                    curve->cp[i].z = v[2];
+                    curve->cp[i].w = v[3];
                     i++;
                 }
             }
@@ -305,8 +336,8 @@ static void read_nurbs_curve( FILE* fh, NurbsCurve* curve )
                         "Unexpected keyname!" );
                 }
 
-                if (sscanf( buffer, "%f", &kn ) == 1){
-                    curve->knot[i] = (NurbsFloat)kn;
+                if (read_values( buffer, v, 1 ) == 1){
+                    curve->knot[i] = v[0];
                     i++;
                 }
             }
@@ -318,7 +349,7 @@ static void read_nurbs_curve( FILE* fh, NurbsCurve* curve )
 static void read_nurbs_surface( FILE* fh, NurbsSurface* surface )
 {
     int i;
-    float x, y, z, w, kn;
+    NurbsFloat v[4];
     char* value;
     char buffer[NURBS_FILE_MAX_LINE_LEN + 1];
     int keytype;
@@ -403,11 +434,11 @@ static void read_nurbs_surface( FILE* fh, NurbsSurface* surface )
                 }
 
                 /* Read the control point coordinates */
-                if (sscanf( buffer, "%f %f %f %f", &x, &y, &z, &w ) == 4){
-                    surface->cp_stream[i].x = (NurbsFloat)x;
-                    surface->cp_stream[i].y = (NurbsFloat)y;
-                    surface->cp_stream[i].z = (NurbsFloat)z;
-                    surface->cp_stream[i].w = (NurbsFloat)w;
+                if (read_values( buffer, v, 4 ) == 4){
+                    surface->cp_stream[i].x = v[0];
+                    surface->cp_stream[i].y = v[1];
+                    surface->cp_stream[i].z = v[2];
+                    surface->cp_stream[i].w = v[3];
                     i++;
                 }
             }
@@ -432,8 +463,8 @@ static void read_nurbs_surface( FILE* fh, NurbsSurface* surface )
                     _warning_( "Reading nurbs surface: Unexpected keyname!" );
                 }
 
-                if (sscanf( buffer, "%f", &kn ) == 1){
-                    surface->knot_u[i] = (NurbsFloat)kn;
+                if (read_values( buffer, v, 1 ) == 1){
+                    surface->knot_u[i] = v[0];
                     i++;
                 }
             }
@@ -459,8 +490,8 @@ static void read_nurbs_surface( FILE* fh, NurbsSurface* surface )
                     _warning_( "Reading nurbs surface: Unexpected keyname!" );
                 }
 
-                if (sscanf( buffer, "%f", &kn ) == 1){
-                    surface->knot_v[i] = (NurbsFloat)kn;
+                if (read_values( buffer, v, 1 ) == 1){
+                    surface->knot_v[i] = v[0];
                     i++;
                 }
             }
@@ -472,7 +503,7 @@ static void read_nurbs_surface( FILE* fh, NurbsSurface* surface )
 static void read_nurbs_controlbox( FILE* fh, NurbsControlBox* cb )
 {
     int i;
-    float x, y, z;
+    NurbsFloat v[3];
     char* value;
     char buffer[NURBS_FILE_MAX_LINE_LEN + 1] = { '\0' };
     int keytype;
@@ -588,10 +619,10 @@ static void read_nurbs_controlbox( FILE* fh, NurbsControlBox* cb )
                 }
 
                 /* Read control point coordinates */
-                if (sscanf( buffer, "%f %f %f", &x, &y, &z ) == 3){
-                    cb->cp_stream[i].x = (NurbsFloat)x;
-                    cb->cp_stream[i].y = (NurbsFloat)y;
-                    cb->cp_stream[i].z = (NurbsFloat)z;
+                if (read_values( buffer, v, 3 ) == 3){
+                    cb->cp_stream[i].x = v[0];
+                    cb->cp_stream[i].y = v[1];
+                    cb->cp_stream[i].z = v[2];
                     i++;
                 }
             }
@@ -870,161 +901,224 @@ NurbsControlBox* nurbs_controlbox_import_ascii
 
 /******************************************************************************/
 
-/* Writes a NURBS curve to an ASCII file */
-void nurbs_curve_fprintf( FILE* fh, const NurbsCurve *nurbs )
+/* Appends the text of a NURBS curve */
+static void curve_text( NurbsText* text, const NurbsCurve *nurbs )
 {
     int i;
 
-    if (fh == NULL)
-        return;
-    if (nurbs == nullptr)
-        return;
-
-    /* Writting the output file  */
-    fprintf( fh, "\nentity type\t: nurbs_curve " );
+    nurbs_text_add( text, "\nentity type\t: nurbs_curve " );
+    nurbs_text_add( text, "\nlabel\t: " );
     if (nurbs->label != nullptr){
-        fprintf( fh, "\nlabel\t: %s", nurbs->label );
-    }
-    else{
-        fprintf( fh, "\nlabel\t: ");
+        nurbs_text_add( text, nurbs->label );
     }
-    fprintf( fh, "\nid\t\t: %i\t<--- Id of the NURBS", nurbs->id );
-    fprintf( fh, "\ncp length\t: %i", nurbs->cp_length );
-    fprintf( fh, "\t<--- Number of control points " );
-    fprintf( fh, "\nDegree\t\t\t: %i", nurbs->degree );
-    fprintf( fh, "\t<--- Degree of the NURBS" );
-
-    fprintf( fh, "\n\nControl Points:" );
+    nurbs_text_add( text, "\nid\t\t: " );
+    nurbs_text_add_int( text, nurbs->id );
+    nurbs_text_add( text, "\t<--- Id of the NURBS" );
+    nurbs_text_add( text, "\ncp length\t: " );
+    nurbs_text_add_int( text, nurbs->cp_length );
+    nurbs_text_add( text, "\t<--- Number of control points " );
+    nurbs_text_add( text, "\nDegree\t\t\t: " );
+    nurbs_text_add_int( text, nurbs->degree );
+    nurbs_text_add( text, "\t<--- Degree of the NURBS" );
+
+    nurbs_text_add( text, "\n\nControl Points:" );
     for (i = 0; i < nurbs->cp_length; i++){
-        fprintf 
-        ( fh, "\n%.8f %.8f %.8f %.8f  \t<---- Pw(%i)"
-        , nurbs->cp[i].x, nurbs->cp[i].y
-        , nurbs->cp[i].z, nurbs->cp[i].w
-        , i
-        );
+        nurbs_text_add( text, "\n" );
+        nurbs_text_add_float( text, nurbs->cp[i].x );
+        nurbs_text_add( text, " " );
+        nurbs_text_add_float( text, nurbs->cp[i].y );
+        nurbs_text_add( text, " " );
+        nurbs_text_add_float( text, nurbs->cp[i].z );
+        nurbs_text_add( text, " " );
+        nurbs_text_add_float( text, nurbs->cp[i].w );
+        nurbs_text_add( text, "  \t<---- Pw(" );
+        nurbs_text_add_int( text, i );
+        nurbs_text_add( text, ")" );
     }
 
-    fprintf( fh, "\nKnots:" );
+    nurbs_text_add( text, "\nKnots:" );
     for (i = 0; i < nurbs->knot_length; i++){
-        fprintf( fh, "\n%f  \t<--- u(%i)", nurbs->knot[i], i );
+        nurbs_text_add( text, "\n" );
+        nurbs_text_add_float( text, nurbs->knot[i] );
+        nurbs_text_add( text, "  \t<--- u(" );
+        nurbs_text_add_int( text, i );
+        nurbs_text_add( text, ")" );
     }
 
-    fprintf( fh,"\n\n----------------------------------------\n" );
+    nurbs_text_add( text, "\n\n----------------------------------------\n" );
 }
 
-/* Writes a NURBS surface to an ASCII file */
-static void nurbs_surface_fprintf( FILE* fh, const NurbsSurface *nurbs )
+
+/* Appends the text of a NURBS surface */
+static void surface_text( NurbsText* text, const NurbsSurface *nurbs )
 {
     int i, j;
 
-    if (fh == NULL)
-        return;
-    if (nurbs == nullptr)
-        return;
-
-    /* Writting the output file  */
-    fprintf( fh, "\nentity type\t: nurbs_surface " );
-    if (nurbs->label != nullptr){
-        fprintf( fh, "\nlabel\t: %s", nurbs->label );
-    }
-    else{
-        fprintf( fh, "\nlabel\t: ");
-    }
-    fprintf( fh, "\nid\t\t: %i\t<--- Id of the NURBS", nurbs->id );
-    fprintf( fh, "\ncp length\t: %i %i"
-        , nurbs->cp_length_u, nurbs->cp_length_v );
-    fprintf( fh, "\t<--- Number of control points in u- and v- directions " );
-    fprintf( fh, "\ndegrees\t\t: %i %i", nurbs->degree_u, nurbs->degree_v );
-    fprintf( fh, "\t<--- Degrees in u- and v-directions " );
-
-    fprintf( fh, "\n\nControl Points:" );
+    nurbs_text_add( text, "\nentity type\t: nurbs_surface " );
+    nurbs_text_add( text, "\nlabel\t: " );
+    nurbs_text_add( text, nurbs->label );
+    nurbs_text_add( text, "\nid\t\t: " );
+    nurbs_text_add_int( text, nurbs->id );
+    nurbs_text_add( text, "\t<--- Id of the NURBS" );
+    nurbs_text_add( text, "\ncp length\t: " );
+    nurbs_text_add_int( text, nurbs->cp_length_u );
+    nurbs_text_add( text, " " );
+    nurbs_text_add_int( text, nurbs->cp_length_v );
+    nurbs_text_add( text
+        , "\t<--- Number of control points in u- and v- directions " );
+    nurbs_text_add( text, "\ndegrees\t\t: " );
+    nurbs_text_add_int( text, nurbs->degree_u );
+    nurbs_text_add( text, " " );
+    nurbs_text_add_int( text, nurbs->degree_v );
+    nurbs_text_add( text, "\t<--- Degrees in u- and v-directions " );
+
+    nurbs_text_add( text, "\n\nControl Points:" );
     for (i = 0; i < nurbs->cp_length_u; i++){
         for (j = 0; j < nurbs->cp_length_v; j++){
-            fprintf 
-            ( fh, "\n%.8f %.8f %.8f %.8f  \t<---- Pw(%i,%i)"
-            , nurbs->cp[i][j].x, nurbs->cp[i][j].y
-            , nurbs->cp[i][j].z, nurbs->cp[i][j].w
-            , i, j
-            );
+            nurbs_text_add( text, "\n" );
+            nurbs_text_add_float( text, nurbs->cp[i][j].x );
+            nurbs_text_add( text, " " );
+            nurbs_text_add_float( text, nurbs->cp[i][j].y );
+            nurbs_text_add( text, " " );
+            nurbs_text_add_float( text, nurbs->cp[i][j].z );
+            nurbs_text_add( text, " " );
+            nurbs_text_add_float( text, nurbs->cp[i][j].w );
+            nurbs_text_add( text, "  \t<---- Pw(" );
+            nurbs_text_add_int( text, i );
+            nurbs_text_add( text, "," );
+            nurbs_text_add_int( text, j );
+            nurbs_text_add( text, ")" );
         }
 
-        fprintf( fh, "\n" );
+        nurbs_text_add( text, "\n" );
     }
 
-    fprintf( fh, "\nKnots U:" );
+    nurbs_text_add( text, "\nKnots U:" );
     for (i = 0; i < nurbs->knot_length_u; i++){
-        fprintf( fh, "\n%f  \t<--- u(%i)", nurbs->knot_u[i], i );
+        nurbs_text_add( text, "\n" );
+        nurbs_text_add_float( text, nurbs->knot_u[i] );
+        nurbs_text_add( text, "  \t<--- u(" );
+        nurbs_text_add_int( text, i );
+        nurbs_text_add( text, ")" );
     }
 
-    fprintf( fh, "\n\nKnots V:" );
+    nurbs_text_add( text, "\n\nKnots V:" );
     for (i = 0; i < nurbs->knot_length_v; i++){
-        fprintf( fh, "\n%f  \t<--- v(%i)", nurbs->knot_v[i], i );
+        nurbs_text_add( text, "\n" );
+        nurbs_text_add_float( text, nurbs->knot_v[i] );
+        nurbs_text_add( text, "  \t<--- v(" );
+        nurbs_text_add_int( text, i );
+        nurbs_text_add( text, ")" );
     }
 
-    fprintf( fh,"\n\n----------------------------------------\n" );
+    nurbs_text_add( text, "\n\n----------------------------------------\n" );
 }
 
-/* Writes a NURBS control box to an ASCII file */
-void nurbs_controlbox_fprintf( FILE* fd, const NurbsControlBox* nurbs )
+
+/* Appends the text of a NURBS control box */
+static void controlbox_text( NurbsText* text, const NurbsControlBox* nurbs )
 {
     int i, j, k, index;
 
-    if (fd == NULL)
-        return;
-    if (nurbs == nullptr)
-        return;
-
-    /* Writting the output file  */
-    fprintf( fd, "\nentity type\t: nurbs_control_box " );
-    if (nurbs->label != nullptr){
-        fprintf( fd, "\nlabel\t: %s", nurbs->label );
-    }
-    else{
-        fprintf( fd, "\nlabel\t: ");
-    }
-    fprintf( fd, "\nid\t\t: %i\t<--- Id of the control box", nurbs->id );
-    fprintf( fd, "\ncp length\t: %i %i %i"
-        , nurbs->cp_length_u, nurbs->cp_length_v, nurbs->cp_length_w );
-    fprintf( fd, "\t<--- Number of control points in u, v, w directions " );
-    fprintf( fd, "\norder\t: %i %i %i"
-        , nurbs->order_u, nurbs->order_v, nurbs->order_w );
-    fprintf( fd, "\t<--- Order of the interpolation in u, v, w directions " );
+    nurbs_text_add( text, "\nentity type\t: nurbs_control_box " );
+    nurbs_text_add( text, "\nlabel\t: " );
+    nurbs_text_add( text, nurbs->label );
+    nurbs_text_add( text, "\nid\t\t: " );
+    nurbs_text_add_int( text, nurbs->id );
+    nurbs_text_add( text, "\t<--- Id of the control box" );
+    nurbs_text_add( text, "\ncp length\t: " );
+    nurbs_text_add_int( text, nurbs->cp_length_u );
+    nurbs_text_add( text, " " );
+    nurbs_text_add_int( text, nurbs->cp_length_v );
+    nurbs_text_add( text, " " );
+    nurbs_text_add_int( text, nurbs->cp_length_w );
+    nurbs_text_add( text
+        , "\t<--- Number of control points in u, v, w directions " );
+    nurbs_text_add( text, "\norder\t: " );
+    nurbs_text_add_int( text, nurbs->order_u );
+    nurbs_text_add( text, " " );
+    nurbs_text_add_int( text, nurbs->order_v );
+    nurbs_text_add( text, " " );
+    nurbs_text_add_int( text, nurbs->order_w );
+    nurbs_text_add( text
+        , "\t<--- Order of the interpolation in u, v, w directions " );
  
-    fprintf( fd, "\nbasis equation: " );
+    nurbs_text_add( text, "\nbasis equation: " );
     if (nurbs->basis_equation == 1){
-        fprintf( fd, "bezier" );
+        nurbs_text_add( text, "bezier" );
     }
     else{
-        fprintf( fd, "nurbs" );
+        nurbs_text_add( text, "nurbs" );
     }
-    fprintf( fd, "\t<--- Basis interporlation (nurbs, bezier) " );
+    nurbs_text_add( text, "\t<--- Basis interporlation (nurbs, bezier) " );
 
-    fprintf( fd, "\n\nControl Points:" );
+    nurbs_text_add( text, "\n\nControl Points:" );
     index = 0;
     for (i = 0; i < nurbs->cp_length_u; i++){
         for (j = 0; j < nurbs->cp_length_v; j++){
             for (k = 0; k < nurbs->cp_length_w; k++){
-                fprintf 
-                ( fd, "\n%.8f %.8f %.8f  \t<---- Pw(%i,%i,%i)"
-                , nurbs->cp_stream[index].x
-                , nurbs->cp_stream[index].y
-                , nurbs->cp_stream[index].z
-                , i, j, k
-                );
+                nurbs_text_add( text, "\n" );
+                nurbs_text_add_float( text, nurbs->cp_stream[index].x );
+                nurbs_text_add( text, " " );
+                nurbs_text_add_float( text, nurbs->cp_stream[index].y );
+                nurbs_text_add( text, " " );
+                nurbs_text_add_float( text, nurbs->cp_stream[index].z );
+                nurbs_text_add( text, "  \t<---- Pw(" );
+                nurbs_text_add_int( text, i );
+                nurbs_text_add( text, "," );
+                nurbs_text_add_int( text, j );
+                nurbs_text_add( text, "," );
+                nurbs_text_add_int( text, k );
+                nurbs_text_add( text, ")" );
                 index++;
             }
-            fprintf( fd, "\n" );
+            nurbs_text_add( text, "\n" );
         }
     }
 
-    fprintf( fd,"\n\n----------------------------------------\n" );
+    nurbs_text_add( text, "\n\n----------------------------------------\n" );
+}
+
+
+/* Writes a NURBS curve to an ASCII file */
+void nurbs_curve_fprintf( FILE* fh, const NurbsCurve *nurbs )
+{
+    NurbsText text;
+
+    if (fh == NULL)
+        return;
+    if (nurbs == nullptr)
+        return;
+
+    nurbs_text_init( &text );
+    curve_text( &text, nurbs );
+    nurbs_text_write( &text, fh );
+    nurbs_text_dispose( &text );
+}
+
+/* Writes a NURBS control box to an ASCII file */
+void nurbs_controlbox_fprintf( FILE* fd, const NurbsControlBox* nurbs )
+{
+    NurbsText text;
+
+    if (fd == NULL)
+        return;
+    if (nurbs == nullptr)
+        return;
+
+    nurbs_text_init( &text );
+    controlbox_text( &text, nurbs );
+    nurbs_text_write( &text, fd );
+    nurbs_text_dispose( &text );
 }
 
 
 /******************************************************************************/
 
-/* Writes all NURBS entities to an ASCII file */
-void nurbs_export_ascii
+/* Writes the entities to an ASCII file. The entities are converted to text
+ * in chunks; the entities of a chunk are converted in parallel, and then
+ * they are written in order. */
+static int export_ascii_file
     ( const char* filename
     , const NurbsCurve *curve_array
     , const int num_curves 
@@ -1034,62 +1128,95 @@ void nurbs_export_ascii
     , const int num_cb 
     )
 {
-    int i;
+    NurbsText text[ASCII_EXPORT_CHUNK];
     FILE* fd;
-    char* time_str = getlocaltime();
-
-    _trace_( "--- %s", time_str );
-    _trace_( "Exporting NURBS file %s\n", filename );
+    int i, i0, n, status = 1;
+    const int nc = (curve_array != nullptr) ? num_curves : 0;
+    const int ns = (surface_array != nullptr) ? num_surfaces : 0;
+    const int nb = (cb_array != nullptr) ? num_cb : 0;
+    const int num_entities = nc + ns + nb;
 
     fd = fopen( filename, "wt" );
     if (fd == NULL){
-        _handle_error_( "Failed to write filename! %s", filename );
-        return;
+        _handle_error_( "Failed to write the NURBS file!" );
+        return 0;
+    }
+
+    for (i = 0; i < ASCII_EXPORT_CHUNK; i++){
+        nurbs_text_init( &text[i] );
     }
-    
-    fprintf( fd, "\nfile format version : %s", CURRENT_FILE_VERSION );
 
-    fprintf( fd,"\n\n----------------------------------------\n" );
+    nurbs_text_add( &text[0], "\nfile format version : " );
+    nurbs_text_add( &text[0], CURRENT_FILE_VERSION );
+    nurbs_text_add( &text[0], "\n\n----------------------------------------\n" );
+    status &= nurbs_text_write( &text[0], fd );
 
-    for (i = 0; i < num_curves; i++){
-        nurbs_curve_fprintf( fd, &(curve_array[i]) );
+    for (i0 = 0; i0 < num_entities && status; i0 += ASCII_EXPORT_CHUNK){
+        n = (num_entities - i0 < ASCII_EXPORT_CHUNK) 
+            ? num_entities - i0 : ASCII_EXPORT_CHUNK;
+
+        #pragma omp parallel for schedule(dynamic) if (n > 1)
+        for (i = 0; i < n; i++){
+            const int k = i0 + i;
+            if (k < nc){
+                curve_text( &text[i], &curve_array[k] );
+            }
+            else if (k < nc + ns){
+                surface_text( &text[i], &surface_array[k - nc] );
+            }
+            else{
+                controlbox_text( &text[i], &cb_array[k - nc - ns] );
+            }
+        }
+
+        for (i = 0; i < n; i++){
+            status &= nurbs_text_write( &text[i], fd );
+        }
     }
-    for (i = 0; i < num_surfaces; i++){
-        nurbs_surface_fprintf( fd, &(surface_array[i]) );
+
+    for (i = 0; i < ASCII_EXPORT_CHUNK; i++){
+        nurbs_text_dispose( &text[i] );
     }
-    for (i = 0; i < num_cb; i++){
-        nurbs_controlbox_fprintf( fd, &(cb_array[i]) );
+
+    if (fclose( fd ) != 0 || !status){
+        _handle_error_( "Failed to write the NURBS file!" );
+        return 0;
     }
 
-    fclose( fd );
+    return 1;
 }
 
 
-/* Writes NURBS curves to an ASCII file */
-void nurbs_curve_export_ascii
+/* Writes all NURBS entities to an ASCII file */
+int nurbs_export_ascii
     ( const char* filename
     , const NurbsCurve *curve_array
     , const int num_curves 
+    , const NurbsSurface *surface_array
+    , const int num_surfaces 
+    , const NurbsControlBox *cb_array
+    , const int num_cb 
     )
 {
-    int i;
-    FILE* fd;
+    char* time_str = getlocaltime();
 
-    fd = fopen( filename, "wt" );
-    if (fd == NULL){
-        _handle_error_( "Failed to write filename! %s", filename );
-        return;
-    }
-    
-    fprintf( fd, "\nfile format version : %s", CURRENT_FILE_VERSION );
+    _trace_( "--- %s", time_str );
+    _trace_( "Exporting NURBS file %s\n", filename );
 
-    fprintf( fd,"\n\n----------------------------------------\n" );
+    return export_ascii_file( filename, curve_array, num_curves
+        , surface_array, num_surfaces, cb_array, num_cb );
+}
 
-    for (i = 0; i < num_curves; i++){
-        nurbs_curve_fprintf( fd, &(curve_array[i]) );
-    }
 
-    fclose( fd );
+/* Writes NURBS curves to an ASCII file */
+void nurbs_curve_export_ascii
+    ( const char* filename
+    , const NurbsCurve *curve_array
+    , const int num_curves 
+    )
+{
+    export_ascii_file( filename, curve_array, num_curves
+        , nullptr, 0, nullptr, 0 );
 }
 
 
@@ -1100,24 +1227,8 @@ void nurbs_surface_export_ascii
     , const int num_surfaces 
     )
 {
-    int i;
-    FILE* fd;
-
-    fd = fopen( filename, "wt" );
-    if (fd == NULL){
-        _handle_error_( "Failed to write filename! %s", filename );
-        return;
-    }
-    
-    fprintf( fd, "\nfile format version : %s", CURRENT_FILE_VERSION );
-
-    fprintf( fd,"\n\n----------------------------------------\n" );
-
-    for (i = 0; i < num_surfaces; i++){
-        nurbs_surface_fprintf( fd, &(surface_array[i]) );
-    }
-
-    fclose( fd );
+    export_ascii_file( filename, nullptr, 0
+        , surface_array, num_surfaces, nullptr, 0 );
 }
 
 
@@ -1128,24 +1239,8 @@ void nurbs_controlbox_export_ascii
     , const int num_cb 
     )
 {
-    int i;
-    FILE* fd;
-
-    fd = fopen( filename, "wt" );
-    if (fd == NULL){
-        _handle_error_( "Failed to write filename! %s", filename );
-        return;
-    }
-    
-    fprintf( fd, "\nfile format version : %s", CURRENT_FILE_VERSION );
-
-    fprintf( fd,"\n\n----------------------------------------\n" );
-
-    for (i = 0; i < num_cb; i++){
-        nurbs_controlbox_fprintf( fd, &(cb_array[i]) );
-    }
-
-    fclose( fd );
+    export_ascii_file( filename, nullptr, 0
+        , nullptr, 0, cb_array, num_cb );
 }
 
 
@@ -11,6 +11,8 @@
 #include "nurbs_internal.h"
 #include "nurbs_basis.h"
 
+#include "nurbs_basis_kernels.inl"
+
 
 static inline void set_zero(NurbsFloat* dest, const int length)
 {
@@ -66,13 +68,14 @@ static NurbsFloat nurbs_basis_calculate_term
     , const NurbsFloat t        /* Parameter */
     , const int k               /* Degree */
     , const int i               /* lower index of the knot interval: x[i] < k < x[i+1] */
+    , const int ib              /* Index of the term i in the basis array */
     , NurbsFloat* bi_1          /* basis of the previous iteration */
     )
 {
     NurbsFloat c, nl, nr, xik1, xi1;
     int i1 = i+1;
 
-    nl = *bi_1 * nk1[i];
+    nl = *bi_1 * nk1[ib];
 
     xik1 = x[i1 + k];
     xi1 = x[i1];
@@ -80,7 +83,7 @@ static NurbsFloat nurbs_basis_calculate_term
     if (xik1 > xi1){ /* x[i + k + 1] - x[i + 1] != 0 */
         c = (xik1 - t) / (xik1 - xi1);
         *bi_1 = 1 - c; /* It happens that the term Bi = 1-Ai */
-        nr = c * nk1[i1];
+        nr = c * nk1[ib + 1];
     }
     else{
         nr = 0;
@@ -127,23 +130,80 @@ static NurbsFloat nurbs_basis_calculate_legacy
 }
 #endif
 
-/* Calculates the all basis functions (one for each knot). 
- * Returns the lower knot index interval */
-int nurbs_basis_function
-    ( NurbsFloat basis[]        /* (out) Basis functions */
+/* Accumulated calculation of the basis from 1 to k degree.
+ * The basis of the control point i is stored in basis[i - first]. */
+static void nurbs_basis_recursion
+    ( NurbsFloat basis[]        /* (in/out) Basis functions */
     , const NurbsFloat t        /* Parameter value */
     , const int degree          /* Degree */
     , const NurbsFloat knots[]  /* Knot vectors */
-    , const int knots_length    /* Knot length */
+    , const int iknot           /* Lower index of the knot interval */
+    , const int first           /* Index of the basis stored in basis[0] */
     )
 {
     register int i, k;
-    int n;            /* Last index of the knot vector */
-    int iknot;        /* Lower index of the knot interval */
     int ik0;          /* Knot_index - degree */
     NurbsFloat bi_1;
 
-    n = knots_length - 1;
+    basis[iknot - first] = 1;
+
+    for (k = 1; k <= degree; k++){
+        ik0 = iknot-k;
+        if (ik0 < 0){
+            ik0 = 0;
+        }
+
+        bi_1 = 0;
+        for (i = ik0; i <= iknot; i++){
+            basis[i - first] = nurbs_basis_calculate_term
+                (basis, knots, t, k, i, i - first, &bi_1);
+        }
+    }
+}
+
+/* Calculates the non zero basis with the kernels specialized for degree 1, 2
+ * and 3, basis[0] being the basis of the control point iknot - degree.
+ * Returns 0 if there is no kernel for the degree or if the first terms are
+ * out of the knot vector; then the generic recursion must be used. */
+static inline int nurbs_basis_kernel
+    ( NurbsFloat basis[]        /* (out) Non zero basis functions */
+    , const NurbsFloat t        /* Parameter value */
+    , const int degree          /* Degree */
+    , const NurbsFloat knots[]  /* Knot vectors */
+    , const int iknot           /* Lower index of the knot interval */
+    )
+{
+    if (iknot < degree){
+        return 0;
+    }
+
+    switch (degree){
+    case 1:
+        nurbs_basis_kernel1(basis, t, &knots[iknot - 1]);
+        return 1;
+    case 2:
+        nurbs_basis_kernel2(basis, t, &knots[iknot - 2]);
+        return 1;
+    case 3:
+        nurbs_basis_kernel3(basis, t, &knots[iknot - 3]);
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/* Calculates the all basis functions (one for each knot) without the
+ * specialized kernels. Returns the lower knot index interval */
+int nurbs_basis_generic_function
+    ( NurbsFloat basis[]        /* (out) Basis functions */
+    , const NurbsFloat t        /* Parameter value */
+    , const int degree          /* Degree */
+    , const NurbsFloat knots[]  /* Knot vectors */
+    , const int knots_length    /* Knot length */
+    )
+{
+    const int n = knots_length - 1;  /* Last index of the knot vector */
+    int iknot;        /* Lower index of the knot interval */
 
     /* Get the lower index of the knot interval */
     iknot = nurbs_basis_knot_index(t, knots, knots_length);
@@ -161,24 +221,84 @@ int nurbs_basis_function
         return iknot;
     }
 
-    basis[iknot] = 1;
+    nurbs_basis_recursion(basis, t, degree, knots, iknot, 0);
 
-    /* Accumulated calculation of the basis from 1 to k degree */
-    for (k = 1; k <= degree; k++){
-        ik0 = iknot-k;
-        if (ik0 < 0){
-            ik0 = 0;
-        }
+    return iknot;
+}
 
-        bi_1 = 0;
-        for (i = ik0; i <= iknot; i++){    
-            basis[i] = nurbs_basis_calculate_term(basis, knots, t, k, i, &bi_1);
-        }
+/* Calculates the all basis functions (one for each knot). 
+ * Returns the lower knot index interval */
+int nurbs_basis_function
+    ( NurbsFloat basis[]        /* (out) Basis functions */
+    , const NurbsFloat t        /* Parameter value */
+    , const int degree          /* Degree */
+    , const NurbsFloat knots[]  /* Knot vectors */
+    , const int knots_length    /* Knot length */
+    )
+{
+    const int n = knots_length - 1;  /* Last index of the knot vector */
+    int iknot;        /* Lower index of the knot interval */
+
+    iknot = nurbs_basis_knot_index(t, knots, knots_length);
+
+    set_zero(basis, knots_length);
+
+    if (iknot < 0){
+        basis[0] = 1;
+        return iknot;
+    }
+    else if (iknot >= n){
+        basis[n - degree - 1] = 1;
+        return iknot;
+    }
+
+    if (!nurbs_basis_kernel(&basis[iknot - degree], t, degree, knots, iknot)){
+        nurbs_basis_recursion(basis, t, degree, knots, iknot, 0);
     }
 
     return iknot;
 }
 
+/* Calculates only the basis functions that are not zero in the knot interval.
+ * basis[j] is the basis function of the control point first + j, j=0..degree.
+ * The array must have room for degree + 2 values, the last one is used 
+ * internally and it is always zero. Returns the index of the first basis. */
+int nurbs_basis_local_function
+    ( NurbsFloat basis[]        /* (out) Non zero basis functions */
+    , const NurbsFloat t        /* Parameter value */
+    , const int degree          /* Degree */
+    , const NurbsFloat knots[]  /* Knot vectors */
+    , const int knots_length    /* Knot length */
+    )
+{
+    const int n = knots_length - 1;  /* Last index of the knot vector */
+    int iknot;        /* Lower index of the knot interval */
+    int first;        /* Index of the basis stored in basis[0] */
+
+    iknot = nurbs_basis_knot_index(t, knots, knots_length);
+
+    set_zero(basis, degree + 2);
+
+    /* Out of the knots interval, the basis are not defined */
+    if (iknot < 0){
+        basis[0] = 1;
+        return 0;
+    }
+    else if (iknot >= n){
+        basis[0] = 1;
+        return n - degree - 1;
+    }
+
+    first = iknot - degree;
+
+    /* Same recursion as nurbs_basis_function() but only on the local terms */
+    if (!nurbs_basis_kernel(basis, t, degree, knots, iknot)){
+        nurbs_basis_recursion(basis, t, degree, knots, iknot, first);
+    }
+
+    return first;
+}
+
 /* Gets the valid interval where the nurbs is defined */
 void nurbs_basis_get_parameter_interval
     ( NurbsFloat* first         /* (out) Lower knot interval */
@@ -203,6 +323,7 @@ static void nurbs_basis_derivate_term
     , const NurbsFloat t        /* Parameter */
     , const int k               /* Degree */
     , const int i               /* Lower knot interval: x[i] < k < x[i+1] */
+    , const int ib              /* Index of the term i in the basis arrays */
     , NurbsFloat* bi_1          /* Basis of the previous iteration */
     )
 {
@@ -212,8 +333,8 @@ static void nurbs_basis_derivate_term
     xki = x[k + i];
     xi = x[i];
     if (xki > xi){ /* xki - xi != 0 */
-        nl = (*bi_1) * nk1[i];
-        dnl = (*bi_1) * dk1[i] + nk1[i] / (xki - xi);
+        nl = (*bi_1) * nk1[ib];
+        dnl = (*bi_1) * dk1[ib] + nk1[ib] / (xki - xi);
     }
     else{
         nl = 0;
@@ -227,8 +348,8 @@ static void nurbs_basis_derivate_term
         c = xki - t;
         d = xki - xi;
         cd = c / d;
-        nr = cd * nk1[i + 1];
-        dnr = (c * dk1[i + 1] - nk1[i + 1]) / d;
+        nr = cd * nk1[ib + 1];
+        dnr = (c * dk1[ib + 1] - nk1[ib + 1]) / d;
         *bi_1 = 1 - cd;
     }
     else{
@@ -241,9 +362,72 @@ static void nurbs_basis_derivate_term
     *d_basis = dnl + dnr;
 }
 
-/* Calculates the basis and the derivate of the basis.
- * Returns the lower index of the knot interval. */
-int nurbs_basis_derivate_function
+/* Recursive calculation of basis and derivatives for k degree.
+ * The values of the control point i are stored in basis[i - first]. */
+static void nurbs_basis_derivate_recursion
+    ( NurbsFloat d_basis[]      /* (in/out) Derivative of the basis function */
+    , NurbsFloat basis[]        /* (in/out) Basis functions */
+    , const NurbsFloat t        /* Parameter */
+    , const int degree          /* Degree */
+    , const NurbsFloat knots[]  /* Knot vector */
+    , const int iknot           /* Lower index of the knot interval */
+    , const int first           /* Index of the basis stored in basis[0] */
+    )
+{
+    int i, k;
+    int ik0;            /* iknot - degree */
+    NurbsFloat bi_1;    /* To temporaly store the basis value of the previous iteration */ 
+
+    basis[iknot - first] = 1;
+
+    for (k = 1; k <= degree; k++){
+        ik0 = iknot - k;
+        if (ik0 < 0){
+            ik0 = 0;
+        }
+
+        bi_1 = 0;
+        for (i = ik0; i <= iknot; i++){
+            nurbs_basis_derivate_term
+            ( &basis[i - first], &d_basis[i - first]
+            , basis, d_basis, knots, t, k, i, i - first, &bi_1
+            );
+        }
+    }
+}
+
+/* Same as nurbs_basis_kernel() for the basis and the derivatives */
+static inline int nurbs_basis_derivate_kernel
+    ( NurbsFloat d_basis[]      /* (out) Derivative of the non zero basis */
+    , NurbsFloat basis[]        /* (out) Non zero basis functions */
+    , const NurbsFloat t        /* Parameter */
+    , const int degree          /* Degree */
+    , const NurbsFloat knots[]  /* Knot vector */
+    , const int iknot           /* Lower index of the knot interval */
+    )
+{
+    if (iknot < degree){
+        return 0;
+    }
+
+    switch (degree){
+    case 1:
+        nurbs_d_basis_kernel1(d_basis, basis, t, &knots[iknot - 1]);
+        return 1;
+    case 2:
+        nurbs_d_basis_kernel2(d_basis, basis, t, &knots[iknot - 2]);
+        return 1;
+    case 3:
+        nurbs_d_basis_kernel3(d_basis, basis, t, &knots[iknot - 3]);
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/* Calculates the basis and the derivate of the basis without the specialized
+ * kernels. Returns the lower index of the knot interval. */
+int nurbs_basis_generic_derivate_function
     ( NurbsFloat d_basis[]      /* (out) Derivative of the basis function */
     , NurbsFloat basis[]        /* (out) Basis functions */
     , const NurbsFloat t        /* Parameter */
@@ -252,11 +436,8 @@ int nurbs_basis_derivate_function
     , const int knots_length    /* Knot vector length */
     )
 {
-    int i, k;
     const int n = knots_length - 1;  /* last index of the knot vector */
     int iknot;          /* Lower index of the knot interval */
-    int ik0;            /* iknot - degree */
-    NurbsFloat bi_1;    /* To temporaly store the basis value of the previous iteration */ 
 
     /* Get the index of the knot interval */
     iknot = nurbs_basis_knot_index(t, knots, knots_length);
@@ -274,27 +455,87 @@ int nurbs_basis_derivate_function
         return iknot;
     }
 
-    basis[iknot] = 1;
+    nurbs_basis_derivate_recursion(d_basis, basis, t, degree, knots, iknot, 0);
 
-    /* Recursive calculation of basis and derivatives for k degree */
-    for (k = 1; k <= degree; k++){
-        ik0 = iknot - k;
-        if (ik0 < 0){
-            ik0 = 0;
-        }
+    return iknot;
+}
 
-        bi_1 = 0;
-        for (i = ik0; i <= iknot; i++){
-            nurbs_basis_derivate_term
-            ( &basis[i], &d_basis[i]
-            , basis, d_basis, knots, t, k, i, &bi_1
-            );
-        }
+/* Calculates the basis and the derivate of the basis.
+ * Returns the lower index of the knot interval. */
+int nurbs_basis_derivate_function
+    ( NurbsFloat d_basis[]      /* (out) Derivative of the basis function */
+    , NurbsFloat basis[]        /* (out) Basis functions */
+    , const NurbsFloat t        /* Parameter */
+    , const int degree          /* Degree */
+    , const NurbsFloat knots[]  /* Knot vector */
+    , const int knots_length    /* Knot vector length */
+    )
+{
+    const int n = knots_length - 1;  /* last index of the knot vector */
+    int iknot;          /* Lower index of the knot interval */
+
+    iknot = nurbs_basis_knot_index(t, knots, knots_length);
+
+    set_zero(basis, knots_length);
+    set_zero(d_basis, knots_length);
+
+    if (iknot < 0){
+        basis[0] = 1;
+        return iknot;
+    }
+    else if (iknot >= n){
+        basis[n - degree - 1] = 1;
+        return iknot;
+    }
+
+    if (!nurbs_basis_derivate_kernel(&d_basis[iknot - degree]
+        , &basis[iknot - degree], t, degree, knots, iknot))
+    {
+        nurbs_basis_derivate_recursion(d_basis, basis, t, degree, knots, iknot, 0);
     }
 
     return iknot;
 }
 
+/* Calculates the basis and the derivate of the basis that are not zero in the
+ * knot interval. The arrays must have room for degree + 2 values.
+ * Returns the index of the first basis. */
+int nurbs_basis_local_derivate_function
+    ( NurbsFloat d_basis[]      /* (out) Derivative of the non zero basis */
+    , NurbsFloat basis[]        /* (out) Non zero basis functions */
+    , const NurbsFloat t        /* Parameter */
+    , const int degree          /* Degree */
+    , const NurbsFloat knots[]  /* Knot vector */
+    , const int knots_length    /* Knot vector length */
+    )
+{
+    const int n = knots_length - 1;  /* last index of the knot vector */
+    int iknot;          /* Lower index of the knot interval */
+    int first;          /* Index of the basis stored in basis[0] */
+
+    iknot = nurbs_basis_knot_index(t, knots, knots_length);
+
+    set_zero(basis, degree + 2);
+    set_zero(d_basis, degree + 2);
+
+    if (iknot < 0){
+        basis[0] = 1;
+        return 0;
+    }
+    else if (iknot >= n){
+        basis[0] = 1;
+        return n - degree - 1;
+    }
+
+    first = iknot - degree;
+
+    if (!nurbs_basis_derivate_kernel(d_basis, basis, t, degree, knots, iknot)){
+        nurbs_basis_derivate_recursion(d_basis, basis, t, degree, knots, iknot, first);
+    }
+
+    return first;
+}
+
 /* Calculates the basis second derivative of the basis function */
 static void nurbs_basis_second_derivate_term
     ( NurbsFloat* basis        /* (out) basis */
@@ -307,6 +548,7 @@ static void nurbs_basis_second_derivate_term
     , const NurbsFloat t       /* Parameter */
     , const int k              /* Degree */
     , const int i              /* knot interval: x[i] < k < x[i+1] */
+    , const int ib             /* Index of the term i in the basis arrays */
     )
 {
     NurbsFloat a, b, c, d, xki, xi, nl, nr, dnl, d2nl, dnr, d2nr;
@@ -316,9 +558,9 @@ static void nurbs_basis_second_derivate_term
     if (xki > xi){ /* xki - xi != 0 */
         a = (t - xi);
         b = xki - xi;
-        nl = (a / b) * nk1[i];
-        dnl = (a*dk1[i] + nk1[i]) / b;
-        d2nl = (a*d2k1[i] + 2*dk1[i]) / b;
+        nl = (a / b) * nk1[ib];
+        dnl = (a*dk1[ib] + nk1[ib]) / b;
+        d2nl = (a*d2k1[ib] + 2*dk1[ib]) / b;
     }
     else{
         nl = 0;
@@ -331,9 +573,9 @@ static void nurbs_basis_second_derivate_term
     if (xki > xi){ /* xki - xi != 0 */
         c = xki - t;
         d = xki - xi;
-        nr = (c / d) * nk1[i + 1];
-        dnr = (c*dk1[i+1] - nk1[i+1]) / d;
-        d2nr = (c*d2k1[i+1] - 2*dk1[i+1]) / d;
+        nr = (c / d) * nk1[ib + 1];
+        dnr = (c*dk1[ib+1] - nk1[ib+1]) / d;
+        d2nr = (c*d2k1[ib+1] - 2*dk1[ib+1]) / d;
     }
     else{
         nr = 0;
@@ -392,13 +634,66 @@ int nurbs_basis_second_derivate_function
         for (i = ik0; i <= iknot; i++){
             nurbs_basis_second_derivate_term
                 (&basis[i], &d_basis[i], &d2_basis[i]
-                , basis, d_basis, d2_basis, knots, t, k, i);
+                , basis, d_basis, d2_basis, knots, t, k, i, i);
         }
     }
 
     return iknot;
 }
 
+/* Calculates the basis, the first and the second derivate of the basis that 
+ * are not zero in the knot interval. The arrays must have room for 
+ * degree + 2 values. Returns the index of the first basis. */
+int nurbs_basis_local_second_derivate_function
+    ( NurbsFloat d2_basis[]     /* (out) Second derivative of the basis func */
+    , NurbsFloat d_basis[]      /* (out) Derivative of the basis function */
+    , NurbsFloat basis[]        /* (out) Basis functions */
+    , const NurbsFloat t        /* Parameter */
+    , const int degree          /* Degree */
+    , const NurbsFloat knots[]  /* Knot vector */
+    , const int knots_length    /* Knot vector length */
+    )
+{
+    int i, k;
+    const int n = knots_length - 1;  /* last index of the knot vector */
+    int iknot;    /* Index of knot interval */
+    int ik0;
+    int first;    /* Index of the basis stored in basis[0] */
+
+    iknot = nurbs_basis_knot_index(t, knots, knots_length);
+
+    set_zero(basis, degree + 2);
+    set_zero(d_basis, degree + 2);
+    set_zero(d2_basis, degree + 2);
+
+    if (iknot < 0){
+        basis[0] = 1;
+        return 0;
+    }
+    else if (iknot >= n){
+        basis[0] = 1;
+        return n - degree - 1;
+    }
+
+    first = iknot - degree;
+    basis[degree] = 1;
+
+    for (k = 1; k <= degree; k++){
+        ik0 = iknot-k;
+        if (ik0 < 0){
+            ik0 = 0;
+        }
+
+        for (i = ik0; i <= iknot; i++){
+            nurbs_basis_second_derivate_term
+                (&basis[i - first], &d_basis[i - first], &d2_basis[i - first]
+                , basis, d_basis, d2_basis, knots, t, k, i, i - first);
+        }
+    }
+
+    return first;
+}
+
 /* Calculate the basis k-degree coeficient at index ibasis for the parameter t.
  * This is the recursive algorithm to calculate only efficient to calculate one single basis term. 
  * Also it is recursive, and cannot be implemented in all hardware. */
@@ -47,6 +47,49 @@ int nurbs_basis_function
     );
 
 
+/*******************************************************************************
+*  Description:
+*     Same as nurbs_basis_function() but always with the generic recursion.
+*     nurbs_basis_function() uses kernels specialized for degree 1, 2 and 3
+*     that must give exactly the same values; this one is the reference.
+*  Return Values:
+*    integer values
+*    @return lower knot index of the knot interval the parameter belongs to.
+*
+*******************************************************************************/
+int nurbs_basis_generic_function
+    ( NurbsFloat basis[]        /** (out) Array of basis values */
+    , const NurbsFloat t        /** Parameter value */
+    , const int degree          /** Degree (degree = order - 1) */
+    , const NurbsFloat knots[]  /** Knot vectors */
+    , const int knots_length    /** Knot length */
+    );
+
+
+/*******************************************************************************
+*  Description:
+*     Calculates only the basis functions that are not zero for a parameter 
+*     value, i.e. basis[j] is the basis of the control point first + j with
+*     j = 0..degree. The array must have room for (degree + 2) values, so it
+*     can be a small buffer in the stack (see NURBS_MAX_DEGREE). 
+*     It does not use any other memory, so it can be called from several 
+*     threads at the same time.
+*  Return Values:
+*    integer values
+*    @return the index of the first basis (first). Note that it can be 
+*    negative or greater than the last control point if the knot vector is 
+*    not clamped; those terms are zero and must be skipped.
+*
+*******************************************************************************/
+int nurbs_basis_local_function
+    ( NurbsFloat basis[]        /** (out) Non zero basis values */
+    , const NurbsFloat t        /** Parameter value */
+    , const int degree          /** Degree (degree = order - 1) */
+    , const NurbsFloat knots[]  /** Knot vectors */
+    , const int knots_length    /** Knot length */
+    );
+
+
 /*******************************************************************************
 *  Description:
 *     Gets the valid knot interval where the nurbs is defined.
@@ -79,6 +122,42 @@ int nurbs_basis_derivate_function
     , const int knots_length    /** Knot vector length */
     );
 
+/*******************************************************************************
+*  Description:
+*     Same as nurbs_basis_derivate_function() but always with the generic 
+*     recursion, without the kernels specialized for degree 1, 2 and 3.
+*  Return Values:
+*    integer values
+*    @return lower knot index of the knot interval the parameter belongs to.
+*
+*******************************************************************************/
+int nurbs_basis_generic_derivate_function
+    ( NurbsFloat d_basis[]      /** (out) Derivative of the basis function */
+    , NurbsFloat basis[]        /** (out) Basis functions */
+    , const NurbsFloat t        /** Parameter */
+    , const int degree          /** Degree */
+    , const NurbsFloat knots[]  /** Knot vector */
+    , const int knots_length    /** Knot vector length */
+    );
+
+/*******************************************************************************
+*  Description:
+*     Calculates the first derivate of the basis that are not zero for a 
+*     parameter value (see nurbs_basis_local_function).
+*  Return Values:
+*    integer values
+*    @return the index of the first basis.
+*
+*******************************************************************************/
+int nurbs_basis_local_derivate_function
+    ( NurbsFloat d_basis[]      /** (out) Derivative of the non zero basis */
+    , NurbsFloat basis[]        /** (out) Non zero basis values */
+    , const NurbsFloat t        /** Parameter */
+    , const int degree          /** Degree */
+    , const NurbsFloat knots[]  /** Knot vector */
+    , const int knots_length    /** Knot vector length */
+    );
+
 /*******************************************************************************
 *  Description:
 *     Calculates the second derivate of the basis for a parameter value.
@@ -97,6 +176,25 @@ int nurbs_basis_second_derivate_function
     , const int knots_length    /** Knot vector length */
     );
 
+/*******************************************************************************
+*  Description:
+*     Calculates the second derivate of the basis that are not zero for a 
+*     parameter value (see nurbs_basis_local_function).
+*  Return Values:
+*    integer values
+*    @return the index of the first basis.
+*
+*******************************************************************************/
+int nurbs_basis_local_second_derivate_function
+    ( NurbsFloat d2_basis[]     /** (out) Second derivative of the basis func */
+    , NurbsFloat d_basis[]      /** (out) Derivative of the basis function */
+    , NurbsFloat basis[]        /** (out) Basis functions */
+    , const NurbsFloat t        /** Parameter */
+    , const int degree          /** Degree */
+    , const NurbsFloat knots[]  /** Knot vector */
+    , const int knots_length    /** Knot vector length */
+    );
+
 /*******************************************************************************
 *  Description:
 *     Calculates the basis value (using the recursive algorithm).
@@ -0,0 +1,230 @@
+ /***
+    Author: Mario J. Martin <dominonurbs$gmail.com>
+
+    Basis functions specialized for degree 1, 2 and 3, which are almost all
+    the surfaces and control boxes we use.
+
+    They are the same recursion of nurbs_basis_function() written term by
+    term, so the compiler can keep everything in registers. The conditions
+    on the knot differences are done with selections instead of branches.
+    The arithmetic operations are exactly the same ones and in the same order
+    than in the generic loops, so the results must be identical bit by bit
+    (checked in dev/test_nurbs).
+
+    The kernels only calculate the non zero basis: b[j] is the basis
+    function of the control point iknot - degree + j, and the knot vector
+    x[] starts at the knot iknot - degree.
+
+*******************************************************************************/
+
+
+/* One term of the recursion (see nurbs_basis_calculate_term).
+ * N is the basis to update, N1 the next basis of the previous degree,
+ * XIK1 = x[i + k + 1], XI1 = x[i + 1] and BI the basis of previous term. */
+#define NURBS_KERNEL_TERM(TYPE, N, N1, XIK1, XI1, T, BI)                     \
+    {                                                                        \
+        const TYPE d_ = (XIK1) - (XI1);                                      \
+        const NurbsFloat c_ = (d_ > 0) ? ((XIK1) - (T)) / d_ : 0;            \
+        N = (BI) * (N) + c_ * (N1);                                          \
+        BI = (d_ > 0) ? 1 - c_ : 0;                                          \
+    }
+
+/* One term of the recursion of the derivatives (see
+ * nurbs_basis_derivate_term). XKI = x[i + k], XI = x[i] */
+#define NURBS_KERNEL_D_TERM(N, D, N1, D1, XKI, XI, XIK1, XI1, T, BI)         \
+    {                                                                        \
+        const NurbsFloat a_ = (XKI) - (XI);                                  \
+        const NurbsFloat d_ = (XIK1) - (XI1);                                \
+        const NurbsFloat c_ = (XIK1) - (T);                                  \
+        const NurbsFloat cd_ = (d_ > 0) ? c_ / d_ : 0;                       \
+        const NurbsFloat nl_ = (a_ > 0) ? (BI) * (N) : 0;                    \
+        const NurbsFloat dnl_ = (a_ > 0) ? (BI) * (D) + (N) / a_ : 0;        \
+        const NurbsFloat dnr_ = (d_ > 0) ? (c_ * (D1) - (N1)) / d_ : 0;      \
+        N = nl_ + cd_ * (N1);                                                \
+        D = dnl_ + dnr_;                                                     \
+        BI = (d_ > 0) ? 1 - cd_ : 0;                                         \
+    }
+
+
+/* Basis of degree 1. x[] starts at knot iknot - 1 */
+static inline void nurbs_basis_kernel1
+    ( NurbsFloat b[], const NurbsFloat t, const NurbsFloat x[] )
+{
+    NurbsFloat n0 = 0, n1 = 1, bi;
+
+    bi = 0;
+    NURBS_KERNEL_TERM(NurbsFloat, n0, n1, x[2], x[1], t, bi);
+    NURBS_KERNEL_TERM(NurbsFloat, n1, 0, x[3], x[2], t, bi);
+
+    b[0] = n0; b[1] = n1;
+}
+
+/* Basis of degree 2. x[] starts at knot iknot - 2 */
+static inline void nurbs_basis_kernel2
+    ( NurbsFloat b[], const NurbsFloat t, const NurbsFloat x[] )
+{
+    NurbsFloat n0 = 0, n1 = 0, n2 = 1, bi;
+
+    bi = 0;
+    NURBS_KERNEL_TERM(NurbsFloat, n1, n2, x[3], x[2], t, bi);
+    NURBS_KERNEL_TERM(NurbsFloat, n2, 0, x[4], x[3], t, bi);
+
+    bi = 0;
+    NURBS_KERNEL_TERM(NurbsFloat, n0, n1, x[3], x[1], t, bi);
+    NURBS_KERNEL_TERM(NurbsFloat, n1, n2, x[4], x[2], t, bi);
+    NURBS_KERNEL_TERM(NurbsFloat, n2, 0, x[5], x[3], t, bi);
+
+    b[0] = n0; b[1] = n1; b[2] = n2;
+}
+
+/* Basis of degree 3. x[] starts at knot iknot - 3 */
+static inline void nurbs_basis_kernel3
+    ( NurbsFloat b[], const NurbsFloat t, const NurbsFloat x[] )
+{
+    NurbsFloat n0 = 0, n1 = 0, n2 = 0, n3 = 1, bi;
+
+    bi = 0;
+    NURBS_KERNEL_TERM(NurbsFloat, n2, n3, x[4], x[3], t, bi);
+    NURBS_KERNEL_TERM(NurbsFloat, n3, 0, x[5], x[4], t, bi);
+
+    bi = 0;
+    NURBS_KERNEL_TERM(NurbsFloat, n1, n2, x[4], x[2], t, bi);
+    NURBS_KERNEL_TERM(NurbsFloat, n2, n3, x[5], x[3], t, bi);
+    NURBS_KERNEL_TERM(NurbsFloat, n3, 0, x[6], x[4], t, bi);
+
+    bi = 0;
+    NURBS_KERNEL_TERM(NurbsFloat, n0, n1, x[4], x[1], t, bi);
+    NURBS_KERNEL_TERM(NurbsFloat, n1, n2, x[5], x[2], t, bi);
+    NURBS_KERNEL_TERM(NurbsFloat, n2, n3, x[6], x[3], t, bi);
+    NURBS_KERNEL_TERM(NurbsFloat, n3, 0, x[7], x[4], t, bi);
+
+    b[0] = n0; b[1] = n1; b[2] = n2; b[3] = n3;
+}
+
+
+/* Basis and derivatives of degree 1. x[] starts at knot iknot - 1 */
+static inline void nurbs_d_basis_kernel1
+    ( NurbsFloat d[], NurbsFloat b[], const NurbsFloat t, const NurbsFloat x[] )
+{
+    NurbsFloat n0 = 0, n1 = 1, d0 = 0, d1 = 0, bi;
+
+    bi = 0;
+    NURBS_KERNEL_D_TERM(n0, d0, n1, d1, x[1], x[0], x[2], x[1], t, bi);
+    NURBS_KERNEL_D_TERM(n1, d1, 0, 0, x[2], x[1], x[3], x[2], t, bi);
+
+    b[0] = n0; b[1] = n1;
+    d[0] = d0; d[1] = d1;
+}
+
+/* Basis and derivatives of degree 2. x[] starts at knot iknot - 2 */
+static inline void nurbs_d_basis_kernel2
+    ( NurbsFloat d[], NurbsFloat b[], const NurbsFloat t, const NurbsFloat x[] )
+{
+    NurbsFloat n0 = 0, n1 = 0, n2 = 1, d0 = 0, d1 = 0, d2 = 0, bi;
+
+    bi = 0;
+    NURBS_KERNEL_D_TERM(n1, d1, n2, d2, x[2], x[1], x[3], x[2], t, bi);
+    NURBS_KERNEL_D_TERM(n2, d2, 0, 0, x[3], x[2], x[4], x[3], t, bi);
+
+    bi = 0;
+    NURBS_KERNEL_D_TERM(n0, d0, n1, d1, x[2], x[0], x[3], x[1], t, bi);
+    NURBS_KERNEL_D_TERM(n1, d1, n2, d2, x[3], x[1], x[4], x[2], t, bi);
+    NURBS_KERNEL_D_TERM(n2, d2, 0, 0, x[4], x[2], x[5], x[3], t, bi);
+
+    b[0] = n0; b[1] = n1; b[2] = n2;
+    d[0] = d0; d[1] = d1; d[2] = d2;
+}
+
+/* Basis and derivatives of degree 3. x[] starts at knot iknot - 3 */
+static inline void nurbs_d_basis_kernel3
+    ( NurbsFloat d[], NurbsFloat b[], const NurbsFloat t, const NurbsFloat x[] )
+{
+    NurbsFloat n0 = 0, n1 = 0, n2 = 0, n3 = 1;
+    NurbsFloat d0 = 0, d1 = 0, d2 = 0, d3 = 0, bi;
+
+    bi = 0;
+    NURBS_KERNEL_D_TERM(n2, d2, n3, d3, x[3], x[2], x[4], x[3], t, bi);
+    NURBS_KERNEL_D_TERM(n3, d3, 0, 0, x[4], x[3], x[5], x[4], t, bi);
+
+    bi = 0;
+    NURBS_KERNEL_D_TERM(n1, d1, n2, d2, x[3], x[1], x[4], x[2], t, bi);
+    NURBS_KERNEL_D_TERM(n2, d2, n3, d3, x[4], x[2], x[5], x[3], t, bi);
+    NURBS_KERNEL_D_TERM(n3, d3, 0, 0, x[5], x[3], x[6], x[4], t, bi);
+
+    bi = 0;
+    NURBS_KERNEL_D_TERM(n0, d0, n1, d1, x[3], x[0], x[4], x[1], t, bi);
+    NURBS_KERNEL_D_TERM(n1, d1, n2, d2, x[4], x[1], x[5], x[2], t, bi);
+    NURBS_KERNEL_D_TERM(n2, d2, n3, d3, x[5], x[2], x[6], x[3], t, bi);
+    NURBS_KERNEL_D_TERM(n3, d3, 0, 0, x[6], x[3], x[7], x[4], t, bi);
+
+    b[0] = n0; b[1] = n1; b[2] = n2; b[3] = n3;
+    d[0] = d0; d[1] = d1; d[2] = d2; d[3] = d3;
+}
+
+
+/* Knot of the uniform clamped knot vector of the control boxes */
+#define NURBS_UNIFORM_KNOT(J, UP) ((J) < 0 ? 0 : ((J) > (UP) ? (UP) : (J)))
+
+/* Uniform b-spline basis of the control boxes for order 1, 2 and 3
+ * (see nurbs_uniform_basis). b[j] is the basis of the control point
+ * iknot + j, and tx the parameter scaled to the knot interval [0, up]. */
+#define NURBS_UNIFORM_TERM(N, N1, J, K)                                      \
+    NURBS_KERNEL_TERM(int, N, N1, NURBS_UNIFORM_KNOT(j0 + (J) + (K), up)     \
+        , NURBS_UNIFORM_KNOT(j0 + (J), up), tx, bi)
+
+static inline void nurbs_uniform_kernel1
+    ( NurbsFloat b[], const NurbsFloat tx, const int iknot, const int up )
+{
+    const int j0 = iknot;
+    NurbsFloat n0 = 0, n1 = 1, bi;
+
+    bi = 0;
+    NURBS_UNIFORM_TERM(n0, n1, 0, 1);
+    NURBS_UNIFORM_TERM(n1, 0, 1, 1);
+
+    b[0] = n0; b[1] = n1;
+}
+
+static inline void nurbs_uniform_kernel2
+    ( NurbsFloat b[], const NurbsFloat tx, const int iknot, const int up )
+{
+    const int j0 = iknot - 1;
+    NurbsFloat n0 = 0, n1 = 0, n2 = 1, bi;
+
+    bi = 0;
+    NURBS_UNIFORM_TERM(n1, n2, 1, 1);
+    NURBS_UNIFORM_TERM(n2, 0, 2, 1);
+
+    bi = 0;
+    NURBS_UNIFORM_TERM(n0, n1, 0, 2);
+    NURBS_UNIFORM_TERM(n1, n2, 1, 2);
+    NURBS_UNIFORM_TERM(n2, 0, 2, 2);
+
+    b[0] = n0; b[1] = n1; b[2] = n2;
+}
+
+static inline void nurbs_uniform_kernel3
+    ( NurbsFloat b[], const NurbsFloat tx, const int iknot, const int up )
+{
+    const int j0 = iknot - 2;
+    NurbsFloat n0 = 0, n1 = 0, n2 = 0, n3 = 1, bi;
+
+    bi = 0;
+    NURBS_UNIFORM_TERM(n2, n3, 2, 1);
+    NURBS_UNIFORM_TERM(n3, 0, 3, 1);
+
+    bi = 0;
+    NURBS_UNIFORM_TERM(n1, n2, 1, 2);
+    NURBS_UNIFORM_TERM(n2, n3, 2, 2);
+    NURBS_UNIFORM_TERM(n3, 0, 3, 2);
+
+    bi = 0;
+    NURBS_UNIFORM_TERM(n0, n1, 0, 3);
+    NURBS_UNIFORM_TERM(n1, n2, 1, 3);
+    NURBS_UNIFORM_TERM(n2, n3, 2, 3);
+    NURBS_UNIFORM_TERM(n3, 0, 3, 3);
+
+    b[0] = n0; b[1] = n1; b[2] = n2; b[3] = n3;
+}
+
+/**/
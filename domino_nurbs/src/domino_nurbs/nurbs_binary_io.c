@@ -0,0 +1,1075 @@
+ /***
+    Author: Mario J. Martin <dominonurbs$gmail.com>
+
+    Binary file format for NURBS curves, surfaces and control boxes.
+    The blocks of data in the file have the same layout as in memory, so
+    a file is loaded by mapping it and setting the pointers of the
+    entities to the blocks, without parsing nor copying any value.
+
+    Layout of the file (version 1):
+      - Header (NURBS_BINARY_HEADER_SIZE bytes): signature, version, byte
+        order, size of NurbsFloat and number of entities.
+      - Records: one BinaryRecord for each entity (curves, then surfaces,
+        then control boxes) with the sizes and the offsets of its blocks.
+      - Blocks, each one aligned to NURBS_BINARY_ALIGN bytes:
+        curves: knots, basis and d_basis buffers (3 * knot_length values),
+                and the control points (NurbsVector4).
+        surfaces: the knot_stream (knot_u, knot_v, and the basis buffers),
+                and the cp_stream (NurbsVector4, row major [u][v]).
+        control boxes: the cp_stream (NurbsVector3, row major [u][v][w]).
+    The values are stored in the byte order of the machine that writes the
+    file; files with a different byte order or precision are rejected.
+
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "common/check_malloc.h"
+#include "common/log.h"
+
+#include "nurbs_internal.h"
+#include "nurbs_curve.h"
+#include "nurbs_surface.h"
+#include "nurbs_controlbox.h"
+#include "nurbs_io.h"
+
+#ifdef SYSTEM_WINDOWS
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+#endif
+
+/* Version of the binary format */
+#define NURBS_BINARY_VERSION 1
+
+/* Signature at the start of the file */
+#define NURBS_BINARY_SIGNATURE "DNURBSB"
+
+/* Value written as an integer to check the byte order */
+#define NURBS_BINARY_BYTE_ORDER 0x01020304
+
+/* Size reserved for the header */
+#define NURBS_BINARY_HEADER_SIZE 64
+
+/* Alignment of the blocks of data in the file */
+#define NURBS_BINARY_ALIGN 64
+
+/* Types of entity */
+#define BINARY_CURVE 1
+#define BINARY_SURFACE 2
+#define BINARY_CONTROLBOX 3
+
+/* Header of the file. The fields have fixed sizes and are laid out without
+ * padding, so the file is the same for all the compilers. */
+typedef struct{
+    char signature[8];          /* NURBS_BINARY_SIGNATURE */
+    int32_t version;            /* NURBS_BINARY_VERSION */
+    int32_t byte_order;         /* NURBS_BINARY_BYTE_ORDER */
+    int32_t float_size;         /* sizeof(NurbsFloat) */
+    int32_t num_curves;
+    int32_t num_surfaces;
+    int32_t num_controlboxes;
+}BinaryHeader;
+
+/* Description of one entity; the ten integers keep the offsets aligned */
+typedef struct{
+    int32_t type;               /* BINARY_CURVE, BINARY_SURFACE... */
+    int32_t id;
+    int32_t degree[3];          /* Degrees (curves, surfaces) or orders (boxes) */
+    int32_t cp_length[3];       /* Number of control points in each direction */
+    int32_t basis_equation;     /* Control boxes: 0 NURBS, 1 Bezier */
+    int32_t reserved;
+    int64_t knot_offset;        /* Offset of the knot block from the start */
+    int64_t knot_size;          /* Size of the knot block in bytes */
+    int64_t cp_offset;          /* Offset of the control points block */
+    int64_t cp_size;            /* Size of the control points block in bytes */
+    char label[DOMINO_NURBS_LABEL_LEN];
+}BinaryRecord;
+
+/* Fails to compile if the compiler adds any padding to the structures */
+typedef char binary_header_size_check
+    [(sizeof(BinaryHeader) == 32) ? 1 : -1];
+typedef char binary_record_size_check
+    [(sizeof(BinaryRecord) == 72 + DOMINO_NURBS_LABEL_LEN) ? 1 : -1];
+
+
+/* Rounds up to the alignment of the blocks */
+static inline long long align_offset( const long long offset )
+{
+    return (offset + NURBS_BINARY_ALIGN - 1)
+        / NURBS_BINARY_ALIGN * NURBS_BINARY_ALIGN;
+}
+
+
+/* Writes zeros */
+static int write_zeros( FILE* fh, long long size )
+{
+    static const char zeros[NURBS_BINARY_ALIGN] = {0};
+    size_t n;
+
+    while (size > 0){
+        n = (size > NURBS_BINARY_ALIGN) ? NURBS_BINARY_ALIGN : (size_t)size;
+        if (fwrite( zeros, 1, n, fh ) != n){
+            return 0;
+        }
+        size -= n;
+    }
+
+    return 1;
+}
+
+
+/* Writes the padding up to the offset */
+static int write_padding( FILE* fh, long long* position, const long long offset )
+{
+    int status = write_zeros( fh, offset - *position );
+    *position = offset;
+    return status;
+}
+
+
+/* Copies a label safely */
+static void copy_label( char* dest, const char* label )
+{
+    memset( dest, 0, DOMINO_NURBS_LABEL_LEN );
+    if (label != nullptr){
+        strncpy( dest, label, DOMINO_NURBS_LABEL_LEN - 1 );
+    }
+}
+
+
+/* Fills the records and calculates the offsets of the blocks.
+ * Returns the size of the file. */
+static long long binary_records
+    ( BinaryRecord* records
+    , const NurbsCurve *curve_array
+    , const int num_curves
+    , const NurbsSurface *surface_array
+    , const int num_surfaces
+    , const NurbsControlBox *cb_array
+    , const int num_cb
+    )
+{
+    int i, k = 0;
+    const int num_records = num_curves + num_surfaces + num_cb;
+    long long offset = align_offset( NURBS_BINARY_HEADER_SIZE
+        + (long long)sizeof(BinaryRecord) * num_records );
+
+    memset( records, 0, sizeof(BinaryRecord) * num_records );
+
+    for (i = 0; i < num_curves; i++, k++){
+        const NurbsCurve* curve = &curve_array[i];
+        BinaryRecord* r = &records[k];
+
+        r->type = BINARY_CURVE;
+        r->id = curve->id;
+        r->degree[0] = curve->degree;
+        r->cp_length[0] = curve->cp_length;
+        copy_label( r->label, curve->label );
+
+        r->knot_offset = offset;
+        r->knot_size = (long long)sizeof(NurbsFloat) * 3 * curve->knot_length;
+        offset = align_offset( offset + r->knot_size );
+
+        r->cp_offset = offset;
+        r->cp_size = (long long)sizeof(NurbsVector4) * curve->cp_length;
+        offset = align_offset( offset + r->cp_size );
+    }
+
+    for (i = 0; i < num_surfaces; i++, k++){
+        const NurbsSurface* surface = &surface_array[i];
+        BinaryRecord* r = &records[k];
+
+        r->type = BINARY_SURFACE;
+        r->id = surface->id;
+        r->degree[0] = surface->degree_u;
+        r->degree[1] = surface->degree_v;
+        r->cp_length[0] = surface->cp_length_u;
+        r->cp_length[1] = surface->cp_length_v;
+        copy_label( r->label, surface->label );
+
+        r->knot_offset = offset;
+        r->knot_size = (long long)sizeof(NurbsFloat) * 3
+            * (surface->knot_length_u + surface->knot_length_v);
+        offset = align_offset( offset + r->knot_size );
+
+        r->cp_offset = offset;
+        r->cp_size = (long long)sizeof(NurbsVector4)
+            * surface->cp_length_u * surface->cp_length_v;
+        offset = align_offset( offset + r->cp_size );
+    }
+
+    for (i = 0; i < num_cb; i++, k++){
+        const NurbsControlBox* cb = &cb_array[i];
+        BinaryRecord* r = &records[k];
+
+        r->type = BINARY_CONTROLBOX;
+        r->id = cb->id;
+        r->degree[0] = cb->order_u;
+        r->degree[1] = cb->order_v;
+        r->degree[2] = cb->order_w;
+        r->cp_length[0] = cb->cp_length_u;
+        r->cp_length[1] = cb->cp_length_v;
+        r->cp_length[2] = cb->cp_length_w;
+        r->basis_equation = cb->basis_equation;
+        copy_label( r->label, cb->label );
+
+        r->knot_offset = offset;
+        r->knot_size = 0;
+
+        r->cp_offset = offset;
+        r->cp_size = (long long)sizeof(NurbsVector3)
+            * cb->cp_length_u * cb->cp_length_v * cb->cp_length_w;
+        offset = align_offset( offset + r->cp_size );
+    }
+
+    return offset;
+}
+
+
+/* Writes all NURBS entities to a binary file */
+int nurbs_export_binary
+    ( const char* filename
+    , const NurbsCurve *curve_array
+    , const int num_curves
+    , const NurbsSurface *surface_array
+    , const int num_surfaces
+    , const NurbsControlBox *cb_array
+    , const int num_cb
+    )
+{
+    FILE* fh;
+    BinaryHeader header;
+    BinaryRecord* records;
+    int i, j, k = 0, status = 1;
+    long long position, file_size;
+    const int nc = (curve_array != nullptr) ? num_curves : 0;
+    const int ns = (surface_array != nullptr) ? num_surfaces : 0;
+    const int nb = (cb_array != nullptr) ? num_cb : 0;
+
+    _check_(records = (BinaryRecord*)_malloc_
+        (sizeof(BinaryRecord) * (nc + ns + nb + 1)));
+    if (records == nullptr){
+        return 0;
+    }
+
+    file_size = binary_records
+        ( records, curve_array, nc, surface_array, ns, cb_array, nb );
+
+    fh = fopen( filename, "wb" );
+    if (fh == NULL){
+        _handle_error_( "Cannot open the binary file" );
+        free( records );
+        return 0;
+    }
+
+    memset( &header, 0, sizeof(BinaryHeader) );
+    strcpy( header.signature, NURBS_BINARY_SIGNATURE );
+    header.version = NURBS_BINARY_VERSION;
+    header.byte_order = NURBS_BINARY_BYTE_ORDER;
+    header.float_size = sizeof(NurbsFloat);
+    header.num_curves = nc;
+    header.num_surfaces = ns;
+    header.num_controlboxes = nb;
+
+    status &= (fwrite( &header, sizeof(BinaryHeader), 1, fh ) == 1);
+    status &= write_zeros( fh, NURBS_BINARY_HEADER_SIZE - sizeof(BinaryHeader) );
+    if (nc + ns + nb > 0){
+        status &= (fwrite( records, sizeof(BinaryRecord), nc + ns + nb, fh )
+            == (size_t)(nc + ns + nb));
+    }
+    position = NURBS_BINARY_HEADER_SIZE + (long long)sizeof(BinaryRecord) * (nc + ns + nb);
+
+    /* The basis buffers are written as zeros; they are only scratch space */
+    for (i = 0; i < nc && status; i++, k++){
+        const NurbsCurve* curve = &curve_array[i];
+
+        status &= write_padding( fh, &position, records[k].knot_offset );
+        status &= (fwrite( curve->knot, sizeof(NurbsFloat), curve->knot_length, fh )
+            == (size_t)curve->knot_length);
+        status &= write_zeros( fh, sizeof(NurbsFloat) * 2 * curve->knot_length );
+        position += records[k].knot_size;
+
+        status &= write_padding( fh, &position, records[k].cp_offset );
+        status &= (fwrite( curve->cp, sizeof(NurbsVector4), curve->cp_length, fh )
+            == (size_t)curve->cp_length);
+        position += records[k].cp_size;
+    }
+
+    for (i = 0; i < ns && status; i++, k++){
+        const NurbsSurface* surface = &surface_array[i];
+
+        status &= write_padding( fh, &position, records[k].knot_offset );
+        status &= (fwrite( surface->knot_u, sizeof(NurbsFloat)
+            , surface->knot_length_u, fh ) == (size_t)surface->knot_length_u);
+        status &= (fwrite( surface->knot_v, sizeof(NurbsFloat)
+            , surface->knot_length_v, fh ) == (size_t)surface->knot_length_v);
+        status &= write_zeros( fh, sizeof(NurbsFloat) * 2
+            * (surface->knot_length_u + surface->knot_length_v) );
+        position += records[k].knot_size;
+
+        status &= write_padding( fh, &position, records[k].cp_offset );
+        for (j = 0; j < surface->cp_length_u; j++){
+            status &= (fwrite( surface->cp[j], sizeof(NurbsVector4)
+                , surface->cp_length_v, fh ) == (size_t)surface->cp_length_v);
+        }
+        position += records[k].cp_size;
+    }
+
+    for (i = 0; i < nb && status; i++, k++){
+        const NurbsControlBox* cb = &cb_array[i];
+        int iu, iv;
+
+        status &= write_padding( fh, &position, records[k].cp_offset );
+        for (iu = 0; iu < cb->cp_length_u; iu++){
+            for (iv = 0; iv < cb->cp_length_v; iv++){
+                status &= (fwrite( cb->cp[iu][iv], sizeof(NurbsVector3)
+                    , cb->cp_length_w, fh ) == (size_t)cb->cp_length_w);
+            }
+        }
+        position += records[k].cp_size;
+    }
+
+    status &= write_padding( fh, &position, file_size );
+
+    if (fclose( fh ) != 0){
+        status = 0;
+    }
+    free( records );
+
+    if (!status){
+        _handle_error_( "Cannot write the binary file" );
+    }
+
+    return status;
+}
+
+
+/* Equivalent to a default constructor */
+void nurbs_model_init( NurbsModel* model )
+{
+    model->num_curves = 0;
+    model->curve = nullptr;
+    model->num_surfaces = 0;
+    model->surface = nullptr;
+    model->num_controlboxes = 0;
+    model->controlbox = nullptr;
+    model->memory = nullptr;
+    model->memory_size = 0;
+    model->mapped = 0;
+}
+
+
+/* Maps the file in memory (private copy on write). Returns nullptr if the
+ * file cannot be mapped. */
+static void* map_file( const char* filename, size_t* size )
+{
+#ifdef SYSTEM_WINDOWS
+    HANDLE file, mapping;
+    LARGE_INTEGER file_size;
+    void* view = nullptr;
+
+    file = CreateFileA( filename, GENERIC_READ, FILE_SHARE_READ, NULL
+        , OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+    if (file == INVALID_HANDLE_VALUE){
+        return nullptr;
+    }
+
+    if (GetFileSizeEx( file, &file_size ) && file_size.QuadPart > 0){
+        mapping = CreateFileMappingA( file, NULL, PAGE_WRITECOPY, 0, 0, NULL );
+        if (mapping != NULL){
+            view = MapViewOfFile( mapping, FILE_MAP_COPY, 0, 0, 0 );
+            CloseHandle( mapping );
+            *size = (size_t)file_size.QuadPart;
+        }
+    }
+    CloseHandle( file );
+
+    return view;
+#else
+    int fd;
+    struct stat st;
+    void* view = nullptr;
+
+    fd = open( filename, O_RDONLY );
+    if (fd < 0){
+        return nullptr;
+    }
+
+    if (fstat( fd, &st ) == 0 && st.st_size > 0){
+        view = mmap( NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE
+            , MAP_PRIVATE, fd, 0 );
+        if (view == MAP_FAILED){
+            view = nullptr;
+        }
+        else{
+            *size = (size_t)st.st_size;
+        }
+    }
+    close( fd );
+
+    return view;
+#endif
+}
+
+
+/* Releases a mapping of map_file() */
+static void unmap_file( void* view, const size_t size )
+{
+#ifdef SYSTEM_WINDOWS
+    (void)size;
+    UnmapViewOfFile( view );
+#else
+    munmap( view, size );
+#endif
+}
+
+
+/* Reads the whole file in allocated memory (if it cannot be mapped) */
+static void* read_file( const char* filename, size_t* size )
+{
+    FILE* fh;
+    long long length;
+    void* memory = nullptr;
+
+    fh = fopen( filename, "rb" );
+    if (fh == NULL){
+        return nullptr;
+    }
+
+    if (nurbs_fseek( fh, 0, SEEK_END ) == 0){
+        length = nurbs_ftell( fh );
+        rewind( fh );
+
+        /* It may not fit in the memory of a 32 bit system */
+        if (length > 0 && (unsigned long long)length <= (size_t)-1){
+            _check_(memory = _malloc_( (size_t)length ));
+            if (memory != nullptr
+                && fread( memory, 1, (size_t)length, fh ) != (size_t)length)
+            {
+                free( memory );
+                memory = nullptr;
+            }
+            *size = (size_t)length;
+        }
+    }
+    fclose( fh );
+
+    return memory;
+}
+
+
+/* Checks that a block lies inside the image and it is aligned */
+static int check_block
+    ( const long long offset
+    , const long long size
+    , const long long expected
+    , const size_t memory_size
+    )
+{
+    return size == expected
+        && offset >= 0
+        && offset % NURBS_BINARY_ALIGN == 0
+        && offset + size <= (long long)memory_size;
+}
+
+
+/* Checks the dimensions of the record and the sizes of its blocks. The 
+ * dimensions are read from the file, so the sizes are calculated in 64 bits
+ * and each product is bounded by the size of the file before it is taken. */
+static int check_record( BinaryRecord* r, const size_t memory_size )
+{
+    long long knot_size, cp_size;
+    const long long limit = (long long)memory_size;
+
+    if (r->cp_length[0] < 1){
+        return 0;
+    }
+    if (r->type == BINARY_CURVE){
+        if (r->degree[0] < 0){
+            return 0;
+        }
+        knot_size = (long long)sizeof(NurbsFloat) * 3
+            * ((long long)r->cp_length[0] + r->degree[0] + 1);
+        cp_size = (long long)sizeof(NurbsVector4) * r->cp_length[0];
+    }
+    else if (r->type == BINARY_SURFACE){
+        if (r->degree[0] < 0 || r->degree[1] < 0 || r->cp_length[1] < 1){
+            return 0;
+        }
+        knot_size = (long long)sizeof(NurbsFloat) * 3
+            * ( (long long)r->cp_length[0] + r->degree[0] + 1
+              + (long long)r->cp_length[1] + r->degree[1] + 1 );
+        cp_size = (long long)sizeof(NurbsVector4) * r->cp_length[0];
+        if (r->cp_length[1] > limit / cp_size){
+            return 0;
+        }
+        cp_size *= r->cp_length[1];
+    }
+    else if (r->type == BINARY_CONTROLBOX){
+        if (r->cp_length[1] < 1 || r->cp_length[2] < 1){
+            return 0;
+        }
+        knot_size = 0;
+        cp_size = (long long)sizeof(NurbsVector3) * r->cp_length[0];
+        if (r->cp_length[1] > limit / cp_size){
+            return 0;
+        }
+        cp_size *= r->cp_length[1];
+        if (r->cp_length[2] > limit / cp_size){
+            return 0;
+        }
+        cp_size *= r->cp_length[2];
+    }
+    else{
+        return 0;
+    }
+
+    /* The label must be terminated */
+    r->label[DOMINO_NURBS_LABEL_LEN - 1] = '\0';
+
+    return check_block( r->knot_offset, r->knot_size, knot_size, memory_size )
+        && check_block( r->cp_offset, r->cp_size, cp_size, memory_size );
+}
+
+
+/* Sets the curve on the blocks of the image */
+static void set_curve( NurbsCurve* curve, BinaryRecord* r, char* base )
+{
+    nurbs_curve_init( curve );
+
+    curve->id = r->id;
+    curve->degree = r->degree[0];
+    curve->cp_length = r->cp_length[0];
+    curve->knot_length = curve->cp_length + curve->degree + 1;
+    curve->label = r->label;
+
+    curve->knot = (NurbsFloat*)(base + r->knot_offset);
+    curve->basis = curve->knot + curve->knot_length;
+    curve->d_basis = curve->basis + curve->knot_length;
+    curve->cp = (NurbsVector4*)(base + r->cp_offset);
+}
+
+
+/* Sets the surface on the blocks of the image.
+ * Returns 0 if the memory is exhausted. */
+static int set_surface( NurbsSurface* surface, const BinaryRecord* r, char* base )
+{
+    int i;
+    NurbsFloat* p1;
+
+    nurbs_surface_init( surface );
+
+    surface->id = r->id;
+    strcpy( surface->label, r->label );
+    surface->degree_u = r->degree[0];
+    surface->degree_v = r->degree[1];
+    surface->cp_length_u = r->cp_length[0];
+    surface->cp_length_v = r->cp_length[1];
+    surface->knot_length_u = surface->cp_length_u + surface->degree_u + 1;
+    surface->knot_length_v = surface->cp_length_v + surface->degree_v + 1;
+
+    /* Same layout as nurbs_surface_alloc() */
+    surface->knot_stream = (NurbsFloat*)(base + r->knot_offset);
+    p1 = surface->knot_stream;
+    surface->knot_u = p1;
+    p1 += surface->knot_length_u;
+    surface->knot_v = p1;
+    p1 += surface->knot_length_v;
+    surface->basis_u = p1;
+    p1 += surface->knot_length_u;
+    surface->basis_v = p1;
+    p1 += surface->knot_length_v;
+    surface->d_basis_u = p1;
+    p1 += surface->knot_length_u;
+    surface->d_basis_v = p1;
+
+    surface->cp_stream = (NurbsVector4*)(base + r->cp_offset);
+
+    _check_(surface->cp = (NurbsVector4**)_malloc_
+        (sizeof(NurbsVector4*) * surface->cp_length_u));
+    if (surface->cp == nullptr){
+        return 0;
+    }
+
+    for (i = 0; i < surface->cp_length_u; i++){
+        surface->cp[i] = surface->cp_stream + i * surface->cp_length_v;
+    }
+
+    return 1;
+}
+
+
+/* Sets the control box on the blocks of the image.
+ * Returns 0 if the memory is exhausted. */
+static int set_controlbox( NurbsControlBox* cb, const BinaryRecord* r, char* base )
+{
+    int iu, iv;
+    size_t offset = 0;
+
+    nurbs_controlbox_init( cb );
+
+    cb->id = r->id;
+    strcpy( cb->label, r->label );
+    cb->cp_length_u = r->cp_length[0];
+    cb->cp_length_v = r->cp_length[1];
+    cb->cp_length_w = r->cp_length[2];
+    cb->order_u = r->degree[0];
+    cb->order_v = r->degree[1];
+    cb->order_w = r->degree[2];
+    cb->basis_equation = r->basis_equation;
+    cb->cp_stream = (NurbsVector3*)(base + r->cp_offset);
+
+    /* Same layout as nurbs_controlbox_alloc() */
+    _check_(cb->cp = (NurbsVector3***)_calloc_
+        (cb->cp_length_u, sizeof(NurbsVector3**)));
+    if (cb->cp == nullptr){
+        return 0;
+    }
+
+    for (iu = 0; iu < cb->cp_length_u; iu++){
+        _check_(cb->cp[iu] = (NurbsVector3**)_malloc_
+            (sizeof(NurbsVector3*) * cb->cp_length_v));
+        if (cb->cp[iu] == nullptr){
+            return 0;
+        }
+
+        for (iv = 0; iv < cb->cp_length_v; iv++){
+            cb->cp[iu][iv] = &(cb->cp_stream[offset]);
+            offset += cb->cp_length_w;
+        }
+    }
+
+    return 1;
+}
+
+
+/* Loads a binary file */
+int nurbs_model_load( NurbsModel* model, const char* filename )
+{
+    BinaryHeader* header;
+    BinaryRecord* records;
+    char* base;
+    int i, k, status = 1;
+    long long num_records;
+
+    nurbs_model_init( model );
+
+    model->memory = map_file( filename, &model->memory_size );
+    model->mapped = (model->memory != nullptr);
+    if (model->memory == nullptr){
+        model->memory = read_file( filename, &model->memory_size );
+    }
+    if (model->memory == nullptr){
+        _handle_error_( "Cannot open the binary file" );
+        model->memory_size = 0;
+        return 0;
+    }
+
+    base = (char*)model->memory;
+    header = (BinaryHeader*)base;
+
+    if (model->memory_size < NURBS_BINARY_HEADER_SIZE
+        || strncmp( header->signature, NURBS_BINARY_SIGNATURE, 8 ) != 0)
+    {
+        _handle_error_( "The file is not a binary NURBS file" );
+        nurbs_model_dispose( model );
+        return 0;
+    }
+    if (header->version != NURBS_BINARY_VERSION){
+        _handle_error_( "Unsupported version of the binary NURBS file" );
+        nurbs_model_dispose( model );
+        return 0;
+    }
+    if (header->byte_order != NURBS_BINARY_BYTE_ORDER
+        || header->float_size != (int)sizeof(NurbsFloat))
+    {
+        _handle_error_( "The binary NURBS file was written with a different "
+            "byte order or precision" );
+        nurbs_model_dispose( model );
+        return 0;
+    }
+
+    /* The counts are checked before adding them, and added in 64 bits */
+    if (header->num_curves < 0 || header->num_surfaces < 0
+        || header->num_controlboxes < 0)
+    {
+        _handle_error_( "The binary NURBS file is corrupted" );
+        nurbs_model_dispose( model );
+        return 0;
+    }
+    num_records = (long long)header->num_curves + header->num_surfaces
+        + header->num_controlboxes;
+    if (NURBS_BINARY_HEADER_SIZE + (long long)sizeof(BinaryRecord) * num_records
+        > (long long)model->memory_size)
+    {
+        _handle_error_( "The binary NURBS file is corrupted" );
+        nurbs_model_dispose( model );
+        return 0;
+    }
+
+    records = (BinaryRecord*)(base + NURBS_BINARY_HEADER_SIZE);
+    for (k = 0; k < num_records; k++){
+        const int type = (k < header->num_curves) ? BINARY_CURVE
+            : ((k < (long long)header->num_curves + header->num_surfaces)
+                ? BINARY_SURFACE : BINARY_CONTROLBOX);
+
+        if (records[k].type != type
+            || !check_record( &records[k], model->memory_size ))
+        {
+            _handle_error_( "The binary NURBS file is corrupted" );
+            nurbs_model_dispose( model );
+            return 0;
+        }
+    }
+
+    /* Arrays of entities */
+    if (header->num_curves > 0){
+        _check_(model->curve = (NurbsCurve*)_malloc_
+            (sizeof(NurbsCurve) * header->num_curves));
+        status &= (model->curve != nullptr);
+    }
+    if (header->num_surfaces > 0){
+        _check_(model->surface = (NurbsSurface*)_malloc_
+            (sizeof(NurbsSurface) * header->num_surfaces));
+        status &= (model->surface != nullptr);
+    }
+    if (header->num_controlboxes > 0){
+        _check_(model->controlbox = (NurbsControlBox*)_malloc_
+            (sizeof(NurbsControlBox) * header->num_controlboxes));
+        status &= (model->controlbox != nullptr);
+    }
+    if (!status){
+        nurbs_model_dispose( model );
+        return 0;
+    }
+
+    /* Pointers to the blocks */
+    k = 0;
+    for (i = 0; i < header->num_curves; i++, k++){
+        set_curve( &model->curve[i], &records[k], base );
+        model->num_curves++;
+    }
+    for (i = 0; i < header->num_surfaces && status; i++, k++){
+        status = set_surface( &model->surface[i], &records[k], base );
+        model->num_surfaces++;
+    }
+    for (i = 0; i < header->num_controlboxes && status; i++, k++){
+        status = set_controlbox( &model->controlbox[i], &records[k], base );
+        model->num_controlboxes++;
+    }
+    if (!status){
+        nurbs_model_dispose( model );
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/* Releases the model */
+void nurbs_model_dispose( NurbsModel* model )
+{
+    int i, iu;
+
+    if (model == nullptr){
+        return;
+    }
+
+    /* Only the pointer tables are allocated */
+    for (i = 0; i < model->num_surfaces; i++){
+        NurbsSurface* surface = &model->surface[i];
+
+        if (surface->cp != nullptr){
+            free( surface->cp );
+        }
+        nurbs_surface_cache_release( surface );
+    }
+
+    for (i = 0; i < model->num_controlboxes; i++){
+        NurbsControlBox* cb = &model->controlbox[i];
+
+        if (cb->cp != nullptr){
+            for (iu = 0; iu < cb->cp_length_u; iu++){
+                if (cb->cp[iu] != nullptr){
+                    free( cb->cp[iu] );
+                }
+            }
+            free( cb->cp );
+        }
+    }
+
+    if (model->curve != nullptr){
+        free( model->curve );
+    }
+    if (model->surface != nullptr){
+        free( model->surface );
+    }
+    if (model->controlbox != nullptr){
+        free( model->controlbox );
+    }
+
+    if (model->memory != nullptr){
+        if (model->mapped){
+            unmap_file( model->memory, model->memory_size );
+        }
+        else{
+            free( model->memory );
+        }
+    }
+
+    nurbs_model_init( model );
+}
+
+
+/* Writes the entities of the model to a binary file */
+int nurbs_model_save( const NurbsModel* model, const char* filename )
+{
+    return nurbs_export_binary
+        ( filename
+        , model->curve, model->num_curves
+        , model->surface, model->num_surfaces
+        , model->controlbox, model->num_controlboxes
+        );
+}
+
+
+/* Copies a curve of the model in allocated memory */
+static void copy_curve( NurbsCurve* dest, const NurbsCurve* orig )
+{
+    nurbs_curve_alloc( dest, orig->cp_length, orig->degree );
+    dest->id = orig->id;
+
+    if (dest->cp != nullptr && dest->knot != nullptr){
+        memcpy( dest->cp, orig->cp, sizeof(NurbsVector4) * orig->cp_length );
+        memcpy( dest->knot, orig->knot, sizeof(NurbsFloat) * orig->knot_length );
+    }
+
+    if (orig->label != nullptr){
+        _check_(dest->label = (char*)_malloc_(strlen( orig->label ) + 1));
+        if (dest->label != nullptr){
+            strcpy( dest->label, orig->label );
+        }
+    }
+}
+
+
+/* Copies a surface of the model in allocated memory */
+static void copy_surface( NurbsSurface* dest, const NurbsSurface* orig )
+{
+    nurbs_surface_init( dest );
+    nurbs_surface_alloc( dest, orig->cp_length_u, orig->cp_length_v
+        , orig->degree_u, orig->degree_v );
+    dest->id = orig->id;
+    strcpy( dest->label, orig->label );
+
+    if (dest->cp_stream != nullptr && dest->knot_stream != nullptr){
+        memcpy( dest->cp_stream, orig->cp_stream, sizeof(NurbsVector4)
+            * orig->cp_length_u * orig->cp_length_v );
+        memcpy( dest->knot_u, orig->knot_u
+            , sizeof(NurbsFloat) * orig->knot_length_u );
+        memcpy( dest->knot_v, orig->knot_v
+            , sizeof(NurbsFloat) * orig->knot_length_v );
+    }
+}
+
+
+/* Copies a control box of the model in allocated memory */
+static void copy_controlbox( NurbsControlBox* dest, const NurbsControlBox* orig )
+{
+    nurbs_controlbox_init( dest );
+    nurbs_controlbox_copy( dest, orig );
+    dest->basis_equation = orig->basis_equation;
+}
+
+
+/* Reads all NURBS entities from a binary file, in allocated memory */
+void nurbs_import_binary
+    ( const char *filename
+    , NurbsCurve** p_nurbs_curve
+    , int* num_curves
+    , NurbsSurface** p_nurbs_surface
+    , int* num_surfaces
+    , NurbsControlBox** p_nurbs_controlbox
+    , int* num_controlbox
+    )
+{
+    NurbsModel model;
+    int i;
+
+    if (p_nurbs_curve != nullptr){
+        *p_nurbs_curve = nullptr;
+    }
+    if (num_curves != nullptr){
+        *num_curves = 0;
+    }
+    if (p_nurbs_surface != nullptr){
+        *p_nurbs_surface = nullptr;
+    }
+    if (num_surfaces != nullptr){
+        *num_surfaces = 0;
+    }
+    if (p_nurbs_controlbox != nullptr){
+        *p_nurbs_controlbox = nullptr;
+    }
+    if (num_controlbox != nullptr){
+        *num_controlbox = 0;
+    }
+
+    if (!nurbs_model_load( &model, filename )){
+        return;
+    }
+
+    if (p_nurbs_curve != nullptr && model.num_curves > 0){
+        _check_(*p_nurbs_curve = (NurbsCurve*)_malloc_
+            (sizeof(NurbsCurve) * model.num_curves));
+        if (*p_nurbs_curve != nullptr){
+            for (i = 0; i < model.num_curves; i++){
+                copy_curve( &(*p_nurbs_curve)[i], &model.curve[i] );
+            }
+            if (num_curves != nullptr){
+                *num_curves = model.num_curves;
+            }
+        }
+    }
+
+    if (p_nurbs_surface != nullptr && model.num_surfaces > 0){
+        _check_(*p_nurbs_surface = (NurbsSurface*)_malloc_
+            (sizeof(NurbsSurface) * model.num_surfaces));
+        if (*p_nurbs_surface != nullptr){
+            for (i = 0; i < model.num_surfaces; i++){
+                copy_surface( &(*p_nurbs_surface)[i], &model.surface[i] );
+            }
+            if (num_surfaces != nullptr){
+                *num_surfaces = model.num_surfaces;
+            }
+        }
+    }
+
+    if (p_nurbs_controlbox != nullptr && model.num_controlboxes > 0){
+        _check_(*p_nurbs_controlbox = (NurbsControlBox*)_malloc_
+            (sizeof(NurbsControlBox) * model.num_controlboxes));
+        if (*p_nurbs_controlbox != nullptr){
+            for (i = 0; i < model.num_controlboxes; i++){
+                copy_controlbox( &(*p_nurbs_controlbox)[i], &model.controlbox[i] );
+            }
+            if (num_controlbox != nullptr){
+                *num_controlbox = model.num_controlboxes;
+            }
+        }
+    }
+
+    nurbs_model_dispose( &model );
+}
+
+
+/******************************************************************************/
+
+/* Converts an ASCII file into a binary file */
+int nurbs_convert_ascii_to_binary
+    ( const char* ascii_filename
+    , const char* binary_filename
+    )
+{
+    NurbsCurve* curves = nullptr;
+    NurbsSurface* surfaces = nullptr;
+    NurbsControlBox* cbs = nullptr;
+    int nc = 0, ns = 0, nb = 0, status;
+
+    nurbs_import_ascii
+        ( ascii_filename, &curves, &nc, &surfaces, &ns, &cbs, &nb );
+
+    status = nurbs_export_binary
+        ( binary_filename, curves, nc, surfaces, ns, cbs, nb );
+
+    nurbs_curve_free( curves, nc );
+    nurbs_surface_free( surfaces, ns );
+    nurbs_controlbox_free( cbs, nb );
+
+    return status;
+}
+
+
+/* Converts an IGES file into a binary file */
+int nurbs_convert_iges_to_binary
+    ( const char* iges_filename
+    , const char* binary_filename
+    )
+{
+    NurbsCurve* curves = nullptr;
+    NurbsSurface* surfaces = nullptr;
+    int nc = 0, ns = 0, status;
+
+    nurbs_import_iges( iges_filename, &curves, &nc, &surfaces, &ns );
+
+    status = nurbs_export_binary
+        ( binary_filename, curves, nc, surfaces, ns, nullptr, 0 );
+
+    nurbs_curve_free( curves, nc );
+    nurbs_surface_free( surfaces, ns );
+
+    return status;
+}
+
+
+/* Converts a binary file into an ASCII file */
+int nurbs_convert_binary_to_ascii
+    ( const char* binary_filename
+    , const char* ascii_filename
+    )
+{
+    NurbsModel model;
+    int status;
+
+    if (!nurbs_model_load( &model, binary_filename )){
+        return 0;
+    }
+
+    status = nurbs_export_ascii
+        ( ascii_filename
+        , model.curve, model.num_curves
+        , model.surface, model.num_surfaces
+        , model.controlbox, model.num_controlboxes
+        );
+
+    nurbs_model_dispose( &model );
+
+    return status;
+}
+
+
+/* Converts a binary file into an IGES file */
+int nurbs_convert_binary_to_iges
+    ( const char* binary_filename
+    , const char* iges_filename
+    )
+{
+    NurbsModel model;
+    int status;
+
+    if (!nurbs_model_load( &model, binary_filename )){
+        return 0;
+    }
+
+    if (model.num_controlboxes > 0){
+        _handle_error_( "The control boxes cannot be written in IGES format" );
+    }
+
+    status = nurbs_export_iges
+        ( iges_filename
+        , model.curve, model.num_curves
+        , model.surface, model.num_surfaces
+        );
+
+    nurbs_model_dispose( &model );
+
+    return status;
+}
+
+/**/
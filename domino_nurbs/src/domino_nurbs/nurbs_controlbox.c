@@ -24,6 +24,7 @@
 #include "nurbs_controlbox.h"
 
 #include "bezier_basis.inl"
+#include "nurbs_basis_kernels.inl"
 
 /* Calculate the basis k-degree coeficient at index i for the parameter t */
 static NurbsFloat uniform_basis_term
@@ -33,13 +34,14 @@ static NurbsFloat uniform_basis_term
     , const int order           /* Order */
     , const int k               /* Iteration */
     , const int i               /* knot interval: x[i] < k < x[i+1] */
+    , const int ib              /* Index of the term i in the basis array */
     , NurbsFloat* bi_1          /* basis of the previous iteration */
     )
 {
     NurbsFloat c, nl, nr;
     int xik1, xi1;
 
-    nl = *bi_1 * nk1[i];
+    nl = *bi_1 * nk1[ib];
 
     xi1 = i + 1 - order;
     xik1 = xi1 + k;
@@ -54,7 +56,7 @@ static NurbsFloat uniform_basis_term
     if (xik1 > xi1){ /* x[i + k + 1] - x[i + 1] != 0 */
         c = (xik1 - t) / (xik1 - xi1);
         *bi_1 = 1 - c;
-        nr = c * nk1[i+1];
+        nr = c * nk1[ib+1];
     }
     else{
         nr = 0;
@@ -75,6 +77,7 @@ static void nurbs_uniform_derivative_basis_term
     , const int order           /* Order */
     , const int k               /* Iteration */
     , const int i               /* knot interval: x[i] < k < x[i+1] */
+    , const int ib              /* Index of the term i in the basis arrays */
     , NurbsFloat* bi_1          /* basis of the previous iteration */
     )
 {
@@ -94,8 +97,8 @@ static void nurbs_uniform_derivative_basis_term
     }
 
     if (xik > xi){ /* xki - xi != 0 */
-        nl = (*bi_1) * nk1[i];
-        dnl = (*bi_1) * dk1[i] + nk1[i] / (xik - xi);
+        nl = (*bi_1) * nk1[ib];
+        dnl = (*bi_1) * dk1[ib] + nk1[ib] / (xik - xi);
     }
     else{
         nl = 0;
@@ -116,8 +119,8 @@ static void nurbs_uniform_derivative_basis_term
         c = xik1 - t;
         d = xik1 - xi1;
         cd = c / d;
-        nr = cd * nk1[i + 1];
-        dnr = (c * dk1[i + 1] - nk1[i + 1]) / d;
+        nr = cd * nk1[ib + 1];
+        dnr = (c * dk1[ib + 1] - nk1[ib + 1]) / d;
         *bi_1 = 1 - cd;
     }
     else{
@@ -134,6 +137,115 @@ static void nurbs_uniform_derivative_basis_term
 }
 
 
+/* Calculates the basis functions that are not zero. basis[j] is the basis
+ * of the control point iknot + j, j = 0..order. The array must have room
+ * for order + 2 values. Returns iknot. */
+static int nurbs_uniform_local_basis
+    ( NurbsFloat basis[]        /* (out) Non zero basis functions */
+    , const NurbsFloat t        /* Parameter value */
+    , const int num_cp          /* Number of control points */
+    , const int order           /* Order */
+    )
+{
+    register int i, k;
+    int ik0;      
+    NurbsFloat bi_1;
+    int up_knot = num_cp - order;   /* Upper knot */
+    NurbsFloat tx = t * up_knot;
+    int iknot = (int)(tx); /* Index of knot interval */
+
+    memset(basis, 0, sizeof(NurbsFloat)*(order + 2));
+
+    /* Especial case when the parameter is out of the knots interval. */
+    if (t < 0){ 
+        basis[0] = 1;
+        return 0;
+    }
+    else if (t >= 1){
+        basis[order] = 1;
+        return num_cp-order-1;
+    }
+
+    /* Specialized kernels, see nurbs_basis_kernels.inl */
+    switch (order){
+    case 1:
+        nurbs_uniform_kernel1( basis, tx, iknot, up_knot );
+        return iknot;
+    case 2:
+        nurbs_uniform_kernel2( basis, tx, iknot, up_knot );
+        return iknot;
+    case 3:
+        nurbs_uniform_kernel3( basis, tx, iknot, up_knot );
+        return iknot;
+    }
+
+    /* Solution basis order 0 */
+    basis[order] = 1;
+
+    /* Recursive calculation of basis coefficients for k degree */
+    for (k = 1; k <= order; k++){
+        ik0 = iknot + order - k;
+
+        bi_1 = 0;
+        for (i = ik0; i <= iknot + order; i++){    
+            basis[i - iknot] = uniform_basis_term
+                (basis, up_knot, tx, order, k, i, i - iknot, &bi_1);
+        }
+    }
+
+    return iknot;
+}
+
+
+/* Calculates the derivative of the basis that are not zero. The arrays 
+ * must have room for order + 2 values. Returns iknot. */
+static int nurbs_uniform_local_d_basis
+    ( NurbsFloat d_basis[]      /* (out) Derivative of the basis functions */
+    , NurbsFloat basis[]        /* (out) Basis functions */
+    , const NurbsFloat t        /* Parameter value */
+    , const int num_cp          /* Number of control points */
+    , const int order           /* Order */
+    )
+{
+    register int i, k;
+    int ik0;      
+    NurbsFloat bi_1;
+    int up_knot = num_cp - order;   /* Upper knot */
+    NurbsFloat tx = t * up_knot;
+    int iknot = (int)(tx); /* Index of knot interval */
+
+    memset(d_basis, 0, sizeof(NurbsFloat)*(order + 2));
+    memset(basis, 0, sizeof(NurbsFloat)*(order + 2));
+
+    /* Especial case when the parameter is out of the knots interval. */
+    if (t < 0){ 
+        tx = 0;
+        iknot = 0;
+    }
+    else if (t >= 1){
+        tx = up_knot;
+        iknot = num_cp-order-1;
+    }
+
+    /* Solution basis order 0 */
+    basis[order] = 1;
+
+    /* Recursive calculation of basis coefficients for k degree */
+    for (k = 1; k <= order; k++){
+        ik0 = iknot + order - k;
+
+        bi_1 = 0;
+        for (i = ik0; i <= iknot + order; i++){    
+            nurbs_uniform_derivative_basis_term
+                ( &(basis[i - iknot]), &(d_basis[i - iknot])
+                , basis, d_basis, up_knot, tx, order, k, i, i - iknot, &bi_1);
+        }
+    }
+
+    return iknot;
+}
+
+
 /* Calculates the derivative of the basis. */
 static int nurbs_uniform_d_basis
     ( NurbsFloat d_basis[]      /* (out) Derivative of the basis functions */
@@ -175,7 +287,7 @@ static int nurbs_uniform_d_basis
         bi_1 = 0;
         for (i = ik0; i <= iknot + order; i++){    
             nurbs_uniform_derivative_basis_term(&(basis[i]), &(d_basis[i])
-                , basis, d_basis, up_knot, tx, order, k, i, &bi_1);
+                , basis, d_basis, up_knot, tx, order, k, i, i, &bi_1);
         }
     }
 
@@ -222,7 +334,7 @@ int nurbs_uniform_basis
         bi_1 = 0;
         for (i = ik0; i <= iknot + order; i++){    
             basis[i] = uniform_basis_term
-                (basis, up_knot, tx, order, k, i, &bi_1);
+                (basis, up_knot, tx, order, k, i, i, &bi_1);
         }
     }
 
@@ -230,6 +342,80 @@ int nurbs_uniform_basis
 }
 
 
+/* Number of basis functions that are not zero */
+int nurbs_controlbox_num_basis
+    ( const int order           /* Order */
+    , const int basis_equation  /* Basis equation (1:bezier 0:b-spline) */
+    )
+{
+    if (basis_equation == 1){
+        if (order <= 0){
+            return 1;
+        }
+        else if (order == 1){
+            return 2;
+        }
+        else if (order == 2 || order == 3){
+            return 4;
+        }
+        else{
+            /* unsuported */
+            return 0;
+        }
+    }
+    else{
+        return order + 1;
+    }
+}
+
+
+/* Calculates the basis functions that are not zero. */
+int nurbs_controlbox_local_basis_function
+    ( NurbsFloat basis[]        /* (out) Non zero basis functions */
+    , const NurbsFloat t        /* Parameter value */
+    , const int num_cp          /* Number of control points */
+    , const int order           /* Order */
+    , const int basis_equation  /* Basis equation (1:bezier 0:b-spline) */
+    )
+{
+    if (basis_equation == 1){
+        return bezier_local_basis( basis, t, num_cp, order );
+    }
+    else{
+        return nurbs_uniform_local_basis( basis, t, num_cp, order );
+    }
+}
+
+
+/* Calculates the derivative of the basis that are not zero. */
+int nurbs_controlbox_local_d_basis_function
+    ( NurbsFloat d_basis[]      /* (out) Derivative of the basis functions */
+    , NurbsFloat basis[]        /* (out) Non zero basis functions */
+    , const NurbsFloat t        /* Parameter value */
+    , const int num_cp          /* Number of control points */
+    , const int order           /* Order */
+    , const int basis_equation  /* Basis equation */
+    )
+{
+    NurbsFloat window[4];
+    int i, iknot, iknot_d;
+
+    if (basis_equation == 1){
+        /* The derivative window may start at a different control point */
+        iknot_d = bezier_local_d_basis( window, t, num_cp, order );
+        iknot = bezier_local_basis( basis, t, num_cp, order );
+        for (i = 0; i < 4; i++){
+            const int j = i + iknot - iknot_d;
+            d_basis[i] = (j >= 0 && j < 4) ? window[j] : 0;
+        }
+        return iknot;
+    }
+    else{
+        return nurbs_uniform_local_d_basis( d_basis, basis, t, num_cp, order );
+    }
+}
+
+
 /* Calculates the basis functions. */
 int nurbs_controlbox_basis_function
     ( NurbsFloat basis[]        /* (out) Basis functions */
@@ -238,6 +424,34 @@ int nurbs_controlbox_basis_function
     , const int order           /* Order */
     , const int basis_equation  /* Basis equation (1:bezier 0:b-spline) */
     )
+{
+    NurbsFloat window[NURBS_MAX_DEGREE + 2];
+    int iknot;
+
+    if (basis_equation == 1){
+        return bezier_basis( basis, t, num_cp, order );
+    }
+    else if (order > NURBS_MAX_DEGREE){
+        return nurbs_uniform_basis( basis, t, num_cp, order );
+    }
+
+    iknot = nurbs_uniform_local_basis( window, t, num_cp, order );
+
+    memset( basis, 0, sizeof(NurbsFloat)*num_cp );
+    bezier_window_copy( basis, window, iknot, order + 1, num_cp );
+
+    return iknot;
+}
+
+
+/* Calculates the basis functions without the specialized kernels. */
+int nurbs_controlbox_generic_basis_function
+    ( NurbsFloat basis[]        /* (out) Basis functions */
+    , const NurbsFloat t        /* Parameter value */
+    , const int num_cp          /* Number of control points */
+    , const int order           /* Order */
+    , const int basis_equation  /* Basis equation (1:bezier 0:b-spline) */
+    )
 {
     if (basis_equation == 1){
         return bezier_basis( basis, t, num_cp, order );
@@ -460,7 +674,22 @@ void nurbs_controlbox_copy
 }
 
 
-/* Calculates the point coordinates from the parametric coordinates */
+/* Checks that the basis fits in the buffers of the stack */
+static inline int check_order(const NurbsControlBox* cb)
+{
+    if (cb->order_u > NURBS_MAX_DEGREE || cb->order_v > NURBS_MAX_DEGREE 
+        || cb->order_w > NURBS_MAX_DEGREE)
+    {
+        _handle_error_("Control box order is greater than NURBS_MAX_DEGREE");
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/* Calculates the point coordinates from the parametric coordinates.
+ * The basis are calculated in buffers of the stack. */
 NurbsVector3 nurbs_controlbox_get_point
     ( const NurbsControlBox* cb
     , const NurbsFloat u
@@ -470,100 +699,51 @@ NurbsVector3 nurbs_controlbox_get_point
 {
     int iknu, iknv, iknw;   /* lower index of the knot interval */
     int iu, iv, iw;    
-    int nu = 0, nv = 0, nw = 0;
+    int nu, nv, nw;
     NurbsFloat bu, bv, bw, buvw;     
     NurbsVector3 cp, point;
 
-    /* Basis functions */
-    NurbsFloat* basis_u = nullptr;
-    NurbsFloat* basis_v = nullptr;
-    NurbsFloat* basis_w = nullptr;
+    /* Non zero basis functions */
+    NurbsFloat basis_u[NURBS_MAX_DEGREE + 2];
+    NurbsFloat basis_v[NURBS_MAX_DEGREE + 2];
+    NurbsFloat basis_w[NURBS_MAX_DEGREE + 2];
 
     point.x = NURBS_ERROR_VALUE;
     point.y = NURBS_ERROR_VALUE;
     point.z = NURBS_ERROR_VALUE;
 
-    if (cb == nullptr){
-        goto ERROR;
-    }
-    
-    _check_(basis_u = (NurbsFloat*)_malloc_
-        ((cb->cp_length_u) * sizeof(NurbsFloat)));
-
-    _check_(basis_v = (NurbsFloat*)_malloc_
-        ((cb->cp_length_v) * sizeof(NurbsFloat)));
-
-    _check_(basis_w = (NurbsFloat*)_malloc_
-        ((cb->cp_length_w) * sizeof(NurbsFloat)));
-
-    if (basis_u == nullptr || basis_v == nullptr || basis_w == nullptr){
-        /* Out of memory */
-        goto ERROR;
+    if (cb == nullptr || !check_order(cb)){
+        return point;
     }
 
     /*  Get basis */
-    iknu = nurbs_controlbox_basis_function
+    iknu = nurbs_controlbox_local_basis_function
         ( basis_u, u, cb->cp_length_u, cb->order_u, cb->basis_equation );
 
-    iknv = nurbs_controlbox_basis_function
+    iknv = nurbs_controlbox_local_basis_function
         ( basis_v, v, cb->cp_length_v, cb->order_v, cb->basis_equation );
 
-    iknw = nurbs_controlbox_basis_function
+    iknw = nurbs_controlbox_local_basis_function
         ( basis_w, w, cb->cp_length_w, cb->order_w, cb->basis_equation );
     
     if (iknu < 0 || iknv < 0 || iknw < 0){
-        goto ERROR;
+        return point;
     }
 
-    if (cb->basis_equation == 1){
-        // Bezier
-        if (cb->order_u == 0){
-            nu = 1;
-        }
-        else if (cb->order_u == 1){
-            nu = 2;
-        }
-        else if (cb->order_u == 2 || cb->order_u == 3){
-            nu = 4;
-        }
-
-        if (cb->order_v == 0){
-            nv = 1;
-        }
-        else if (cb->order_v == 1){
-            nv = 2;
-        }
-        else if (cb->order_v == 2 || cb->order_v == 3){
-            nv = 4;
-        }
-
-        if (cb->order_w == 0){
-            nw = 1;
-        }
-        else if (cb->order_w == 1){
-            nw = 2;
-        }
-        else if (cb->order_w == 2 || cb->order_w == 3){
-            nw = 4;
-        }
-    }
-    else{   
-        // b-spline
-        nu = cb->order_u + 1;
-        nv = cb->order_v + 1;
-        nw = cb->order_w + 1;
-    }
+    nu = nurbs_controlbox_num_basis( cb->order_u, cb->basis_equation );
+    nv = nurbs_controlbox_num_basis( cb->order_v, cb->basis_equation );
+    nw = nurbs_controlbox_num_basis( cb->order_w, cb->basis_equation );
 
     point.x = 0;
     point.y = 0;
     point.z = 0;
 
     for (iu = 0; iu < nu; iu++){
-        bu = basis_u[iu + iknu];
+        bu = basis_u[iu];
         for (iv = 0; iv < nv; iv++){
-            bv = basis_v[iv + iknv];
+            bv = basis_v[iv];
             for (iw = 0; iw < nw; iw++){
-                bw = basis_w[iw + iknw];
+                bw = basis_w[iw];
                 buvw = bu*bv*bw;
 
                 cp = cb->cp[iu + iknu][iv + iknv][iw + iknw];
@@ -574,17 +754,6 @@ NurbsVector3 nurbs_controlbox_get_point
         }
     }
 
-ERROR:
-    if (basis_u != nullptr){
-        free(basis_u);
-    }
-    if (basis_v != nullptr){
-        free(basis_v);
-    }
-    if (basis_w != nullptr){
-        free(basis_w);
-    }
-
     return point;
 }
 
@@ -605,17 +774,22 @@ void nurbs_controlbox_get_derivatives
     int nu, nv, nw;
     NurbsFloat bu, bv, bw, buvw, du, dv, dw;     
     NurbsVector3 cp;
-    const int order_u = cb->order_u;
-    const int order_v = cb->order_v;
-    const int order_w = cb->order_w;
-
-    /* Basis functions */
-    NurbsFloat* basis_u = nullptr;
-    NurbsFloat* basis_v = nullptr;
-    NurbsFloat* basis_w = nullptr;
-    NurbsFloat* d_basis_u = nullptr;
-    NurbsFloat* d_basis_v = nullptr;
-    NurbsFloat* d_basis_w = nullptr;
+
+    /* Non zero basis functions */
+    NurbsFloat basis_u[NURBS_MAX_DEGREE + 2];
+    NurbsFloat basis_v[NURBS_MAX_DEGREE + 2];
+    NurbsFloat basis_w[NURBS_MAX_DEGREE + 2];
+    NurbsFloat d_basis_u[NURBS_MAX_DEGREE + 2];
+    NurbsFloat d_basis_v[NURBS_MAX_DEGREE + 2];
+    NurbsFloat d_basis_w[NURBS_MAX_DEGREE + 2];
+
+    if (!check_order(cb)){
+        point->x = point->y = point->z = NURBS_ERROR_VALUE;
+        deriv_u->x = deriv_u->y = deriv_u->z = NURBS_ERROR_VALUE;
+        deriv_v->x = deriv_v->y = deriv_v->z = NURBS_ERROR_VALUE;
+        deriv_w->x = deriv_w->y = deriv_w->z = NURBS_ERROR_VALUE;
+        return;
+    }
 
     point->x = 0;
     point->y = 0;
@@ -632,101 +806,35 @@ void nurbs_controlbox_get_derivatives
     deriv_w->x = 0;
     deriv_w->y = 0;
     deriv_w->z = 0;
-    
-    _check_(basis_u = (NurbsFloat*)_malloc_
-        ((cb->cp_length_u) * sizeof(NurbsFloat)));
-
-    _check_( basis_v = (NurbsFloat*)_malloc_
-        ((cb->cp_length_v) * sizeof(NurbsFloat)));
-
-    _check_( basis_w = (NurbsFloat*)_malloc_
-        ((cb->cp_length_w) * sizeof(NurbsFloat)));
-
-    _check_( d_basis_u = (NurbsFloat*)_malloc_
-        ((cb->cp_length_u) * sizeof(NurbsFloat)));
-
-    _check_( d_basis_v = (NurbsFloat*)_malloc_
-        ((cb->cp_length_v) * sizeof(NurbsFloat)));
-
-    _check_( d_basis_w = (NurbsFloat*)_malloc_
-        ((cb->cp_length_w) * sizeof(NurbsFloat)));
-
-    if (basis_u == nullptr || basis_v == nullptr || basis_w == nullptr 
-      || d_basis_u == nullptr || d_basis_v == nullptr || d_basis_w == nullptr){
-        /* Out of memory */
-        goto ERROR;
-    }
 
     /*  Get basis */
-    iknu = nurbs_controlbox_d_basis_function
-        ( d_basis_u, basis_u, u, cb->cp_length_u, order_u, cb->basis_equation);
-
-    iknv = nurbs_controlbox_d_basis_function
-        ( d_basis_v, basis_v, v, cb->cp_length_v, order_v, cb->basis_equation);
+    iknu = nurbs_controlbox_local_d_basis_function
+        ( d_basis_u, basis_u, u, cb->cp_length_u, cb->order_u, cb->basis_equation);
 
-    iknw = nurbs_controlbox_d_basis_function
-        ( d_basis_w, basis_w, w, cb->cp_length_w, order_w, cb->basis_equation);
+    iknv = nurbs_controlbox_local_d_basis_function
+        ( d_basis_v, basis_v, v, cb->cp_length_v, cb->order_v, cb->basis_equation);
 
-    if (cb->basis_equation == 1){
-        /* BEZIER basis */
-        if (cb->order_u <= 0){
-            nu = 1;
-        }
-        else if (cb->order_u == 1){
-            nu = 2;
-        }
-        else if (cb->order_u == 2 || cb->order_u == 3){
-            nu = 4;
-        }
-        else{
-            /* unsuported */
-            nu = 0;
-        }
+    iknw = nurbs_controlbox_local_d_basis_function
+        ( d_basis_w, basis_w, w, cb->cp_length_w, cb->order_w, cb->basis_equation);
 
-        if (cb->order_v <= 0){
-            nv = 1;
-        }
-        else if (cb->order_v == 1){
-            nv = 2;
-        }
-        else if (cb->order_v == 2 || cb->order_v == 3){
-            nv = 4;
-        }
-        else{
-            /* unsuported */
-            nv = 0;
-        }
-
-        if (cb->order_w <= 0){
-            nw = 1;
-        }
-        else if (cb->order_w == 1){
-            nw = 2;
-        }
-        else if (cb->order_w == 2 || cb->order_w == 3){
-            nw = 4;
-        }
-        else{
-            /* unsuported */
-            nw = 0;
-        }
-    }
-    else{
-        /* NURBS basis */
-        nu = cb->order_u+1;
-        nv = cb->order_v+1;
-        nw = cb->order_w+1;
+    if (iknu < 0 || iknv < 0 || iknw < 0){
+        /* Not enough control points for the order */
+        return;
     }
 
+    nu = nurbs_controlbox_num_basis( cb->order_u, cb->basis_equation );
+    nv = nurbs_controlbox_num_basis( cb->order_v, cb->basis_equation );
+    nw = nurbs_controlbox_num_basis( cb->order_w, cb->basis_equation );
+
     for (iu = 0; iu < nu; iu++){
-        bu = basis_u[iu + iknu];
-        du = d_basis_u[iu + iknu];
+        bu = basis_u[iu];
+        du = d_basis_u[iu];
         for (iv = 0; iv < nv; iv++){
-            bv = basis_v[iv + iknv];
-            dv = d_basis_v[iv + iknv];
+            bv = basis_v[iv];
+            dv = d_basis_v[iv];
             for (iw = 0; iw < nw; iw++){
-                bw = basis_w[iw + iknw];
-                dw = d_basis_w[iw + iknw];
+                bw = basis_w[iw];
+                dw = d_basis_w[iw];
 
                 cp = cb->cp[iu + iknu][iv + iknv][iw + iknw];
 
@@ -752,26 +860,6 @@ void nurbs_controlbox_get_derivatives
             }
         }
     }
-
-ERROR:
-    if (basis_u != nullptr){
-        free(basis_u);
-    }
-    if (basis_v != nullptr){
-        free(basis_v);
-    }
-    if (basis_w != nullptr){
-        free(basis_w);
-    }
-    if (d_basis_u != nullptr){
-        free(d_basis_u);
-    }
-    if (d_basis_v != nullptr){
-        free(d_basis_v);
-    }
-    if (d_basis_w != nullptr){
-        free(d_basis_w);
-    };
 }
 
 /* Calculates the point coordinates from the parametric coordinates */
@@ -881,183 +969,488 @@ static void solve_linear3
 }
 
 
-/* Calculates a fair approximation of the inversion point */
-static NurbsVector3 cb_inversion_estimation_xyz
-    ( const NurbsControlBox* ffd
+/* Estimates the inversion point with the linear approximation of the cell
+ * {iu, iv, iw}, and keeps it if it is better than the present estimation */
+static void cb_estimation_cell_xyz
+    ( NurbsVector3* tuvw
+    , NurbsFloat* best_dist
+    , const NurbsControlBox* ffd
     , const NurbsVector3 p
+    , const int iu
+    , const int iv
+    , const int iw
     )
 {
-    int iu, iv, iw, iu0, iv0, iw0, iu1, iv1, iw1;
+    int iu0, iv0, iw0, iu1, iv1, iw1;
     NurbsVector3 p000, p001, p010, p011, p100, p101, p110, p111;
     NurbsVector3 pt;
     NurbsFloat u, v, w;
-    NurbsVector3 tuvw = {-1, -1, -1};
-    NurbsFloat dist, best_dist = -1;
+    NurbsFloat dist;
+    NurbsFloat ma, mb, mc, md, me, mf, mg, mh, mk;
+    NurbsFloat M;
+
+    iu0 = iu;
+    iu1 = iu + 1;
+
+    iv0 = iv;
+    iv1 = iv + 1;
+
+    iw0 = iw;
+    iw1 = iw + 1;
+
+    p000 = ffd->cp[iu0][iv0][iw0];
+    p001 = ffd->cp[iu0][iv0][iw1];
+    p010 = ffd->cp[iu0][iv1][iw0];
+    p011 = ffd->cp[iu0][iv1][iw1];
+    p100 = ffd->cp[iu1][iv0][iw0];
+    p101 = ffd->cp[iu1][iv0][iw1];
+    p110 = ffd->cp[iu1][iv1][iw0];
+    p111 = ffd->cp[iu1][iv1][iw1];
+
+    /* Translate to origin */
+    p100.x -= p000.x;
+    p100.y -= p000.y;
+    p100.z -= p000.z;
+
+    p010.x -= p000.x;
+    p010.y -= p000.y;
+    p010.z -= p000.z;
+
+    p001.x -= p000.x;
+    p001.y -= p000.y;
+    p001.z -= p000.z;
+
+    p110.x -= p000.x;
+    p110.y -= p000.y;
+    p110.z -= p000.z;
+
+    p101.x -= p000.x;
+    p101.y -= p000.y;
+    p101.z -= p000.z;
+
+    p011.x -= p000.x;
+    p011.y -= p000.y;
+    p011.z -= p000.z;
+
+    p111.x -= p000.x;
+    p111.y -= p000.y;
+    p111.z -= p000.z;
+
+    /* Calculate a linear transformation to make a unitary ortogonal
+    control box. ==> p100={1,0,0}; p010={0,1,0}; p001={0,0,1}  */
+    M = det3( p100.x, p100.y, p100.z
+            , p010.x, p010.y, p010.z 
+            , p001.x, p001.y, p001.z 
+            );
+
+    if (M > 0 || M < 0){
+        solve_linear3
+            ( &ma, &md, &mg
+            , p100.x,   p100.y,     p100.z
+            , p010.x,   p010.y,     p010.z 
+            , p001.x,   p001.y,     p001.z 
+            , 1,        0,          0
+            , M
+            );
+
+        solve_linear3 
+            ( &mb, &me, &mh
+            , p100.x,   p100.y,     p100.z 
+            , p010.x,   p010.y,     p010.z 
+            , p001.x,   p001.y,     p001.z
+            , 0,        1,          0
+            , M
+            );
+
+        solve_linear3
+            ( &mc, &mf, &mk
+            , p100.x,   p100.y,     p100.z
+            , p010.x,   p010.y,     p010.z
+            , p001.x,   p001.y,     p001.z
+            , 0,        0,          1
+            , M
+            );
+
+        /* Apply the linear transformation to the control points */
+
+
+        /*
+        pt.x = p100.x * ma + p100.y * mb + p100.z * mc;
+        pt.y = p100.x * md + p100.y * me + p100.z * mf;
+        pt.z = p100.x * mg + p100.y * mh + p100.z * mk;
+        p100 = pt;  //( Should be {1, 0, 0} )
+
+        pt.x = p010.x * ma + p010.y * mb + p010.z * mc;
+        pt.y = p010.x * md + p010.y * me + p010.z * mf;
+        pt.z = p010.x * mg + p010.y * mh + p010.z * mk;
+        p010 = pt;  //( Should be {0, 1, 0} )
+
+        pt.x = p001.x * ma + p001.y * mb + p001.z * mc;
+        pt.y = p001.x * md + p001.y * me + p001.z * mf;
+        pt.z = p001.x * mg + p001.y * mh + p001.z * mk;
+        p001 = pt;  //( Should be {0, 0, 1} )
+
+
+        pt.x = p110.x * ma + p110.y * mb + p110.z * mc;
+        pt.y = p110.x * md + p110.y * me + p110.z * mf;
+        pt.z = p110.x * mg + p110.y * mh + p110.z * mk;
+        p110 = pt;  //( This leads to the non linear term )
+
+        pt.x = p101.x * ma + p101.y * mb + p101.z * mc;
+        pt.y = p101.x * md + p101.y * me + p101.z * mf;
+        pt.z = p101.x * mg + p101.y * mh + p101.z * mk;
+        p101 = pt;  //( This leads to the non linear term )
+
+        pt.x = p011.x * ma + p011.y * mb + p011.z * mc;
+        pt.y = p011.x * md + p011.y * me + p011.z * mf;
+        pt.z = p011.x * mg + p011.y * mh + p011.z * mk;
+        p011 = pt;  //( This leads to the non linear term )
+
+        pt.x = p111.x * ma + p111.y * mb + p111.z * mc;
+        pt.y = p111.x * md + p111.y * me + p111.z * mf;
+        pt.z = p111.x * mg + p111.y * mh + p111.z * mk;
+        p111 = pt;  //( This leads to the non linear term )
+        */
+
+        pt.x = p.x - p000.x;
+        pt.y = p.y - p000.y;
+        pt.z = p.z - p000.z;
+
+        u = pt.x * ma + pt.y * mb + pt.z * mc;
+        v = pt.x * md + pt.y * me + pt.z * mf;
+        w = pt.x * mg + pt.y * mh + pt.z * mk;
+
+        u = (u + iu) / (ffd->cp_length_u - 1);
+        v = (v + iv) / (ffd->cp_length_v - 1);
+        w = (w + iw) / (ffd->cp_length_w - 1);
+
+        if (u < -0.05 || u > 1.05 || v < -0.05 || v > 1.05 || w < -0.05 || w > 1.05){
+            return;
+        }
+
+        pt = nurbs_controlbox_get_point( ffd, u, v, w );
+        
+        dist = (pt.x - p.x) * (pt.x - p.x);
+        dist += (pt.y - p.y) * (pt.y - p.y);
+        dist += (pt.z - p.z) * (pt.z - p.z);
+
+        if (*best_dist > dist || *best_dist < 0){
+            *best_dist = dist;
+            tuvw->x = u;
+            tuvw->y = v;
+            tuvw->z = w;
+        }
+    }
+}
+
+
+/* Estimates the inversion point with the linear approximation of the cell
+ * {iu, iv, iw} when some direction has only one layer of control points, 
+ * and keeps it if it is better than the present estimation */
+static void cb_estimation_cell_2d
+    ( NurbsVector3* tuvw
+    , NurbsFloat* best_dist
+    , const NurbsControlBox* ffd
+    , const NurbsVector3 p
+    , const int iu
+    , const int iv
+    , const int iw
+    )
+{
+    int iu0, iv0, iw0, iu1, iv1, iw1;
+    NurbsVector3 p000, p001, p010, p011, p100, p101, p110, p111;
+    NurbsFloat a0, a1, a2;
+    NurbsVector3 pt;
+    NurbsFloat u, v, w;
+    NurbsFloat dist;
     NurbsFloat ma, mb, mc, md, me, mf, mg, mh, mk;
     NurbsFloat M;
     int nu, nv, nw;
 
+    nu = (ffd->cp_length_u > 1) ? ffd->cp_length_u - 1 : 1;
+    nv = (ffd->cp_length_v > 1) ? ffd->cp_length_v - 1 : 1;
+    nw = (ffd->cp_length_w > 1) ? ffd->cp_length_w - 1 : 1;
+
+    iu0 = iu;
+    if (ffd->cp_length_u > 1){
+        iu1 = iu + 1;
+    }
+    else{
+        iu1 = iu0;
+    }
+
+    iv0 = iv;
+    if (ffd->cp_length_v > 1){
+        iv1 = iv + 1;
+    }
+    else{
+        iv1 = iv0;
+    }
+
+    iw0 = iw;
+    if (ffd->cp_length_w > 1){
+        iw1 = iw + 1;
+    }
+    else{
+        iw1 = iw0;
+    }
+
+    p000 = ffd->cp[iu0][iv0][iw0];
+    p001 = ffd->cp[iu0][iv0][iw1];
+    p010 = ffd->cp[iu0][iv1][iw0];
+    p011 = ffd->cp[iu0][iv1][iw1];
+    p100 = ffd->cp[iu1][iv0][iw0];
+    p101 = ffd->cp[iu1][iv0][iw1];
+    p110 = ffd->cp[iu1][iv1][iw0];
+    p111 = ffd->cp[iu1][iv1][iw1];
+
+    /* Translate to origin */
+    p100.x -= p000.x;
+    p100.y -= p000.y;
+    p100.z -= p000.z;
+
+    p010.x -= p000.x;
+    p010.y -= p000.y;
+    p010.z -= p000.z;
+
+    p001.x -= p000.x;
+    p001.y -= p000.y;
+    p001.z -= p000.z;
+
+    p110.x -= p000.x;
+    p110.y -= p000.y;
+    p110.z -= p000.z;
+
+    p101.x -= p000.x;
+    p101.y -= p000.y;
+    p101.z -= p000.z;
+
+    p011.x -= p000.x;
+    p011.y -= p000.y;
+    p011.z -= p000.z;
+
+    p111.x -= p000.x;
+    p111.y -= p000.y;
+    p111.z -= p000.z;
+
+    /* Calculate a linear transformation to make a unitary ortogonal
+    control box. ==> p100={1,0,0}; p010={0,1,0}; p001={0,0,1}  */
+    if (ffd->cp_length_u <= 1){
+        a0 = 1;
+    }
+    else{
+        a0 = p100.x;
+    }
+    if (ffd->cp_length_v <= 1){
+        a1 = 1;
+    }
+    else{
+        a1 = p010.y;
+    }
+    if (ffd->cp_length_w <= 1){
+        a2 = 1;
+    }
+    else{
+        a2 = p001.z;
+    }
+
+    M = det3( a0, p100.y, p100.z
+            , p010.x, a1, p010.z 
+            , p001.x, p001.y, a2 
+            );
+
+    if (M > 0 || M < 0){
+        solve_linear3
+            ( &ma, &md, &mg
+            , a0,       p100.y,     p100.z
+            , p010.x,   a1,         p010.z 
+            , p001.x,   p001.y,     a2 
+            , 1,        0,          0
+            , M
+            );
+
+        solve_linear3 
+            ( &mb, &me, &mh
+            , a0,       p100.y,     p100.z 
+            , p010.x,   a1,         p010.z 
+            , p001.x,   p001.y,     a2
+            , 0,        1,          0
+            , M
+            );
+
+        solve_linear3
+            ( &mc, &mf, &mk
+            , a0,       p100.y,     p100.z
+            , p010.x,   a1,         p010.z
+            , p001.x,   p001.y,     a2
+            , 0,        0,          1
+            , M
+            );
+
+        /* Apply the linear transformation to the control points */
+
+
+        pt.x = p100.x * ma + p100.y * mb + p100.z * mc;
+        pt.y = p100.x * md + p100.y * me + p100.z * mf;
+        pt.z = p100.x * mg + p100.y * mh + p100.z * mk;
+        p100 = pt;  /*( Should be {1, 0, 0} )*/
+
+        pt.x = p010.x * ma + p010.y * mb + p010.z * mc;
+        pt.y = p010.x * md + p010.y * me + p010.z * mf;
+        pt.z = p010.x * mg + p010.y * mh + p010.z * mk;
+        p010 = pt;  /*( Should be {0, 1, 0} )*/
+
+        pt.x = p001.x * ma + p001.y * mb + p001.z * mc;
+        pt.y = p001.x * md + p001.y * me + p001.z * mf;
+        pt.z = p001.x * mg + p001.y * mh + p001.z * mk;
+        p001 = pt;  /*( Should be {0, 0, 1} )*/
+
+
+        pt.x = p110.x * ma + p110.y * mb + p110.z * mc;
+        pt.y = p110.x * md + p110.y * me + p110.z * mf;
+        pt.z = p110.x * mg + p110.y * mh + p110.z * mk;
+        p110 = pt;  /*( This leads to the non linear term )*/
+
+        pt.x = p101.x * ma + p101.y * mb + p101.z * mc;
+        pt.y = p101.x * md + p101.y * me + p101.z * mf;
+        pt.z = p101.x * mg + p101.y * mh + p101.z * mk;
+        p101 = pt;  /*( This leads to the non linear term )*/
+
+        pt.x = p011.x * ma + p011.y * mb + p011.z * mc;
+        pt.y = p011.x * md + p011.y * me + p011.z * mf;
+        pt.z = p011.x * mg + p011.y * mh + p011.z * mk;
+        p011 = pt;  /*( This leads to the non linear term )*/
+
+        pt.x = p111.x * ma + p111.y * mb + p111.z * mc;
+        pt.y = p111.x * md + p111.y * me + p111.z * mf;
+        pt.z = p111.x * mg + p111.y * mh + p111.z * mk;
+        p111 = pt;  /*( This leads to the non linear term )*/
+        
+
+        pt.x = p.x - p000.x;
+        pt.y = p.y - p000.y;
+        pt.z = p.z - p000.z;
+
+        u = pt.x * ma + pt.y * mb + pt.z * mc;
+        v = pt.x * md + pt.y * me + pt.z * mf;
+        w = pt.x * mg + pt.y * mh + pt.z * mk;
+
+        u = (u + iu) / nu;
+        v = (v + iv) / nv;
+        w = (w + iw) / nw;
+
+        /* The linear estimation falls outside of the box */
+        if (u < 0 || u > 1 || v < 0 || v > 1 || w < 0 || w > 1){
+            return;
+        }
+
+        pt = nurbs_controlbox_get_point( ffd, u, v, w );
+        
+        dist = (pt.x - p.x) * (pt.x - p.x);
+        dist += (pt.y - p.y) * (pt.y - p.y);
+        dist += (pt.z - p.z) * (pt.z - p.z);
+
+        if (*best_dist > dist || *best_dist < 0){
+            *best_dist = dist;
+            tuvw->x = u;
+            tuvw->y = v;
+            tuvw->z = w;
+        }
+    }
+}
+
+
+/* Candidate cells of the index kept in the stack (more are allocated) */
+#define CB_INDEX_CANDIDATES 64
+
+/* Estimation of one cell */
+typedef void (*CbEstimationCell)
+    ( NurbsVector3*, NurbsFloat*, const NurbsControlBox*, const NurbsVector3
+    , const int, const int, const int );
+
+/* Tests only the cells of the index that contain the point. 
+ * Returns 0 if there is no index or no cell gives an estimation. */
+static int cb_estimation_index
+    ( NurbsVector3* tuvw
+    , NurbsFloat* best_dist
+    , const NurbsControlBox* ffd
+    , const NurbsControlBoxIndex* index
+    , const NurbsVector3 p
+    , CbEstimationCell estimation_cell
+    )
+{
+    int buffer[CB_INDEX_CANDIDATES];
+    int* cells = buffer;
+    int i, n, cell, iu, iv, iw;
+
+    if (index == nullptr || index->cp_length_u != ffd->cp_length_u
+        || index->cp_length_v != ffd->cp_length_v
+        || index->cp_length_w != ffd->cp_length_w)
+    {
+        return 0;
+    }
+
+    n = nurbs_controlbox_index_query( cells, CB_INDEX_CANDIDATES, index, p );
+    if (n <= 0){
+        return 0;
+    }
+
+    /* Many overlapped cells (e.g. a folded box); test all of them */
+    if (n > CB_INDEX_CANDIDATES){
+        _check_(cells = (int*)_malloc_(sizeof(int) * n));
+        if (cells == nullptr){
+            /* Out of memory; the caller tries all the cells */
+            return 0;
+        }
+        nurbs_controlbox_index_query( cells, n, index, p );
+    }
+
+    for (i = 0; i < n; i++){
+        cell = cells[i];
+        iw = cell % index->num_cells_w;
+        cell /= index->num_cells_w;
+        iv = cell % index->num_cells_v;
+        iu = cell / index->num_cells_v;
+
+        estimation_cell( tuvw, best_dist, ffd, p, iu, iv, iw );
+    }
+
+    if (cells != buffer){
+        free( cells );
+    }
+
+    return (*best_dist >= 0);
+}
+
+
+/* Calculates a fair approximation of the inversion point.
+ * If there is an index, only the cells that contain the point are tested */
+static NurbsVector3 cb_inversion_estimation_xyz
+    ( const NurbsControlBox* ffd
+    , const NurbsControlBoxIndex* index
+    , const NurbsVector3 p
+    )
+{
+    int iu, iv, iw;
+    NurbsVector3 tuvw = {-1, -1, -1};
+    NurbsFloat best_dist = -1;
+    int nu, nv, nw;
+
     nu = ffd->cp_length_u - 1;
     nv = ffd->cp_length_v - 1;
     nw = ffd->cp_length_w - 1;
 
+    if (cb_estimation_index
+        ( &tuvw, &best_dist, ffd, index, p, cb_estimation_cell_xyz ))
+    {
+        return tuvw;
+    }
+
     /* Loop through all boxes to find a good approximation */
     for (iu = 0; iu < nu; iu++){
         for (iv = 0; iv < nv; iv++){
             for (iw = 0; iw < nw; iw++){
-
-                iu0 = iu;
-                iu1 = iu + 1;
-
-                iv0 = iv;
-                iv1 = iv + 1;
-
-                iw0 = iw;
-                iw1 = iw + 1;
-
-                p000 = ffd->cp[iu0][iv0][iw0];
-                p001 = ffd->cp[iu0][iv0][iw1];
-                p010 = ffd->cp[iu0][iv1][iw0];
-                p011 = ffd->cp[iu0][iv1][iw1];
-                p100 = ffd->cp[iu1][iv0][iw0];
-                p101 = ffd->cp[iu1][iv0][iw1];
-                p110 = ffd->cp[iu1][iv1][iw0];
-                p111 = ffd->cp[iu1][iv1][iw1];
-
-                /* Translate to origin */
-                p100.x -= p000.x;
-                p100.y -= p000.y;
-                p100.z -= p000.z;
-
-                p010.x -= p000.x;
-                p010.y -= p000.y;
-                p010.z -= p000.z;
-
-                p001.x -= p000.x;
-                p001.y -= p000.y;
-                p001.z -= p000.z;
-
-                p110.x -= p000.x;
-                p110.y -= p000.y;
-                p110.z -= p000.z;
-
-                p101.x -= p000.x;
-                p101.y -= p000.y;
-                p101.z -= p000.z;
-
-                p011.x -= p000.x;
-                p011.y -= p000.y;
-                p011.z -= p000.z;
-
-                p111.x -= p000.x;
-                p111.y -= p000.y;
-                p111.z -= p000.z;
-
-                /* Calculate a linear transformation to make a unitary ortogonal
-                control box. ==> p100={1,0,0}; p010={0,1,0}; p001={0,0,1}  */
-                M = det3( p100.x, p100.y, p100.z
-                        , p010.x, p010.y, p010.z 
-                        , p001.x, p001.y, p001.z 
-                        );
-
-                if (M > 0 || M < 0){
-                    solve_linear3
-                        ( &ma, &md, &mg
-                        , p100.x,   p100.y,     p100.z
-                        , p010.x,   p010.y,     p010.z 
-                        , p001.x,   p001.y,     p001.z 
-                        , 1,        0,          0
-                        , M
-                        );
-
-                    solve_linear3 
-                        ( &mb, &me, &mh
-                        , p100.x,   p100.y,     p100.z 
-                        , p010.x,   p010.y,     p010.z 
-                        , p001.x,   p001.y,     p001.z
-                        , 0,        1,          0
-                        , M
-                        );
-
-                    solve_linear3
-                        ( &mc, &mf, &mk
-                        , p100.x,   p100.y,     p100.z
-                        , p010.x,   p010.y,     p010.z
-                        , p001.x,   p001.y,     p001.z
-                        , 0,        0,          1
-                        , M
-                        );
-
-                    /* Apply the linear transformation to the control points */
-
-
-                    /*
-                    pt.x = p100.x * ma + p100.y * mb + p100.z * mc;
-                    pt.y = p100.x * md + p100.y * me + p100.z * mf;
-                    pt.z = p100.x * mg + p100.y * mh + p100.z * mk;
-                    p100 = pt;  //( Should be {1, 0, 0} )
-
-                    pt.x = p010.x * ma + p010.y * mb + p010.z * mc;
-                    pt.y = p010.x * md + p010.y * me + p010.z * mf;
-                    pt.z = p010.x * mg + p010.y * mh + p010.z * mk;
-                    p010 = pt;  //( Should be {0, 1, 0} )
-
-                    pt.x = p001.x * ma + p001.y * mb + p001.z * mc;
-                    pt.y = p001.x * md + p001.y * me + p001.z * mf;
-                    pt.z = p001.x * mg + p001.y * mh + p001.z * mk;
-                    p001 = pt;  //( Should be {0, 0, 1} )
-
-
-                    pt.x = p110.x * ma + p110.y * mb + p110.z * mc;
-                    pt.y = p110.x * md + p110.y * me + p110.z * mf;
-                    pt.z = p110.x * mg + p110.y * mh + p110.z * mk;
-                    p110 = pt;  //( This leads to the non linear term )
-
-                    pt.x = p101.x * ma + p101.y * mb + p101.z * mc;
-                    pt.y = p101.x * md + p101.y * me + p101.z * mf;
-                    pt.z = p101.x * mg + p101.y * mh + p101.z * mk;
-                    p101 = pt;  //( This leads to the non linear term )
-
-                    pt.x = p011.x * ma + p011.y * mb + p011.z * mc;
-                    pt.y = p011.x * md + p011.y * me + p011.z * mf;
-                    pt.z = p011.x * mg + p011.y * mh + p011.z * mk;
-                    p011 = pt;  //( This leads to the non linear term )
-
-                    pt.x = p111.x * ma + p111.y * mb + p111.z * mc;
-                    pt.y = p111.x * md + p111.y * me + p111.z * mf;
-                    pt.z = p111.x * mg + p111.y * mh + p111.z * mk;
-                    p111 = pt;  //( This leads to the non linear term )
-                    */
-
-                    pt.x = p.x - p000.x;
-                    pt.y = p.y - p000.y;
-                    pt.z = p.z - p000.z;
-
-                    u = pt.x * ma + pt.y * mb + pt.z * mc;
-                    v = pt.x * md + pt.y * me + pt.z * mf;
-                    w = pt.x * mg + pt.y * mh + pt.z * mk;
-
-                    u = (u + iu) / (ffd->cp_length_u - 1);
-                    v = (v + iv) / (ffd->cp_length_v - 1);
-                    w = (w + iw) / (ffd->cp_length_w - 1);
-
-                    if (u < -0.05 || u > 1.05 || v < -0.05 || v > 1.05 || w < -0.05 || w > 1.05){
-                        continue;
-                    }
-
-                    pt = nurbs_controlbox_get_point( ffd, u, v, w );
-                    
-                    dist = (pt.x - p.x) * (pt.x - p.x);
-                    dist += (pt.y - p.y) * (pt.y - p.y);
-                    dist += (pt.z - p.z) * (pt.z - p.z);
-
-                    if (best_dist > dist || best_dist < 0){
-                        best_dist = dist;
-                        tuvw.x = u;
-                        tuvw.y = v;
-                        tuvw.z = w;
-                    }
-                }
+                cb_estimation_cell_xyz( &tuvw, &best_dist, ffd, p, iu, iv, iw );
             }
         }
     }
@@ -1065,21 +1458,17 @@ static NurbsVector3 cb_inversion_estimation_xyz
     return tuvw;
 }
 
-/* Calculates a fair approximation of the inversion point */
+/* Calculates a fair approximation of the inversion point.
+ * If there is an index, only the cells that contain the point are tested */
 static NurbsVector3 cb_inversion_estimation_2d
     ( const NurbsControlBox* ffd
+    , const NurbsControlBoxIndex* index
     , const NurbsVector3 p
     )
 {
-    int iu, iv, iw, iu0, iv0, iw0, iu1, iv1, iw1;
-    NurbsVector3 p000, p001, p010, p011, p100, p101, p110, p111;
-    NurbsFloat a0, a1, a2;
-    NurbsVector3 pt;
-    NurbsFloat u, v, w;
+    int iu, iv, iw;
     NurbsVector3 tuvw = {-1, -1, -1};
-    NurbsFloat dist, best_dist = -1;
-    NurbsFloat ma, mb, mc, md, me, mf, mg, mh, mk;
-    NurbsFloat M;
+    NurbsFloat best_dist = -1;
     int nu, nv, nw;
 
     nu = ffd->cp_length_u - 1;
@@ -1096,217 +1485,17 @@ static NurbsVector3 cb_inversion_estimation_2d
         nw = 1;
     }
 
+    if (cb_estimation_index
+        ( &tuvw, &best_dist, ffd, index, p, cb_estimation_cell_2d ))
+    {
+        return tuvw;
+    }
+
     /* Loop through all sub boxes to find a good approximation */
     for (iu = 0; iu < nu; iu++){
         for (iv = 0; iv < nv; iv++){
             for (iw = 0; iw < nw; iw++){
-
-                iu0 = iu;
-                if (ffd->cp_length_u > 1){
-                    iu1 = iu + 1;
-                }
-                else{
-                    iu1 = iu0;
-                }
-
-                iv0 = iv;
-                if (ffd->cp_length_v > 1){
-                    iv1 = iv + 1;
-                }
-                else{
-                    iv1 = iv0;
-                }
-
-                iw0 = iw;
-                if (ffd->cp_length_w > 1){
-                    iw1 = iw + 1;
-                }
-                else{
-                    iw1 = iw0;
-                }
-
-                p000 = ffd->cp[iu0][iv0][iw0];
-                p001 = ffd->cp[iu0][iv0][iw1];
-                p010 = ffd->cp[iu0][iv1][iw0];
-                p011 = ffd->cp[iu0][iv1][iw1];
-                p100 = ffd->cp[iu1][iv0][iw0];
-                p101 = ffd->cp[iu1][iv0][iw1];
-                p110 = ffd->cp[iu1][iv1][iw0];
-                p111 = ffd->cp[iu1][iv1][iw1];
-
-                /* Translate to origin */
-                p100.x -= p000.x;
-                p100.y -= p000.y;
-                p100.z -= p000.z;
-
-                p010.x -= p000.x;
-                p010.y -= p000.y;
-                p010.z -= p000.z;
-
-                p001.x -= p000.x;
-                p001.y -= p000.y;
-                p001.z -= p000.z;
-
-                p110.x -= p000.x;
-                p110.y -= p000.y;
-                p110.z -= p000.z;
-
-                p101.x -= p000.x;
-                p101.y -= p000.y;
-                p101.z -= p000.z;
-
-                p011.x -= p000.x;
-                p011.y -= p000.y;
-                p011.z -= p000.z;
-
-                p111.x -= p000.x;
-                p111.y -= p000.y;
-                p111.z -= p000.z;
-
-                /* Calculate a linear transformation to make a unitary ortogonal
-                control box. ==> p100={1,0,0}; p010={0,1,0}; p001={0,0,1}  */
-                if (ffd->cp_length_u <= 1){
-                    a0 = 1;
-                }
-                else{
-                    a0 = p100.x;
-                }
-                if (ffd->cp_length_v <= 1){
-                    a1 = 1;
-                }
-                else{
-                    a1 = p010.y;
-                }
-                if (ffd->cp_length_w <= 1){
-                    a2 = 1;
-                }
-                else{
-                    a2 = p001.z;
-                }
-
-                M = det3( a0, p100.y, p100.z
-                        , p010.x, a1, p010.z 
-                        , p001.x, p001.y, a2 
-                        );
-
-                if (M > 0 || M < 0){
-                    solve_linear3
-                        ( &ma, &md, &mg
-                        , a0,       p100.y,     p100.z
-                        , p010.x,   a1,         p010.z 
-                        , p001.x,   p001.y,     a2 
-                        , 1,        0,          0
-                        , M
-                        );
-
-                    solve_linear3 
-                        ( &mb, &me, &mh
-                        , a0,       p100.y,     p100.z 
-                        , p010.x,   a1,         p010.z 
-                        , p001.x,   p001.y,     a2
-                        , 0,        1,          0
-                        , M
-                        );
-
-                    solve_linear3
-                        ( &mc, &mf, &mk
-                        , a0,       p100.y,     p100.z
-                        , p010.x,   a1,         p010.z
-                        , p001.x,   p001.y,     a2
-                        , 0,        0,          1
-                        , M
-                        );
-
-                    /* Apply the linear transformation to the control points */
-
-
-                    pt.x = p100.x * ma + p100.y * mb + p100.z * mc;
-                    pt.y = p100.x * md + p100.y * me + p100.z * mf;
-                    pt.z = p100.x * mg + p100.y * mh + p100.z * mk;
-                    p100 = pt;  /*( Should be {1, 0, 0} )*/
-
-                    pt.x = p010.x * ma + p010.y * mb + p010.z * mc;
-                    pt.y = p010.x * md + p010.y * me + p010.z * mf;
-                    pt.z = p010.x * mg + p010.y * mh + p010.z * mk;
-                    p010 = pt;  /*( Should be {0, 1, 0} )*/
-
-                    pt.x = p001.x * ma + p001.y * mb + p001.z * mc;
-                    pt.y = p001.x * md + p001.y * me + p001.z * mf;
-                    pt.z = p001.x * mg + p001.y * mh + p001.z * mk;
-                    p001 = pt;  /*( Should be {0, 0, 1} )*/
-
-
-                    pt.x = p110.x * ma + p110.y * mb + p110.z * mc;
-                    pt.y = p110.x * md + p110.y * me + p110.z * mf;
-                    pt.z = p110.x * mg + p110.y * mh + p110.z * mk;
-                    p110 = pt;  /*( This leads to the non linear term )*/
-
-                    pt.x = p101.x * ma + p101.y * mb + p101.z * mc;
-                    pt.y = p101.x * md + p101.y * me + p101.z * mf;
-                    pt.z = p101.x * mg + p101.y * mh + p101.z * mk;
-                    p101 = pt;  /*( This leads to the non linear term )*/
-
-                    pt.x = p011.x * ma + p011.y * mb + p011.z * mc;
-                    pt.y = p011.x * md + p011.y * me + p011.z * mf;
-                    pt.z = p011.x * mg + p011.y * mh + p011.z * mk;
-                    p011 = pt;  /*( This leads to the non linear term )*/
-
-                    pt.x = p111.x * ma + p111.y * mb + p111.z * mc;
-                    pt.y = p111.x * md + p111.y * me + p111.z * mf;
-                    pt.z = p111.x * mg + p111.y * mh + p111.z * mk;
-                    p111 = pt;  /*( This leads to the non linear term )*/
-                    
-
-                    pt.x = p.x - p000.x;
-                    pt.y = p.y - p000.y;
-                    pt.z = p.z - p000.z;
-
-                    u = pt.x * ma + pt.y * mb + pt.z * mc;
-                    v = pt.x * md + pt.y * me + pt.z * mf;
-                    w = pt.x * mg + pt.y * mh + pt.z * mk;
-
-                    u = (u + iu) / nu;
-                    v = (v + iv) / nv;
-                    w = (w + iw) / nw;
-
-                    if (u < 0){
-                        u = 0;
-                        continue;
-                    }
-                    if (u > 1){
-                        continue;
-                        u = 1;
-                    }
-                    if (v < 0){
-                        continue;
-                        v = 0;
-                    }
-                    if (v > 1){
-                        continue;
-                        v = 1;
-                    }
-                    if (w < 0){
-                        continue;
-                        w = 0;
-                    }
-                    if (w > 1){
-                        continue;
-                        w = 1;
-                    }
-
-                    pt = nurbs_controlbox_get_point( ffd, u, v, w );
-                    
-                    dist = (pt.x - p.x) * (pt.x - p.x);
-                    dist += (pt.y - p.y) * (pt.y - p.y);
-                    dist += (pt.z - p.z) * (pt.z - p.z);
-
-                    if (best_dist > dist || best_dist < 0){
-                        best_dist = dist;
-                        tuvw.x = u;
-                        tuvw.y = v;
-                        tuvw.z = w;
-                    }
-                }
+                cb_estimation_cell_2d( &tuvw, &best_dist, ffd, p, iu, iv, iw );
             }
         }
     }
@@ -1410,13 +1599,15 @@ static NurbsFloat absf( const NurbsFloat a )
 }
 
 
-/* Calculates the parametric values from the spatial coordinates */
-NurbsVector3 nurbs_controlbox_inversion_newton
+/* Calculates the parametric values from the spatial coordinates.
+ * Returns also the number of iterations. */
+static NurbsVector3 cb_inversion_newton
     ( const NurbsControlBox* ffd
     , const NurbsVector3 p
     , const NurbsVector3 t
     , const NurbsFloat epsilon
     , NurbsFloat* err
+    , int* iterations
     )
 {
     NurbsVector3 t0, t1;
@@ -1428,7 +1619,11 @@ NurbsVector3 nurbs_controlbox_inversion_newton
     NurbsFloat mod1, mod0;
     int it = 0, fail = 0, status;
 
-    t0 = t;
+    /* The estimation of a cell can be a bit outside the box; the point is
+     * evaluated clamped, so if it is already there Newton does not move */
+    t0.x = (t.x < 0) ? 0 : ((t.x > 1) ? 1 : t.x);
+    t0.y = (t.y < 0) ? 0 : ((t.y > 1) ? 1 : t.y);
+    t0.z = (t.z < 0) ? 0 : ((t.z > 1) ? 1 : t.z);
     p0 = nurbs_controlbox_get_point( ffd, t0.x, t0.y, t0.z );
 
     mod0 = (p.x - p0.x) * (p.x - p0.x);
@@ -1533,25 +1728,59 @@ NurbsVector3 nurbs_controlbox_inversion_newton
     if (err != nullptr){
         *err = mod0;
     }
+    if (iterations != nullptr){
+        *iterations = it;
+    }
 
     return t0;
 }
 
 
+/* Calculates the parametric values from the spatial coordinates */
+NurbsVector3 nurbs_controlbox_inversion_newton
+    ( const NurbsControlBox* ffd
+    , const NurbsVector3 p
+    , const NurbsVector3 t
+    , const NurbsFloat epsilon
+    , NurbsFloat* err
+    )
+{
+    return cb_inversion_newton( ffd, p, t, epsilon, err, nullptr );
+}
+
+
+/* Calculates a fair approximation of the inversion point */
+static NurbsVector3 cb_inversion_estimation
+    ( const NurbsControlBox* ffd
+    , const NurbsControlBoxIndex* index
+    , const NurbsVector3 p
+    )
+{
+    if (ffd->cp_length_u > 1 && ffd->cp_length_v > 1 && ffd->cp_length_w > 1){
+        return cb_inversion_estimation_xyz( ffd, index, p );
+    }
+    else{
+        return cb_inversion_estimation_2d( ffd, index, p );
+    }
+}
+
+
 /* Calculates the parametric values from the spatial coordinates.
- * First estimates an initial value and then runs a Newthon-Raphson. */
-NurbsVector3 nurbs_controlbox_inversion
+ * First estimates an initial value and then runs a Newthon-Raphson. 
+ * Returns also the total number of Newton iterations. 
+ * The index is optional (it can be nullptr). */
+static NurbsVector3 cb_inversion
     ( const NurbsControlBox* ffd
-    , const NurbsFloat x
-    , const NurbsFloat y
-    , const NurbsFloat z
+    , const NurbsControlBoxIndex* index
+    , const NurbsVector3 p
     , const NurbsFloat epsilon
     , NurbsFloat* err
+    , int* iterations
     )
 {
     NurbsVector3 t;
-    NurbsVector3 p = {x, y, z};
     NurbsFloat dist;
+    int it = 0, total = 0;
     int iu, iv, iw;
     int nu = 0, nv = 0, nw = 0;
     NurbsVector3 t0, t1;
@@ -1564,18 +1793,35 @@ NurbsVector3 nurbs_controlbox_inversion
         return t;
     }
 
-    if (ffd->cp_length_u > 1 && ffd->cp_length_v > 1 && ffd->cp_length_w > 1){
-        t = cb_inversion_estimation_xyz( ffd, p );
-    }
-    else{
-        t = cb_inversion_estimation_2d( ffd, p );
-    }
+    t = cb_inversion_estimation( ffd, index, p );
 
-    t = nurbs_controlbox_inversion_newton( ffd, p, t, epsilon, err );
+    t = cb_inversion_newton( ffd, p, t, epsilon, err, &total );
     if (*err < epsilon){
+        if (iterations != nullptr){
+            *iterations = total;
+        }
         return t;
     }
 
+    /* The cells of the index may miss the right one, try all of them */
+    if (index != nullptr){
+        t1 = cb_inversion_estimation( ffd, nullptr, p );
+        t1 = cb_inversion_newton( ffd, p, t1, epsilon, &dist, &it );
+        total += it;
+
+        if (dist < *err){
+            *err = dist;
+            t = t1;
+        }
+
+        if (*err < epsilon){
+            if (iterations != nullptr){
+                *iterations = total;
+            }
+            return t;
+        }
+    }
+
     if (ffd->basis_equation == 1){
         nu = ffd->order_u - 1;
         nv = ffd->order_v - 1;
@@ -1590,8 +1836,9 @@ NurbsVector3 nurbs_controlbox_inversion
                         t1.y = t0.y + (NurbsFloat)iv / (2 * (ffd->cp_length_v - 1));
                         t1.z = t0.z + (NurbsFloat)iw / (2 * (ffd->cp_length_w - 1));
 
-                        t1 = nurbs_controlbox_inversion_newton
-                            ( ffd, p, t1, epsilon, &dist );
+                        t1 = cb_inversion_newton
+                            ( ffd, p, t1, epsilon, &dist, &it );
+                        total += it;
 
                         if (dist < *err){
                             *err = dist;
@@ -1603,6 +1850,200 @@ NurbsVector3 nurbs_controlbox_inversion
         }
     }
 
+    if (iterations != nullptr){
+        *iterations = total;
+    }
+
     return t;
 }
 
+
+/* Calculates the parametric values from the spatial coordinates.
+ * First estimates an initial value and then runs a Newthon-Raphson. */
+NurbsVector3 nurbs_controlbox_inversion
+    ( const NurbsControlBox* ffd
+    , const NurbsFloat x
+    , const NurbsFloat y
+    , const NurbsFloat z
+    , const NurbsFloat epsilon
+    , NurbsFloat* err
+    )
+{
+    NurbsVector3 p = {x, y, z};
+
+    return cb_inversion( ffd, nullptr, p, epsilon, err, nullptr );
+}
+
+
+/* Calculates the parametric values from the spatial coordinates, using the
+ * spatial index to find the initial value. */
+NurbsVector3 nurbs_controlbox_index_inversion
+    ( const NurbsControlBoxIndex* index
+    , const NurbsControlBox* cb
+    , const NurbsVector3 p
+    , const NurbsFloat epsilon
+    , NurbsFloat* err
+    )
+{
+    return cb_inversion( cb, index, p, epsilon, err, nullptr );
+}
+
+
+/* Points of the batch inversion sorted along a space filling curve */
+typedef struct
+{
+    unsigned int key;   /* Morton code of the point */
+    int index;          /* Index of the point */
+}CbInversionKey;
+
+
+static int cb_inversion_key_compare( const void* a, const void* b )
+{
+    const unsigned int ka = ((const CbInversionKey*)a)->key;
+    const unsigned int kb = ((const CbInversionKey*)b)->key;
+
+    return (ka > kb) - (ka < kb);
+}
+
+
+/* Spreads the 10 lower bits of a integer to every third bit */
+static inline unsigned int cb_morton_spread( unsigned int a )
+{
+    a &= 0x3ff;
+    a = (a | (a << 16)) & 0x030000FF;
+    a = (a | (a << 8)) & 0x0300F00F;
+    a = (a | (a << 4)) & 0x030C30C3;
+    a = (a | (a << 2)) & 0x09249249;
+
+    return a;
+}
+
+
+/* Quantizes a coordinate to 10 bits inside the bounding box */
+static inline unsigned int cb_morton_coordinate
+    ( const NurbsFloat x, const NurbsFloat x0, const NurbsFloat scale )
+{
+    NurbsFloat q = (x - x0) * scale;
+
+    if (!(q > 0)){  /* Also NaN */
+        return 0;
+    }
+    if (q > 1023){
+        return 1023;
+    }
+    return (unsigned int)q;
+}
+
+
+/* Calculates the parametric values of an array of points.
+ * The points are sorted along a Morton curve and split in chunks of
+ * neighbour points. Each chunk is processed by one thread, and Newton 
+ * starts from the solution of the previous point of the chunk. The 
+ * estimation with the spatial index is only used if that fails. */
+int nurbs_controlbox_inversion_batch
+    ( NurbsVector3 param[]
+    , NurbsFloat err[]
+    , int iterations[]
+    , const NurbsControlBox* cb
+    , const NurbsVector3 points[]
+    , const int num_points
+    , const NurbsFloat epsilon
+    )
+{
+    const int chunk = 256;
+    int i, k, c, num_chunks, it, total, has_prev;
+    NurbsFloat dist, scale_x, scale_y, scale_z;
+    NurbsVector3 t, t_prev, p, pmin, pmax;
+    CbInversionKey* keys = nullptr;
+    NurbsControlBoxIndex index;
+
+    if (cb == nullptr || num_points < 0){
+        return 0;
+    }
+    if (num_points == 0){
+        return 1;
+    }
+
+    _check_(keys = (CbInversionKey*)_malloc_
+        (sizeof(CbInversionKey) * num_points));
+
+    if (keys == nullptr){
+        return 0;
+    }
+
+    /* Sort the points along a space filling curve of the bounding box */
+    pmin = points[0];
+    pmax = points[0];
+    for (i = 1; i < num_points; i++){
+        if (points[i].x < pmin.x) pmin.x = points[i].x;
+        if (points[i].y < pmin.y) pmin.y = points[i].y;
+        if (points[i].z < pmin.z) pmin.z = points[i].z;
+        if (points[i].x > pmax.x) pmax.x = points[i].x;
+        if (points[i].y > pmax.y) pmax.y = points[i].y;
+        if (points[i].z > pmax.z) pmax.z = points[i].z;
+    }
+
+    scale_x = (pmax.x > pmin.x) ? 1023 / (pmax.x - pmin.x) : 0;
+    scale_y = (pmax.y > pmin.y) ? 1023 / (pmax.y - pmin.y) : 0;
+    scale_z = (pmax.z > pmin.z) ? 1023 / (pmax.z - pmin.z) : 0;
+
+    for (i = 0; i < num_points; i++){
+        keys[i].index = i;
+        keys[i].key 
+            = cb_morton_spread( cb_morton_coordinate( points[i].x, pmin.x, scale_x ) )
+            | (cb_morton_spread( cb_morton_coordinate( points[i].y, pmin.y, scale_y ) ) << 1)
+            | (cb_morton_spread( cb_morton_coordinate( points[i].z, pmin.z, scale_z ) ) << 2);
+    }
+
+    qsort( keys, num_points, sizeof(CbInversionKey), cb_inversion_key_compare );
+
+    /* Without index (e.g. no memory) all the cells are tested */
+    nurbs_controlbox_index_init( &index );
+    nurbs_controlbox_index_build( &index, cb );
+
+    num_chunks = (num_points + chunk - 1) / chunk;
+
+    #pragma omp parallel for private(i, k, it, total, has_prev, dist, t, t_prev, p) schedule(dynamic, 1)
+    for (c = 0; c < num_chunks; c++){
+        has_prev = 0;
+        t_prev.x = t_prev.y = t_prev.z = 0;
+
+        for (k = c * chunk; k < num_points && k < (c + 1) * chunk; k++){
+            i = keys[k].index;
+            p = points[i];
+            total = 0;
+            dist = -1;
+
+            /* Warm start from the previous point */
+            if (has_prev){
+                t = cb_inversion_newton( cb, p, t_prev, epsilon, &dist, &it );
+                total = it;
+            }
+
+            if (!has_prev || !(dist < epsilon)){
+                t = cb_inversion
+                    ( cb, (index.num_nodes > 0) ? &index : nullptr
+                    , p, epsilon, &dist, &it );
+                total += it;
+            }
+
+            if (dist < epsilon){
+                t_prev = t;
+                has_prev = 1;
+            }
+
+            param[i] = t;
+            if (err != nullptr){
+                err[i] = dist;
+            }
+            if (iterations != nullptr){
+                iterations[i] = total;
+            }
+        }
+    }
+
+    nurbs_controlbox_index_dispose( &index );
+    free( keys );
+
+    return 1;
+}
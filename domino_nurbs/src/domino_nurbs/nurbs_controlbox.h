@@ -55,9 +55,50 @@ int nurbs_controlbox_basis_function
     , const int order           /** Order */
     , const int basis_equation  /** Basis equation (1:bezier 0:b-spline) */
     );
+
+/** Same as nurbs_controlbox_basis_function, but without the kernels 
+ *  specialized for order 1, 2 and 3 (they must give the same values). */
+int nurbs_controlbox_generic_basis_function
+    ( NurbsFloat basis[]        /** (out) Basis functions */
+    , const NurbsFloat t        /** Parameter value */
+    , const int num_cp          /** Number of control points */
+    , const int order           /** Order */
+    , const int basis_equation  /** Basis equation (1:bezier 0:b-spline) */
+    );
+
+/** Calculates only the basis functions that are not zero, basis[j] is the
+ *  basis of the control point iknot + j. The array must have room for 
+ *  NURBS_MAX_DEGREE + 2 values (a buffer in the stack is fine), so it does
+ *  not depend on the number of control points. Returns iknot. */
+int nurbs_controlbox_local_basis_function
+    ( NurbsFloat basis[]        /** (out) Non zero basis functions */
+    , const NurbsFloat t        /** Parameter value */
+    , const int num_cp          /** Number of control points */
+    , const int order           /** Order (up to NURBS_MAX_DEGREE) */
+    , const int basis_equation  /** Basis equation (1:bezier 0:b-spline) */
+    );
+
+/** Number of basis functions that are not zero for a parameter value, i.e.
+ *  the length of the window of nurbs_controlbox_local_basis_function. */
+int nurbs_controlbox_num_basis
+    ( const int order           /** Order */
+    , const int basis_equation  /** Basis equation (1:bezier 0:b-spline) */
+    );
+
+/** Same as nurbs_controlbox_local_basis_function with the derivatives. 
+ *  d_basis[j] is the derivative of basis[j]. */
+int nurbs_controlbox_local_d_basis_function
+    ( NurbsFloat d_basis[]      /** (out) Derivative of the non zero basis */
+    , NurbsFloat basis[]        /** (out) Non zero basis functions */
+    , const NurbsFloat t        /** Parameter value */
+    , const int num_cp          /** Number of control points */
+    , const int order           /** Order (up to NURBS_MAX_DEGREE) */
+    , const int basis_equation  /** Basis equation (1:bezier 0:b-spline) */
+    );
 #endif
 
-/** Calculates the point coordinates from the parametric coordinates */
+/** Calculates the point coordinates from the parametric coordinates. 
+ *  It does not allocate memory and it can be called from several threads. */
 NurbsVector3 nurbs_controlbox_get_point
     ( const NurbsControlBox* cb   /** Control box */
     , const NurbsFloat u    /** Parameter value */
@@ -119,6 +160,163 @@ NurbsVector3 nurbs_controlbox_inversion_newton
 
 #endif
 
+/** Calculates the parametric values of an array of points (in parallel).
+ *  Close points are processed together, and the Newton iterations start 
+ *  from the solution of a neighbour point; the full estimation of 
+ *  nurbs_controlbox_inversion() is used only when that fails.
+ *  err[i] is the distance of the inversion and iterations[i] the number of 
+ *  Newton iterations of each point (both can be nullptr).
+ *  Returns 1 on success, 0 on error (e.g. the memory is exhausted). */
+#ifndef SWIG 
+int nurbs_controlbox_inversion_batch
+    ( NurbsVector3 param[]          /** (out) Parametric values {u,v,w} */
+    , NurbsFloat err[]              /** (out) Error of each point */
+    , int iterations[]              /** (out) Iterations of each point */
+    , const NurbsControlBox* cb     /** Control box */
+    , const NurbsVector3 points[]   /** Points in the space */
+    , const int num_points          /** Number of points */
+    , const NurbsFloat epsilon      /** Tolerance */
+    );
+#endif
+
+/** Equivalent to a default constructor */
+void nurbs_controlbox_index_init( NurbsControlBoxIndex* index );
+
+/** Releases the memory of the index (but not the structure) */
+void nurbs_controlbox_index_dispose( NurbsControlBoxIndex* index );
+
+/** Builds the spatial index over the cells of the control box. 
+ *  Previous data of the index are released. The index belongs to the 
+ *  caller, as the bounding volume hierarchy of the surfaces; the control
+ *  box does not know about it, so nurbs_controlbox_index_refit() must be 
+ *  called after moving the control points.
+ *  Returns 1 on success, 0 on error (e.g. the memory is exhausted). */
+int nurbs_controlbox_index_build
+    ( NurbsControlBoxIndex* index   /** (out) Spatial index */
+    , const NurbsControlBox* cb     /** Control box */
+    );
+
+/** Updates the index after moving the control points in the range 
+ *  [iu0, iu1] x [iv0, iv1] x [iw0, iw1] (both included). Only the cells 
+ *  around those control points and their parents are refitted. 
+ *  Returns 0 if the box does not match the index. */
+#ifndef SWIG 
+int nurbs_controlbox_index_refit
+    ( NurbsControlBoxIndex* index   /** (in/out) Spatial index */
+    , const NurbsControlBox* cb     /** Control box */
+    , const int iu0, const int iu1  /** Moved control points in u */
+    , const int iv0, const int iv1  /** Moved control points in v */
+    , const int iw0, const int iw1  /** Moved control points in w */
+    );
+
+/** Finds the cells whose bounding box contains the point. The cell 
+ *  {cu, cv, cw} is returned as (cu * num_cells_v + cv) * num_cells_w + cw.
+ *  Returns the number of cells found, which can be greater than max_cells
+ *  (only the first max_cells are stored). */
+int nurbs_controlbox_index_query
+    ( int cells[]                       /** (out) Cells that contain p */
+    , const int max_cells               /** Size of cells[] */
+    , const NurbsControlBoxIndex* index /** Spatial index */
+    , const NurbsVector3 p              /** Point */
+    );
+
+/** Same as nurbs_controlbox_inversion(), but the initial guess is found 
+ *  with the spatial index. The index must be up to date with the control 
+ *  points; the brute force search is still used if the guess fails. */
+NurbsVector3 nurbs_controlbox_index_inversion
+    ( const NurbsControlBoxIndex* index /** Spatial index */
+    , const NurbsControlBox* cb         /** Control box */
+    , const NurbsVector3 p              /** Point */
+    , const NurbsFloat epsilon          /** Tolerance */
+    , NurbsFloat* err                   /** (out) Error of the inversion */
+    );
+#endif
+
+/** Equivalent to a default constructor */
+void nurbs_controlbox_weights_init( NurbsControlBoxWeights* weights );
+
+/** Releases the memory of the weights (but not the structure) */
+void nurbs_controlbox_weights_dispose( NurbsControlBoxWeights* weights );
+
+/** Calculates the non zero weights of the control points for the points with
+ *  parametric coordinates param[i] = {u,v,w}. Previous weights are released.
+ *  Returns 1 on success, 0 on error (e.g. the memory is exhausted). */
+#ifndef SWIG 
+int nurbs_controlbox_weights_compute
+    ( NurbsControlBoxWeights* weights /** (out) Sparse matrix of weights */
+    , const NurbsControlBox* cb       /** Control box */
+    , const NurbsVector3 param[]      /** Parametric coordinates {u,v,w} */
+    , const int num_points            /** Number of points */
+    );
+
+/** Embeds a set of points in the control box: finds the parametric 
+ *  coordinates of each point (see nurbs_controlbox_inversion_batch) and
+ *  calculates the weights.
+ *  err[i] is the distance of the inversion (it can be nullptr).
+ *  Returns 1 on success, 0 on error (e.g. the memory is exhausted). */
+int nurbs_controlbox_weights_embed
+    ( NurbsControlBoxWeights* weights /** (out) Sparse matrix of weights */
+    , const NurbsControlBox* cb       /** Control box */
+    , const NurbsVector3 points[]     /** Points to embed */
+    , const int num_points            /** Number of points */
+    , const NurbsFloat epsilon        /** Tolerance of the inversion */
+    , NurbsFloat err[]                /** (out) Error of each inversion */
+    );
+
+/** Calculates the deformed points with the present control points of the box
+ *  (a sparse matrix-vector product, in parallel). The result is the same 
+ *  as nurbs_controlbox_get_point() of each point. Points without weights 
+ *  get NURBS_ERROR_VALUE. Returns 0 if the box does not match the weights. */
+int nurbs_controlbox_weights_deform
+    ( NurbsVector3 points[]                 /** (out) Deformed points */
+    , const NurbsControlBoxWeights* weights /** Sparse matrix of weights */
+    , const NurbsControlBox* cb             /** Control box */
+    );
+
+/** Copies the weights in single precision, for the deformation with
+ *  nurbs_controlbox_weights_deform_single(). It must be called again if 
+ *  the weights are computed again. Returns 0 if there are no weights. */
+int nurbs_controlbox_weights_set_single
+    ( NurbsControlBoxWeights* weights       /** Sparse matrix of weights */
+    );
+
+/** The same as nurbs_controlbox_weights_deform() in single precision 
+ *  (e.g. for visualization). The points are stored as points[3*i + {0,1,2}].
+ *  Returns 0 if nurbs_controlbox_weights_set_single() was not called or
+ *  the box does not match the weights. */
+int nurbs_controlbox_weights_deform_single
+    ( float points[]                        /** (out) Deformed points */
+    , const NurbsControlBoxWeights* weights /** Sparse matrix of weights */
+    , const NurbsControlBox* cb             /** Control box */
+    );
+
+/** Calculates the support of each control point: the points that depend on
+ *  it, with their weights (the transpose of the sparse matrix), for the 
+ *  updates with nurbs_controlbox_weights_update(). It must be called again
+ *  if the weights are computed again. Returns 0 if there are no weights or
+ *  the memory is exhausted. */
+int nurbs_controlbox_weights_set_support
+    ( NurbsControlBoxWeights* weights       /** Sparse matrix of weights */
+    );
+
+/** Updates the deformed points when only some control points move: adds
+ *  weight * delta[m] to the points in the support of cp_index[m]. The cost
+ *  is proportional to the size of the supports, not to the number of 
+ *  points. The points must be the result of a previous deformation; many
+ *  updates accumulate round-off, which is removed with a new 
+ *  nurbs_controlbox_weights_deform(). Returns 0 if the support was not 
+ *  calculated or an index is out of range (then no point is modified). */
+int nurbs_controlbox_weights_update
+    ( NurbsVector3 points[]                 /** (in/out) Deformed points */
+    , const NurbsControlBoxWeights* weights /** Weights, with the supports */
+    , const int cp_index[]                  /** Index of the control points 
+                                              * that move, in cp_stream */
+    , const NurbsVector3 delta[]            /** Displacement of each one */
+    , const int num_moved                   /** Number of control points 
+                                              * that move */
+    );
+#endif
+
 #ifdef  __cplusplus
   }
 #endif
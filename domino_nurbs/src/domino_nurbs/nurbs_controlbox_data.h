@@ -46,6 +46,78 @@ typedef struct NurbsControlBox_
 }NurbsControlBox;
 
 
+/** Weights of the control points of a control box for a set of points, 
+  * stored as a sparse matrix (CSR). The point i is the sum of 
+  * weight[k] * cp_stream[index[k]] for k = row[i] .. row[i+1]-1.
+  * The deformation is linear in the control points, so the weights are 
+  * calculated once and any later position of the control points is a 
+  * sparse matrix-vector product.
+  */
+typedef struct NurbsControlBoxWeights_
+{
+    int num_points; /**< Number of points (rows). */
+    int num_cp;     /**< Number of control points of the box (columns). */
+    int num_weights;/**< Number of non zero weights. */
+
+    int* row;       /**< First weight of each point, num_points + 1 values. */
+    int* index;     /**< Index of the control point in cp_stream. */
+    NurbsFloat* weight; /**< Non zero weights. */
+
+    NurbsVector3* param; /**< Parametric coordinates {u,v,w} of the points. */
+
+    float* weight_single; /**< Weights in single precision (nullptr until
+                            * nurbs_controlbox_weights_set_single). */
+
+    int* support_row;   /**< First entry of the support of each control point,
+                          * num_cp + 1 values (nullptr until 
+                          * nurbs_controlbox_weights_set_support). */
+    int* support_point; /**< Points with a non zero weight of the control
+                          * point, from support_row[c] to support_row[c+1]-1.*/
+    NurbsFloat* support_weight; /**< Weight of the control point for each
+                          * point of its support. */
+
+}NurbsControlBoxWeights;
+
+
+/** Node of the hierarchy of bounding boxes of the cells of a control box.
+  * The cells are the hexahedra of eight neighbour control points.
+  */
+typedef struct NurbsControlBoxIndexNode_
+{
+    NurbsVector3 pmin;  /**< Lower corner of the bounding box. */
+    NurbsVector3 pmax;  /**< Upper corner of the bounding box. */
+
+    int cell_u0, cell_u1; /**< Range of cells [u0, u1) in the u direction. */
+    int cell_v0, cell_v1; /**< Range of cells [v0, v1) in the v direction. */
+    int cell_w0, cell_w1; /**< Range of cells [w0, w1) in the w direction. */
+
+    int left;   /**< First child, -1 for the leaves (a single cell). */
+    int right;  /**< Second child, -1 for the leaves. */
+
+}NurbsControlBoxIndexNode;
+
+
+/** Spatial index over the cells of a control box, used to find the initial
+  * guess of the inversion without testing every cell. The hierarchy splits 
+  * the cells by their indices, so the topology does not change when the 
+  * control points move and only the bounding boxes need to be refitted.
+  */
+typedef struct NurbsControlBoxIndex_
+{
+    int cp_length_u; /**< Control points of the box in the u direction. */
+    int cp_length_v; /**< Control points of the box in the v direction. */
+    int cp_length_w; /**< Control points of the box in the w direction. */
+
+    int num_cells_u; /**< Number of cells in the u direction. */
+    int num_cells_v; /**< Number of cells in the v direction. */
+    int num_cells_w; /**< Number of cells in the w direction. */
+
+    int num_nodes;  /**< Number of nodes, the root is the first one. */
+    NurbsControlBoxIndexNode* node; /**< Nodes of the hierarchy. */
+
+}NurbsControlBoxIndex;
+
+
 #endif /* _DOMINO_NURBS_CONTROLBOX_DATA_H */
 
 
@@ -0,0 +1,334 @@
+ /***
+    Author: Mario J. Martin <dominonurbs$gmail.com>
+
+    Spatial index over the cells of a control box.
+    The inversion needs an initial guess, which is found testing the cells
+    of the control points. Instead of testing all of them, a hierarchy of
+    bounding boxes returns the few cells that contain the point.
+    The hierarchy splits the cells by their indices, so the topology is
+    fixed and moving the control points only requires to refit the bounding
+    boxes of the cells around them.
+
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/check_malloc.h"
+#include "common/log.h"
+
+#include "nurbs_internal.h"
+#include "nurbs_controlbox.h"
+
+/* Maximum depth of the traversal of the hierarchy */
+#define INDEX_STACK_SIZE 64
+
+/* Relative enlargement of the bounding box of each cell */
+#define INDEX_CELL_MARGIN 0.05
+
+
+/* Expands the bounding box with a point */
+static inline void bounds_add
+    ( NurbsVector3* pmin, NurbsVector3* pmax, const NurbsVector3 p )
+{
+    if (p.x < pmin->x) pmin->x = p.x;
+    if (p.y < pmin->y) pmin->y = p.y;
+    if (p.z < pmin->z) pmin->z = p.z;
+    if (p.x > pmax->x) pmax->x = p.x;
+    if (p.y > pmax->y) pmax->y = p.y;
+    if (p.z > pmax->z) pmax->z = p.z;
+}
+
+
+/* Calculates the bounding box of the eight control points of a cell.
+ * If there is only one layer of control points in one direction, the cell
+ * is flat. The box is enlarged a bit, so points on the faces are not lost. */
+static void cell_bounds
+    ( NurbsControlBoxIndexNode* node
+    , const NurbsControlBox* cb
+    , const int cu, const int cv, const int cw
+    )
+{
+    int iu, iv, iw, iu1, iv1, iw1;
+    NurbsFloat margin, dx, dy, dz;
+
+    iu1 = (cu + 1 < cb->cp_length_u) ? cu + 1 : cu;
+    iv1 = (cv + 1 < cb->cp_length_v) ? cv + 1 : cv;
+    iw1 = (cw + 1 < cb->cp_length_w) ? cw + 1 : cw;
+
+    node->pmin = cb->cp[cu][cv][cw];
+    node->pmax = cb->cp[cu][cv][cw];
+
+    for (iu = cu; iu <= iu1; iu++){
+        for (iv = cv; iv <= iv1; iv++){
+            for (iw = cw; iw <= iw1; iw++){
+                bounds_add( &(node->pmin), &(node->pmax), cb->cp[iu][iv][iw] );
+            }
+        }
+    }
+
+    dx = node->pmax.x - node->pmin.x;
+    dy = node->pmax.y - node->pmin.y;
+    dz = node->pmax.z - node->pmin.z;
+
+    margin = dx;
+    if (dy > margin) margin = dy;
+    if (dz > margin) margin = dz;
+    margin *= INDEX_CELL_MARGIN;
+
+    node->pmin.x -= margin;
+    node->pmin.y -= margin;
+    node->pmin.z -= margin;
+    node->pmax.x += margin;
+    node->pmax.y += margin;
+    node->pmax.z += margin;
+}
+
+
+/* Builds the node and its children recursively.
+ * Returns the index of the next free node. */
+static int build_node
+    ( NurbsControlBoxIndex* index
+    , const NurbsControlBox* cb
+    , const int inode
+    , const int u0, const int u1
+    , const int v0, const int v1
+    , const int w0, const int w1
+    )
+{
+    NurbsControlBoxIndexNode* node = &(index->node[inode]);
+    int next = inode + 1;
+    int lu = u1 - u0, lv = v1 - v0, lw = w1 - w0;
+    int um, vm, wm;
+
+    node->cell_u0 = u0;
+    node->cell_u1 = u1;
+    node->cell_v0 = v0;
+    node->cell_v1 = v1;
+    node->cell_w0 = w0;
+    node->cell_w1 = w1;
+
+    if (lu == 1 && lv == 1 && lw == 1){
+        node->left = -1;
+        node->right = -1;
+        cell_bounds( node, cb, u0, v0, w0 );
+        return next;
+    }
+
+    /* Split the longest direction */
+    um = u1;
+    vm = v1;
+    wm = w1;
+    if (lu >= lv && lu >= lw){
+        um = u0 + lu / 2;
+    }
+    else if (lv >= lw){
+        vm = v0 + lv / 2;
+    }
+    else{
+        wm = w0 + lw / 2;
+    }
+
+    node->left = next;
+    next = build_node( index, cb, next, u0, um, v0, vm, w0, wm );
+
+    node->right = next;
+    next = build_node
+        ( index, cb, next
+        , (um < u1) ? um : u0, u1
+        , (vm < v1) ? vm : v0, v1
+        , (wm < w1) ? wm : w0, w1
+        );
+
+    node->pmin = index->node[node->left].pmin;
+    node->pmax = index->node[node->left].pmax;
+    bounds_add( &(node->pmin), &(node->pmax), index->node[node->right].pmin );
+    bounds_add( &(node->pmin), &(node->pmax), index->node[node->right].pmax );
+
+    return next;
+}
+
+
+/* Refits the nodes that contain any cell of the range (both included) */
+static void refit_node
+    ( NurbsControlBoxIndex* index
+    , const NurbsControlBox* cb
+    , const int inode
+    , const int u0, const int u1
+    , const int v0, const int v1
+    , const int w0, const int w1
+    )
+{
+    NurbsControlBoxIndexNode* node = &(index->node[inode]);
+
+    if (node->cell_u1 <= u0 || node->cell_u0 > u1
+        || node->cell_v1 <= v0 || node->cell_v0 > v1
+        || node->cell_w1 <= w0 || node->cell_w0 > w1)
+    {
+        return;
+    }
+
+    if (node->left < 0){
+        cell_bounds( node, cb, node->cell_u0, node->cell_v0, node->cell_w0 );
+        return;
+    }
+
+    refit_node( index, cb, node->left, u0, u1, v0, v1, w0, w1 );
+    refit_node( index, cb, node->right, u0, u1, v0, v1, w0, w1 );
+
+    node->pmin = index->node[node->left].pmin;
+    node->pmax = index->node[node->left].pmax;
+    bounds_add( &(node->pmin), &(node->pmax), index->node[node->right].pmin );
+    bounds_add( &(node->pmin), &(node->pmax), index->node[node->right].pmax );
+}
+
+
+/* Equivalent to a default constructor */
+void nurbs_controlbox_index_init( NurbsControlBoxIndex* index )
+{
+    index->cp_length_u = 0;
+    index->cp_length_v = 0;
+    index->cp_length_w = 0;
+
+    index->num_cells_u = 0;
+    index->num_cells_v = 0;
+    index->num_cells_w = 0;
+
+    index->num_nodes = 0;
+    index->node = nullptr;
+}
+
+
+/* Releases the memory of the index (but not the structure) */
+void nurbs_controlbox_index_dispose( NurbsControlBoxIndex* index )
+{
+    if (index == nullptr){
+        return;
+    }
+
+    if (index->node != nullptr){
+        free( index->node );
+    }
+
+    nurbs_controlbox_index_init( index );
+}
+
+
+/* Builds the spatial index over the cells of the control box */
+int nurbs_controlbox_index_build
+    ( NurbsControlBoxIndex* index
+    , const NurbsControlBox* cb
+    )
+{
+    int num_cells;
+
+    nurbs_controlbox_index_dispose( index );
+
+    if (cb == nullptr || cb->cp == nullptr || cb->cp_length_u <= 0
+        || cb->cp_length_v <= 0 || cb->cp_length_w <= 0)
+    {
+        return 0;
+    }
+
+    index->cp_length_u = cb->cp_length_u;
+    index->cp_length_v = cb->cp_length_v;
+    index->cp_length_w = cb->cp_length_w;
+
+    /* A single layer of control points is one flat cell */
+    index->num_cells_u = (cb->cp_length_u > 1) ? cb->cp_length_u - 1 : 1;
+    index->num_cells_v = (cb->cp_length_v > 1) ? cb->cp_length_v - 1 : 1;
+    index->num_cells_w = (cb->cp_length_w > 1) ? cb->cp_length_w - 1 : 1;
+
+    num_cells = index->num_cells_u * index->num_cells_v * index->num_cells_w;
+
+    _check_(index->node = (NurbsControlBoxIndexNode*)_malloc_
+        (sizeof(NurbsControlBoxIndexNode) * 2 * num_cells));
+
+    if (index->node == nullptr){
+        nurbs_controlbox_index_dispose( index );
+        return 0;
+    }
+
+    index->num_nodes = build_node
+        ( index, cb, 0
+        , 0, index->num_cells_u
+        , 0, index->num_cells_v
+        , 0, index->num_cells_w
+        );
+
+    return 1;
+}
+
+
+/* Updates the bounding boxes after moving some control points */
+int nurbs_controlbox_index_refit
+    ( NurbsControlBoxIndex* index
+    , const NurbsControlBox* cb
+    , const int iu0, const int iu1
+    , const int iv0, const int iv1
+    , const int iw0, const int iw1
+    )
+{
+    if (index == nullptr || cb == nullptr || index->num_nodes == 0){
+        return 0;
+    }
+
+    if (index->cp_length_u != cb->cp_length_u
+        || index->cp_length_v != cb->cp_length_v
+        || index->cp_length_w != cb->cp_length_w)
+    {
+        _handle_error_("The control box does not match the index");
+        return 0;
+    }
+
+    /* The control point {iu, iv, iw} belongs to the cells iu-1 and iu */
+    refit_node( index, cb, 0, iu0 - 1, iu1, iv0 - 1, iv1, iw0 - 1, iw1 );
+
+    return 1;
+}
+
+
+/* Finds the cells whose bounding box contains the point */
+int nurbs_controlbox_index_query
+    ( int cells[]
+    , const int max_cells
+    , const NurbsControlBoxIndex* index
+    , const NurbsVector3 p
+    )
+{
+    int stack[INDEX_STACK_SIZE];
+    int top = 0, count = 0;
+    const NurbsControlBoxIndexNode* node;
+
+    if (index == nullptr || index->num_nodes == 0){
+        return 0;
+    }
+
+    stack[top++] = 0;
+    while (top > 0){
+        node = &(index->node[stack[--top]]);
+
+        if (p.x < node->pmin.x || p.x > node->pmax.x
+            || p.y < node->pmin.y || p.y > node->pmax.y
+            || p.z < node->pmin.z || p.z > node->pmax.z)
+        {
+            continue;
+        }
+
+        if (node->left < 0){
+            if (count < max_cells){
+                cells[count] = (node->cell_u0 * index->num_cells_v
+                    + node->cell_v0) * index->num_cells_w + node->cell_w0;
+            }
+            count++;
+        }
+        else if (top + 2 <= INDEX_STACK_SIZE){
+            stack[top++] = node->right;
+            stack[top++] = node->left;
+        }
+    }
+
+    return count;
+}
+
+/**/
@@ -0,0 +1,437 @@
+ /***
+    Author: Mario J. Martin <dominonurbs$gmail.com>
+
+    Free form deformation of large sets of points.
+    The deformation is linear in the control points of the box, so the
+    weights of each point are calculated only once and stored as a sparse
+    matrix (CSR). Moving the control points only requires a sparse
+    matrix-vector product.
+    When only a few control points move (e.g. finite differences of each
+    control point), the transpose of the matrix gives the support of each
+    control point: the points with a non zero weight. Then only these 
+    points are updated, with the displacement of the control point.
+
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/check_malloc.h"
+#include "common/log.h"
+
+#include "nurbs_internal.h"
+#include "nurbs_controlbox.h"
+
+/* Minimum size of a support that is updated in parallel */
+#define SUPPORT_PARALLEL_MIN 4096
+
+/* Calculates the non zero weights of one point, in the same order as in
+ * nurbs_controlbox_get_point(). If weight is nullptr, only counts them.
+ * Returns the number of weights, or -1 if the point cannot be evaluated. */
+static int point_weights
+    ( int index[]               /* (out) Index of the control points */
+    , NurbsFloat weight[]       /* (out) Weights */
+    , const NurbsControlBox* cb /* Control box */
+    , const NurbsVector3 t      /* Parametric coordinates */
+    )
+{
+    int iknu, iknv, iknw;
+    int iu, iv, iw;
+    int nu, nv, nw;
+    int count = 0;
+    NurbsFloat buvw;
+    NurbsFloat basis_u[NURBS_MAX_DEGREE + 2];
+    NurbsFloat basis_v[NURBS_MAX_DEGREE + 2];
+    NurbsFloat basis_w[NURBS_MAX_DEGREE + 2];
+
+    iknu = nurbs_controlbox_local_basis_function
+        ( basis_u, t.x, cb->cp_length_u, cb->order_u, cb->basis_equation );
+
+    iknv = nurbs_controlbox_local_basis_function
+        ( basis_v, t.y, cb->cp_length_v, cb->order_v, cb->basis_equation );
+
+    iknw = nurbs_controlbox_local_basis_function
+        ( basis_w, t.z, cb->cp_length_w, cb->order_w, cb->basis_equation );
+
+    if (iknu < 0 || iknv < 0 || iknw < 0){
+        return -1;
+    }
+
+    nu = nurbs_controlbox_num_basis( cb->order_u, cb->basis_equation );
+    nv = nurbs_controlbox_num_basis( cb->order_v, cb->basis_equation );
+    nw = nurbs_controlbox_num_basis( cb->order_w, cb->basis_equation );
+
+    for (iu = 0; iu < nu; iu++){
+        for (iv = 0; iv < nv; iv++){
+            for (iw = 0; iw < nw; iw++){
+                buvw = basis_u[iu] * basis_v[iv] * basis_w[iw];
+                if (buvw == 0){
+                    continue;
+                }
+
+                if (weight != nullptr){
+                    /* Same layout as cp[u][v][w] on cp_stream */
+                    index[count] = ((iu + iknu) * cb->cp_length_v + iv + iknv)
+                        * cb->cp_length_w + iw + iknw;
+                    weight[count] = buvw;
+                }
+                count++;
+            }
+        }
+    }
+
+    return count;
+}
+
+
+/* Equivalent to a default constructor */
+void nurbs_controlbox_weights_init( NurbsControlBoxWeights* weights )
+{
+    weights->num_points = 0;
+    weights->num_cp = 0;
+    weights->num_weights = 0;
+
+    weights->row = nullptr;
+    weights->index = nullptr;
+    weights->weight = nullptr;
+    weights->param = nullptr;
+    weights->weight_single = nullptr;
+
+    weights->support_row = nullptr;
+    weights->support_point = nullptr;
+    weights->support_weight = nullptr;
+}
+
+
+/* Releases the memory of the weights (but not the structure) */
+void nurbs_controlbox_weights_dispose( NurbsControlBoxWeights* weights )
+{
+    if (weights == nullptr){
+        return;
+    }
+
+    if (weights->row != nullptr){
+        free( weights->row );
+    }
+    if (weights->index != nullptr){
+        free( weights->index );
+    }
+    if (weights->weight != nullptr){
+        free( weights->weight );
+    }
+    if (weights->param != nullptr){
+        free( weights->param );
+    }
+    if (weights->weight_single != nullptr){
+        free( weights->weight_single );
+    }
+    if (weights->support_row != nullptr){
+        free( weights->support_row );
+    }
+    if (weights->support_point != nullptr){
+        free( weights->support_point );
+    }
+    if (weights->support_weight != nullptr){
+        free( weights->support_weight );
+    }
+
+    nurbs_controlbox_weights_init( weights );
+}
+
+
+/* Calculates the non zero weights of the control points for a set of
+ * points with known parametric coordinates. */
+int nurbs_controlbox_weights_compute
+    ( NurbsControlBoxWeights* weights
+    , const NurbsControlBox* cb
+    , const NurbsVector3 param[]
+    , const int num_points
+    )
+{
+    int i, n;
+
+    nurbs_controlbox_weights_dispose( weights );
+
+    if (cb == nullptr || num_points < 0){
+        return 0;
+    }
+
+    if (cb->order_u > NURBS_MAX_DEGREE || cb->order_v > NURBS_MAX_DEGREE
+        || cb->order_w > NURBS_MAX_DEGREE)
+    {
+        _handle_error_("Control box order is greater than NURBS_MAX_DEGREE");
+        return 0;
+    }
+
+    _check_(weights->row = (int*)_malloc_(sizeof(int) * (num_points + 1)));
+    _check_(weights->param = (NurbsVector3*)_malloc_
+        (sizeof(NurbsVector3) * (num_points + 1)));
+
+    if (weights->row == nullptr || weights->param == nullptr){
+        nurbs_controlbox_weights_dispose( weights );
+        return 0;
+    }
+
+    weights->num_points = num_points;
+    weights->num_cp = cb->cp_length_u * cb->cp_length_v * cb->cp_length_w;
+    memcpy( weights->param, param, sizeof(NurbsVector3) * num_points );
+
+    /* Count the weights of each point */
+    weights->row[0] = 0;
+    #pragma omp parallel for private(n) schedule(static)
+    for (i = 0; i < num_points; i++){
+        n = point_weights( nullptr, nullptr, cb, param[i] );
+        weights->row[i + 1] = (n > 0) ? n : 0;
+    }
+
+    for (i = 0; i < num_points; i++){
+        weights->row[i + 1] += weights->row[i];
+    }
+    weights->num_weights = weights->row[num_points];
+
+    _check_(weights->index = (int*)_malloc_
+        (sizeof(int) * (weights->num_weights + 1)));
+    _check_(weights->weight = (NurbsFloat*)_malloc_
+        (sizeof(NurbsFloat) * (weights->num_weights + 1)));
+
+    if (weights->index == nullptr || weights->weight == nullptr){
+        nurbs_controlbox_weights_dispose( weights );
+        return 0;
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (i = 0; i < num_points; i++){
+        if (weights->row[i + 1] > weights->row[i]){
+            point_weights( &(weights->index[weights->row[i]])
+                , &(weights->weight[weights->row[i]]), cb, param[i] );
+        }
+    }
+
+    return 1;
+}
+
+
+/* Finds the parametric coordinates of a set of points and calculates their
+ * weights. */
+int nurbs_controlbox_weights_embed
+    ( NurbsControlBoxWeights* weights
+    , const NurbsControlBox* cb
+    , const NurbsVector3 points[]
+    , const int num_points
+    , const NurbsFloat epsilon
+    , NurbsFloat err[]
+    )
+{
+    int status;
+    NurbsVector3* param = nullptr;
+
+    if (cb == nullptr || num_points < 0){
+        nurbs_controlbox_weights_dispose( weights );
+        return 0;
+    }
+
+    _check_(param = (NurbsVector3*)_malloc_
+        (sizeof(NurbsVector3) * (num_points + 1)));
+
+    if (param == nullptr){
+        nurbs_controlbox_weights_dispose( weights );
+        return 0;
+    }
+
+    status = nurbs_controlbox_inversion_batch
+        ( param, err, nullptr, cb, points, num_points, epsilon );
+
+    if (status){
+        status = nurbs_controlbox_weights_compute
+            ( weights, cb, param, num_points );
+    }
+    else{
+        nurbs_controlbox_weights_dispose( weights );
+    }
+
+    free( param );
+
+    return status;
+}
+
+
+/* Calculates the deformed points: sparse matrix-vector product of the
+ * weights with the control points of the box. */
+int nurbs_controlbox_weights_deform
+    ( NurbsVector3 points[]
+    , const NurbsControlBoxWeights* weights
+    , const NurbsControlBox* cb
+    )
+{
+    int i, k;
+    NurbsFloat b;
+    NurbsVector3 p;
+    const NurbsVector3* cp;
+    const int* row;
+    const int* index;
+    const NurbsFloat* weight;
+
+    if (weights == nullptr || cb == nullptr){
+        return 0;
+    }
+
+    if (weights->num_cp != cb->cp_length_u * cb->cp_length_v * cb->cp_length_w){
+        _handle_error_("The control box does not match the weights");
+        return 0;
+    }
+
+    cp = cb->cp_stream;
+    row = weights->row;
+    index = weights->index;
+    weight = weights->weight;
+
+    #pragma omp parallel for private(k, b, p) schedule(static)
+    for (i = 0; i < weights->num_points; i++){
+        if (row[i + 1] == row[i]){
+            p.x = NURBS_ERROR_VALUE;
+            p.y = NURBS_ERROR_VALUE;
+            p.z = NURBS_ERROR_VALUE;
+        }
+        else{
+            p.x = 0;
+            p.y = 0;
+            p.z = 0;
+            for (k = row[i]; k < row[i + 1]; k++){
+                b = weight[k];
+                p.x += b * cp[index[k]].x;
+                p.y += b * cp[index[k]].y;
+                p.z += b * cp[index[k]].z;
+            }
+        }
+        points[i] = p;
+    }
+
+    return 1;
+}
+
+
+/* Calculates the support of each control point: the transpose of the 
+ * sparse matrix of weights. */
+int nurbs_controlbox_weights_set_support( NurbsControlBoxWeights* weights )
+{
+    int i, k, c;
+    int* next;
+
+    if (weights == nullptr || weights->row == nullptr){
+        return 0;
+    }
+
+    if (weights->support_row != nullptr){
+        free( weights->support_row );
+    }
+    if (weights->support_point != nullptr){
+        free( weights->support_point );
+    }
+    if (weights->support_weight != nullptr){
+        free( weights->support_weight );
+    }
+
+    _check_(weights->support_row = (int*)_calloc_
+        (weights->num_cp + 1, sizeof(int)));
+    _check_(weights->support_point = (int*)_malloc_
+        (sizeof(int) * (weights->num_weights + 1)));
+    _check_(weights->support_weight = (NurbsFloat*)_malloc_
+        (sizeof(NurbsFloat) * (weights->num_weights + 1)));
+    _check_(next = (int*)_malloc_(sizeof(int) * (weights->num_cp + 1)));
+
+    if (weights->support_row == nullptr || weights->support_point == nullptr
+        || weights->support_weight == nullptr || next == nullptr)
+    {
+        if (next != nullptr){
+            free( next );
+        }
+        free( weights->support_row );
+        free( weights->support_point );
+        free( weights->support_weight );
+        weights->support_row = nullptr;
+        weights->support_point = nullptr;
+        weights->support_weight = nullptr;
+        return 0;
+    }
+
+    /* Count the points of each control point */
+    for (k = 0; k < weights->num_weights; k++){
+        weights->support_row[weights->index[k] + 1]++;
+    }
+    for (c = 0; c < weights->num_cp; c++){
+        weights->support_row[c + 1] += weights->support_row[c];
+        next[c] = weights->support_row[c];
+    }
+
+    /* The points of each support are sorted */
+    for (i = 0; i < weights->num_points; i++){
+        for (k = weights->row[i]; k < weights->row[i + 1]; k++){
+            c = weights->index[k];
+            weights->support_point[next[c]] = i;
+            weights->support_weight[next[c]] = weights->weight[k];
+            next[c]++;
+        }
+    }
+
+    free( next );
+
+    return 1;
+}
+
+
+/* Updates the deformed points with the displacements of some control 
+ * points. Only the points in their supports are modified. */
+int nurbs_controlbox_weights_update
+    ( NurbsVector3 points[]
+    , const NurbsControlBoxWeights* weights
+    , const int cp_index[]
+    , const NurbsVector3 delta[]
+    , const int num_moved
+    )
+{
+    int m, k, k0, k1;
+    NurbsVector3 d;
+    NurbsFloat b;
+    const int* point;
+    const NurbsFloat* weight;
+
+    if (weights == nullptr || weights->support_row == nullptr){
+        _handle_error_("The support of the control points is not calculated");
+        return 0;
+    }
+
+    for (m = 0; m < num_moved; m++){
+        if (cp_index[m] < 0 || cp_index[m] >= weights->num_cp){
+            _handle_error_("Index out of the range of the control points");
+            return 0;
+        }
+    }
+
+    point = weights->support_point;
+    weight = weights->support_weight;
+
+    /* A point may be in several supports, so the control points are 
+     * updated one after the other; the points of one support are unique */
+    for (m = 0; m < num_moved; m++){
+        d = delta[m];
+        if (d.x == 0 && d.y == 0 && d.z == 0){
+            continue;
+        }
+
+        k0 = weights->support_row[cp_index[m]];
+        k1 = weights->support_row[cp_index[m] + 1];
+
+        #pragma omp parallel for private(b) schedule(static) \
+            if (k1 - k0 > SUPPORT_PARALLEL_MIN)
+        for (k = k0; k < k1; k++){
+            b = weight[k];
+            points[point[k]].x += b * d.x;
+            points[point[k]].y += b * d.y;
+            points[point[k]].z += b * d.z;
+        }
+    }
+
+    return 1;
+}
+
+/**/
@@ -294,3 +294,113 @@ void nurbs_curve_get_derivatives
     deriv->z = (deriv->z * norm - point->z * dNorm) / (norm * norm);
 }
 
+
+/* Point and, optionally, the first and second derivatives of the curve, 
+ * with the buffers in the stack, so it is reentrant (the other curve
+ * routines use the buffers of the curve). The derivatives vanish at the 
+ * last knot, so they are calculated a tiny bit before it. */
+void nurbs_curve_get_local_derivatives
+    ( NurbsVector3* point
+    , NurbsVector3* d1
+    , NurbsVector3* d2
+    , const NurbsCurve* curve
+    , NurbsFloat t
+    )
+{
+    NurbsFloat basis[NURBS_MAX_DEGREE + 2];
+    NurbsFloat d_basis[NURBS_MAX_DEGREE + 2];
+    NurbsFloat d2_basis[NURBS_MAX_DEGREE + 2];
+    NurbsFloat gw, w = 0, dw = 0, d2w = 0;
+    NurbsVector3 a, da, d2a;
+    NurbsFloat tL;
+    int i, j0, j1, first;
+
+    if (d2 != nullptr || d1 != nullptr){
+        tL = curve->knot[curve->cp_length];
+        if (t >= tL){
+            t = tL - (tL - curve->knot[curve->cp_length - 1]) * 1e-12;
+        }
+    }
+
+    if (d2 != nullptr){
+        first = nurbs_basis_local_second_derivate_function
+            ( d2_basis, d_basis, basis, t
+            , curve->degree, curve->knot, curve->knot_length );
+    }
+    else if (d1 != nullptr){
+        first = nurbs_basis_local_derivate_function
+            ( d_basis, basis, t, curve->degree, curve->knot, curve->knot_length );
+    }
+    else{
+        first = nurbs_basis_local_function
+            ( basis, t, curve->degree, curve->knot, curve->knot_length );
+    }
+
+    /* Range of the local basis with actual control points */
+    j0 = (first < 0) ? -first : 0;
+    j1 = curve->cp_length - 1 - first;
+    if (j1 > curve->degree){
+        j1 = curve->degree;
+    }
+
+    a.x = a.y = a.z = 0;
+    da.x = da.y = da.z = 0;
+    d2a.x = d2a.y = d2a.z = 0;
+
+    for (i = j0; i <= j1; i++){
+        const NurbsVector4 cp = curve->cp[first + i];
+
+        gw = basis[i] * cp.w;
+        a.x += gw * cp.x;
+        a.y += gw * cp.y;
+        a.z += gw * cp.z;
+        w += gw;
+
+        if (d1 != nullptr || d2 != nullptr){
+            gw = d_basis[i] * cp.w;
+            da.x += gw * cp.x;
+            da.y += gw * cp.y;
+            da.z += gw * cp.z;
+            dw += gw;
+        }
+
+        if (d2 != nullptr){
+            gw = d2_basis[i] * cp.w;
+            d2a.x += gw * cp.x;
+            d2a.y += gw * cp.y;
+            d2a.z += gw * cp.z;
+            d2w += gw;
+        }
+    }
+
+    if (w == 0){
+        point->x = point->y = point->z = NURBS_ERROR_VALUE;
+        if (d1 != nullptr){
+            d1->x = d1->y = d1->z = 0;
+        }
+        if (d2 != nullptr){
+            d2->x = d2->y = d2->z = 0;
+        }
+        return;
+    }
+
+    point->x = a.x / w;
+    point->y = a.y / w;
+    point->z = a.z / w;
+
+    /* C' = (A' - w' C) / w;  C'' = (A'' - 2 w' C' - w'' C) / w */
+    da.x = (da.x - dw * point->x) / w;
+    da.y = (da.y - dw * point->y) / w;
+    da.z = (da.z - dw * point->z) / w;
+
+    if (d1 != nullptr){
+        *d1 = da;
+    }
+    if (d2 != nullptr){
+        d2->x = (d2a.x - 2 * dw * da.x - d2w * point->x) / w;
+        d2->y = (d2a.y - 2 * dw * da.y - d2w * point->y) / w;
+        d2->z = (d2a.z - 2 * dw * da.z - d2w * point->z) / w;
+    }
+}
+
+/**/
@@ -119,6 +119,141 @@ void nurbs_curve_get_derivatives
     );
 #endif
 
+/*******************************************************************************
+*  Description:
+*    Gets the points of an array of parameters, in parallel. Unlike 
+*    nurbs_curve_get_point(), it does not use the buffers of the curve, so
+*    it is thread safe.
+*  Return Values:
+*    integer
+*  @return 1 on success; 0 if the curve is not valid.
+*******************************************************************************/
+#ifndef SWIG 
+int nurbs_curve_get_points
+    ( NurbsVector3 points[]     /** (out) Point coordinates {x, y, z} */
+    , const NurbsCurve* curve   /** Pointer to the NURBS data structure */
+    , const NurbsFloat t[]      /** Parameters */
+    , const int length          /** Number of points */
+    );
+#endif
+
+/*******************************************************************************
+*  Description:
+*    Gets the points and the derivatives of an array of parameters, in 
+*    parallel. The points are optional (nullptr).
+*  Return Values:
+*    integer
+*  @return 1 on success; 0 if the curve is not valid.
+*******************************************************************************/
+#ifndef SWIG 
+int nurbs_curve_get_points_derivatives
+    ( NurbsVector3 deriv[]      /** (out) Derivative coordinates {x, y, z} */
+    , NurbsVector3 points[]     /** (out) Point coordinates (or nullptr) */
+    , const NurbsCurve* curve   /** Pointer to the NURBS data structure */
+    , const NurbsFloat t[]      /** Parameters */
+    , const int length          /** Number of points */
+    );
+#endif
+
+/*******************************************************************************
+*  Description:
+*     Equivalent to a default constructor of the arc length table, and the
+*     release of its memory (but not the structure).
+*******************************************************************************/
+void nurbs_curve_arclength_init( NurbsCurveArcLength* table );
+void nurbs_curve_arclength_dispose( NurbsCurveArcLength* table );
+
+/*******************************************************************************
+*  Description:
+*    Builds the arc length table of the curve. Each knot span is split until
+*    the Gauss quadrature of the halves differs from the whole less than the
+*    relative tolerance (e.g. 1e-10). It must be built again if the curve
+*    changes.
+*  Return Values:
+*    integer
+*  @return 1 on success; 0 if the curve is not valid or the memory is 
+*    exhausted.
+*******************************************************************************/
+int nurbs_curve_arclength_build
+    ( NurbsCurveArcLength* table    /** (out) Arc length table */
+    , const NurbsCurve* curve       /** Pointer to the NURBS data structure */
+    , const NurbsFloat tolerance    /** Relative tolerance of the lengths */
+    );
+
+/*******************************************************************************
+*  Description:
+*    Gets the parameter of the point at the arc length s from the start of
+*    the curve: a binary search in the table and Newton iterations in the
+*    segment. The length is clamped to [0, table->total].
+*  Return Values:
+*    NurbsFloat
+*  @return the parameter; NURBS_ERROR_VALUE if the table is empty.
+*******************************************************************************/
+NurbsFloat nurbs_curve_arclength_parameter
+    ( const NurbsCurveArcLength* table  /** Arc length table */
+    , const NurbsCurve* curve           /** Curve of the table */
+    , const NurbsFloat s                /** Arc length */
+    );
+
+/*******************************************************************************
+*  Description:
+*    Same as nurbs_curve_arclength_parameter() for an array of arc lengths,
+*    in parallel.
+*  Return Values:
+*    integer
+*  @return 1 on success; 0 if the table is empty or does not match the curve.
+*******************************************************************************/
+#ifndef SWIG 
+int nurbs_curve_arclength_parameters
+    ( NurbsFloat t[]                    /** (out) Parameters */
+    , const NurbsCurveArcLength* table  /** Arc length table */
+    , const NurbsCurve* curve           /** Curve of the table */
+    , const NurbsFloat s[]              /** Arc lengths */
+    , const int length                  /** Number of points */
+    );
+#endif
+
+/*******************************************************************************
+*  Description:
+*    Gets points equally spaced along the curve, the first and the last ones
+*    at the ends. Both the points and the parameters are optional (nullptr).
+*  Return Values:
+*    integer
+*  @return 1 on success; 0 if the table is empty or does not match the curve.
+*******************************************************************************/
+#ifndef SWIG 
+int nurbs_curve_get_uniform_points
+    ( NurbsVector3 points[]             /** (out) Points (or nullptr) */
+    , NurbsFloat t[]                    /** (out) Parameters (or nullptr) */
+    , const NurbsCurveArcLength* table  /** Arc length table */
+    , const NurbsCurve* curve           /** Curve of the table */
+    , const int num_points              /** Number of points (at least 2) */
+    );
+#endif
+
+/*******************************************************************************
+*  Description:
+*    Projects an array of points onto the curve (closest points), in 
+*    parallel. Each point starts the Newton iterations from the solution of
+*    the previous one, so neighbouring nodes (e.g. along a boundary) should be
+*    consecutive. The knot spans whose control points are farther than this 
+*    first solution are discarded; the other ones are searched again. 
+*    The distances are optional (nullptr).
+*  Return Values:
+*    integer
+*  @return 1 on success; 0 if the curve is not valid or the memory is 
+*    exhausted.
+*******************************************************************************/
+#ifndef SWIG 
+int nurbs_curve_projection
+    ( NurbsFloat t[]                /** (out) Parameters of the projections */
+    , NurbsFloat distance[]         /** (out) Distances to the curve */
+    , const NurbsCurve* curve       /** Pointer to the NURBS data structure */
+    , const NurbsVector3 points[]   /** Coordinates of the points */
+    , const int length              /** Number of points */
+    );
+#endif
+
 #ifdef  __cplusplus
   }
 #endif
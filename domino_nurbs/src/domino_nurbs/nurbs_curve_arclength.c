@@ -0,0 +1,441 @@
+ /***
+    Author: Mario J. Martin <dominonurbs$gmail.com>
+
+    Evaluation of many points of a NURBS curve at once, and arc length
+    parametrization of NURBS curves.
+    The length of each knot span is integrated with Gauss quadrature, and
+    the spans are split until the quadrature of the halves agrees with the
+    quadrature of the whole. The lengths at the ends of the segments are
+    stored, so the parameter of any arc length is found with a binary
+    search and a few Newton iterations inside one segment, instead of
+    integrating the curve from the start each time.
+
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "common/check_malloc.h"
+#include "common/log.h"
+
+#include "nurbs_internal.h"
+#include "nurbs_basis.h"
+#include "nurbs_curve.h"
+
+/* Maximum number of bisections of a knot span */
+#define ARCLENGTH_MAX_DEPTH 20
+
+/* Maximum number of Newton iterations of the inverse */
+#define ARCLENGTH_MAX_IT 16
+
+/* Stop condition of the inverse, relative to the segment */
+#define ARCLENGTH_EPSILON 1e-13
+
+/* Gauss-Legendre quadrature of 5 points in [-1, 1] */
+static const NurbsFloat gauss_x[5] =
+    { -0.906179845938663992797626878299
+    , -0.538469310105683091036314420700
+    , 0
+    , 0.538469310105683091036314420700
+    , 0.906179845938663992797626878299
+    };
+
+static const NurbsFloat gauss_w[5] =
+    { 0.236926885056189087514264040720
+    , 0.478628670499366468041291514836
+    , 0.568888888888888888888888888889
+    , 0.478628670499366468041291514836
+    , 0.236926885056189087514264040720
+    };
+
+
+/* Checks that the basis fit in the local buffers */
+static inline int check_degree( const NurbsCurve* curve )
+{
+    if (curve->degree > NURBS_MAX_DEGREE){
+        _handle_error_("NURBS curve degree is greater than NURBS_MAX_DEGREE");
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/* Speed |C'(t)| of the curve */
+static inline NurbsFloat curve_speed( const NurbsCurve* curve, const NurbsFloat t )
+{
+    NurbsVector3 p, d;
+
+    nurbs_curve_get_local_derivatives( &p, &d, nullptr, curve, t );
+
+    return sqrt( d.x * d.x + d.y * d.y + d.z * d.z );
+}
+
+
+/* Length of the curve between a and b (Gauss quadrature) */
+static NurbsFloat gauss_length
+    ( const NurbsCurve* curve
+    , const NurbsFloat a
+    , const NurbsFloat b
+    )
+{
+    const NurbsFloat h = (b - a) / 2;
+    const NurbsFloat m = (a + b) / 2;
+    NurbsFloat length = 0;
+    int k;
+
+    for (k = 0; k < 5; k++){
+        length += gauss_w[k] * curve_speed( curve, m + h * gauss_x[k] );
+    }
+
+    return length * h;
+}
+
+
+/* Appends a segment to the table. Returns 0 if the memory is exhausted. */
+static int add_segment
+    ( NurbsCurveArcLength* table
+    , int* max_segments
+    , const NurbsFloat t1
+    , const NurbsFloat length
+    )
+{
+    NurbsFloat* t;
+    NurbsFloat* l;
+    int max;
+
+    if (table->num_segments + 1 >= *max_segments){
+        max = 2 * (*max_segments);
+        _check_(t = (NurbsFloat*)_realloc_(table->t, sizeof(NurbsFloat) * max));
+        if (t != nullptr){
+            table->t = t;
+        }
+        _check_(l = (NurbsFloat*)_realloc_(table->length, sizeof(NurbsFloat) * max));
+        if (l != nullptr){
+            table->length = l;
+        }
+        if (t == nullptr || l == nullptr){
+            return 0;
+        }
+        *max_segments = max;
+    }
+
+    table->num_segments++;
+    table->t[table->num_segments] = t1;
+    table->length[table->num_segments] = table->length[table->num_segments - 1]
+        + length;
+
+    return 1;
+}
+
+
+/* Splits the interval [a, b] until the quadrature converges, and appends
+ * the segments to the table. Returns 0 if the memory is exhausted. */
+static int adaptive_segments
+    ( NurbsCurveArcLength* table
+    , int* max_segments
+    , const NurbsCurve* curve
+    , const NurbsFloat a
+    , const NurbsFloat b
+    , const NurbsFloat length
+    , const NurbsFloat tolerance
+    , const int depth
+    )
+{
+    const NurbsFloat m = (a + b) / 2;
+    const NurbsFloat l1 = gauss_length( curve, a, m );
+    const NurbsFloat l2 = gauss_length( curve, m, b );
+
+    if (fabs( l1 + l2 - length ) <= tolerance * (l1 + l2)
+        || depth >= ARCLENGTH_MAX_DEPTH)
+    {
+        return add_segment( table, max_segments, m, l1 )
+            && add_segment( table, max_segments, b, l2 );
+    }
+
+    return adaptive_segments( table, max_segments, curve, a, m, l1, tolerance, depth + 1 )
+        && adaptive_segments( table, max_segments, curve, m, b, l2, tolerance, depth + 1 );
+}
+
+
+/* Gets the points of an array of parameters */
+int nurbs_curve_get_points
+    ( NurbsVector3 points[]
+    , const NurbsCurve* curve
+    , const NurbsFloat t[]
+    , const int length
+    )
+{
+    int i;
+
+    if (curve == nullptr || curve->cp == nullptr || !check_degree( curve )){
+        return 0;
+    }
+
+    #pragma omp parallel for schedule(static) if (length > 256)
+    for (i = 0; i < length; i++){
+        nurbs_curve_get_local_derivatives( &(points[i]), nullptr, nullptr, curve, t[i] );
+    }
+
+    return 1;
+}
+
+
+/* Gets the points and the derivatives of an array of parameters */
+int nurbs_curve_get_points_derivatives
+    ( NurbsVector3 deriv[]
+    , NurbsVector3 points[]
+    , const NurbsCurve* curve
+    , const NurbsFloat t[]
+    , const int length
+    )
+{
+    int i;
+    NurbsVector3 p;
+
+    if (curve == nullptr || curve->cp == nullptr || !check_degree( curve )){
+        return 0;
+    }
+
+    #pragma omp parallel for private(p) schedule(static) if (length > 256)
+    for (i = 0; i < length; i++){
+        nurbs_curve_get_local_derivatives( (points != nullptr) ? &(points[i]) : &p, &(deriv[i]), nullptr, curve, t[i] );
+    }
+
+    return 1;
+}
+
+
+/* Equivalent to a default constructor */
+void nurbs_curve_arclength_init( NurbsCurveArcLength* table )
+{
+    table->num_segments = 0;
+    table->t = nullptr;
+    table->length = nullptr;
+    table->total = 0;
+    table->degree = 0;
+    table->cp_length = 0;
+}
+
+
+/* Releases the memory of the table (but not the structure) */
+void nurbs_curve_arclength_dispose( NurbsCurveArcLength* table )
+{
+    if (table == nullptr){
+        return;
+    }
+
+    if (table->t != nullptr){
+        free( table->t );
+    }
+    if (table->length != nullptr){
+        free( table->length );
+    }
+
+    nurbs_curve_arclength_init( table );
+}
+
+
+/* Builds the arc length table of the curve */
+int nurbs_curve_arclength_build
+    ( NurbsCurveArcLength* table
+    , const NurbsCurve* curve
+    , const NurbsFloat tolerance
+    )
+{
+    int i, max_segments;
+    NurbsFloat a, b;
+
+    nurbs_curve_arclength_dispose( table );
+
+    if (curve == nullptr || curve->cp == nullptr || curve->degree < 1
+        || curve->cp_length <= curve->degree || !check_degree( curve ))
+    {
+        return 0;
+    }
+
+    max_segments = 2 * curve->cp_length + 2;
+    _check_(table->t = (NurbsFloat*)_malloc_(sizeof(NurbsFloat) * max_segments));
+    _check_(table->length = (NurbsFloat*)_malloc_(sizeof(NurbsFloat) * max_segments));
+    if (table->t == nullptr || table->length == nullptr){
+        nurbs_curve_arclength_dispose( table );
+        return 0;
+    }
+
+    table->degree = curve->degree;
+    table->cp_length = curve->cp_length;
+    table->t[0] = curve->knot[curve->degree];
+    table->length[0] = 0;
+
+    /* The curve is smooth inside each knot span */
+    for (i = curve->degree; i < curve->cp_length; i++){
+        a = curve->knot[i];
+        b = curve->knot[i + 1];
+        if (!(a < b)){
+            continue;
+        }
+
+        if (!adaptive_segments( table, &max_segments, curve, a, b
+            , gauss_length( curve, a, b ), tolerance, 0 ))
+        {
+            nurbs_curve_arclength_dispose( table );
+            return 0;
+        }
+    }
+
+    table->total = table->length[table->num_segments];
+
+    return 1;
+}
+
+
+/* Gets the parameter of the point at the arc length s from the start */
+NurbsFloat nurbs_curve_arclength_parameter
+    ( const NurbsCurveArcLength* table
+    , const NurbsCurve* curve
+    , const NurbsFloat s
+    )
+{
+    int low, high, mid, it;
+    NurbsFloat t0, t1, l0, l1, t, f, df, dt, lo, hi, target;
+
+    if (table == nullptr || table->num_segments == 0){
+        return NURBS_ERROR_VALUE;
+    }
+
+    if (s <= 0){
+        return table->t[0];
+    }
+    if (s >= table->total){
+        return table->t[table->num_segments];
+    }
+
+    /* Last segment with length[low] <= s */
+    low = 0;
+    high = table->num_segments;
+    while (high - low > 1){
+        mid = (low + high) / 2;
+        if (table->length[mid] <= s){
+            low = mid;
+        }
+        else{
+            high = mid;
+        }
+    }
+
+    t0 = table->t[low];
+    t1 = table->t[low + 1];
+    l0 = table->length[low];
+    l1 = table->length[low + 1];
+    target = s - l0;
+
+    if (!(l1 > l0)){
+        return t0;
+    }
+
+    /* Newton in the segment, with bisection if it jumps outside */
+    t = t0 + (t1 - t0) * target / (l1 - l0);
+    lo = t0;
+    hi = t1;
+    for (it = 0; it < ARCLENGTH_MAX_IT; it++){
+        f = gauss_length( curve, t0, t ) - target;
+        if (f > 0){
+            hi = t;
+        }
+        else{
+            lo = t;
+        }
+
+        df = curve_speed( curve, t );
+        if (!(df > 0)){
+            t = (lo + hi) / 2;
+            continue;
+        }
+
+        dt = f / df;
+        if (fabs( dt ) <= ARCLENGTH_EPSILON * (t1 - t0)){
+            t -= dt;
+            break;
+        }
+
+        if (t - dt > lo && t - dt < hi){
+            t -= dt;
+        }
+        else{
+            t = (lo + hi) / 2;
+        }
+    }
+
+    return t;
+}
+
+
+/* Gets the parameters of an array of arc lengths */
+int nurbs_curve_arclength_parameters
+    ( NurbsFloat t[]
+    , const NurbsCurveArcLength* table
+    , const NurbsCurve* curve
+    , const NurbsFloat s[]
+    , const int length
+    )
+{
+    int i;
+
+    if (table == nullptr || table->num_segments == 0 || curve == nullptr){
+        return 0;
+    }
+
+    if (table->degree != curve->degree || table->cp_length != curve->cp_length){
+        _handle_error_("The arc length table does not match the curve");
+        return 0;
+    }
+
+    #pragma omp parallel for schedule(static) if (length > 64)
+    for (i = 0; i < length; i++){
+        t[i] = nurbs_curve_arclength_parameter( table, curve, s[i] );
+    }
+
+    return 1;
+}
+
+
+/* Gets points equally spaced along the curve */
+int nurbs_curve_get_uniform_points
+    ( NurbsVector3 points[]
+    , NurbsFloat t[]
+    , const NurbsCurveArcLength* table
+    , const NurbsCurve* curve
+    , const int num_points
+    )
+{
+    int i;
+    NurbsFloat ti;
+
+    if (table == nullptr || table->num_segments == 0 || curve == nullptr
+        || num_points < 2)
+    {
+        return 0;
+    }
+
+    if (table->degree != curve->degree || table->cp_length != curve->cp_length){
+        _handle_error_("The arc length table does not match the curve");
+        return 0;
+    }
+
+    #pragma omp parallel for private(ti) schedule(static) if (num_points > 64)
+    for (i = 0; i < num_points; i++){
+        ti = nurbs_curve_arclength_parameter
+            ( table, curve, table->total * i / (num_points - 1) );
+        if (t != nullptr){
+            t[i] = ti;
+        }
+        if (points != nullptr){
+            nurbs_curve_get_local_derivatives( &(points[i]), nullptr, nullptr, curve, ti );
+        }
+    }
+
+    return 1;
+}
+
+/**/
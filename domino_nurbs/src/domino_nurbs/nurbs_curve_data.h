@@ -41,6 +41,26 @@ typedef struct NurbsCurve_
 }NurbsCurve;
 
 
+/** Arc length table of a NURBS curve (see nurbs_curve_arclength_build).
+  * The parametric interval is split in segments, small enough to 
+  * integrate the length of each one with Gauss quadrature. The length from
+  * the start of the curve is tabulated at the end of each segment, so the
+  * parameter of an arc length is found with a binary search and a few 
+  * Newton iterations inside the segment.
+  */
+typedef struct NurbsCurveArcLength_
+{
+    int num_segments;   /**< Number of segments. */
+    NurbsFloat* t;      /**< Parameters of the ends of the segments, 
+                          * num_segments + 1 values. */
+    NurbsFloat* length; /**< Arc length from the start at each t[i]. */
+    NurbsFloat total;   /**< Length of the curve. */
+
+    int degree;         /**< Degree of the curve of the table. */
+    int cp_length;      /**< Number of control points of the curve. */
+
+}NurbsCurveArcLength;
+
 #endif /* _NURBS_CURVE_DATA_H_ */
 
 /**/
\ No newline at end of file
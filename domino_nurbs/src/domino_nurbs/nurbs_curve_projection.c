@@ -0,0 +1,296 @@
+ /***
+    Author: Mario J. Martin <dominonurbs$gmail.com>
+
+    Projection of points onto NURBS curves (closest point).
+    Each knot span lies inside the convex hull of its control points, so
+    the distance to the bounding box of these control points is a lower
+    bound of the distance to the span. The points are processed in blocks,
+    and each point starts from the solution of the previous one, which is
+    usually close for nodes along a boundary. Only the spans whose bounding
+    box is closer than this first solution are searched again.
+
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "common/check_malloc.h"
+#include "common/log.h"
+
+#include "nurbs_internal.h"
+#include "nurbs_basis.h"
+#include "nurbs_curve.h"
+
+/* Number of consecutive points that are solved with warm starts */
+#define PROJECTION_BLOCK 64
+
+/* Maximum number of Newton iterations */
+#define PROJECTION_MAX_IT 32
+
+/* Stop condition of the Newton iterations, relative to the span */
+#define PROJECTION_EPSILON 1e-14
+
+/* Bounding box of the control points of a knot span */
+typedef struct{
+    NurbsFloat t0, t1;      /* Parameter range of the span */
+    NurbsVector3 low, high; /* Bounding box of the control points */
+}SpanBox;
+
+
+/* Square of the distance from the point to the box */
+static inline NurbsFloat box_distance2
+    ( const SpanBox* box
+    , const NurbsVector3* p
+    )
+{
+    NurbsFloat d, d2 = 0;
+
+    d = (p->x < box->low.x) ? box->low.x - p->x
+        : ((p->x > box->high.x) ? p->x - box->high.x : 0);
+    d2 += d * d;
+    d = (p->y < box->low.y) ? box->low.y - p->y
+        : ((p->y > box->high.y) ? p->y - box->high.y : 0);
+    d2 += d * d;
+    d = (p->z < box->low.z) ? box->low.z - p->z
+        : ((p->z > box->high.z) ? p->z - box->high.z : 0);
+    d2 += d * d;
+
+    return d2;
+}
+
+
+/* Minimizes the distance from the point to the curve in [t0, t1] with
+ * Newton iterations from the parameter *pt. Returns the square of the
+ * distance. */
+static NurbsFloat newton_projection
+    ( NurbsFloat* pt
+    , const NurbsCurve* curve
+    , const NurbsVector3* p
+    , const NurbsFloat t0
+    , const NurbsFloat t1
+    )
+{
+    NurbsVector3 c, d1, d2, r;
+    NurbsFloat t = *pt, f, df, dt, dist2;
+    int it;
+
+    for (it = 0; it < PROJECTION_MAX_IT; it++){
+        nurbs_curve_get_local_derivatives( &c, &d1, &d2, curve, t );
+        r.x = c.x - p->x;
+        r.y = c.y - p->y;
+        r.z = c.z - p->z;
+
+        /* Stationary point of |C - P|^2: f = C'.(C - P) = 0 */
+        f = d1.x * r.x + d1.y * r.y + d1.z * r.z;
+        df = d2.x * r.x + d2.y * r.y + d2.z * r.z
+            + d1.x * d1.x + d1.y * d1.y + d1.z * d1.z;
+
+        if (df <= 0){
+            /* Not convex here; Gauss-Newton step, which goes downhill */
+            df = d1.x * d1.x + d1.y * d1.y + d1.z * d1.z;
+            if (df == 0){
+                break;
+            }
+        }
+
+        dt = f / df;
+        if (t - dt < t0){
+            dt = t - t0;
+        }
+        else if (t - dt > t1){
+            dt = t - t1;
+        }
+        t -= dt;
+
+        if (fabs( dt ) <= PROJECTION_EPSILON * (t1 - t0)){
+            break;
+        }
+    }
+
+    nurbs_curve_get_local_derivatives( &c, &d1, &d2, curve, t );
+    r.x = c.x - p->x;
+    r.y = c.y - p->y;
+    r.z = c.z - p->z;
+    dist2 = r.x * r.x + r.y * r.y + r.z * r.z;
+
+    *pt = t;
+    return dist2;
+}
+
+
+/* Searches the minimum distance in one span: coarse sampling and Newton
+ * iterations from the closest sample */
+static NurbsFloat span_projection
+    ( NurbsFloat* pt
+    , const NurbsCurve* curve
+    , const NurbsVector3* p
+    , const SpanBox* box
+    )
+{
+    NurbsVector3 c, d1, d2v;
+    NurbsFloat t, d2, best = -1;
+    const int n = curve->degree + 2;
+    int k;
+
+    for (k = 0; k <= n; k++){
+        t = box->t0 + (box->t1 - box->t0) * k / n;
+        nurbs_curve_get_local_derivatives( &c, &d1, &d2v, curve, t );
+        d2 = (c.x - p->x) * (c.x - p->x) + (c.y - p->y) * (c.y - p->y)
+            + (c.z - p->z) * (c.z - p->z);
+
+        if (best < 0 || d2 < best){
+            best = d2;
+            *pt = t;
+        }
+    }
+
+    return newton_projection( pt, curve, p, box->t0, box->t1 );
+}
+
+
+/* Calculates the bounding boxes of the non empty spans.
+ * Returns the number of spans; -1 if the memory is exhausted. */
+static int span_boxes( SpanBox** pboxes, const NurbsCurve* curve )
+{
+    SpanBox* boxes;
+    int i, k, n = 0;
+
+    _check_(boxes = (SpanBox*)_malloc_(sizeof(SpanBox)
+        * (curve->cp_length - curve->degree)));
+    if (boxes == nullptr){
+        return -1;
+    }
+
+    for (i = curve->degree; i < curve->cp_length; i++){
+        SpanBox* box = &boxes[n];
+
+        if (curve->knot[i] >= curve->knot[i + 1]){
+            continue;
+        }
+
+        box->t0 = curve->knot[i];
+        box->t1 = curve->knot[i + 1];
+        box->low.x = box->high.x = curve->cp[i].x;
+        box->low.y = box->high.y = curve->cp[i].y;
+        box->low.z = box->high.z = curve->cp[i].z;
+
+        for (k = i - curve->degree; k < i; k++){
+            const NurbsVector4 cp = curve->cp[k];
+            box->low.x = (cp.x < box->low.x) ? cp.x : box->low.x;
+            box->low.y = (cp.y < box->low.y) ? cp.y : box->low.y;
+            box->low.z = (cp.z < box->low.z) ? cp.z : box->low.z;
+            box->high.x = (cp.x > box->high.x) ? cp.x : box->high.x;
+            box->high.y = (cp.y > box->high.y) ? cp.y : box->high.y;
+            box->high.z = (cp.z > box->high.z) ? cp.z : box->high.z;
+        }
+
+        n++;
+    }
+
+    *pboxes = boxes;
+    return n;
+}
+
+
+/* Projects one point, starting from warm if has_warm is set */
+static NurbsFloat point_projection
+    ( NurbsFloat* pt
+    , const NurbsCurve* curve
+    , const SpanBox boxes[]
+    , const int num_spans
+    , const NurbsVector3* p
+    , const int has_warm
+    , const NurbsFloat warm
+    )
+{
+    NurbsFloat t, d2, best = -1, best_t = 0;
+    int k;
+    const NurbsFloat t0 = boxes[0].t0;
+    const NurbsFloat t1 = boxes[num_spans - 1].t1;
+
+    if (has_warm != 0){
+        best_t = warm;
+        best = newton_projection( &best_t, curve, p, t0, t1 );
+    }
+
+    /* Spans that may contain a closer point (including the one of the 
+     * first solution, which may have another local minimum) */
+    for (k = 0; k < num_spans; k++){
+        if (best >= 0 && box_distance2( &boxes[k], p ) >= best){
+            continue;
+        }
+
+        d2 = span_projection( &t, curve, p, &boxes[k] );
+        if (best < 0 || d2 < best){
+            best = d2;
+            best_t = t;
+        }
+    }
+
+    *pt = best_t;
+    return sqrt( best );
+}
+
+
+/* Batched projection of points onto the curve */
+int nurbs_curve_projection
+    ( NurbsFloat t[]
+    , NurbsFloat distance[]
+    , const NurbsCurve* curve
+    , const NurbsVector3 points[]
+    , const int length
+    )
+{
+    SpanBox* boxes = nullptr;
+    int num_spans, ib;
+    const int num_blocks = (length + PROJECTION_BLOCK - 1) / PROJECTION_BLOCK;
+
+    if (curve == nullptr || curve->cp == nullptr || curve->knot == nullptr){
+        _handle_error_("The NURBS curve is not valid");
+        return 0;
+    }
+    if (curve->degree > NURBS_MAX_DEGREE){
+        _handle_error_("NURBS curve degree is greater than NURBS_MAX_DEGREE");
+        return 0;
+    }
+
+    num_spans = span_boxes( &boxes, curve );
+    if (num_spans < 0){
+        return 0;
+    }
+    if (num_spans == 0){
+        _handle_error_("The NURBS curve has no knot spans");
+        free( boxes );
+        return 0;
+    }
+
+    #pragma omp parallel for schedule(dynamic) if (num_blocks > 1)
+    for (ib = 0; ib < num_blocks; ib++){
+        NurbsFloat warm = 0, d, tk;
+        int has_warm = 0;
+        int i, i1 = (ib + 1) * PROJECTION_BLOCK;
+
+        if (i1 > length){
+            i1 = length;
+        }
+
+        for (i = ib * PROJECTION_BLOCK; i < i1; i++){
+            d = point_projection( &tk, curve, boxes, num_spans, &points[i], has_warm, warm );
+            t[i] = tk;
+            if (distance != nullptr){
+                distance[i] = d;
+            }
+
+            /* Consecutive nodes are usually close to each other */
+            warm = tk;
+            has_warm = 1;
+        }
+    }
+
+    free( boxes );
+
+    return 1;
+}
+
+/**/
@@ -10,6 +10,10 @@
 
 #define DOMINO_NURBS_LABEL_LEN 128  /* IGES labels has only 8 caracters */
 
+/* Maximum degree of the curves and surfaces that can be evaluated.
+ * The non zero basis are stored in buffers in the stack of this size. */
+#define NURBS_MAX_DEGREE 31
+
 /*------------------------------------------------------------------------------
       DEFINITIONS
 ------------------------------------------------------------------------------*/
@@ -1,7 +1,16 @@
  /***
     Author: Mario J. Martin <dominonurbs$gmail.com>
 
-    Methods for importing NURBS curves and surfaces from an IGES file
+    Methods for importing and exporting NURBS curves and surfaces from and to
+    an IGES file
+
+    The reader loads the whole file in one buffer and indexes the lines, so
+    any line is found directly by its sequence number. The Directory Entry
+    section is read first; it gives the line and the number of lines of the
+    Parameter Data of each entity. Then the NURBS entities (126 and 128)
+    are decoded in parallel, each one from its own lines. The numbers are 
+    read with nurbs_text_to_float(): fast, in double precision, and with 
+    '.' as the decimal point whatever the locale.
 
 *******************************************************************************/
 
@@ -9,115 +18,54 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include "nurbs_internal.h"
 #include "nurbs_curve.h"
 #include "nurbs_surface.h"
+#include "nurbs_text.h"
 
 #include "domino_nurbs.h" /* TAKE THIS OUT */
 
-/* Parameters readed from the global section */
-typedef struct 
-{
-    char parameter_delimiter_character;         /* 1 */
-    char record_delimiter_character;            /* 2 */
-    char product_identification[256];           /* 3 */
-    char filename[256];                         /* 4 */
-    char native_system_id[256];                 /* 5 */
-    char preprocessor_version[256];             /* 6 */
-    int num_bits_integer;                       /* 7 */
-    int max_power_single;                       /* 8 */
-    int number_significat_bits_single;          /* 9 */
-    int max_power_double;                       /* 10 */
-    int number_significat_bits_double;          /* 11 */
-    char product_identification_receiving[256]; /* 12 */
-    float model_space_scale;                   /* 13 */
-    int units_flag;                             /* 14 */
-    char units_name[256];                       /* 15 */
-    int num_line_weights_gradation;             /* 16 */
-    float max_line_weight;                     /* 17 */
-    char file_data_time_generation[256];        /* 18 */
-    float granularity;                         /* 19 */
-    float max_ccordinate_value;                /* 20 */
-    char authors_name[256];                     /* 21 */
-    char authors_organization[256];             /* 22 */
-    int file_version;                           /* 23 */
-    int drafting_standard;                      /* 24 */
-    char file_data_time_modification[256];      /* 25 */
-    char application_protocol[256];             /* 26 */
-
-}GlobalSectionFields;
-
-
-typedef struct 
-{
-    int entity_type_number; /* 126 nurbs_curve; 128 nurbs_surface */
-    int data_line;          /* line in the IGES file with the parameter data */
-    int form;               /* 0 is for rational B-spline parameters */
-    char label[9];          /* Entity label */
-    int subscript;          /* Entity subscript number */
-    NurbsCurve* curve;      /* if it is a curve, data is stored here */
-    NurbsSurface* surface;  /* if it is a surface, data is stored here*/
-}Entity;
-
+/* Columns of the data in the Parameter Data section */
+#define IGES_PARAMETER_COLUMNS 64
 
-/******************************************************************************/
-
-typedef struct _DynamicStack
-{
-    struct _DynamicStack *next; /* Pointer to the next element of the stack */
-    struct _DynamicStack *from; /* Pointer to the previous element */
-    void *data;                 /* Pointer to the data */
-} DynamicStack;
+/* Column of the letter code of the section */
+#define IGES_LETTER_COLUMN 72
 
-/** Creates a token */
-static DynamicStack* dynamic_stack_create_token(void)
+/* Lines of the file, indexed */
+typedef struct
 {
-    DynamicStack* token;
-    _check_(token = (DynamicStack*)_malloc_(sizeof(DynamicStack)));
-    token->data = nullptr;
-    token->next = nullptr;
+    char* buffer;       /* Contents of the file */
+    size_t size;        /* Size of the file */
 
-    return token;
-}
+    char** line;        /* Start of each line */
+    int num_lines;      /* Number of lines */
 
-/**
- * Releases the memory used by the stack structure, but NOT the data
- * To clear the data uses the optional function pointer
- */
-static void dynamic_stack_free
-    ( DynamicStack *root, void (*data_free_handler)(DynamicStack* node))
-{
-    DynamicStack* token = root;
-    DynamicStack* next;
+    int global;         /* First line of the Global section */
+    int num_global;     /* Number of lines of the Global section */
+    int directory;      /* First line of the Directory Entry section */
+    int num_directory;  /* Number of lines of the Directory Entry section */
+    int parameter;      /* First line of the Parameter Data section */
+    int num_parameter;  /* Number of lines of the Parameter Data section */
 
-    while (token != nullptr){
-        next = (DynamicStack*)token->next;
-        if (data_free_handler != nullptr){
-            (*data_free_handler)(token);
-        }
-        free(token);
-        token = next;
-    }
-}
+    char parameter_delimiter_character;
+    char record_delimiter_character;
+}IgesFile;
 
-/******************************************************************************/
 
-/* Safe version of the strcat routine */
-static void strcat_safe(char* dest, char* source, int dest_size)
+/* Reader of the parameters of an entity */
+typedef struct
 {
-    int size = strlen(dest);
-    char* ps = source;
-    char* pd = dest + size;
+    const char* pt;         /* Next character */
+    char parameter_delimiter_character;
+    char record_delimiter_character;
+    int end_of_record;      /* The record delimiter has been found */
+    int error;              /* A value is not a number */
+}IgesParameters;
 
-    size += 1;
-    while (*ps != '\n' && size < dest_size){
-        *pd++ = *ps++;
-        dest++;
-        size++;
-    }
-    *dest = '\0';
-}
+
+/******************************************************************************/
 
 /** Eliminates spaces, tabs and line breaks at the beginning and the end
   * of the string */
@@ -152,797 +100,561 @@ static char* str_trim(char *str)
     return str;
 }
 
-/* Gets the letter code in the line */
-static char getLetterCode(const char* line)
-{
-    if (line != nullptr){
-        return line[72];
-    }
-    else{
-        return '\0';
-    }
-}
 
-/* Reads a string data type in Hollerith format, e.g. 3Habcd */
-static char* readHollerithString(char* input_string, char** text)
+/* Reads the integer of a fixed field of 8 columns */
+static int field_int( const char* line, const int field )
 {
-    char* pt = input_string;
-    char* end;
+    char buffer[9];
 
-    int hlen, slen;
+    memcpy( buffer, line + 8 * field, 8 );
+    buffer[8] = '\0';
 
-    /* Look for the 'H' character */
-    while (*pt != '\0' && *pt != 'H' && *pt != 'h'){
-        pt++;
-    }
+    return (int)strtol( buffer, NULL, 10 );
+}
 
-    if (*pt == '\0'){
-        /* The string does not contains an H */
-        *text = pt;
-        return pt;
-    }
 
-    *pt = '\0';
-    sscanf(input_string, "%i", &hlen);
-    pt++;
-    slen = strlen(pt);
+/* Equivalent to a default constructor */
+static void iges_file_init( IgesFile* iges )
+{
+    iges->buffer = nullptr;
+    iges->size = 0;
+    iges->line = nullptr;
+    iges->num_lines = 0;
+    iges->global = iges->num_global = 0;
+    iges->directory = iges->num_directory = 0;
+    iges->parameter = iges->num_parameter = 0;
+    iges->parameter_delimiter_character = ',';
+    iges->record_delimiter_character = ';';
+}
+
 
-    if (slen > hlen){
-        pt[hlen] = '\0';
-        end = pt + hlen + 1;
+/* Releases the memory */
+static void iges_file_dispose( IgesFile* iges )
+{
+    if (iges->buffer != nullptr){
+        free( iges->buffer );
     }
-    else{
-        end = pt + hlen;
+    if (iges->line != nullptr){
+        free( iges->line );
     }
-
-    *text = pt;
-
-    return end;
+    iges_file_init( iges );
 }
 
 
-/* Extracts one data  */
-static char* parseData(char* pt
-        , char* value_buffer
-        , int* end_of_param
-        , int* end_of_record
-        , int* str_len
-        , const char param_delimiter
-        , const char record_delimiter
-){
-    char* p1 = pt;
-
-    *end_of_record = 0;
-
-    if (*str_len > 0){
-        /* We are already reading a string in Hollerith notation */
-        while(*p1 != '\0' && *p1 != '\n' && *str_len > 0){
-            (*str_len)--;
-            p1++;
-        }
-    }
-    else{
-        /* Find the next delimiter or Hollerith or end of line */
-        while(*p1 != param_delimiter && *p1 != record_delimiter 
-                && *p1 != '\0' && *p1 != '\n' && *p1 != 'H' && *p1 != 'h'){
-            p1++;
+/* Splits the buffer in lines. The lines are usually terminated by a line 
+ * break, but they may also be records of 80 characters without it. 
+ * Each line is cut after the letter code; the sequence number is not used,
+ * as it is the position of the line in its section.
+ * Returns 0 if the memory is exhausted. */
+static int iges_index_lines( IgesFile* iges )
+{
+    char* p = iges->buffer;
+    char* end = iges->buffer + iges->size;
+    char* next;
+    size_t max_lines;
+    int fixed_records;
+
+    /* Without line breaks in the first record, all records are 80 chars */
+    next = (char*)memchr( p, '\n', (iges->size < 82) ? iges->size : 82 );
+    fixed_records = (next == NULL && iges->size >= 160);
+
+    max_lines = fixed_records ? iges->size / 80 + 1 : 1;
+    if (!fixed_records){
+        for (next = p; next < end; next++){
+            max_lines += (*next == '\n');
         }
     }
 
-    if (*p1 == '\0'){
-        /* End of line. Continue with the next one? */
-        strcat_safe(value_buffer, pt, 256);
-        *end_of_param = 0;
-        return p1;
+    _check_(iges->line = (char**)_malloc_(sizeof(char*) * max_lines));
+    if (iges->line == nullptr){
+        return 0;
     }
-    else if (*p1 == 'H' || *p1 == 'h'){
-        /* String in Hollerith notation */
-        if (sscanf(pt, "%i", str_len) == 0){
-            *str_len = 0;
-        }
-        *end_of_param = 0;
-        return p1+1;
-    }
-    else if (*p1 == record_delimiter){
-        *end_of_record = 1;
-    }
-    
-    if (*p1 != param_delimiter && *p1 != record_delimiter){
-        /* Uh!? something is terribly wrong! */
-        while(*p1 != param_delimiter && *p1 != record_delimiter 
-                && *p1 != '\0' && *p1 != '\n'){
-            p1++;
+
+    while (p < end){
+        size_t length;
+
+        if (fixed_records){
+            next = (p + 80 < end) ? p + 80 : end;
+            length = next - p;
         }
-        if (*p1 == '\0'){
-            *end_of_param = 0;
-            return p1;
+        else{
+            next = (char*)memchr( p, '\n', end - p );
+            if (next == NULL){
+                next = end;
+            }
+            length = next - p;
+            if (length > 0 && p[length - 1] == '\r'){
+                length--;
+            }
+            if (next < end){
+                next++;
+            }
         }
-    }
 
-    *p1 = '\0';
-    p1++;
-    *end_of_param = 1;
+        /* Lines too short for the letter code are ignored */
+        if (length > IGES_LETTER_COLUMN){
+            p[IGES_LETTER_COLUMN + 1] = '\0';
+            iges->line[iges->num_lines++] = p;
+        }
 
-    /* Copy the string */
-    strcat_safe(value_buffer, pt, 256);
+        p = next;
+    }
 
-    return p1;
+    return 1;
 }
 
 
-/* Get the next raw parameter value */
-static char* getValue(FILE* fd  /* File handler */
-        , char* *status         /* If status == NULL we are at the end of file */
-        , char* pt              /* Jumping pointer through the parameters */
-        , char* line_buffer     /* Buffer used to read lines     */
-        , char* value_buffer    /* Returned pointer value */
-        , int* end_of_record    /* Indicates if the end of record character is found */
-        , const char parameter_delimiter_character  /* Delimiter */
-        , const char record_delimiter_character     /* Delimiter */
-        , const int line_length /* Where the line should be cut */
-){
-    int end_of_parameter = 0;
-    int str_len = 0;    /* Size of the string taken from the Hollerith */
-
-    *end_of_record = 0;
-
-    /* Initialize value */
-    value_buffer[0] = '\0';
-    /* Cut the line to get only the data we are interested */
-    line_buffer[line_length+1] = '\0';
-
-    while (end_of_parameter == 0 && pt != nullptr && *status != NULL){
-        pt =  parseData
-              ( pt, &(value_buffer[0])
-              , &end_of_parameter, end_of_record
-              , &str_len
-              , parameter_delimiter_character
-              , record_delimiter_character
-              );
-
-        if (pt[0] == '\0'){
-            /* End of line */
-            *status = fgets(line_buffer, 127, fd);
-            if (*status == NULL){
-                /* End of file (something is terribly wrong!) */
-                return nullptr;
+/* Finds the sections of the file */
+static void iges_index_sections( IgesFile* iges )
+{
+    int i;
+
+    for (i = 0; i < iges->num_lines; i++){
+        switch (iges->line[i][IGES_LETTER_COLUMN]){
+        case 'G':
+            if (iges->num_global++ == 0){
+                iges->global = i;
+            }
+            break;
+        case 'D':
+            if (iges->num_directory++ == 0){
+                iges->directory = i;
+            }
+            break;
+        case 'P':
+            if (iges->num_parameter++ == 0){
+                iges->parameter = i;
             }
-            pt = line_buffer;
+            break;
+        default:
+            break;
         }
     }
-
-    return pt;
 }
 
-/* Reads the start section of an ASCII IGES file */
-static void readStartSectionASCII(FILE* fd
-        , char* *status
-        , char* line_buffer)
+
+/* Gets the delimiters from the first two parameters of the global section, 
+ * in Hollerith notation (e.g. 1H,,1H;) or empty (default values) */
+static void iges_delimiters( IgesFile* iges )
 {
-    char letter_code;
+    const char* pt;
 
-    letter_code = getLetterCode(line_buffer);
-    /* Advance until we find the start section */
-    while(*status != NULL && letter_code != 'S'){        
-        *status = fgets(line_buffer, 127, fd);
-        letter_code = getLetterCode(line_buffer);
-    }
+    iges->parameter_delimiter_character = ',';
+    iges->record_delimiter_character = ';';
 
-    while(*status != NULL && letter_code == 'S'){
-        /* Not much to do */
-        *status = fgets(line_buffer, 127, fd);
-        letter_code = getLetterCode(line_buffer);
+    if (iges->num_global == 0){
+        return;
     }
-}
-
-
-/* Reads the global section from an ASCII IGES file */
-static void readGlobalSectionASCII(FILE* fd
-    , char* *status
-    , char* line_buffer
-    , GlobalSectionFields* global
-){
-    char* pt = line_buffer;
-    char* ph;
-    char letter_code;
-    char value_buffer[256];
-    char pdc, rdc;
-    int end_of_record;
 
-    letter_code = getLetterCode(line_buffer);
-    /* Advance until we find the global section */
-    while(*status != NULL && letter_code != 'G'){    
-        *status = fgets(line_buffer, 127, fd);
-        letter_code = getLetterCode(line_buffer);
+    pt = iges->line[iges->global];
+    while (*pt == ' '){
+        pt++;
     }
 
-    /* Set default parameters */
-    global->parameter_delimiter_character = ',';
-    global->record_delimiter_character = ';';
-
-    if (*status == NULL){
-        return;
+    if (pt[0] == '1' && (pt[1] == 'H' || pt[1] == 'h') && pt[2] != '\0'){
+        iges->parameter_delimiter_character = pt[2];
+        pt += 3;
     }
-
-    /* The first parameter should be taken to know the separator character */
-    pt = readHollerithString(line_buffer, &ph);
-    if (ph[0] != '\0'){
-        global->parameter_delimiter_character = ph[0];
+    if (*pt == iges->parameter_delimiter_character){
+        pt++;
     }
-
-    /* And the second one, which is the record delimiter character */
-    pt = readHollerithString(pt, &ph);
-    if (ph[0] != '\0'){
-        global->record_delimiter_character = ph[0];
+    while (*pt == ' '){
+        pt++;
     }
+    if (pt[0] == '1' && (pt[1] == 'H' || pt[1] == 'h') && pt[2] != '\0'){
+        iges->record_delimiter_character = pt[2];
+    }
+}
 
-    pdc = global->parameter_delimiter_character;
-    rdc = global->record_delimiter_character;
-
-    /* Read the rest of the global section */
-    pt = getValue(fd, status, pt, line_buffer
-        , &(global->product_identification[0]), &end_of_record, pdc, rdc, 71);
-
-    pt = getValue(fd, status, pt, line_buffer
-        , &(global->filename[0]), &end_of_record, pdc, rdc, 71);
-
-    pt = getValue(fd, status, pt, line_buffer
-        , &(global->native_system_id[0]), &end_of_record, pdc, rdc, 71);
 
-    pt = getValue(fd, status, pt, line_buffer
-        , &(global->preprocessor_version[0]), &end_of_record, pdc, rdc, 71);
+/* Reads the whole file and indexes the lines and the sections.
+ * Returns 0 if the file cannot be read or it is not an ASCII IGES file. */
+static int iges_file_read( IgesFile* iges, const char* filename )
+{
+    FILE* fd;
+    long long length;
 
-    pt = getValue(fd, status, pt, line_buffer
-        , &(value_buffer[0]), &end_of_record, pdc, rdc, 71);
-    sscanf(value_buffer, "%i", &global->num_bits_integer);
+    iges_file_init( iges );
 
-    pt = getValue(fd, status, pt, line_buffer
-        , &(value_buffer[0]), &end_of_record, pdc, rdc, 71);
-    sscanf(value_buffer, "%i", &global->max_power_single);
+    fd = fopen( filename, "rb" );
+    if (fd == NULL){
+        _handle_error_( "Cannot open the IGES file" );
+        return 0;
+    }
 
-    pt = getValue(fd, status, pt, line_buffer
-        , &(value_buffer[0]), &end_of_record, pdc, rdc, 71);
-    sscanf(value_buffer, "%i", &global->number_significat_bits_single);
+    if (nurbs_fseek( fd, 0, SEEK_END ) == 0 && (length = nurbs_ftell( fd )) > 0
+        && (unsigned long long)length < (size_t)-1)
+    {
+        rewind( fd );
+        _check_(iges->buffer = (char*)_malloc_((size_t)length + 1));
+        if (iges->buffer != nullptr){
+            iges->size = fread( iges->buffer, 1, (size_t)length, fd );
+            iges->buffer[iges->size] = '\0';
+        }
+    }
+    fclose( fd );
 
-    pt = getValue(fd, status, pt, line_buffer
-        , &(value_buffer[0]), &end_of_record, pdc, rdc, 71);
-    sscanf(value_buffer, "%i", &global->max_power_double);
+    if (iges->buffer == nullptr || iges->size == 0){
+        _handle_error_( "Cannot read the IGES file" );
+        iges_file_dispose( iges );
+        return 0;
+    }
 
-    pt = getValue(fd, status, pt, line_buffer
-        , &(value_buffer[0]), &end_of_record, pdc, rdc, 71);
-    sscanf(value_buffer, "%i", &global->number_significat_bits_double);
+    if (!iges_index_lines( iges )){
+        iges_file_dispose( iges );
+        return 0;
+    }
 
-    pt = getValue(fd, status, pt, line_buffer
-        , &(global->product_identification_receiving[0]), &end_of_record
-        , pdc, rdc, 71);
+    if (iges->num_lines > 0 && iges->line[0][IGES_LETTER_COLUMN] == 'C'){
+        _handle_error_( "Cannot read compressed IGES files" );
+        iges_file_dispose( iges );
+        return 0;
+    }
 
-    pt = getValue(fd, status, pt, line_buffer
-        , &(value_buffer[0]), &end_of_record, pdc, rdc, 71);
-    sscanf(value_buffer, "%g", &global->model_space_scale);
+    iges_index_sections( iges );
+    iges_delimiters( iges );
 
-    pt = getValue(fd, status, pt, line_buffer
-        , &(value_buffer[0]), &end_of_record, pdc, rdc, 71);
-    sscanf(value_buffer, "%i", &global->units_flag);
+    return 1;
+}
 
-    pt = getValue(fd, status, pt, line_buffer
-        , &(global->units_name[0]), &end_of_record, pdc, rdc, 71);
 
-    pt = getValue(fd, status, pt, line_buffer
-        , &(value_buffer[0]), &end_of_record, pdc, rdc, 71);
-    sscanf(value_buffer, "%i", &global->num_line_weights_gradation);
+/* Reads a directory entry: two lines with 10 fields of 8 characters */
+static void read_directory_entry
+    ( NurbsIgesEntity* entity
+    , const char* line1
+    , const char* line2
+    , const int directory_line
+    )
+{
+    entity->type = field_int( line1, 0 );
+    entity->data_line = field_int( line1, 1 );
+    entity->data_count = field_int( line2, 3 );
+    entity->directory_line = directory_line;
+    entity->form = field_int( line2, 4 );
+    memcpy( entity->label, line2 + 8 * 7, 8 );
+    entity->label[8] = '\0';
+    str_trim( entity->label );
+    entity->id = field_int( line2, 8 );
+    entity->curve = nullptr;
+    entity->surface = nullptr;
+}
 
-    pt = getValue(fd, status, pt, line_buffer
-        , &(value_buffer[0]), &end_of_record, pdc, rdc, 71);
-    sscanf(value_buffer, "%g", &global->max_line_weight);
 
-    pt = getValue(fd, status, pt, line_buffer
-        , &(global->file_data_time_generation[0]), &end_of_record, pdc, rdc, 71);
+/* Reads the directory entries of the NURBS curves and surfaces 
+ * (entities 126 and 128). Returns the number of entities; -1 if the memory
+ * is exhausted. */
+static int iges_directory_nurbs( const IgesFile* iges, NurbsIgesEntity** p_entities )
+{
+    int i, n = 0, type;
+    NurbsIgesEntity* entities;
 
-    pt = getValue(fd, status, pt, line_buffer
-        , &(value_buffer[0]), &end_of_record, pdc, rdc, 71);
-    sscanf(value_buffer, "%g", &global->granularity);
+    *p_entities = nullptr;
 
-    pt = getValue(fd, status, pt, line_buffer
-        , &(value_buffer[0]), &end_of_record, pdc, rdc, 71);
-    sscanf(value_buffer, "%g", &global->max_ccordinate_value);
+    for (i = 0; i + 1 < iges->num_directory; i += 2){
+        type = field_int( iges->line[iges->directory + i], 0 );
+        n += (type == 126 || type == 128);
+    }
+    if (n == 0){
+        return 0;
+    }
 
-    pt = getValue(fd, status, pt, line_buffer
-        , &(global->authors_name[0]), &end_of_record, pdc, rdc, 71);
+    _check_(entities = (NurbsIgesEntity*)_malloc_(sizeof(NurbsIgesEntity) * n));
+    if (entities == nullptr){
+        return -1;
+    }
 
-    pt = getValue(fd, status, pt, line_buffer
-        , &(global->authors_organization[0]), &end_of_record, pdc, rdc, 71);
+    n = 0;
+    for (i = 0; i + 1 < iges->num_directory; i += 2){
+        const char* line1 = iges->line[iges->directory + i];
+        const char* line2 = iges->line[iges->directory + i + 1];
+        NurbsIgesEntity* entity = &entities[n];
 
-    pt = getValue(fd, status, pt, line_buffer
-        , &(value_buffer[0]), &end_of_record, pdc, rdc, 71);
-    sscanf(value_buffer, "%g", &global->model_space_scale);
+        type = field_int( line1, 0 );
+        if (type != 126 && type != 128){
+            continue;
+        }
 
-    pt = getValue(fd, status, pt, line_buffer
-        , &(value_buffer[0]), &end_of_record, pdc, rdc, 71);
-    sscanf(value_buffer, "%i", &global->file_version);
+        read_directory_entry( entity, line1, line2, i + 1 );
+        n++;
+    }
 
-    pt = getValue(fd, status, pt, line_buffer
-        , &(global->file_data_time_modification[0]), &end_of_record, pdc, rdc, 71);
+    *p_entities = entities;
 
-    // Seems that some files do not have the last one
-    if (end_of_record == 1) return;
-    pt = getValue(fd, status, pt, line_buffer
-          , &(global->application_protocol[0]), &end_of_record, pdc, rdc, 71);
+    return n;
 }
 
 
-/* Arranges the entities by the parameter line */
-static void arrangeEntities(Entity* entities, const int num_entities)
+/* Copies the parameter data of the entity (the first 64 columns of its 
+ * lines) into one string. Returns nullptr if the lines are not in the file
+ * or the memory is exhausted. */
+static char* iges_parameter_text( const IgesFile* iges, const NurbsIgesEntity* entity )
 {
-    int i;
-    int flag = 1;
-    Entity buffer;
-
-    while (flag == 1){
-        flag = 0;
-        for (i = 0; i < num_entities-1; i++){
-            if (entities[i].data_line > entities[i+1].data_line){
-                /* Swap */
-                flag = 1;
-                buffer = entities[i];
-                entities[i] = entities[i+1];
-                entities[i+1] = buffer;
-            }
-        }
-    }
-}
-
-
-/* Reads the directory section */
-static void readDirectorySectionASCII(FILE* fd
-    , char* *status
-    , char* line_buffer
-    , Entity** entities
-    , int *num_entities
-){
-    int i, j, k, entity_type;
-    char* line;
-    char* field[20];
-    char letter_code;
-    DynamicStack* root;
-    DynamicStack* token;
+    char* text;
+    char* p;
+    int i, count = entity->data_count;
+    const int first = iges->parameter + entity->data_line - 1;
 
-    letter_code = getLetterCode(line_buffer);
-    /* Advance until we find the directory section */
-    while(*status != NULL && letter_code != 'D'){        
-        *status = fgets(line_buffer, 127, fd);
-        letter_code = getLetterCode(line_buffer);
-    }
-
-    if (*status == NULL){
-        /* THERE IS NO DIRECToRY SECTION!!! */
-        return;
+    if (entity->data_line < 1 || entity->data_line > iges->num_parameter){
+        return nullptr;
     }
 
-    *num_entities = 0;
-    root = dynamic_stack_create_token();
-    token = root;
-    letter_code = getLetterCode(line_buffer);
-
-    while(*status != NULL && letter_code == 'D'){
-        /* Create a new token */
-        _check_(token->data = _malloc_(sizeof(char) * 20 * 9));
-        line = (char*)token->data;
-        token->next = dynamic_stack_create_token();
-        token = token->next;
-
-        k = 0;
-        /* It should be two lines for each directory entry */
-        for (i = 0; i < 2 && letter_code == 'D'; i++){
-            /* There are always 10 fields of 8 characteres 
-             * and a total of 80 characters per line */
-            for (j = 0; j < 10; j++){
-                strncpy(&(line[k * 9]), &(line_buffer[j * 8]), 8);
-                line[k * 9 + 8] = '\0';
-                k++;
-            }
-
-            /* Read the next line */
-            *status = fgets(line_buffer, 127, fd);
-            letter_code = getLetterCode(line_buffer);
-        }
-
-        /* Check if it is a NURBS entity (entities 126 and 128) */
-        sscanf(&(line[0]), "%i", &entity_type);
-        if (entity_type == 126 || entity_type == 128){
-            (*num_entities)++;
+    /* Without the count, the lines with the pointer to the directory entry */
+    if (count <= 0){
+        count = 0;
+        while (entity->data_line + count <= iges->num_parameter
+            && field_int( iges->line[first + count], 8 ) 
+                == entity->directory_line)
+        {
+            count++;
         }
     }
-
-    /* Now we know how many entities we have */
-    if (*num_entities <= 0){
-        *entities = nullptr;
+    if (entity->data_line + count - 1 > iges->num_parameter){
+        count = iges->num_parameter - entity->data_line + 1;
     }
-    else{
-        token = root;
-        _check_(*entities = (Entity*)_malloc_(sizeof(Entity) * (*num_entities)));
-
-        j = 0;
-        while (token != nullptr){
-            if (token->data != nullptr){
-                line = (char*)token->data;
-                for (i = 0; i < 20; i++){
-                    field[i] = &(line[9*i]);
-                }
 
-                /* Check (again) if it is a nurbs surface or nurbs curve */
-                sscanf(field[0], "%i", &entity_type);
-                if (entity_type == 126 || entity_type == 128){
-                    (*entities)[j].curve = nullptr;
-                    (*entities)[j].surface = nullptr;
-                    (*entities)[j].entity_type_number = entity_type;
-                    sscanf(field[1], "%i", &((*entities)[j].data_line));
-                    sscanf(field[14], "%i", &((*entities)[j].form));
-                    strcpy((*entities)[j].label, field[17]);
-                    sscanf(field[18], "%i", &((*entities)[j].subscript));
-                    j++;
-                }
-            }
-            token = token->next;
-        }
+    _check_(text = (char*)_malloc_(count * IGES_PARAMETER_COLUMNS + 1));
+    if (text == nullptr){
+        return nullptr;
     }
 
-    /* Arrange the entities by the parameter line,  
-     * so we can find them in the correct order */
-    arrangeEntities(*entities, *num_entities);
-
-    /* Clear the data memory */
-    token = root;
-    while (token != nullptr){
-        if (token->data != nullptr){
-            free(token->data);
-        }
-        token = token->next;
+    p = text;
+    for (i = 0; i < count; i++){
+        const char* line = iges->line[first + i];
+        memcpy( p, line, IGES_PARAMETER_COLUMNS );
+        p += IGES_PARAMETER_COLUMNS;
     }
+    *p = '\0';
 
-    /* Release the stack */
-    dynamic_stack_free(root, nullptr);
+    return text;
 }
 
-/* Reads all data parameters for a parametric curve */
-static void parseCurveEntity
-  ( Entity* entity
-  , FILE* fd, char* *status
-  , char* line_buffer
-  , const char parameter_delimiter_character
-  , const char record_delimiter_character
-  )
-{
-    char* pt = &(line_buffer[0]);
-    char value[128];
-    int entity_type_number;
-    int k, m, n, a, i;
-    float fvalue;
-    int end_of_record;
-
-    /* Entity type number should be the same as in the directory */
-    pt = getValue(fd, status, pt, line_buffer, &(value[0]), &end_of_record
-        , parameter_delimiter_character, record_delimiter_character, 64);
 
-    sscanf(value, "%i", &entity_type_number);
+/* Reads the next parameter as a number. Empty parameters are 0. */
+static NurbsFloat iges_next_value( IgesParameters* params )
+{
+    NurbsFloat value = 0;
+    const char* end;
+    const char pdc = params->parameter_delimiter_character;
+    const char rdc = params->record_delimiter_character;
+
+    if (params->end_of_record){
+        params->error = 1;
+        return 0;
+    }
 
-    if (entity_type_number != entity->entity_type_number){
-        _handle_error_("type numbers are not the same!"); 
+    while (*params->pt == ' '){
+        params->pt++;
     }
 
-    /* Upper Index of sum */
-    pt = getValue(fd, status, pt, line_buffer, &(value[0]), &end_of_record
-        , parameter_delimiter_character, record_delimiter_character, 64);
+    if (*params->pt != pdc && *params->pt != rdc){
+        value = nurbs_text_to_float( params->pt, &end );
+        if (end == params->pt){
+            params->error = 1;
+        }
+        params->pt = end;
 
-    sscanf(value, "%i", &k);
+        /* Up to the delimiter */
+        while (*params->pt != pdc && *params->pt != rdc && *params->pt != '\0'){
+            params->pt++;
+        }
+    }
 
-    /* Degree of basis function */
-    pt = getValue(fd, status, pt, line_buffer, &(value[0]), &end_of_record
-        , parameter_delimiter_character, record_delimiter_character, 64);
+    if (*params->pt == rdc || *params->pt == '\0'){
+        params->end_of_record = 1;
+    }
+    if (*params->pt != '\0'){
+        params->pt++;
+    }
 
-    sscanf(value, "%i", &m);
+    return value;
+}
 
-    n = 1+k-m;
-    a = n+2*m;
 
-    entity->curve = nurbs_curve_alloc(nullptr, k+1, m);
+/* Reads the next parameter as an integer */
+static int iges_next_int( IgesParameters* params )
+{
+    const NurbsFloat value = iges_next_value( params );
 
-    /* Get the label and id */
-    str_trim(entity->label);
-    strcpy(entity->curve->label, entity->label);
-    entity->curve->id = entity->subscript;
+    return (int)(value < 0 ? value - 0.5 : value + 0.5);
+}
 
-    /* Read property 0 - nonplanar, 1 - planar */
-    pt = getValue( fd, status, pt, line_buffer, &(value[0]), &end_of_record
-          , parameter_delimiter_character, record_delimiter_character, 64);
 
-    /* Read property 0 - open curve, 1 - closed curve */
-    pt = getValue( fd, status, pt, line_buffer, &(value[0]), &end_of_record
-        , parameter_delimiter_character, record_delimiter_character, 64);
+/* Decodes the parameters of a curve (entity 126).
+ * Returns nullptr if the data is not valid or the memory is exhausted. */
+static NurbsCurve* decode_curve( IgesParameters* params, const NurbsIgesEntity* entity )
+{
+    NurbsCurve* curve;
+    int k, m, i;
 
-    /* Read property 0 - rational 1 - polynomial */
-    pt = getValue( fd, status, pt, line_buffer, &(value[0]), &end_of_record
-        , parameter_delimiter_character, record_delimiter_character, 64);
+    /* NurbsIgesEntity type number, upper index of sum, degree */
+    if (iges_next_int( params ) != 126){
+        return nullptr;
+    }
+    k = iges_next_int( params );
+    m = iges_next_int( params );
+    if (params->error || k < 0 || m < 0 || m > NURBS_MAX_DEGREE){
+        return nullptr;
+    }
 
-    /* Read property 0 - nonperiodic 1 - periodic */
-    pt = getValue( fd, status, pt, line_buffer, &(value[0]), &end_of_record
-        , parameter_delimiter_character, record_delimiter_character, 64);
+    /* Properties: planar, closed, polynomial, periodic */
+    for (i = 0; i < 4; i++){
+        iges_next_value( params );
+    }
 
-    /* Read the knots */
-    for (i = 0; i <= a; i++){
-        pt =  getValue( fd, status, pt, line_buffer, &(value[0]), &end_of_record
-               , parameter_delimiter_character, record_delimiter_character, 64);
+    curve = nurbs_curve_alloc( nullptr, k + 1, m );
+    if (curve == nullptr || curve->cp == nullptr || curve->knot == nullptr){
+        return curve;
+    }
 
-        sscanf(value, "%g", &fvalue);
-        entity->curve->knot[i] = (NurbsFloat)fvalue;
+    curve->id = entity->id;
+    _check_(curve->label = (char*)_malloc_(strlen( entity->label ) + 1));
+    if (curve->label != nullptr){
+        strcpy( curve->label, entity->label );
     }
 
-    /* Read the weights */
+    for (i = 0; i < curve->knot_length; i++){
+        curve->knot[i] = iges_next_value( params );
+    }
     for (i = 0; i <= k; i++){
-        pt = getValue( fd, status, pt, line_buffer, &(value[0]), &end_of_record
-              , parameter_delimiter_character, record_delimiter_character, 64);
-        sscanf(value, "%g", &fvalue);
-        entity->curve->cp[i].w = (NurbsFloat)fvalue;
+        curve->cp[i].w = iges_next_value( params );
     }
-
-    /* Read the control point coordinates x y z */
     for (i = 0; i <= k; i++){
-        pt =  getValue(fd, status, pt, line_buffer, &(value[0]), &end_of_record
-              , parameter_delimiter_character, record_delimiter_character, 64
-              );
-        sscanf(value, "%g", &fvalue);
-        entity->curve->cp[i].x = (NurbsFloat)fvalue;
-        pt =  getValue
-              ( fd, status, pt, line_buffer, &(value[0]), &end_of_record
-              , parameter_delimiter_character, record_delimiter_character, 64
-              );
-        sscanf(value, "%g", &fvalue);
-        entity->curve->cp[i].y = (NurbsFloat)fvalue;
-        pt =  getValue
-              ( fd, status, pt, line_buffer, &(value[0]), &end_of_record
-              , parameter_delimiter_character, record_delimiter_character, 64
-              );
-        sscanf(value, "%g", &fvalue);
-        entity->curve->cp[i].z = (NurbsFloat)fvalue;
-    }
-
-    /* Read x norm */
-    pt = getValue
-        ( fd, status, pt, line_buffer, &(value[0]), &end_of_record
-        , parameter_delimiter_character, record_delimiter_character, 64
-        );
-    /* Read y norm */
-    pt = getValue
-        ( fd, status, pt, line_buffer, &(value[0]), &end_of_record
-        , parameter_delimiter_character, record_delimiter_character, 64
-        );
-    /* Read z norm */
-    pt =  getValue
-        ( fd, status, pt, line_buffer, &(value[0]), &end_of_record
-        , parameter_delimiter_character, record_delimiter_character, 64
-        );
+        curve->cp[i].x = iges_next_value( params );
+        curve->cp[i].y = iges_next_value( params );
+        curve->cp[i].z = iges_next_value( params );
+    }
+
+    /* The parametric range and the normal are not used */
+
+    return curve;
 }
 
 
-/* Reads all data parameters */
-static void parseSurfaceEntity(Entity* entity
-    , FILE* fd, char* *status
-    , char* line_buffer
-    , const char parameter_delimiter_character
-    , const char record_delimiter_character)
+/* Decodes the parameters of a surface (entity 128).
+ * Returns nullptr if the data is not valid or the memory is exhausted. */
+static NurbsSurface* decode_surface( IgesParameters* params, const NurbsIgesEntity* entity )
 {
-    char* pt = &(line_buffer[0]);
-    char value[128];
-    int entity_type_number;
+    NurbsSurface* surface;
     int k1, k2, m1, m2, i, j;
-    float fvalue;
-    int end_of_record;
 
-    /* Entity type number should be the same as in the directory */
-    pt = getValue(fd, status, pt, line_buffer, &(value[0]), &end_of_record
-        , parameter_delimiter_character, record_delimiter_character, 64);
-
-    sscanf(value, "%i", &entity_type_number);
-    if (entity_type_number != entity->entity_type_number){
-        _handle_error_("type numbers are not the same!"); 
+    /* NurbsIgesEntity type number, upper indexes of the sums, degrees */
+    if (iges_next_int( params ) != 128){
+        return nullptr;
+    }
+    k1 = iges_next_int( params );
+    k2 = iges_next_int( params );
+    m1 = iges_next_int( params );
+    m2 = iges_next_int( params );
+    if (params->error || k1 < 0 || k2 < 0 || m1 < 0 || m2 < 0
+        || m1 > NURBS_MAX_DEGREE || m2 > NURBS_MAX_DEGREE)
+    {
+        return nullptr;
     }
 
-    /* Upper index of first sum */
-    pt = getValue(fd, status, pt, line_buffer, &(value[0]), &end_of_record
-        , parameter_delimiter_character, record_delimiter_character, 64);
-
-    sscanf(value, "%i", &k1);
-
-    /* Upper index of second sum */
-    pt = getValue(fd, status, pt, line_buffer, &(value[0]), &end_of_record
-        , parameter_delimiter_character, record_delimiter_character, 64);
-
-    sscanf(value, "%i", &k2);
-
-    /* Degree of first basis function */
-    pt = getValue(fd, status, pt, line_buffer, &(value[0]), &end_of_record
-        , parameter_delimiter_character, record_delimiter_character, 64);
-
-    sscanf(value, "%i", &m1);
+    /* Properties: closed in u and v, polynomial, periodic in u and v */
+    for (i = 0; i < 5; i++){
+        iges_next_value( params );
+    }
 
-    /* Degree of second basis function */
-    pt = getValue(fd, status, pt, line_buffer, &(value[0]), &end_of_record
-        , parameter_delimiter_character, record_delimiter_character, 64);
+    _check_(surface = (NurbsSurface*)_malloc_(sizeof(NurbsSurface)));
+    if (surface == nullptr){
+        return nullptr;
+    }
+    nurbs_surface_init( surface );
+    nurbs_surface_alloc( surface, k1 + 1, k2 + 1, m1, m2 );
+    if (surface->cp_stream == nullptr || surface->knot_stream == nullptr){
+        return surface;
+    }
 
-    sscanf(value, "%i", &m2);
+    strcpy( surface->label, entity->label );
+    surface->id = entity->id;
 
-    /* property: 0 - closed in the first parametric direction, 1 - not closed */
-    pt = getValue(fd, status, pt, line_buffer, &(value[0]), &end_of_record
-        , parameter_delimiter_character, record_delimiter_character, 64);
+    for (i = 0; i < surface->knot_length_u; i++){
+        surface->knot_u[i] = iges_next_value( params );
+    }
+    for (i = 0; i < surface->knot_length_v; i++){
+        surface->knot_v[i] = iges_next_value( params );
+    }
 
-    /* property: 0 - closed in the second parametric direction, 1 - not closed */
-    pt = getValue(fd, status, pt, line_buffer, &(value[0]), &end_of_record
-        , parameter_delimiter_character, record_delimiter_character, 64);
+    /* The first index varies faster */
+    for (j = 0; j <= k2; j++){
+        for (i = 0; i <= k1; i++){
+            surface->cp[i][j].w = iges_next_value( params );
+        }
+    }
+    for (j = 0; j <= k2; j++){
+        for (i = 0; i <= k1; i++){
+            surface->cp[i][j].x = iges_next_value( params );
+            surface->cp[i][j].y = iges_next_value( params );
+            surface->cp[i][j].z = iges_next_value( params );
+        }
+    }
 
-    /* property: 0 - rational, 1 - polynomial */
-    pt = getValue(fd, status, pt, line_buffer, &(value[0]), &end_of_record
-        , parameter_delimiter_character, record_delimiter_character, 64);
+    /* The parametric ranges are not used */
 
-    /* property: 0 - non periodic in the first parametric direction, 1 - periodic */
-    pt = getValue(fd, status, pt, line_buffer, &(value[0]), &end_of_record
-        , parameter_delimiter_character, record_delimiter_character, 64);
+    return surface;
+}
 
-    /* property: 0 - non periodic in the second parametric direction, 1 - periodic */
-    pt = getValue(fd, status, pt, line_buffer, &(value[0]), &end_of_record
-        , parameter_delimiter_character, record_delimiter_character, 64);
 
-    entity->surface = nurbs_surface_alloc(nullptr, 1+k1, 1+k2, m1, m2);
+/* Decodes the parameter data of an entity. Returns 0 if it is not valid. */
+static int decode_parameters
+    ( NurbsIgesEntity* entity
+    , const char* text
+    , const char parameter_delimiter_character
+    , const char record_delimiter_character
+    )
+{
+    IgesParameters params;
 
-    /* Set the label and id */
-    str_trim(entity->label);
-    strcpy(entity->surface->label, entity->label);
-    entity->surface->id = entity->subscript;
+    params.pt = text;
+    params.parameter_delimiter_character = parameter_delimiter_character;
+    params.record_delimiter_character = record_delimiter_character;
+    params.end_of_record = 0;
+    params.error = 0;
 
-    /* Read the first knots sequence */
-    for (i = 0; i < entity->surface->knot_length_u; i++){
-        pt = getValue(fd, status, pt, line_buffer, &(value[0]), &end_of_record
-            , parameter_delimiter_character, record_delimiter_character, 64);
-        sscanf(value, "%g", &fvalue);
-        entity->surface->knot_u[i] = (NurbsFloat)fvalue;
+    if (entity->type == 126){
+        entity->curve = decode_curve( &params, entity );
     }
-
-    /* Read the second knots sequence */
-    for (i = 0; i < entity->surface->knot_length_v; i++){
-        pt = getValue(fd, status, pt, line_buffer, &(value[0]), &end_of_record
-            , parameter_delimiter_character, record_delimiter_character, 64);
-        sscanf(value, "%g", &fvalue);
-        entity->surface->knot_v[i] = (NurbsFloat)fvalue;
+    else if (entity->type == 128){
+        entity->surface = decode_surface( &params, entity );
     }
 
-    /* Read the weights */
-    for (i = 0; i < entity->surface->cp_length_u; i++){
-        for (j = 0; j < entity->surface->cp_length_v; j++){
-          pt = getValue
-                ( fd, status, pt, line_buffer, &(value[0]), &end_of_record
-                , parameter_delimiter_character
-                , record_delimiter_character, 64
-                );
-          sscanf(value, "%g", &fvalue);
-          entity->surface->cp[i][j].w = (NurbsFloat)fvalue;
+    if (params.error){
+        if (entity->curve != nullptr){
+            nurbs_curve_dispose( entity->curve );
+            free( entity->curve );
+            entity->curve = nullptr;
         }
-    }
-
-    /* Read the control points coordinates x y z */
-    for (i = 0; i < entity->surface->cp_length_v; i++){
-        for (j = 0; j < entity->surface->cp_length_u; j++){
-            pt = getValue
-                ( fd, status, pt, line_buffer, &(value[0]), &end_of_record
-                , parameter_delimiter_character
-                , record_delimiter_character, 64
-                );
-
-            sscanf(value, "%g", &fvalue);
-            entity->surface->cp[j][i].x = (NurbsFloat)fvalue;
-            pt = getValue
-                ( fd, status, pt, line_buffer, &(value[0]), &end_of_record
-                , parameter_delimiter_character
-                , record_delimiter_character, 64
-                );
-
-            sscanf(value, "%g", &fvalue);
-            entity->surface->cp[j][i].y = (NurbsFloat)fvalue;
-            pt = getValue
-                ( fd, status, pt, line_buffer, &(value[0]), &end_of_record
-                , parameter_delimiter_character
-                , record_delimiter_character, 64
-                );
-
-            sscanf(value, "%g", &fvalue);
-            entity->surface->cp[j][i].z = (NurbsFloat)fvalue;
+        if (entity->surface != nullptr){
+            nurbs_surface_dispose( entity->surface );
+            free( entity->surface );
+            entity->surface = nullptr;
         }
+        return 0;
     }
 
-    /* Starting value for the first parametric direction */
-    pt = getValue(fd, status, pt, line_buffer, &(value[0]), &end_of_record
-        , parameter_delimiter_character, record_delimiter_character, 64);
-
-    /* Ending value for the first parametric direction */
-    pt = getValue(fd, status, pt, line_buffer, &(value[0]), &end_of_record
-        , parameter_delimiter_character, record_delimiter_character, 64);
-
-    /* Starting value for the second parametric direction */
-    pt = getValue(fd, status, pt, line_buffer, &(value[0]), &end_of_record
-        , parameter_delimiter_character, record_delimiter_character, 64);
-
-    /* Ending value for the second parametric direction */
-    pt = getValue(fd, status, pt, line_buffer, &(value[0]), &end_of_record
-        , parameter_delimiter_character, record_delimiter_character, 64);
+    return (entity->curve != nullptr || entity->surface != nullptr);
 }
 
 
-/* Copies a string */
-static char* str_copy_label( const char* label )
+/* Decodes one entity. Returns 0 if the data is not valid. */
+static int decode_entity( const IgesFile* iges, NurbsIgesEntity* entity )
 {
-    char* dest = nullptr;
+    char* text;
+    int status;
 
-    if (label == nullptr){
-        return nullptr;
+    text = iges_parameter_text( iges, entity );
+    if (text == nullptr){
+        return 0;
     }
 
-    dest = (char*)malloc( sizeof(char) * (strlen(label) + 1) );
-    strcpy(dest, label);
-
-    return dest;
-}
-
-
-/* Reads the NURBS entities in the parameter section */
-static void readParameterSectionASCII(FILE* fd
-    , char** status
-    , char* line_buffer
-    , Entity* entities
-    , const int num_entities
-    , const char parameter_delimiter_character
-    , const char record_delimiter_character
-){
-    char letter_code;       /* Letter code of the line */
-    int line_number;        /* Line number readed from the IGES line */
-    int entity_number = 0;  /* Entity indexer */
-
-    letter_code = getLetterCode(line_buffer);
-    /* Advance until we find the parameter section */
-    while(*status != NULL && letter_code != 'P'){        
-        *status = fgets(line_buffer, 127, fd);
-        letter_code = getLetterCode(line_buffer);
-    }
-
-    while(*status != NULL && letter_code == 'P' && strlen(line_buffer) >= 80){        
-        /* The line number is at the last characters */
-        sscanf(&(line_buffer[74]), "%i", &line_number);
-        /* Cut at column 65; it must be a space */
-        line_buffer[65] = '\0';
-
-        /* If the line number is one with a nurbs, extract the data */
-        if (line_number == entities[entity_number].data_line){
-            if (entities[entity_number].entity_type_number == 128){
-                parseSurfaceEntity
-                    ( &(entities[entity_number]), fd, status, line_buffer
-                    , parameter_delimiter_character
-                    , record_delimiter_character
-                    );
-
-                entity_number++;
+    status = decode_parameters( entity, text
+        , iges->parameter_delimiter_character
+        , iges->record_delimiter_character );
 
-            }
-            else if (entities[entity_number].entity_type_number == 126){
-                parseCurveEntity
-                    ( &(entities[entity_number]), fd, status, line_buffer
-                    , parameter_delimiter_character
-                    , record_delimiter_character
-                    );
-
-                entity_number++;
-            }
-        }
+    free( text );
 
-        /* Read the next line */
-        *status = fgets(line_buffer, 82, fd);
-        letter_code = getLetterCode(line_buffer);
-    }
+    return status;
 }
 
 
@@ -1008,139 +720,112 @@ static void check_curves_ids( NurbsCurve* curve_array, const int nurbs_length )
 
 /* Reads the NURBS curves and surfaces from a IGES file in ASCII format */
 static void nurbs_import_iges_file
-		( FILE* fd 			             /* File handler */
+		( const char* filename 	         /* IGES file name */
         , NurbsCurve** p_curve_array     /* Output array with the curves */
         , int* num_curves                /* Number of curves */
         , NurbsSurface** p_surface_array /* Output array with the surfaces */
         , int* num_surfaces              /* Number of surfaces */
 ){
-    char line_buffer[128];      /* Buffer for reading text lines in the file */
-    char* status;               /* If status == NULL we are at the end of file */
-    GlobalSectionFields global; /* Parameter in the global section  */
-    Entity* entities = nullptr; /* CAD entities (NURBS curves or surface) */
+    IgesFile iges;
+    NurbsIgesEntity* entities = nullptr; /* CAD entities (NURBS curves or surface) */
     int num_entities = 0;       /* Total number of CAD entities */
-    int i, j;
+    int num_errors = 0;
+    int i, nc = 0, ns = 0;
 
     NurbsCurve* curve_array = nullptr;
     NurbsSurface* surface_array = nullptr;
 
-    /* Lines must have 80 characters, but there are also \n \r,  
-     * which increases the line length, so rows requires more that 80 chars */
-    status = fgets(&(line_buffer[0]), 127, fd);
-    /* Check that is not a flag section */
-    if (getLetterCode(&(line_buffer[0])) == 'C'){
-        _handle_error_("Cannot read compressed IGES files");
+    if (!iges_file_read( &iges, filename )){
         return;
     }
 
-    readStartSectionASCII(fd, &status, &(line_buffer[0]));
-
-    rewind(fd);
-    status = fgets(&(line_buffer[0]), 127, fd);
-
-    readGlobalSectionASCII(fd, &status, &(line_buffer[0]), &global);
-
-    rewind(fd);
-    status = fgets(&(line_buffer[0]), 127, fd);
-
-    readDirectorySectionASCII(fd, &status, &(line_buffer[0])
-        , &entities, &num_entities);
-
+    /* The directory gives the lines of the parameters of each entity */
+    num_entities = iges_directory_nurbs( &iges, &entities );
     if (num_entities <= 0){
         /* The file is empty or it is not an IGES file or who knows... */
-        _handle_error_("There are no entities in the file");
+        if (num_entities == 0){
+            _handle_error_("There are no entities in the file");
+        }
+        iges_file_dispose( &iges );
         return;
     }
 
-    rewind(fd);
-    status = fgets(&(line_buffer[0]), 127, fd);
+    /* Skip the entities that are not requested */
+    for (i = 0; i < num_entities; i++){
+        if ((entities[i].type == 126 && p_curve_array == nullptr)
+         || (entities[i].type == 128 && p_surface_array == nullptr))
+        {
+            entities[i].type = 0;
+        }
+    }
 
-    readParameterSectionASCII
-        ( fd, &status, &(line_buffer[0])
-        , entities, num_entities
-        , global.parameter_delimiter_character
-        , global.record_delimiter_character
-        );
+    /* The entities are independent of each other */
+    #pragma omp parallel for schedule(dynamic) reduction(+:num_errors)
+    for (i = 0; i < num_entities; i++){
+        if (entities[i].type != 0){
+            num_errors += !decode_entity( &iges, &entities[i] );
+        }
+    }
 
-    /* Close file */
-    fclose(fd);
+    iges_file_dispose( &iges );
 
-    /* Store the curves */
-    if (num_curves != nullptr && p_curve_array != nullptr){
-        *num_curves = 0;
-        for (i = 0; i < num_entities; i++){
-            if (entities[i].curve != nullptr){
-            *num_curves += 1;
-            }
-        }
-        if (*num_curves > 0){
-            _check_( curve_array = (NurbsCurve*)
-                _malloc_(sizeof(NurbsCurve)* (*num_curves)));
-
-            j = 0;
-            for (i = 0; i < num_entities; i++){
-                if (entities[i].curve != nullptr){
-                    curve_array[j] = *(entities[i].curve);
-                    free(entities[i].curve);
-                    j++;
-                }
-            }
-        }
+    if (num_errors > 0){
+        _handle_error_("Some NURBS entities of the IGES file are not valid");
     }
 
-    /* Stores the surfaces */
-    if (num_surfaces != nullptr && p_surface_array != nullptr){
-        *num_surfaces = 0;
-        for (i = 0; i < num_entities; i++){
-            if (entities[i].surface != nullptr){
-                *num_surfaces += 1;
+    /* Store the curves and the surfaces in arrays */
+    for (i = 0; i < num_entities; i++){
+        nc += (entities[i].curve != nullptr);
+        ns += (entities[i].surface != nullptr);
+    }
+
+    if (nc > 0){
+        _check_(curve_array = (NurbsCurve*)_malloc_(sizeof(NurbsCurve) * nc));
+    }
+    if (ns > 0){
+        _check_(surface_array = (NurbsSurface*)_malloc_(sizeof(NurbsSurface) * ns));
+    }
+
+    nc = 0;
+    ns = 0;
+    for (i = 0; i < num_entities; i++){
+        if (entities[i].curve != nullptr){
+            if (curve_array != nullptr){
+                curve_array[nc++] = *(entities[i].curve);
+            }
+            else{
+                nurbs_curve_dispose( entities[i].curve );
             }
+            free( entities[i].curve );
         }
-        if (*num_surfaces > 0){
-            _check_( surface_array = (NurbsSurface*)
-                _malloc_(sizeof(NurbsSurface) * (*num_surfaces)));
-
-            j = 0;
-            for (i = 0; i < num_entities; i++){
-                if (entities[i].surface != nullptr){
-                    surface_array[j] = *(entities[i].surface);
-                    free(entities[i].surface);
-                    j++;
-                }
+        if (entities[i].surface != nullptr){
+            if (surface_array != nullptr){
+                surface_array[ns++] = *(entities[i].surface);
+            }
+            else{
+                nurbs_surface_dispose( entities[i].surface );
             }
+            free( entities[i].surface );
         }
     }
+    free(entities);
+
+    /* Check that all ids are different */
+    check_surface_ids( surface_array, ns );
+    check_curves_ids( curve_array, nc );
 
-    /* Release memory */
     if (p_curve_array != nullptr){
         *p_curve_array = curve_array;
     }
-    else{
-        /* Release the unused entities */
-        for (i = 0; i < num_entities; i++){
-            if (entities[i].curve != nullptr){
-                nurbs_curve_dispose( entities[i].curve );
-                free( entities[i].curve );
-            }
-        }
+    if (num_curves != nullptr){
+        *num_curves = nc;
     }
     if (p_surface_array != nullptr){
         *p_surface_array = surface_array;
     }
-    else{
-        /* Release the unused entities */
-        for (i = 0; i < num_entities; i++){
-            if (entities[i].surface != nullptr){
-                nurbs_surface_dispose( entities[i].surface );
-                free( entities[i].surface );
-            }
-        }
+    if (num_surfaces != nullptr){
+        *num_surfaces = ns;
     }
-    free(entities);
-
-    /* Check that all ids are different */
-    check_surface_ids( surface_array, *num_surfaces );
-    check_curves_ids( curve_array, *num_surfaces );
 }
 
 
@@ -1152,8 +837,6 @@ void nurbs_import_iges
         , NurbsSurface** p_surface_array /* Output array with the surfaces */
         , int* num_surfaces              /* Number of surfaces */
 ){
-    FILE* fd;
-
     /* Initialize */
     if (p_curve_array != nullptr){
         *p_curve_array = nullptr;
@@ -1168,14 +851,7 @@ void nurbs_import_iges
         *num_surfaces = 0;
     }
 
-    fd = fopen(filename, "r");
-
-    if (fd == NULL){
-        _handle_error_("Cannot open file %s", filename);
-        return;
-    }
-
-    nurbs_import_iges_file(fd, p_curve_array, num_curves, p_surface_array, num_surfaces);
+    nurbs_import_iges_file(filename, p_curve_array, num_curves, p_surface_array, num_surfaces);
 }
 
 
@@ -1186,7 +862,6 @@ NurbsSurface* nurbs_surface_import_iges
     )
 {
     NurbsSurface* surface_array = nullptr;
-    FILE* fd;
     char* time_str = getlocaltime();
 
     *num_surfaces = 0;
@@ -1194,15 +869,1025 @@ NurbsSurface* nurbs_surface_import_iges
     _trace_( "--- %s", time_str );
     _trace_( "Loading IGES file %s\n", filename );
 
-    fd = fopen(filename, "r");
+    nurbs_import_iges_file(filename, nullptr, nullptr, &surface_array, num_surfaces);
 
-    if (fd == NULL){
-        _handle_error_("Cannot open file %s", filename);
-        return nullptr;
+    return surface_array;
+}
+
+
+/******************************************************************************/
+
+/* Size of the blocks read from the beginning of the file */
+#define IGES_HEAD_BLOCK 65536
+
+
+/* Reads the Start, Global and Directory Entry sections, up to the first line
+ * of the Parameter Data section, which is not read. The position of that 
+ * line is stored in the handle, and the size of the lines if they have all
+ * the same size. Returns 0 if the file is not valid or the memory is
+ * exhausted. */
+static int iges_read_head( NurbsIges* handle, IgesFile* iges )
+{
+    char* buffer;
+    size_t capacity = IGES_HEAD_BLOCK, size = 0, scan = 0, n = 1;
+    int fixed_records = -1, found = 0, line_size = -1;
+
+    iges_file_init( iges );
+
+    _check_(buffer = (char*)_malloc_(capacity + 1));
+    if (buffer == nullptr){
+        return 0;
     }
 
-    nurbs_import_iges_file(fd, nullptr, nullptr, &surface_array, num_surfaces);
+    while (!found && n > 0){
+        if (size == capacity){
+            char* tmp;
+            _check_(tmp = (char*)_realloc_(buffer, 2 * capacity + 1));
+            if (tmp == nullptr){
+                free( buffer );
+                return 0;
+            }
+            buffer = tmp;
+            capacity *= 2;
+        }
 
-    return surface_array;
+        n = fread( buffer + size, 1, capacity - size, handle->fd );
+        size += n;
+
+        /* Without line breaks in the first record, all records are 80 chars */
+        if (fixed_records < 0 && (size >= 82 || n == 0)){
+            fixed_records = (memchr( buffer, '\n', (size < 82) ? size : 82 ) 
+                == NULL && size >= 160);
+        }
+        if (fixed_records < 0){
+            continue;
+        }
+
+        /* Complete lines */
+        while (scan < size){
+            char* p = buffer + scan;
+            size_t length, next;
+
+            if (fixed_records){
+                if (size - scan < 80 && n > 0){
+                    break;
+                }
+                length = next = (size - scan < 80) ? size - scan : 80;
+            }
+            else{
+                char* q = (char*)memchr( p, '\n', size - scan );
+                if (q == NULL){
+                    if (n > 0){
+                        break;
+                    }
+                    length = next = size - scan;
+                }
+                else{
+                    length = q - p;
+                    next = length + 1;
+                }
+                if (length > 0 && p[length - 1] == '\r'){
+                    length--;
+                }
+            }
+
+            if (length > IGES_LETTER_COLUMN && p[IGES_LETTER_COLUMN] == 'P'){
+                found = 1;
+                break;
+            }
+
+            if (line_size < 0){
+                line_size = (int)next;
+            }
+            else if (line_size != (int)next){
+                line_size = 0;
+            }
+            scan += next;
+        }
+    }
+
+    if (!found){
+        _handle_error_( "There is no Parameter Data section in the IGES file" );
+        free( buffer );
+        return 0;
+    }
+
+    handle->parameter_offset = (long long)scan;
+    handle->line_size = (line_size > 0 && line_size < 256) ? line_size : 0;
+
+    buffer[scan] = '\0';
+    iges->buffer = buffer;
+    iges->size = scan;
+
+    if (!iges_index_lines( iges )){
+        iges_file_dispose( iges );
+        return 0;
+    }
+    if (iges->num_lines > 0 && iges->line[0][IGES_LETTER_COLUMN] == 'C'){
+        _handle_error_( "Cannot read compressed IGES files" );
+        iges_file_dispose( iges );
+        return 0;
+    }
+
+    iges_index_sections( iges );
+    iges_delimiters( iges );
+
+    return 1;
+}
+
+
+/* Finds the position of each line of the Parameter Data section.
+ * Returns 0 if the memory is exhausted. */
+static int iges_index_parameter_lines( NurbsIges* handle )
+{
+    char line[256];
+    long long position;
+    int capacity = 1024;
+    long long* index;
+
+    _check_(handle->parameter_line = (long long*)_malloc_
+        (sizeof(long long) * capacity));
+    if (handle->parameter_line == nullptr){
+        return 0;
+    }
+    handle->num_parameter_lines = 0;
+
+    nurbs_fseek( handle->fd, handle->parameter_offset, SEEK_SET );
+    position = handle->parameter_offset;
+
+    while (fgets( line, sizeof(line), handle->fd ) != NULL){
+        const size_t length = strlen( line );
+
+        if (length > IGES_LETTER_COLUMN && line[IGES_LETTER_COLUMN] == 'P'){
+            if (handle->num_parameter_lines == capacity){
+                _check_(index = (long long*)_realloc_(handle->parameter_line
+                    , sizeof(long long) * 2 * capacity));
+                if (index == nullptr){
+                    return 0;
+                }
+                handle->parameter_line = index;
+                capacity *= 2;
+            }
+            handle->parameter_line[handle->num_parameter_lines++] = position;
+        }
+        else if (length > IGES_LETTER_COLUMN){
+            break;  /* Terminate section */
+        }
+
+        /* The rest of a long line */
+        while (length > 0 && line[length - 1] != '\n' 
+            && fgets( line, sizeof(line), handle->fd ) != NULL)
+        {
+            if (strchr( line, '\n' ) != NULL){
+                break;
+            }
+        }
+        position = nurbs_ftell( handle->fd );
+    }
+
+    return 1;
+}
+
+
+/* Reads the line of the Parameter Data section, from the current position.
+ * Returns 0 if it is not a line of the section. */
+static int iges_read_parameter_line( NurbsIges* handle, char line[] )
+{
+    size_t length;
+
+    if (handle->line_size > 0){
+        length = fread( line, 1, handle->line_size, handle->fd );
+        line[length] = '\0';
+    }
+    else{
+        if (fgets( line, 256, handle->fd ) == NULL){
+            return 0;
+        }
+        length = strlen( line );
+    }
+
+    return (length > IGES_LETTER_COLUMN && line[IGES_LETTER_COLUMN] == 'P');
+}
+
+
+/* Reads the parameter data of the entity (the first 64 columns of its lines)
+ * from the file. Returns nullptr if the lines are not in the file or the 
+ * memory is exhausted. */
+static char* iges_read_parameter_text
+    ( NurbsIges* handle
+    , const NurbsIgesEntity* entity
+    )
+{
+    char line[256];
+    char* text;
+    int i, count = (entity->data_count > 0) ? entity->data_count : 1;
+    int capacity = count;
+    int valid = 1;
+
+    if (entity->data_line < 1){
+        return nullptr;
+    }
+
+    /* The size of the lines gives the position of any line. Otherwise (or 
+     * if the lines of this section have a different size), the position of
+     * each line is read once. */
+    if (handle->line_size > 0){
+        nurbs_fseek( handle->fd, handle->parameter_offset 
+            + (long long)(entity->data_line - 1) * handle->line_size, SEEK_SET );
+        valid = iges_read_parameter_line( handle, line );
+        if (!valid){
+            handle->line_size = 0;
+        }
+    }
+    if (handle->line_size == 0){
+        if (handle->parameter_line == nullptr 
+            && !iges_index_parameter_lines( handle ))
+        {
+            return nullptr;
+        }
+        if (entity->data_line > handle->num_parameter_lines){
+            return nullptr;
+        }
+        nurbs_fseek( handle->fd, handle->parameter_line[entity->data_line - 1]
+            , SEEK_SET );
+        valid = iges_read_parameter_line( handle, line );
+    }
+    if (!valid){
+        return nullptr;
+    }
+
+    _check_(text = (char*)_malloc_(capacity * IGES_PARAMETER_COLUMNS + 1));
+    if (text == nullptr){
+        return nullptr;
+    }
+
+    /* Without the count, the lines with the pointer to the directory entry */
+    for (i = 0; valid; ){
+        if (entity->data_count <= 0 
+            && field_int( line, 8 ) != entity->directory_line)
+        {
+            break;
+        }
+        if (i == capacity){
+            char* tmp;
+            _check_(tmp = (char*)_realloc_(text
+                , 2 * capacity * IGES_PARAMETER_COLUMNS + 1));
+            if (tmp == nullptr){
+                free( text );
+                return nullptr;
+            }
+            text = tmp;
+            capacity *= 2;
+        }
+
+        memcpy( text + i * IGES_PARAMETER_COLUMNS, line, IGES_PARAMETER_COLUMNS );
+        i++;
+
+        if (entity->data_count > 0 && i == entity->data_count){
+            break;
+        }
+        valid = iges_read_parameter_line( handle, line );
+    }
+    text[i * IGES_PARAMETER_COLUMNS] = '\0';
+
+    return text;
+}
+
+
+/* Reads the entity from the file, if it has not been read yet */
+static void iges_load_entity( NurbsIges* handle, NurbsIgesEntity* entity )
+{
+    char* text;
+
+    if (entity->curve != nullptr || entity->surface != nullptr){
+        return;
+    }
+
+    text = iges_read_parameter_text( handle, entity );
+    if (text == nullptr){
+        _handle_error_( "Cannot read the parameter data of the IGES entity" );
+        return;
+    }
+
+    if (!decode_parameters( entity, text
+        , handle->parameter_delimiter, handle->record_delimiter ))
+    {
+        _handle_error_( "The NURBS entity of the IGES file is not valid" );
+    }
+
+    free( text );
+}
+
+
+/* Equivalent to a default constructor */
+void nurbs_iges_init( NurbsIges* handle )
+{
+    handle->num_entities = 0;
+    handle->entity = nullptr;
+    handle->fd = nullptr;
+    handle->parameter_offset = 0;
+    handle->line_size = 0;
+    handle->parameter_line = nullptr;
+    handle->num_parameter_lines = 0;
+    handle->parameter_delimiter = ',';
+    handle->record_delimiter = ';';
+}
+
+
+/* Opens an IGES file and reads the directory */
+int nurbs_iges_open( NurbsIges* handle, const char* filename )
+{
+    IgesFile iges;
+    int i;
+
+    nurbs_iges_init( handle );
+
+    handle->fd = fopen( filename, "rb" );
+    if (handle->fd == nullptr){
+        _handle_error_( "Cannot open the IGES file" );
+        return 0;
+    }
+
+    if (!iges_read_head( handle, &iges )){
+        nurbs_iges_close( handle );
+        return 0;
+    }
+
+    handle->parameter_delimiter = iges.parameter_delimiter_character;
+    handle->record_delimiter = iges.record_delimiter_character;
+
+    if (iges.num_directory >= 2){
+        _check_(handle->entity = (NurbsIgesEntity*)_malloc_(
+            sizeof(NurbsIgesEntity) * (iges.num_directory / 2)));
+        if (handle->entity == nullptr){
+            iges_file_dispose( &iges );
+            nurbs_iges_close( handle );
+            return 0;
+        }
+    }
+
+    for (i = 0; i + 1 < iges.num_directory; i += 2){
+        read_directory_entry( &handle->entity[handle->num_entities++]
+            , iges.line[iges.directory + i]
+            , iges.line[iges.directory + i + 1], i + 1 );
+    }
+
+    iges_file_dispose( &iges );
+
+    return 1;
+}
+
+
+/* Finds an entity by its label */
+int nurbs_iges_find
+    ( const NurbsIges* handle
+    , const char* label
+    , const int type
+    )
+{
+    int i;
+
+    for (i = 0; i < handle->num_entities; i++){
+        if ((type == 0 || handle->entity[i].type == type)
+            && strcmp( handle->entity[i].label, label ) == 0)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+
+/* Reads a curve (entity 126) */
+NurbsCurve* nurbs_iges_get_curve( NurbsIges* handle, const int index )
+{
+    NurbsIgesEntity* entity;
+
+    if (index < 0 || index >= handle->num_entities){
+        _handle_error_( "Index out of the range of the IGES entities" );
+        return nullptr;
+    }
+
+    entity = &handle->entity[index];
+    if (entity->type != 126){
+        _handle_error_( "The IGES entity is not a NURBS curve" );
+        return nullptr;
+    }
+
+    iges_load_entity( handle, entity );
+
+    return entity->curve;
+}
+
+
+/* Reads a surface (entity 128) */
+NurbsSurface* nurbs_iges_get_surface( NurbsIges* handle, const int index )
+{
+    NurbsIgesEntity* entity;
+
+    if (index < 0 || index >= handle->num_entities){
+        _handle_error_( "Index out of the range of the IGES entities" );
+        return nullptr;
+    }
+
+    entity = &handle->entity[index];
+    if (entity->type != 128){
+        _handle_error_( "The IGES entity is not a NURBS surface" );
+        return nullptr;
+    }
+
+    iges_load_entity( handle, entity );
+
+    return entity->surface;
+}
+
+
+/* Releases a curve or surface that has been read */
+void nurbs_iges_release( NurbsIges* handle, const int index )
+{
+    NurbsIgesEntity* entity;
+
+    if (index < 0 || index >= handle->num_entities){
+        return;
+    }
+
+    entity = &handle->entity[index];
+    if (entity->curve != nullptr){
+        nurbs_curve_dispose( entity->curve );
+        free( entity->curve );
+        entity->curve = nullptr;
+    }
+    if (entity->surface != nullptr){
+        nurbs_surface_dispose( entity->surface );
+        free( entity->surface );
+        entity->surface = nullptr;
+    }
+}
+
+
+/* Closes the file and releases the entities */
+void nurbs_iges_close( NurbsIges* handle )
+{
+    int i;
+
+    for (i = 0; i < handle->num_entities; i++){
+        nurbs_iges_release( handle, i );
+    }
+    if (handle->entity != nullptr){
+        free( handle->entity );
+    }
+    if (handle->parameter_line != nullptr){
+        free( handle->parameter_line );
+    }
+    if (handle->fd != nullptr){
+        fclose( handle->fd );
+    }
+
+    nurbs_iges_init( handle );
+}
+
+
+/******************************************************************************/
+
+/* Text of a section of the IGES file (fixed format lines) */
+typedef struct
+{
+    char* text;         /* Lines of the section */
+    size_t length;      /* Length of the text */
+    size_t capacity;    /* Size of the allocated memory */
+    int num_lines;      /* Number of lines (sequence number of the last one) */
+    char line[81];      /* Line being filled */
+    int line_length;    /* Characters in the line being filled */
+}IgesSection;
+
+
+/* Equivalent to a default constructor */
+static void iges_section_init( IgesSection* section )
+{
+    section->text = nullptr;
+    section->length = 0;
+    section->capacity = 0;
+    section->num_lines = 0;
+    section->line_length = 0;
+}
+
+
+/* Makes room for more characters. Returns 0 if the memory is exhausted. */
+static int iges_section_reserve( IgesSection* section, const size_t length )
+{
+    char* text;
+    size_t capacity;
+
+    if (section->length + length <= section->capacity){
+        return 1;
+    }
+
+    capacity = (section->capacity > 0) ? 2 * section->capacity : 8192;
+    while (capacity < section->length + length){
+        capacity *= 2;
+    }
+
+    _check_(text = (char*)_realloc_(section->text, capacity));
+    if (text == nullptr){
+        return 0;
+    }
+    section->text = text;
+    section->capacity = capacity;
+
+    return 1;
+}
+
+
+/* Writes a number in a field of 7 columns, aligned to the right */
+static void iges_field7( char* field, int number )
+{
+    int i;
+
+    for (i = 6; i >= 0; i--){
+        field[i] = (number > 0 || i == 6) ? (char)('0' + number % 10) : ' ';
+        number /= 10;
+    }
+}
+
+
+/* Appends a complete line of 80 characters: the data, the letter code and
+ * the sequence number. Returns 0 if the memory is exhausted. */
+static int iges_section_add_line
+    ( IgesSection* section
+    , const char* data      /* Data of the line (up to 72 characters) */
+    , const char letter     /* Letter code of the section */
+    )
+{
+    char* line;
+    size_t length = strlen( data );
+
+    if (!iges_section_reserve( section, 81 )){
+        return 0;
+    }
+
+    if (length > 72){
+        length = 72;
+    }
+
+    line = section->text + section->length;
+    memcpy( line, data, length );
+    memset( line + length, ' ', 72 - length );
+    line[72] = letter;
+    iges_field7( line + 73, ++section->num_lines );
+    line[80] = '\n';
+    section->length += 81;
+
+    return 1;
+}
+
+
+/* Appends the lines of another section, with new sequence numbers.
+ * Returns 0 if the memory is exhausted. */
+static int iges_section_append( IgesSection* section, const IgesSection* lines )
+{
+    size_t i;
+
+    if (!iges_section_reserve( section, lines->length )){
+        return 0;
+    }
+
+    memcpy( section->text + section->length, lines->text, lines->length );
+    for (i = 0; i < lines->length; i += 81){
+        iges_field7( section->text + section->length + i + 73
+            , ++section->num_lines );
+    }
+    section->length += lines->length;
+
+    return 1;
+}
+
+
+/* Writes the line of parameter data being filled. The data is 64 columns,
+ * followed by the pointer to the directory entry. */
+static int iges_section_flush
+    ( IgesSection* section
+    , const char letter
+    , const int directory_pointer
+    )
+{
+    char data[73];
+
+    if (section->line_length == 0){
+        return 1;
+    }
+
+    memcpy( data, section->line, section->line_length );
+    if (directory_pointer > 0){
+        memset( data + section->line_length, ' ', 65 - section->line_length );
+        iges_field7( data + 65, directory_pointer );
+        data[72] = '\0';
+    }
+    else{
+        data[section->line_length] = '\0';
+    }
+    section->line_length = 0;
+
+    return iges_section_add_line( section, data, letter );
+}
+
+
+/* Appends a parameter (with its delimiter) to the section. The parameters 
+ * are not split between lines. */
+static int iges_section_add
+    ( IgesSection* section
+    , const char* parameter
+    , const char letter
+    , const int directory_pointer   /* 0 if it is not the parameter section */
+    )
+{
+    const int width = (directory_pointer > 0) ? 64 : 72;
+    int length = (int)strlen( parameter );
+    int status = 1;
+
+    if (section->line_length + length > width){
+        status = iges_section_flush( section, letter, directory_pointer );
+    }
+    if (length > width){
+        length = width;
+    }
+
+    memcpy( section->line + section->line_length, parameter, length );
+    section->line_length += length;
+
+    return status;
+}
+
+
+/* Appends a real parameter and the delimiter */
+static int iges_add_real
+    ( IgesSection* section
+    , const NurbsFloat value
+    , const char delimiter
+    , const int directory_pointer
+    )
+{
+    char buffer[40];
+    const int n = nurbs_float_to_text( buffer, value );
+
+    buffer[n] = delimiter;
+    buffer[n + 1] = '\0';
+
+    return iges_section_add( section, buffer, 'P', directory_pointer );
+}
+
+
+/* Appends an integer parameter and the delimiter */
+static int iges_add_int
+    ( IgesSection* section
+    , const int value
+    , const char delimiter
+    , const int directory_pointer
+    )
+{
+    char buffer[16];
+
+    sprintf( buffer, "%i%c", value, delimiter );
+
+    return iges_section_add( section, buffer, 'P', directory_pointer );
+}
+
+
+/* Appends a string parameter (Hollerith) and the delimiter */
+static int iges_add_string
+    ( IgesSection* section
+    , const char* value
+    , const char delimiter
+    )
+{
+    char buffer[80];
+
+    if (value == nullptr || value[0] == '\0'){
+        sprintf( buffer, "%c", delimiter );
+    }
+    else{
+        sprintf( buffer, "%iH%.60s%c", (int)strlen( value ) > 60 
+            ? 60 : (int)strlen( value ), value, delimiter );
+    }
+
+    return iges_section_add( section, buffer, 'G', 0 );
+}
+
+
+/* Checks if all the weights are the same (polynomial) */
+static int iges_polynomial( const NurbsVector4* cp, const int length )
+{
+    int i;
+
+    for (i = 1; i < length; i++){
+        if (cp[i].w != cp[0].w){
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+
+/* Appends the parameter data of a curve (entity 126) */
+static int iges_curve_parameters
+    ( IgesSection* section
+    , const NurbsCurve* curve
+    , const int de      /* Sequence number of the directory entry */
+    )
+{
+    int i, status = 1;
+    const int k = curve->cp_length - 1;
+    const int m = curve->degree;
+    const NurbsVector4 p0 = curve->cp[0];
+    const NurbsVector4 p1 = curve->cp[k];
+
+    status &= iges_add_int( section, 126, ',', de );
+    status &= iges_add_int( section, k, ',', de );
+    status &= iges_add_int( section, m, ',', de );
+
+    /* Non planar, open or closed, rational or polynomial, non periodic */
+    status &= iges_add_int( section, 0, ',', de );
+    status &= iges_add_int( section
+        , (p0.x == p1.x && p0.y == p1.y && p0.z == p1.z), ',', de );
+    status &= iges_add_int( section
+        , iges_polynomial( curve->cp, curve->cp_length ), ',', de );
+    status &= iges_add_int( section, 0, ',', de );
+
+    for (i = 0; i < curve->knot_length; i++){
+        status &= iges_add_real( section, curve->knot[i], ',', de );
+    }
+    for (i = 0; i <= k; i++){
+        status &= iges_add_real( section, curve->cp[i].w, ',', de );
+    }
+    for (i = 0; i <= k; i++){
+        status &= iges_add_real( section, curve->cp[i].x, ',', de );
+        status &= iges_add_real( section, curve->cp[i].y, ',', de );
+        status &= iges_add_real( section, curve->cp[i].z, ',', de );
+    }
+
+    /* Parametric range and normal (not used, non planar) */
+    status &= iges_add_real( section, curve->knot[m], ',', de );
+    status &= iges_add_real( section, curve->knot[k + 1], ',', de );
+    status &= iges_add_real( section, 0, ',', de );
+    status &= iges_add_real( section, 0, ',', de );
+    status &= iges_add_real( section, 0, ';', de );
+
+    status &= iges_section_flush( section, 'P', de );
+
+    return status;
+}
+
+
+/* Appends the parameter data of a surface (entity 128) */
+static int iges_surface_parameters
+    ( IgesSection* section
+    , const NurbsSurface* surface
+    , const int de      /* Sequence number of the directory entry */
+    )
+{
+    int i, j, polynomial = 1, status = 1;
+    const int k1 = surface->cp_length_u - 1;
+    const int k2 = surface->cp_length_v - 1;
+    const int m1 = surface->degree_u;
+    const int m2 = surface->degree_v;
+
+    for (i = 0; i < surface->cp_length_u; i++){
+        polynomial &= iges_polynomial( surface->cp[i], surface->cp_length_v );
+        polynomial &= (surface->cp[i][0].w == surface->cp[0][0].w);
+    }
+
+    status &= iges_add_int( section, 128, ',', de );
+    status &= iges_add_int( section, k1, ',', de );
+    status &= iges_add_int( section, k2, ',', de );
+    status &= iges_add_int( section, m1, ',', de );
+    status &= iges_add_int( section, m2, ',', de );
+
+    /* Open, rational or polynomial, non periodic */
+    status &= iges_add_int( section, 0, ',', de );
+    status &= iges_add_int( section, 0, ',', de );
+    status &= iges_add_int( section, polynomial, ',', de );
+    status &= iges_add_int( section, 0, ',', de );
+    status &= iges_add_int( section, 0, ',', de );
+
+    for (i = 0; i < surface->knot_length_u; i++){
+        status &= iges_add_real( section, surface->knot_u[i], ',', de );
+    }
+    for (i = 0; i < surface->knot_length_v; i++){
+        status &= iges_add_real( section, surface->knot_v[i], ',', de );
+    }
+
+    /* The first index is the one that varies faster */
+    for (j = 0; j <= k2; j++){
+        for (i = 0; i <= k1; i++){
+            status &= iges_add_real( section, surface->cp[i][j].w, ',', de );
+        }
+    }
+    for (j = 0; j <= k2; j++){
+        for (i = 0; i <= k1; i++){
+            status &= iges_add_real( section, surface->cp[i][j].x, ',', de );
+            status &= iges_add_real( section, surface->cp[i][j].y, ',', de );
+            status &= iges_add_real( section, surface->cp[i][j].z, ',', de );
+        }
+    }
+
+    /* Parametric range */
+    status &= iges_add_real( section, surface->knot_u[m1], ',', de );
+    status &= iges_add_real( section, surface->knot_u[k1 + 1], ',', de );
+    status &= iges_add_real( section, surface->knot_v[m2], ',', de );
+    status &= iges_add_real( section, surface->knot_v[k2 + 1], ';', de );
+
+    status &= iges_section_flush( section, 'P', de );
+
+    return status;
+}
+
+
+/* Appends the two lines of a directory entry */
+static int iges_directory_entry
+    ( IgesSection* section
+    , const int type
+    , const int parameter_line
+    , const int parameter_count
+    , const char* label
+    , const int id
+    )
+{
+    char data[128];
+    char label8[9];
+    int n, status;
+
+    /* IGES labels have 8 characters at most */
+    n = 0;
+    if (label != nullptr){
+        while (n < 8 && label[n] != '\0'){
+            n++;
+        }
+        memcpy( label8, label, n );
+    }
+    label8[n] = '\0';
+
+    sprintf( data, "%8i%8i%8i%8i%8i%8i%8i%8i%8s"
+        , type, parameter_line, 0, 0, 0, 0, 0, 0, "00000000" );
+    status = iges_section_add_line( section, data, 'D' );
+
+    sprintf( data, "%8i%8i%8i%8i%8i%8s%8s%8s%8i"
+        , type, 0, 0, parameter_count, 0, "", "", label8, id );
+    status &= iges_section_add_line( section, data, 'D' );
+
+    return status;
+}
+
+
+/* Maximum absolute value of the coordinates */
+static NurbsFloat iges_max_coordinate
+    ( const NurbsCurve *curve_array
+    , const int num_curves
+    , const NurbsSurface *surface_array
+    , const int num_surfaces
+    )
+{
+    int i, j;
+    NurbsFloat a, max = 0;
+
+    for (i = 0; i < num_curves; i++){
+        for (j = 0; j < curve_array[i].cp_length; j++){
+            const NurbsVector4 p = curve_array[i].cp[j];
+            a = (p.x < 0) ? -p.x : p.x;  max = (a > max) ? a : max;
+            a = (p.y < 0) ? -p.y : p.y;  max = (a > max) ? a : max;
+            a = (p.z < 0) ? -p.z : p.z;  max = (a > max) ? a : max;
+        }
+    }
+    for (i = 0; i < num_surfaces; i++){
+        const NurbsSurface* s = &surface_array[i];
+        for (j = 0; j < s->cp_length_u * s->cp_length_v; j++){
+            const NurbsVector4 p = s->cp[j / s->cp_length_v][j % s->cp_length_v];
+            a = (p.x < 0) ? -p.x : p.x;  max = (a > max) ? a : max;
+            a = (p.y < 0) ? -p.y : p.y;  max = (a > max) ? a : max;
+            a = (p.z < 0) ? -p.z : p.z;  max = (a > max) ? a : max;
+        }
+    }
+
+    return max;
+}
+
+
+/* Writes the NURBS curves and surfaces to an IGES file in ASCII format */
+int nurbs_export_iges
+    ( const char* filename
+    , const NurbsCurve *curve_array
+    , const int num_curves
+    , const NurbsSurface *surface_array
+    , const int num_surfaces
+    )
+{
+    FILE* fd;
+    IgesSection start, global, directory, parameter;
+    IgesSection* entity;
+    char buffer[80];
+    char date[16];
+    time_t now = time( NULL );
+    int i, line, status = 1;
+    const int nc = (curve_array != nullptr) ? num_curves : 0;
+    const int ns = (surface_array != nullptr) ? num_surfaces : 0;
+
+    iges_section_init( &start );
+    iges_section_init( &global );
+    iges_section_init( &directory );
+    iges_section_init( &parameter );
+
+    strftime( date, sizeof(date), "%Y%m%d.%H%M%S", localtime( &now ) );
+
+    /* Start section */
+    status &= iges_section_add_line( &start, "NURBS curves and surfaces", 'S' );
+
+    /* Global section */
+    status &= iges_add_string( &global, ",", ',' );
+    status &= iges_add_string( &global, ";", ',' );
+    status &= iges_add_string( &global, "domino_nurbs", ',' );
+    status &= iges_add_string( &global, filename, ',' );
+    status &= iges_add_string( &global, "domino_nurbs", ',' );
+    status &= iges_add_string( &global, "domino_nurbs", ',' );
+    status &= iges_section_add( &global, "32,38,6,308,15,", 'G', 0 );
+    status &= iges_add_string( &global, "domino_nurbs", ',' );
+    status &= iges_section_add( &global, "1.,2,2HMM,1,1.,", 'G', 0 );
+    status &= iges_add_string( &global, date, ',' );
+    status &= iges_section_add( &global, "1.E-10,", 'G', 0 );
+    nurbs_float_to_text( buffer
+        , iges_max_coordinate( curve_array, nc, surface_array, ns ) );
+    strcat( buffer, "," );
+    status &= iges_section_add( &global, buffer, 'G', 0 );
+    status &= iges_add_string( &global, "", ',' );
+    status &= iges_add_string( &global, "", ',' );
+    status &= iges_section_add( &global, "11,0,", 'G', 0 );
+    status &= iges_add_string( &global, date, ';' );
+    status &= iges_section_flush( &global, 'G', 0 );
+
+    /* Parameter data of each entity, in parallel; the directory entries 
+     * are known in advance (two lines per entity) */
+    _check_(entity = (IgesSection*)_malloc_(sizeof(IgesSection) * (nc + ns + 1)));
+    if (entity == nullptr){
+        status = 0;
+    }
+    else{
+        #pragma omp parallel for schedule(dynamic) reduction(&:status) if (nc + ns > 1)
+        for (i = 0; i < nc + ns; i++){
+            iges_section_init( &entity[i] );
+            if (i < nc){
+                status &= iges_curve_parameters
+                    ( &entity[i], &curve_array[i], 2 * i + 1 );
+            }
+            else{
+                status &= iges_surface_parameters
+                    ( &entity[i], &surface_array[i - nc], 2 * i + 1 );
+            }
+        }
+
+        for (i = 0; i < nc + ns; i++){
+            if (status){
+                line = parameter.num_lines + 1;
+                status &= iges_section_append( &parameter, &entity[i] );
+                status &= iges_directory_entry
+                    ( &directory, (i < nc) ? 126 : 128
+                    , line, entity[i].num_lines
+                    , (i < nc) ? curve_array[i].label : surface_array[i - nc].label
+                    , (i < nc) ? curve_array[i].id : surface_array[i - nc].id );
+            }
+            free( entity[i].text );
+        }
+        free( entity );
+    }
+
+    /* Terminate section */
+    sprintf( buffer, "S%7iG%7iD%7iP%7i"
+        , start.num_lines, global.num_lines
+        , directory.num_lines, parameter.num_lines );
+
+    if (status){
+        fd = fopen( filename, "w" );
+        if (fd == NULL){
+            _handle_error_( "Cannot open the IGES file" );
+            status = 0;
+        }
+        else{
+            fwrite( start.text, 1, start.length, fd );
+            fwrite( global.text, 1, global.length, fd );
+            fwrite( directory.text, 1, directory.length, fd );
+            fwrite( parameter.text, 1, parameter.length, fd );
+            fprintf( fd, "%-72.72sT%7i\n", buffer, 1 );
+            if (fclose( fd ) != 0){
+                _handle_error_( "Cannot write the IGES file" );
+                status = 0;
+            }
+        }
+    }
+
+    free( start.text );
+    free( global.text );
+    free( directory.text );
+    free( parameter.text );
+
+    return status;
 }
 
+/**/
@@ -44,6 +44,75 @@
 
 #endif
 
+#include <float.h>
+#include "nurbs_curve_data.h"
+#include "nurbs_surface_data.h"
+
+/* Positions in files, in 64 bits (long has 32 bits in Windows, and the
+ * files could not be larger than 2 GB) */
+#ifdef SYSTEM_WINDOWS
+  #define nurbs_fseek _fseeki64
+  #define nurbs_ftell _ftelli64
+#else
+  #define nurbs_fseek fseeko
+  #define nurbs_ftell ftello
+#endif
+
+/* Below this squared modulus a first derivative is considered zero */
+#define NURBS_DEGENERATE_EPSILON FLT_EPSILON
+
+/* Point, first and second derivatives used by the iterative methods of
+ * inversion and intersection (see nurbs_surface.c) */
+void nurbs_surface_get_regular_derivatives
+    ( NurbsVector3 *deriv_uu  /* (out) Second derivative Suu */
+    , NurbsVector3 *deriv_uv  /* (out) Second derivative Suv */
+    , NurbsVector3 *deriv_vv  /* (out) Second derivative Svv */
+    , NurbsVector3 *deriv_u   /* (out) First derivative Su */
+    , NurbsVector3 *deriv_v   /* (out) First derivative Sv */
+    , NurbsVector3 *point     /* (out) Point coordinates {x, y, z} */
+    , const NurbsSurface *nurbs
+    , const NurbsFloat u
+    , const NurbsFloat v
+    );
+
+/* Point and, optionally, the first and second derivatives of a curve, 
+ * reentrant (see nurbs_curve.c) */
+void nurbs_curve_get_local_derivatives
+    ( NurbsVector3* point       /* (out) Point coordinates {x, y, z} */
+    , NurbsVector3* d1          /* (out) First derivative (or nullptr) */
+    , NurbsVector3* d2          /* (out) Second derivative (or nullptr) */
+    , const NurbsCurve* curve
+    , NurbsFloat t
+    );
+
+/* Releases the data derived from the surface and kept in it 
+ * (see nurbs_surface_bezier.c) */
+void nurbs_surface_cache_release( NurbsSurface* surface );
+
+/* Returns a version that no other surface has (see nurbs_surface_bezier.c) */
+unsigned int nurbs_surface_new_version();
+
+/* Range of the local basis that corresponds with actual control points 
+ * (shared by the single point and the batch evaluations) */
+static inline void local_basis_range
+    ( int* j0           /* (out) First valid index of the local basis */
+    , int* j1           /* (out) Last valid index of the local basis */
+    , const int first   /* Control point of the first local basis */
+    , const int degree  /* Degree */
+    , const int cp_length  /* Number of control points */
+    )
+{
+    *j0 = 0;
+    if (first < 0){
+        *j0 = -first;
+    }
+
+    *j1 = cp_length - 1 - first;
+    if (*j1 > degree){
+        *j1 = degree;
+    }
+}
+
 #endif /*_NURBS_INTERNAL_H */
 
 /**/
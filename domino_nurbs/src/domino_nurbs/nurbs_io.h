@@ -13,6 +13,7 @@ Methods for importing NURBS curves and surfaces
 #include "nurbs_curve_data.h"
 #include "nurbs_surface_data.h"
 #include "nurbs_controlbox_data.h"
+#include "domino_nurbs_data.h"
 
 #ifdef  __cplusplus
   extern "C" {
@@ -70,8 +71,8 @@ NurbsControlBox* nurbs_controlbox_import_ascii
     );
 
 
-/* Writes all NURBS entities to an ASCII file */
-void nurbs_export_ascii
+/* Writes all NURBS entities to an ASCII file. Returns 1 on success. */
+int nurbs_export_ascii
     ( const char* filename
     , const NurbsCurve *curve_array
     , const int num_curves 
@@ -105,6 +106,120 @@ void nurbs_controlbox_export_ascii
     , const int num_cb 
     );
 
+
+#ifndef SWIG 
+
+/** Writes the NURBS curves and surfaces to an IGES file (entities 126 and 
+  * 128). Returns 1 on success. */
+int nurbs_export_iges
+    ( const char* filename
+    , const NurbsCurve *curve_array
+    , const int num_curves 
+    , const NurbsSurface *surface_array
+    , const int num_surfaces 
+    );
+
+/** Writes all NURBS entities to a binary file, with the same layout of the 
+  * knots and control points as in memory (see nurbs_model_load). 
+  * Returns 1 on success. */
+int nurbs_export_binary
+    ( const char* filename
+    , const NurbsCurve *curve_array
+    , const int num_curves 
+    , const NurbsSurface *surface_array
+    , const int num_surfaces 
+    , const NurbsControlBox *cb_array
+    , const int num_cb 
+    );
+
+/** Reads all NURBS entities from a binary file, as a copy in allocated 
+  * memory (the same as nurbs_import_ascii). */
+void nurbs_import_binary
+    ( const char *filename
+    , NurbsCurve** p_nurbs_curve
+    , int* num_curves
+    , NurbsSurface** p_nurbs_surface
+    , int* num_surfaces
+    , NurbsControlBox** p_nurbs_controlbox
+    , int* num_controlbox
+    );
+
+#endif
+
+/** Equivalent to a default constructor of the model. */
+void nurbs_model_init( NurbsModel* model );
+
+/** Loads a binary file. The file is mapped in memory (copy on write) and 
+  * the knots and control points of the entities point to it, so nothing
+  * is parsed nor copied. Returns 1 on success; 0 if the file cannot be 
+  * read, it is not a binary NURBS file, or it was written with a different
+  * byte order or precision. */
+int nurbs_model_load( NurbsModel* model, const char* filename );
+
+/** Writes the entities of the model to a binary file. Returns 1 on success.*/
+int nurbs_model_save( const NurbsModel* model, const char* filename );
+
+/** Releases the model and the image of the file. */
+void nurbs_model_dispose( NurbsModel* model );
+
+/** Converts an ASCII file into a binary file. Returns 1 on success. */
+int nurbs_convert_ascii_to_binary
+    ( const char* ascii_filename
+    , const char* binary_filename
+    );
+
+/** Converts a binary file into an ASCII file. Returns 1 on success. */
+int nurbs_convert_binary_to_ascii
+    ( const char* binary_filename
+    , const char* ascii_filename
+    );
+
+/** Converts the curves and surfaces of an IGES file into a binary file. 
+  * Returns 1 on success. */
+int nurbs_convert_iges_to_binary
+    ( const char* iges_filename
+    , const char* binary_filename
+    );
+
+/** Converts a binary file into an IGES file. The control boxes are not 
+  * written (there is no such IGES entity). Returns 1 on success. */
+int nurbs_convert_binary_to_iges
+    ( const char* binary_filename
+    , const char* iges_filename
+    );
+
+/** Equivalent to a default constructor of the IGES handle. */
+void nurbs_iges_init( NurbsIges* handle );
+
+/** Opens an IGES file and reads only its directory: the type, form, label
+  * and subscript of each entity. The file is kept open, and the curves and
+  * surfaces are read when they are requested. Returns 1 on success. */
+int nurbs_iges_open( NurbsIges* handle, const char* filename );
+
+/** Returns the index of the first entity with the label and the type 
+  * (126 curve, 128 surface, or 0 for any type); -1 if there is none. */
+int nurbs_iges_find
+    ( const NurbsIges* handle
+    , const char* label
+    , const int type
+    );
+
+/** Returns the curve of the entity (type 126), which is read from the file
+  * the first time. The curve belongs to the handle; it is valid until it 
+  * is released or the file is closed. Returns nullptr on error. */
+NurbsCurve* nurbs_iges_get_curve( NurbsIges* handle, const int index );
+
+/** Returns the surface of the entity (type 128), which is read from the 
+  * file the first time. The surface belongs to the handle; it is valid 
+  * until it is released or the file is closed. Returns nullptr on error. */
+NurbsSurface* nurbs_iges_get_surface( NurbsIges* handle, const int index );
+
+/** Releases the curve or surface of the entity, if it has been read. */
+void nurbs_iges_release( NurbsIges* handle, const int index );
+
+/** Closes the file and releases all the curves and surfaces read. */
+void nurbs_iges_close( NurbsIges* handle );
+
 #ifdef  __cplusplus
 }
 #endif
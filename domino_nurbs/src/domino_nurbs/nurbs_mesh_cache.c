@@ -0,0 +1,541 @@
+ /***
+    Author: Mario J. Martin <dominonurbs$gmail.com>
+
+    Cache of tessellations of NURBS surfaces.
+    Redrawing or exporting a model tessellates the same surfaces again and
+    again. The cache keeps the meshes keyed by the id of the surface, the
+    version of its control points and knots, and the tolerances. Every
+    surface (and every call to nurbs_surface_modified) takes a new version,
+    so an edited surface (or a new surface at the address of a released 
+    one) misses the cache, and editing one surface only tessellates that 
+    surface again.
+    The meshes are released in least recently used order when their memory
+    is over the budget.
+
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/check_malloc.h"
+#include "common/log.h"
+
+#include "nurbs_internal.h"
+#include "nurbs_surface.h"
+
+/* Initial number of buckets */
+#define CACHE_MIN_BUCKETS 256
+
+
+/* Memory of a mesh in bytes */
+static size_t mesh_size( const NurbsMesh* mesh )
+{
+    return sizeof(NurbsMesh)
+        + (size_t)mesh->num_vertices * (2 * sizeof(NurbsVector3)
+            + 2 * sizeof(NurbsFloat) + sizeof(int))
+        + (size_t)mesh->num_triangles * 4 * sizeof(int);
+}
+
+
+/* Bucket of a key */
+static inline int bucket_index
+    ( const NurbsMeshCache* cache
+    , const int id
+    , const unsigned int version
+    )
+{
+    unsigned int h = version * 2654435761u ^ (unsigned int)id * 40503u;
+
+    h ^= h >> 16;
+
+    return (int)(h & (unsigned int)(cache->num_buckets - 1));
+}
+
+
+/* Checks if the entry has the same key */
+static inline int entry_match
+    ( const NurbsMeshCacheEntry* e
+    , const NurbsSurface* surface
+    , const NurbsFloat chord_height
+    , const NurbsFloat normal_angle
+    , const int max_depth
+    )
+{
+    return e->surface != nullptr && e->version == surface->version 
+        && e->id == surface->id
+        && e->chord_height == chord_height
+        && e->normal_angle == normal_angle
+        && e->max_depth == max_depth;
+}
+
+
+/* Removes the entry from the list of recently used entries */
+static void lru_unlink( NurbsMeshCache* cache, const int k )
+{
+    NurbsMeshCacheEntry* e = &(cache->entry[k]);
+
+    if (e->prev >= 0){
+        cache->entry[e->prev].next = e->next;
+    }
+    else{
+        cache->first = e->next;
+    }
+    if (e->next >= 0){
+        cache->entry[e->next].prev = e->prev;
+    }
+    else{
+        cache->last = e->prev;
+    }
+
+    e->prev = -1;
+    e->next = -1;
+}
+
+
+/* Puts the entry as the most recently used */
+static void lru_push_front( NurbsMeshCache* cache, const int k )
+{
+    NurbsMeshCacheEntry* e = &(cache->entry[k]);
+
+    e->prev = -1;
+    e->next = cache->first;
+    if (cache->first >= 0){
+        cache->entry[cache->first].prev = k;
+    }
+    cache->first = k;
+    if (cache->last < 0){
+        cache->last = k;
+    }
+}
+
+
+/* Releases the mesh of the entry and moves it to the free list */
+static void entry_remove( NurbsMeshCache* cache, const int k )
+{
+    NurbsMeshCacheEntry* e = &(cache->entry[k]);
+    int* p;
+
+    /* Unlink from the bucket */
+    p = &(cache->bucket[bucket_index( cache, e->id, e->version )]);
+    while (*p >= 0 && *p != k){
+        p = &(cache->entry[*p].next_in_bucket);
+    }
+    if (*p == k){
+        *p = e->next_in_bucket;
+    }
+
+    lru_unlink( cache, k );
+
+    cache->size -= e->size;
+    nurbs_mesh_dispose( &(e->mesh) );
+
+    e->surface = nullptr;
+    e->size = 0;
+    e->next_in_bucket = -1;
+    e->next = cache->free_entry;
+    cache->free_entry = k;
+    cache->num_entries--;
+}
+
+
+/* Rebuilds the buckets with twice the number of buckets */
+static int grow_buckets( NurbsMeshCache* cache )
+{
+    int* bucket;
+    int k, b, num_buckets = 2 * cache->num_buckets;
+
+    _check_(bucket = (int*)_malloc_(sizeof(int) * num_buckets));
+    if (bucket == nullptr){
+        return 0;
+    }
+
+    free( cache->bucket );
+    cache->bucket = bucket;
+    cache->num_buckets = num_buckets;
+
+    for (b = 0; b < num_buckets; b++){
+        bucket[b] = -1;
+    }
+    for (k = 0; k < cache->max_entries; k++){
+        if (cache->entry[k].surface != nullptr){
+            b = bucket_index( cache, cache->entry[k].id, cache->entry[k].version );
+            cache->entry[k].next_in_bucket = bucket[b];
+            bucket[b] = k;
+        }
+    }
+
+    return 1;
+}
+
+
+/* Returns a free entry, or -1 if the memory is exhausted */
+static int entry_alloc( NurbsMeshCache* cache )
+{
+    NurbsMeshCacheEntry* p;
+    int k, max;
+
+    if (cache->free_entry < 0){
+        max = (cache->max_entries > 0) ? 2 * cache->max_entries : 64;
+        _check_(p = (NurbsMeshCacheEntry*)_realloc_
+            (cache->entry, sizeof(NurbsMeshCacheEntry) * max));
+        if (p == nullptr){
+            return -1;
+        }
+        cache->entry = p;
+
+        for (k = max - 1; k >= cache->max_entries; k--){
+            cache->entry[k].surface = nullptr;
+            cache->entry[k].size = 0;
+            cache->entry[k].prev = -1;
+            cache->entry[k].next = cache->free_entry;
+            cache->entry[k].next_in_bucket = -1;
+            nurbs_mesh_init( &(cache->entry[k].mesh) );
+            cache->free_entry = k;
+        }
+        cache->max_entries = max;
+    }
+
+    if (cache->num_entries + 1 > 2 * cache->num_buckets && !grow_buckets( cache )){
+        return -1;
+    }
+
+    k = cache->free_entry;
+    cache->free_entry = cache->entry[k].next;
+    cache->num_entries++;
+
+    return k;
+}
+
+
+/* Looks for the mesh in the cache. Returns the entry or -1. */
+static int cache_find
+    ( NurbsMeshCache* cache
+    , const NurbsSurface* surface
+    , const NurbsFloat chord_height
+    , const NurbsFloat normal_angle
+    , const int max_depth
+    )
+{
+    int k;
+
+    k = cache->bucket[bucket_index( cache, surface->id, surface->version )];
+    while (k >= 0){
+        if (entry_match( &(cache->entry[k]), surface
+            , chord_height, normal_angle, max_depth ))
+        {
+            return k;
+        }
+        k = cache->entry[k].next_in_bucket;
+    }
+
+    return -1;
+}
+
+
+/* Releases the meshes tessellated from older versions of the surface, which
+ * cannot be found anymore */
+static void cache_remove_old
+    ( NurbsMeshCache* cache
+    , const NurbsSurface* surface
+    )
+{
+    int k;
+
+    for (k = 0; k < cache->max_entries; k++){
+        if (cache->entry[k].surface == surface 
+            && cache->entry[k].version != surface->version)
+        {
+            entry_remove( cache, k );
+        }
+    }
+}
+
+
+/* Moves the mesh into a new entry of the cache. Returns the entry, or -1
+ * if the memory is exhausted (then the mesh is released). */
+static int cache_insert
+    ( NurbsMeshCache* cache
+    , NurbsMesh* mesh
+    , const NurbsSurface* surface
+    , const NurbsFloat chord_height
+    , const NurbsFloat normal_angle
+    , const int max_depth
+    )
+{
+    NurbsMeshCacheEntry* e;
+    int k, b;
+
+    /* A miss is the only time a surface can have older meshes */
+    cache_remove_old( cache, surface );
+
+    k = entry_alloc( cache );
+    if (k < 0){
+        nurbs_mesh_dispose( mesh );
+        return -1;
+    }
+
+    e = &(cache->entry[k]);
+    e->surface = surface;
+    e->id = surface->id;
+    e->version = surface->version;
+    e->chord_height = chord_height;
+    e->normal_angle = normal_angle;
+    e->max_depth = max_depth;
+    e->mesh = *mesh;
+    e->size = mesh_size( mesh );
+    nurbs_mesh_init( mesh );
+
+    b = bucket_index( cache, e->id, e->version );
+    e->next_in_bucket = cache->bucket[b];
+    cache->bucket[b] = k;
+
+    lru_push_front( cache, k );
+    cache->size += e->size;
+
+    return k;
+}
+
+
+/* Releases the least recently used meshes until the memory is under the
+ * budget. The most recently used mesh is always kept. */
+static void cache_evict( NurbsMeshCache* cache )
+{
+    if (cache->budget == 0){
+        return;
+    }
+
+    while (cache->size > cache->budget && cache->last >= 0
+        && cache->last != cache->first)
+    {
+        entry_remove( cache, cache->last );
+    }
+}
+
+
+/* Equivalent to a default constructor */
+void nurbs_mesh_cache_init( NurbsMeshCache* cache, const size_t budget )
+{
+    cache->budget = budget;
+    cache->size = 0;
+
+    cache->num_entries = 0;
+    cache->max_entries = 0;
+    cache->entry = nullptr;
+
+    cache->first = -1;
+    cache->last = -1;
+    cache->free_entry = -1;
+
+    cache->num_buckets = 0;
+    cache->bucket = nullptr;
+
+    cache->hits = 0;
+    cache->misses = 0;
+}
+
+
+/* Releases all the meshes and the memory of the cache (but not the
+ * structure) */
+void nurbs_mesh_cache_dispose( NurbsMeshCache* cache )
+{
+    int k;
+
+    if (cache == nullptr){
+        return;
+    }
+
+    for (k = 0; k < cache->max_entries; k++){
+        nurbs_mesh_dispose( &(cache->entry[k].mesh) );
+    }
+    if (cache->entry != nullptr){
+        free( cache->entry );
+    }
+    if (cache->bucket != nullptr){
+        free( cache->bucket );
+    }
+
+    nurbs_mesh_cache_init( cache, cache->budget );
+}
+
+
+/* Releases the meshes of one surface, or all of them if it is nullptr */
+void nurbs_mesh_cache_invalidate( NurbsMeshCache* cache, const NurbsSurface* surface )
+{
+    int k;
+
+    if (cache == nullptr || cache->bucket == nullptr){
+        return;
+    }
+
+    for (k = 0; k < cache->max_entries; k++){
+        if (cache->entry[k].surface != nullptr
+            && (surface == nullptr || cache->entry[k].surface == surface))
+        {
+            entry_remove( cache, k );
+        }
+    }
+}
+
+
+/* Checks the buckets are allocated */
+static int cache_ready( NurbsMeshCache* cache )
+{
+    int b;
+
+    if (cache->bucket != nullptr){
+        return 1;
+    }
+
+    _check_(cache->bucket = (int*)_malloc_(sizeof(int) * CACHE_MIN_BUCKETS));
+    if (cache->bucket == nullptr){
+        return 0;
+    }
+
+    cache->num_buckets = CACHE_MIN_BUCKETS;
+    for (b = 0; b < CACHE_MIN_BUCKETS; b++){
+        cache->bucket[b] = -1;
+    }
+
+    return 1;
+}
+
+
+/* Returns the tessellation of the surface, from the cache if possible */
+const NurbsMesh* nurbs_mesh_cache_get
+    ( NurbsMeshCache* cache
+    , const NurbsSurface* surface
+    , const NurbsFloat chord_height
+    , const NurbsFloat normal_angle
+    , const int max_depth
+    )
+{
+    NurbsMesh mesh;
+    int k;
+
+    if (cache == nullptr || surface == nullptr || !cache_ready( cache )){
+        return nullptr;
+    }
+
+    k = cache_find( cache, surface, chord_height, normal_angle, max_depth );
+    if (k >= 0){
+        cache->hits++;
+        lru_unlink( cache, k );
+        lru_push_front( cache, k );
+        return &(cache->entry[k].mesh);
+    }
+
+    cache->misses++;
+    nurbs_mesh_init( &mesh );
+    if (!nurbs_surface_tessellate( &mesh, surface, 1
+        , chord_height, normal_angle, max_depth ))
+    {
+        return nullptr;
+    }
+
+    k = cache_insert( cache, &mesh, surface, chord_height, normal_angle, max_depth );
+    if (k < 0){
+        return nullptr;
+    }
+
+    cache_evict( cache );
+
+    return &(cache->entry[k].mesh);
+}
+
+
+/* Tessellates a set of surfaces into one mesh, using the cache */
+int nurbs_mesh_cache_tessellate
+    ( NurbsMesh* mesh
+    , NurbsMeshCache* cache
+    , const NurbsSurface surfaces[]
+    , const int num_surfaces
+    , const NurbsFloat chord_height
+    , const NurbsFloat normal_angle
+    , const int max_depth
+    )
+{
+    const NurbsMesh** parts = nullptr;
+    NurbsMesh* missing = nullptr;
+    int* index = nullptr;
+    int* miss = nullptr;
+    int i, k, num_missing = 0, status = 1;
+
+    nurbs_mesh_dispose( mesh );
+
+    if (cache == nullptr || surfaces == nullptr || num_surfaces <= 0
+        || !cache_ready( cache ))
+    {
+        return 0;
+    }
+
+    _check_(parts = (const NurbsMesh**)_malloc_(sizeof(NurbsMesh*) * num_surfaces));
+    _check_(index = (int*)_malloc_(sizeof(int) * num_surfaces));
+    _check_(miss = (int*)_malloc_(sizeof(int) * num_surfaces));
+    _check_(missing = (NurbsMesh*)_malloc_(sizeof(NurbsMesh) * num_surfaces));
+
+    if (parts == nullptr || index == nullptr || miss == nullptr || missing == nullptr){
+        status = 0;
+    }
+    else{
+        /* The cache is not thread safe, so the look up is serial */
+        for (i = 0; i < num_surfaces; i++){
+            index[i] = cache_find( cache, &(surfaces[i])
+                , chord_height, normal_angle, max_depth );
+            if (index[i] >= 0){
+                cache->hits++;
+                lru_unlink( cache, index[i] );
+                lru_push_front( cache, index[i] );
+            }
+            else{
+                cache->misses++;
+                miss[num_missing++] = i;
+            }
+        }
+
+        /* Only the missing surfaces are tessellated, in parallel.
+         * miss[k] is set to -1 if the memory is exhausted. */
+        #pragma omp parallel for schedule(dynamic)
+        for (k = 0; k < num_missing; k++){
+            nurbs_mesh_init( &(missing[k]) );
+            if (!nurbs_surface_tessellate( &(missing[k]), &(surfaces[miss[k]]), 1
+                , chord_height, normal_angle, max_depth ))
+            {
+                miss[k] = -1;
+            }
+        }
+
+        for (k = 0; k < num_missing; k++){
+            i = miss[k];
+            if (i < 0){
+                status = 0;
+                continue;
+            }
+            index[i] = cache_insert( cache, &(missing[k]), &(surfaces[i])
+                , chord_height, normal_angle, max_depth );
+            if (index[i] < 0){
+                status = 0;
+            }
+        }
+    }
+
+    if (status){
+        /* The entries may move when new ones are added, so the pointers
+         * are taken at the end */
+        for (i = 0; i < num_surfaces; i++){
+            parts[i] = &(cache->entry[index[i]].mesh);
+        }
+        status = nurbs_mesh_merge( mesh, parts, num_surfaces );
+    }
+
+    /* The meshes of this call can be evicted now that they are copied */
+    cache_evict( cache );
+
+    if (parts != nullptr) free( (void*)parts );
+    if (index != nullptr) free( index );
+    if (miss != nullptr) free( miss );
+    if (missing != nullptr) free( missing );
+
+    return status;
+}
+
+/**/
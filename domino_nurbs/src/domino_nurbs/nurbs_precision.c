@@ -0,0 +1,383 @@
+ /***
+    Author: Mario J. Martin <dominonurbs$gmail.com>
+
+    Single and double precision versions of the evaluation, inversion and
+    free form deformation kernels, in the same build.
+    The kernels are written once in nurbs_precision_kernels.inl and
+    included for each type. Single precision is enough for visualization
+    and for the initial guess of the inversion, which is then polished in
+    the precision of the library (NurbsFloat).
+
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "common/check_malloc.h"
+#include "common/log.h"
+
+#include "nurbs_internal.h"
+#include "nurbs_basis.h"
+#include "nurbs_surface.h"
+#include "nurbs_controlbox.h"
+
+/* Alignment of the arrays in bytes (AVX) */
+#define NURBS_PRECISION_ALIGN 32
+
+/* Maximum number of iterations of the inversion */
+#define NURBS_PRECISION_MAX_IT 32
+
+/* Samples per control point of the initial guess of the inversion */
+#define NURBS_PRECISION_SAMPLES 2
+
+
+/* Size of the grid of samples of the initial guess */
+static void sample_size( int* nu, int* nv, const int cp_length_u, const int cp_length_v )
+{
+    *nu = NURBS_PRECISION_SAMPLES * cp_length_u;
+    *nv = NURBS_PRECISION_SAMPLES * cp_length_v;
+    if (*nu < 2){
+        *nu = 2;
+    }
+    if (*nv < 2){
+        *nv = 2;
+    }
+}
+
+
+#define NURBS_REAL float
+#define NURBS_PRECISION(name) single_##name
+#define NURBS_PRECISION_SURFACE NurbsSurfaceSingle
+#include "nurbs_precision_kernels.inl"
+
+#define NURBS_REAL double
+#define NURBS_PRECISION(name) double_##name
+#define NURBS_PRECISION_SURFACE NurbsSurfaceDouble
+#include "nurbs_precision_kernels.inl"
+
+
+/* Equivalent to a default constructor */
+void nurbs_surface_single_init( NurbsSurfaceSingle* s )
+{
+    memset( s, 0, sizeof(NurbsSurfaceSingle) );
+    s->memory = nullptr;
+}
+
+
+/* Releases the memory of the copy (but not the structure) */
+void nurbs_surface_single_dispose( NurbsSurfaceSingle* s )
+{
+    if (s == nullptr){
+        return;
+    }
+
+    if (s->memory != nullptr){
+        free( s->memory );
+    }
+
+    nurbs_surface_single_init( s );
+}
+
+
+/* Copies the surface in single precision */
+int nurbs_surface_single_create( NurbsSurfaceSingle* s, const NurbsSurface* surface )
+{
+    nurbs_surface_single_dispose( s );
+
+    if (!single_surface_create( s, surface )){
+        nurbs_surface_single_init( s );
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/* Equivalent to a default constructor */
+void nurbs_surface_double_init( NurbsSurfaceDouble* s )
+{
+    memset( s, 0, sizeof(NurbsSurfaceDouble) );
+    s->memory = nullptr;
+}
+
+
+/* Releases the memory of the copy (but not the structure) */
+void nurbs_surface_double_dispose( NurbsSurfaceDouble* s )
+{
+    if (s == nullptr){
+        return;
+    }
+
+    if (s->memory != nullptr){
+        free( s->memory );
+    }
+
+    nurbs_surface_double_init( s );
+}
+
+
+/* Copies the surface in double precision */
+int nurbs_surface_double_create( NurbsSurfaceDouble* s, const NurbsSurface* surface )
+{
+    nurbs_surface_double_dispose( s );
+
+    if (!double_surface_create( s, surface )){
+        nurbs_surface_double_init( s );
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/* Gets the points, and optionally the normals, in single precision */
+int nurbs_surface_single_get_points
+    ( float points[]
+    , float normals[]
+    , const NurbsSurfaceSingle* s
+    , const float u[]
+    , const float v[]
+    , const int length
+    )
+{
+    if (s == nullptr || s->memory == nullptr || points == nullptr){
+        return 0;
+    }
+
+    single_get_points( points, normals, s, u, v, length );
+
+    return 1;
+}
+
+
+/* Gets the points, and optionally the normals, in double precision */
+int nurbs_surface_double_get_points
+    ( double points[]
+    , double normals[]
+    , const NurbsSurfaceDouble* s
+    , const double u[]
+    , const double v[]
+    , const int length
+    )
+{
+    if (s == nullptr || s->memory == nullptr || points == nullptr){
+        return 0;
+    }
+
+    double_get_points( points, normals, s, u, v, length );
+
+    return 1;
+}
+
+
+/* Inversion of a set of points in single precision */
+int nurbs_surface_single_inversion
+    ( float u[]
+    , float v[]
+    , float dist[]
+    , const NurbsSurfaceSingle* s
+    , const float points[]
+    , const int length
+    , const float epsilon
+    )
+{
+    if (s == nullptr || s->memory == nullptr || points == nullptr){
+        return 0;
+    }
+
+    return single_inversion( u, v, dist, s, points, length, epsilon );
+}
+
+
+/* Inversion of a set of points in double precision */
+int nurbs_surface_double_inversion
+    ( double u[]
+    , double v[]
+    , double dist[]
+    , const NurbsSurfaceDouble* s
+    , const double points[]
+    , const int length
+    , const double epsilon
+    )
+{
+    if (s == nullptr || s->memory == nullptr || points == nullptr){
+        return 0;
+    }
+
+    return double_inversion( u, v, dist, s, points, length, epsilon );
+}
+
+
+/* Inversion with the initial guess in single precision and the final
+ * iterations of nurbs_surface_inversion_proj */
+int nurbs_surface_inversion_mixed
+    ( NurbsFloat u[]
+    , NurbsFloat v[]
+    , NurbsFloat dist[]
+    , const NurbsSurface* surface
+    , const NurbsSurfaceSingle* s
+    , const NurbsVector3 points[]
+    , const int length
+    , const NurbsFloat epsilon
+    )
+{
+    int i, nu, nv;
+    float su, sv, q[3];
+    NurbsVector3 p;
+    float* grid = nullptr;
+
+    if (surface == nullptr || s == nullptr || s->memory == nullptr
+        || points == nullptr)
+    {
+        return 0;
+    }
+
+    if (s->cp_length_u != surface->cp_length_u
+        || s->cp_length_v != surface->cp_length_v)
+    {
+        _handle_error_("The single precision copy does not match the surface");
+        return 0;
+    }
+
+    sample_size( &nu, &nv, s->cp_length_u, s->cp_length_v );
+
+    _check_(grid = (float*)_malloc_(sizeof(float) * 3 * nu * nv));
+    if (grid == nullptr){
+        return 0;
+    }
+
+    single_surface_sample( grid, s, nu, nv );
+
+    #pragma omp parallel for private(su, sv, q, p) schedule(static)
+    for (i = 0; i < length; i++){
+        q[0] = (float)points[i].x;
+        q[1] = (float)points[i].y;
+        q[2] = (float)points[i].z;
+
+        /* The single precision cannot go further than ~1e-6 relative */
+        single_sample_closest( &su, &sv, s, grid, nu, nv, q );
+        single_surface_invert( &su, &sv, s, q, (float)epsilon
+            , NURBS_PRECISION_MAX_IT );
+
+        u[i] = su;
+        v[i] = sv;
+        nurbs_surface_inversion_proj( &(u[i]), &(v[i]), &(points[i])
+            , surface, epsilon );
+
+        if (dist != nullptr){
+            p = nurbs_surface_get_point( surface, u[i], v[i] );
+            dist[i] = sqrt( (p.x - points[i].x) * (p.x - points[i].x)
+                + (p.y - points[i].y) * (p.y - points[i].y)
+                + (p.z - points[i].z) * (p.z - points[i].z) );
+        }
+    }
+
+    free( grid );
+
+    return 1;
+}
+
+
+/* Copies the weights of the deformation in single precision */
+int nurbs_controlbox_weights_set_single( NurbsControlBoxWeights* weights )
+{
+    int k;
+
+    if (weights == nullptr || weights->weight == nullptr){
+        return 0;
+    }
+
+    if (weights->weight_single != nullptr){
+        free( weights->weight_single );
+    }
+
+    _check_(weights->weight_single = (float*)_malloc_
+        (sizeof(float) * (weights->num_weights + 1)));
+    if (weights->weight_single == nullptr){
+        return 0;
+    }
+
+    for (k = 0; k < weights->num_weights; k++){
+        weights->weight_single[k] = (float)weights->weight[k];
+    }
+
+    return 1;
+}
+
+
+/* Sparse matrix-vector product of the weights of a control box with the
+ * control points cp[3*i + {0,1,2}] (see nurbs_controlbox_weights_deform) */
+static void sparse_deform_single
+    ( float points[]            /* (out) Points, points[3*i + {0,1,2}] */
+    , const int row[]
+    , const int index[]
+    , const float weight[]
+    , const float cp[]
+    , const int num_points
+    )
+{
+    int i, k;
+    float b, x, y, z;
+
+    #pragma omp parallel for private(k, b, x, y, z) schedule(static)
+    for (i = 0; i < num_points; i++){
+        if (row[i + 1] == row[i]){
+            x = y = z = (float)NURBS_ERROR_VALUE;
+        }
+        else{
+            x = y = z = 0;
+            for (k = row[i]; k < row[i + 1]; k++){
+                b = weight[k];
+                x += b * cp[3 * index[k]];
+                y += b * cp[3 * index[k] + 1];
+                z += b * cp[3 * index[k] + 2];
+            }
+        }
+        points[3 * i] = x;
+        points[3 * i + 1] = y;
+        points[3 * i + 2] = z;
+    }
+}
+
+
+/* Calculates the deformed points in single precision */
+int nurbs_controlbox_weights_deform_single
+    ( float points[]
+    , const NurbsControlBoxWeights* weights
+    , const NurbsControlBox* cb
+    )
+{
+    int k;
+    float* cp = nullptr;
+
+    if (weights == nullptr || cb == nullptr || weights->weight_single == nullptr){
+        return 0;
+    }
+
+    if (weights->num_cp != cb->cp_length_u * cb->cp_length_v * cb->cp_length_w){
+        _handle_error_("The control box does not match the weights");
+        return 0;
+    }
+
+    _check_(cp = (float*)_malloc_(sizeof(float) * 3 * (weights->num_cp + 1)));
+    if (cp == nullptr){
+        return 0;
+    }
+
+    for (k = 0; k < weights->num_cp; k++){
+        cp[3 * k] = (float)cb->cp_stream[k].x;
+        cp[3 * k + 1] = (float)cb->cp_stream[k].y;
+        cp[3 * k + 2] = (float)cb->cp_stream[k].z;
+    }
+
+    sparse_deform_single( points, weights->row, weights->index
+        , weights->weight_single, cp, weights->num_points );
+
+    free( cp );
+
+    return 1;
+}
+
+/**/
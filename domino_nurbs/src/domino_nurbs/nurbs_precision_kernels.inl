@@ -0,0 +1,481 @@
+ /***
+    Author: Mario J. Martin <dominonurbs$gmail.com>
+
+    Evaluation, inversion and deformation kernels written once for any
+    floating point type. This file is included several times, each one with
+    a different definition of:
+
+      NURBS_REAL              the floating point type (float, double)
+      NURBS_PRECISION(name)   the name of the function for that type
+      NURBS_PRECISION_SURFACE the surface structure for that type
+
+    The basis functions are calculated by nurbs_basis.c in the precision
+    of the library (NurbsFloat), which keeps the knots; only the products
+    with the control points, which are most of the operations, are done in
+    NURBS_REAL. With float, the vector units process twice the values at
+    once and the memory traffic is half.
+    The three macros are undefined at the end of the file.
+
+*******************************************************************************/
+
+
+/* Copies the surface in the precision of the kernels.
+ * Returns 0 if the memory is exhausted or the surface is not valid */
+static inline int NURBS_PRECISION(surface_create)
+    ( NURBS_PRECISION_SURFACE* s
+    , const NurbsSurface* surface
+    )
+{
+    const int lanes = NURBS_PRECISION_ALIGN / sizeof(NURBS_REAL);
+    size_t size, size_knots;
+    uintptr_t p;
+    NurbsVector4 cp;
+    int i, j, k;
+
+    s->memory = nullptr;
+
+    if (surface == nullptr || surface->cp == nullptr
+        || surface->degree_u > NURBS_MAX_DEGREE
+        || surface->degree_v > NURBS_MAX_DEGREE)
+    {
+        return 0;
+    }
+
+    s->degree_u = surface->degree_u;
+    s->degree_v = surface->degree_v;
+    s->cp_length_u = surface->cp_length_u;
+    s->cp_length_v = surface->cp_length_v;
+    s->knot_length_u = surface->knot_length_u;
+    s->knot_length_v = surface->knot_length_v;
+    s->stride = ((surface->cp_length_v + lanes - 1) / lanes) * lanes;
+
+    size = sizeof(NURBS_REAL) * s->cp_length_u * s->stride;
+    size_knots = sizeof(NurbsFloat) * (s->knot_length_u + s->knot_length_v);
+    size_knots = ((size_knots + NURBS_PRECISION_ALIGN - 1)
+        / NURBS_PRECISION_ALIGN) * NURBS_PRECISION_ALIGN;
+
+    _check_(s->memory = _malloc_(4 * size + size_knots + NURBS_PRECISION_ALIGN));
+    if (s->memory == nullptr){
+        return 0;
+    }
+
+    p = (uintptr_t)s->memory;
+    p = (p + NURBS_PRECISION_ALIGN - 1) & ~(uintptr_t)(NURBS_PRECISION_ALIGN - 1);
+
+    s->wx = (NURBS_REAL*)p;
+    s->wy = (NURBS_REAL*)(p + size);
+    s->wz = (NURBS_REAL*)(p + 2 * size);
+    s->w = (NURBS_REAL*)(p + 3 * size);
+    s->knot_u = (NurbsFloat*)(p + 4 * size);
+    s->knot_v = s->knot_u + s->knot_length_u;
+
+    memcpy( s->knot_u, surface->knot_u, sizeof(NurbsFloat) * s->knot_length_u );
+    memcpy( s->knot_v, surface->knot_v, sizeof(NurbsFloat) * s->knot_length_v );
+
+    for (i = 0; i < s->cp_length_u; i++){
+        for (j = 0; j < s->stride; j++){
+            k = i * s->stride + j;
+            if (j < s->cp_length_v){
+                cp = surface->cp[i][j];
+            }
+            else{
+                /* Padding */
+                cp.x = cp.y = cp.z = cp.w = 0;
+            }
+            s->wx[k] = (NURBS_REAL)(cp.x * cp.w);
+            s->wy[k] = (NURBS_REAL)(cp.y * cp.w);
+            s->wz[k] = (NURBS_REAL)(cp.z * cp.w);
+            s->w[k] = (NURBS_REAL)cp.w;
+        }
+    }
+
+    return 1;
+}
+
+
+/* Contracts the local basis with the control points:
+ * f[0..3] with the basis, f[4..7] with the derivatives in u and f[8..11] 
+ * with the derivatives in v (only if d_bu and d_bv are given) */
+static inline void NURBS_PRECISION(surface_contract)
+    ( NURBS_REAL f[12]
+    , const NURBS_PRECISION_SURFACE* s
+    , const NurbsFloat basis_u[]
+    , const NurbsFloat d_basis_u[]
+    , const int first_u
+    , const NurbsFloat basis_v[]
+    , const NurbsFloat d_basis_v[]
+    , const int first_v
+    )
+{
+    int i, j, k, iu0, iu1, iv0, iv1;
+    NURBS_REAL bu[NURBS_MAX_DEGREE + 2], bv[NURBS_MAX_DEGREE + 2];
+    NURBS_REAL dbu[NURBS_MAX_DEGREE + 2], dbv[NURBS_MAX_DEGREE + 2];
+    NURBS_REAL g, gu, gv;
+    const int deriv = (d_basis_u != nullptr && d_basis_v != nullptr);
+
+    for (k = 0; k < 12; k++){
+        f[k] = 0;
+    }
+
+    /* Range of the local basis with actual control points */
+    iu0 = (first_u < 0) ? -first_u : 0;
+    iu1 = s->cp_length_u - 1 - first_u;
+    if (iu1 > s->degree_u){
+        iu1 = s->degree_u;
+    }
+    iv0 = (first_v < 0) ? -first_v : 0;
+    iv1 = s->cp_length_v - 1 - first_v;
+    if (iv1 > s->degree_v){
+        iv1 = s->degree_v;
+    }
+
+    for (i = 0; i <= s->degree_u; i++){
+        bu[i] = (NURBS_REAL)basis_u[i];
+        dbu[i] = deriv ? (NURBS_REAL)d_basis_u[i] : 0;
+    }
+    for (j = 0; j <= s->degree_v; j++){
+        bv[j] = (NURBS_REAL)basis_v[j];
+        dbv[j] = deriv ? (NURBS_REAL)d_basis_v[j] : 0;
+    }
+
+    for (i = iu0; i <= iu1; i++){
+        k = (first_u + i) * s->stride + first_v;
+        for (j = iv0; j <= iv1; j++){
+            g = bu[i] * bv[j];
+            f[0] += g * s->wx[k + j];
+            f[1] += g * s->wy[k + j];
+            f[2] += g * s->wz[k + j];
+            f[3] += g * s->w[k + j];
+
+            if (deriv){
+                gu = dbu[i] * bv[j];
+                gv = bu[i] * dbv[j];
+                f[4] += gu * s->wx[k + j];
+                f[5] += gu * s->wy[k + j];
+                f[6] += gu * s->wz[k + j];
+                f[7] += gu * s->w[k + j];
+                f[8] += gv * s->wx[k + j];
+                f[9] += gv * s->wy[k + j];
+                f[10] += gv * s->wz[k + j];
+                f[11] += gv * s->w[k + j];
+            }
+        }
+    }
+}
+
+
+/* Gets the point and, optionally, the derivatives of the surface (see
+ * nurbs_surface_get_derivatives). The point and the derivatives come from
+ * the same pass, except on the last knot, where the derivatives are 
+ * calculated a bit before it. Returns 0 if the point is not defined */
+static inline int NURBS_PRECISION(surface_eval)
+    ( NURBS_REAL p[3]           /* (out) Point */
+    , NURBS_REAL du[3]          /* (out) Derivative in u (or nullptr) */
+    , NURBS_REAL dv[3]          /* (out) Derivative in v (or nullptr) */
+    , const NURBS_PRECISION_SURFACE* s
+    , const NURBS_REAL u
+    , const NURBS_REAL v
+    )
+{
+    int k, first_u, first_v;
+    NurbsFloat bu[NURBS_MAX_DEGREE + 2], bv[NURBS_MAX_DEGREE + 2];
+    NurbsFloat dbu[NURBS_MAX_DEGREE + 2], dbv[NURBS_MAX_DEGREE + 2];
+    NurbsFloat tu = u, tv = v, tL;
+    NURBS_REAL f[12], q[3];
+    const int deriv = (du != nullptr && dv != nullptr);
+
+    if (deriv){
+        tL = s->knot_u[s->knot_length_u - s->degree_u - 1];
+        if (tu >= tL){
+            tu = tL - (tL - s->knot_u[s->knot_length_u - s->degree_u - 2]) / 256;
+        }
+        tL = s->knot_v[s->knot_length_v - s->degree_v - 1];
+        if (tv >= tL){
+            tv = tL - (tL - s->knot_v[s->knot_length_v - s->degree_v - 2]) / 256;
+        }
+
+        first_u = nurbs_basis_local_derivate_function
+            (dbu, bu, tu, s->degree_u, s->knot_u, s->knot_length_u);
+        first_v = nurbs_basis_local_derivate_function
+            (dbv, bv, tv, s->degree_v, s->knot_v, s->knot_length_v);
+        NURBS_PRECISION(surface_contract)(f, s, bu, dbu, first_u, bv, dbv, first_v);
+
+        if (f[3] == 0){
+            p[0] = p[1] = p[2] = (NURBS_REAL)NURBS_ERROR_VALUE;
+            return 0;
+        }
+
+        /* Derivative of a quotient: S' = (A' - w' S) / w */
+        for (k = 0; k < 3; k++){
+            q[k] = f[k] / f[3];
+            du[k] = (f[4 + k] - f[7] * q[k]) / f[3];
+            dv[k] = (f[8 + k] - f[11] * q[k]) / f[3];
+        }
+
+        if (tu == (NurbsFloat)u && tv == (NurbsFloat)v){
+            p[0] = q[0];
+            p[1] = q[1];
+            p[2] = q[2];
+            return 1;
+        }
+    }
+
+    first_u = nurbs_basis_local_function
+        (bu, u, s->degree_u, s->knot_u, s->knot_length_u);
+    first_v = nurbs_basis_local_function
+        (bv, v, s->degree_v, s->knot_v, s->knot_length_v);
+    NURBS_PRECISION(surface_contract)(f, s, bu, nullptr, first_u, bv, nullptr, first_v);
+
+    if (f[3] == 0){
+        p[0] = p[1] = p[2] = (NURBS_REAL)NURBS_ERROR_VALUE;
+        return 0;
+    }
+
+    p[0] = f[0] / f[3];
+    p[1] = f[1] / f[3];
+    p[2] = f[2] / f[3];
+
+    return 1;
+}
+
+
+/* Inversion of a point with the Gauss-Newton method, starting at {*pu, *pv}
+ * and constrained to the parameter intervals. Returns the distance. */
+static inline NURBS_REAL NURBS_PRECISION(surface_invert)
+    ( NURBS_REAL* pu            /* (in) Initial guess (out) solution */
+    , NURBS_REAL* pv            /* (in) Initial guess (out) solution */
+    , const NURBS_PRECISION_SURFACE* s
+    , const NURBS_REAL q[3]     /* Point */
+    , const NURBS_REAL epsilon  /* Stop condition for the distance */
+    , const int max_it          /* Maximum number of iterations */
+    )
+{
+    NURBS_REAL p[3], du[3], dv[3], p1[3], r[3];
+    NURBS_REAL umin, umax, vmin, vmax, u, v, u1, v1, h;
+    NURBS_REAL a11, a12, a22, b1, b2, det, delta_u, delta_v, dist, dist1;
+    int it, k, halving;
+
+    umin = (NURBS_REAL)s->knot_u[s->degree_u];
+    umax = (NURBS_REAL)s->knot_u[s->knot_length_u - s->degree_u - 1];
+    vmin = (NURBS_REAL)s->knot_v[s->degree_v];
+    vmax = (NURBS_REAL)s->knot_v[s->knot_length_v - s->degree_v - 1];
+
+    u = (*pu < umin) ? umin : ((*pu > umax) ? umax : *pu);
+    v = (*pv < vmin) ? vmin : ((*pv > vmax) ? vmax : *pv);
+
+    NURBS_PRECISION(surface_eval)(p, nullptr, nullptr, s, u, v);
+    dist = 0;
+    for (k = 0; k < 3; k++){
+        dist += (p[k] - q[k]) * (p[k] - q[k]);
+    }
+
+    for (it = 0; it < max_it && dist > epsilon * epsilon; it++){
+        /* The point of the derivatives may be shifted from the last knot */
+        if (!NURBS_PRECISION(surface_eval)(p1, du, dv, s, u, v)){
+            break;
+        }
+
+        /* Gauss-Newton: (J^T J) delta = J^T (q - p) */
+        a11 = a12 = a22 = b1 = b2 = 0;
+        for (k = 0; k < 3; k++){
+            r[k] = q[k] - p[k];
+            a11 += du[k] * du[k];
+            a12 += du[k] * dv[k];
+            a22 += dv[k] * dv[k];
+            b1 += du[k] * r[k];
+            b2 += dv[k] * r[k];
+        }
+
+        det = a11 * a22 - a12 * a12;
+        if (!(det > 0)){
+            break;
+        }
+
+        delta_u = (b1 * a22 - b2 * a12) / det;
+        delta_v = (b2 * a11 - b1 * a12) / det;
+
+        /* Halves the step until the distance decreases */
+        for (halving = 0, h = 1; halving < 8; halving++, h /= 2){
+            u1 = u + h * delta_u;
+            v1 = v + h * delta_v;
+            u1 = (u1 < umin) ? umin : ((u1 > umax) ? umax : u1);
+            v1 = (v1 < vmin) ? vmin : ((v1 > vmax) ? vmax : v1);
+
+            NURBS_PRECISION(surface_eval)(p1, nullptr, nullptr, s, u1, v1);
+            dist1 = 0;
+            for (k = 0; k < 3; k++){
+                dist1 += (p1[k] - q[k]) * (p1[k] - q[k]);
+            }
+            if (dist1 < dist){
+                break;
+            }
+        }
+
+        if (!(dist1 < dist)){
+            break;
+        }
+
+        u = u1;
+        v = v1;
+        dist = dist1;
+        p[0] = p1[0];
+        p[1] = p1[1];
+        p[2] = p1[2];
+    }
+
+    *pu = u;
+    *pv = v;
+
+    return (NURBS_REAL)sqrt(dist);
+}
+
+
+/* Samples the surface in a uniform grid of the parameters, which is the
+ * initial guess of the inversion. grid[] has 3 * nu * nv values. */
+static inline void NURBS_PRECISION(surface_sample)
+    ( NURBS_REAL grid[]         /* (out) Points of the grid */
+    , const NURBS_PRECISION_SURFACE* s
+    , const int nu
+    , const int nv
+    )
+{
+    int i, j;
+    NURBS_REAL u, v, umin, umax, vmin, vmax;
+
+    umin = (NURBS_REAL)s->knot_u[s->degree_u];
+    umax = (NURBS_REAL)s->knot_u[s->knot_length_u - s->degree_u - 1];
+    vmin = (NURBS_REAL)s->knot_v[s->degree_v];
+    vmax = (NURBS_REAL)s->knot_v[s->knot_length_v - s->degree_v - 1];
+
+    for (i = 0; i < nu; i++){
+        u = umin + (umax - umin) * i / (nu - 1);
+        for (j = 0; j < nv; j++){
+            v = vmin + (vmax - vmin) * j / (nv - 1);
+            NURBS_PRECISION(surface_eval)
+                ( &(grid[3 * (i * nv + j)]), nullptr, nullptr, s, u, v );
+        }
+    }
+}
+
+
+/* Parameters of the closest point of the grid of surface_sample */
+static inline void NURBS_PRECISION(sample_closest)
+    ( NURBS_REAL* pu
+    , NURBS_REAL* pv
+    , const NURBS_PRECISION_SURFACE* s
+    , const NURBS_REAL grid[]
+    , const int nu
+    , const int nv
+    , const NURBS_REAL q[3]
+    )
+{
+    int k, best = 0;
+    NURBS_REAL dx, dy, dz, dist, best_dist = -1;
+    NURBS_REAL umin, umax, vmin, vmax;
+
+    for (k = 0; k < nu * nv; k++){
+        dx = grid[3 * k] - q[0];
+        dy = grid[3 * k + 1] - q[1];
+        dz = grid[3 * k + 2] - q[2];
+        dist = dx * dx + dy * dy + dz * dz;
+        if (best_dist < 0 || dist < best_dist){
+            best_dist = dist;
+            best = k;
+        }
+    }
+
+    umin = (NURBS_REAL)s->knot_u[s->degree_u];
+    umax = (NURBS_REAL)s->knot_u[s->knot_length_u - s->degree_u - 1];
+    vmin = (NURBS_REAL)s->knot_v[s->degree_v];
+    vmax = (NURBS_REAL)s->knot_v[s->knot_length_v - s->degree_v - 1];
+
+    *pu = umin + (umax - umin) * (best / nv) / (nu - 1);
+    *pv = vmin + (vmax - vmin) * (best % nv) / (nv - 1);
+}
+
+
+/* Gets the points, and optionally the unit normals, of a set of 
+ * parameters (see nurbs_surface_single_get_points) */
+static void NURBS_PRECISION(get_points)
+    ( NURBS_REAL points[]
+    , NURBS_REAL normals[]
+    , const NURBS_PRECISION_SURFACE* s
+    , const NURBS_REAL u[]
+    , const NURBS_REAL v[]
+    , const int length
+    )
+{
+    int i;
+    NURBS_REAL du[3], dv[3], n[3], d;
+
+    #pragma omp parallel for private(du, dv, n, d) schedule(static)
+    for (i = 0; i < length; i++){
+        if (normals == nullptr){
+            NURBS_PRECISION(surface_eval)
+                ( &(points[3 * i]), nullptr, nullptr, s, u[i], v[i] );
+            continue;
+        }
+
+        NURBS_PRECISION(surface_eval)( &(points[3 * i]), du, dv, s, u[i], v[i] );
+
+        n[0] = du[1] * dv[2] - du[2] * dv[1];
+        n[1] = du[2] * dv[0] - du[0] * dv[2];
+        n[2] = du[0] * dv[1] - du[1] * dv[0];
+        d = (NURBS_REAL)sqrt( n[0] * n[0] + n[1] * n[1] + n[2] * n[2] );
+        if (d > 0){
+            d = 1 / d;
+        }
+
+        normals[3 * i] = n[0] * d;
+        normals[3 * i + 1] = n[1] * d;
+        normals[3 * i + 2] = n[2] * d;
+    }
+}
+
+
+/* Inversion of a set of points (see nurbs_surface_single_inversion).
+ * Returns 0 if the memory is exhausted */
+static int NURBS_PRECISION(inversion)
+    ( NURBS_REAL u[]
+    , NURBS_REAL v[]
+    , NURBS_REAL dist[]
+    , const NURBS_PRECISION_SURFACE* s
+    , const NURBS_REAL points[]
+    , const int length
+    , const NURBS_REAL epsilon
+    )
+{
+    int i, nu, nv;
+    NURBS_REAL d;
+    NURBS_REAL* grid = nullptr;
+
+    sample_size( &nu, &nv, s->cp_length_u, s->cp_length_v );
+
+    _check_(grid = (NURBS_REAL*)_malloc_(sizeof(NURBS_REAL) * 3 * nu * nv));
+    if (grid == nullptr){
+        return 0;
+    }
+
+    NURBS_PRECISION(surface_sample)( grid, s, nu, nv );
+
+    #pragma omp parallel for private(d) schedule(static)
+    for (i = 0; i < length; i++){
+        NURBS_PRECISION(sample_closest)
+            ( &(u[i]), &(v[i]), s, grid, nu, nv, &(points[3 * i]) );
+        d = NURBS_PRECISION(surface_invert)( &(u[i]), &(v[i]), s, &(points[3 * i])
+            , epsilon, NURBS_PRECISION_MAX_IT );
+        if (dist != nullptr){
+            dist[i] = d;
+        }
+    }
+
+    free( grid );
+
+    return 1;
+}
+
+#undef NURBS_REAL
+#undef NURBS_PRECISION
+#undef NURBS_PRECISION_SURFACE
+
+/**/
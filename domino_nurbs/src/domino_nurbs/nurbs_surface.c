@@ -52,6 +52,12 @@ void nurbs_surface_init( NurbsSurface* surface )
 
     surface->d_basis_u = nullptr;
     surface->d_basis_v = nullptr;
+
+    surface->layout = NURBS_LAYOUT_CP;
+    surface->version = nurbs_surface_new_version();
+    surface->bezier = nullptr;
+    surface->order2 = nullptr;
+    surface->homogeneous = nullptr;
 }
 
 
@@ -86,6 +92,11 @@ NurbsSurface* nurbs_surface_alloc
     surface->cp = nullptr;
     surface->cp_stream = nullptr;
     surface->knot_stream = nullptr;
+    surface->layout = NURBS_LAYOUT_CP;
+    surface->version = nurbs_surface_new_version();
+    surface->bezier = nullptr;
+    surface->order2 = nullptr;
+    surface->homogeneous = nullptr;
 
     if (num_cp_u < 1 || num_cp_v < 1 
         || surface->knot_length_u < 1 || surface->knot_length_v < 1){
@@ -172,6 +183,7 @@ void nurbs_surface_dispose(NurbsSurface* surface)
     if (surface->cp != nullptr){
         free(surface->cp);
     }
+    nurbs_surface_cache_release(surface);
 
     surface->cp_stream = nullptr;
     surface->knot_stream = nullptr;
@@ -235,6 +247,7 @@ NurbsSurface* nurbs_surface_copy(NurbsSurface* dest, const NurbsSurface* orig)
 
     /* Copy id */
     dest->id = orig->id;
+    dest->layout = orig->layout;
 
     /* Copy control points */
     memcpy(dest->cp_stream, orig->cp_stream
@@ -251,6 +264,18 @@ NurbsSurface* nurbs_surface_copy(NurbsSurface* dest, const NurbsSurface* orig)
 }
 
 
+/* Checks that the basis fit in the local buffers */
+static inline int check_degree(const NurbsSurface *nurbs)
+{
+    if (nurbs->degree_u > NURBS_MAX_DEGREE || nurbs->degree_v > NURBS_MAX_DEGREE){
+        _handle_error_("NURBS surface degree is greater than NURBS_MAX_DEGREE");
+        return 0;
+    }
+
+    return 1;
+}
+
+
 /* Gets the point coordinates on a nurbs surface with parameters [u,v] */
 NurbsVector3 nurbs_surface_get_point
     ( const NurbsSurface *nurbs
@@ -263,57 +288,63 @@ NurbsVector3 nurbs_surface_get_point
     register NurbsFloat gw;
     register NurbsVector3 point = {0};
     NurbsFloat nu, nv;
-    int knotU;  /* Lower knot index of the interval where t belongs */
-    int knotV;  /* Lower knot index of the interval where t belongs */
+    NurbsFloat basis_u[NURBS_MAX_DEGREE + 2];
+    NurbsFloat basis_v[NURBS_MAX_DEGREE + 2];
+    int first_u;  /* Control point of the first non zero basis */
+    int first_v;  /* Control point of the first non zero basis */
     int iu0, iv0, iu1, iv1;  
     NurbsFloat norm;  /* = Sum(basis_ij * weight_ij) */
+    const NurbsSurfaceHomogeneous* h;
+    int k;
+
+    if (!check_degree(nurbs)){
+        point.x = point.y = point.z = NURBS_ERROR_VALUE;
+        return point;
+    }
 
-    knotU = nurbs_basis_function(nurbs->basis_u, u, nurbs->degree_u
+    first_u = nurbs_basis_local_function(basis_u, u, nurbs->degree_u
         , nurbs->knot_u, nurbs->knot_length_u);
 
-    knotV = nurbs_basis_function(nurbs->basis_v, v, nurbs->degree_v
+    first_v = nurbs_basis_local_function(basis_v, v, nurbs->degree_v
         , nurbs->knot_v, nurbs->knot_length_v);
 
     norm = 0;
 
     /* Set the intervals where the basis functions are defined */
-    iu0 = knotU - nurbs->degree_u - 1;
-    if (iu0 < 0){ 
-        iu0 = 0;
-    }
-
-    iu1 = knotU;
-    if (iu1 > nurbs->cp_length_u - 1){
-        iu1 = nurbs->cp_length_u - 1;
-    }
-    if (iu1 < 0){
-        iu1 = 0;
-    }
-
-    iv0 = knotV - nurbs->degree_v - 1;
-    if (iv0 < 0) {
-        iv0 = 0;
-    }
-    iv1 = knotV;
-    if (iv1 > nurbs->cp_length_v - 1){
-        iv1 = nurbs->cp_length_v - 1;
-    }
-    if (iv1 < 0){
-        iv1 = 0;
+    local_basis_range(&iu0, &iu1, first_u, nurbs->degree_u, nurbs->cp_length_u);
+    local_basis_range(&iv0, &iv1, first_v, nurbs->degree_v, nurbs->cp_length_v);
+
+    h = nurbs_surface_get_homogeneous(nurbs);
+    if (h != nullptr){
+        /* Pre-weighted control points, contiguous in v */
+        for (i = iu0; i <= iu1; i++){
+            nu = basis_u[i];
+            k = (first_u + i) * h->stride + first_v;
+            for (j = iv0; j <= iv1; j++){
+                gw = nu * basis_v[j];
+
+                point.x += gw * h->wx[k + j];
+                point.y += gw * h->wy[k + j];
+                point.z += gw * h->wz[k + j];
+
+                norm += gw * h->w[k + j];
+            }
+        }
     }
-
-    for (i = iu0; i <= iu1; i++){
-        nu = nurbs->basis_u[i];
-        for (j = iv0; j <= iv1; j++){
-            nv = nurbs->basis_v[j];
-            cp = nurbs->cp[i][j];
-            gw = nu * nv * cp.w;
-
-            point.x += gw * cp.x;
-            point.y += gw * cp.y;
-            point.z += gw * cp.z;
-
-            norm += gw;
+    else{
+        for (i = iu0; i <= iu1; i++){
+            nu = basis_u[i];
+            for (j = iv0; j <= iv1; j++){
+                nv = basis_v[j];
+                cp = nurbs->cp[first_u + i][first_v + j];
+                gw = nu * nv * cp.w;
+
+                point.x += gw * cp.x;
+                point.y += gw * cp.y;
+                point.z += gw * cp.z;
+
+                norm += gw;
+            }
         }
     }
 
@@ -344,9 +375,22 @@ void nurbs_surface_get_derivatives
     register NurbsFloat gw, guw, gvw;
     NurbsFloat nu, dnu, nv, dnv;
     NurbsFloat uL, vL, uL1, vL1;
-    int knotU;  /* Lower knot index of the knot interval where t belongs */
-    int knotV;  /* Lower knot index of the knot interval where t belongs */
+    NurbsFloat basis_u[NURBS_MAX_DEGREE + 2];
+    NurbsFloat basis_v[NURBS_MAX_DEGREE + 2];
+    NurbsFloat d_basis_u[NURBS_MAX_DEGREE + 2];
+    NurbsFloat d_basis_v[NURBS_MAX_DEGREE + 2];
+    int first_u;  /* Control point of the first non zero basis */
+    int first_v;  /* Control point of the first non zero basis */
     int iu0, iv0, iu1, iv1;  
+    const NurbsSurfaceHomogeneous* h;
+    int k;
+
+    if (!check_degree(nurbs)){
+        point->x = point->y = point->z = NURBS_ERROR_VALUE;
+        deriv_u->x = deriv_u->y = deriv_u->z = NURBS_ERROR_VALUE;
+        deriv_v->x = deriv_v->y = deriv_v->z = NURBS_ERROR_VALUE;
+        return;
+    }
 
     /* The formulation of the derivatives in NURBS is a backward derivative.
      * So, for the last control point, there is no derivative. 
@@ -363,70 +407,80 @@ void nurbs_surface_get_derivatives
         vt = vL - (vL - vL1) / 256;
     }
 
-    knotU = nurbs_basis_derivate_function
-        ( nurbs->d_basis_u, nurbs->basis_u
+    first_u = nurbs_basis_local_derivate_function
+        ( d_basis_u, basis_u
         , ut, nurbs->degree_u
         , nurbs->knot_u, nurbs->knot_length_u
         );
 
-    knotV = nurbs_basis_derivate_function
-        ( nurbs->d_basis_v, nurbs->basis_v
+    first_v = nurbs_basis_local_derivate_function
+        ( d_basis_v, basis_v
         , vt, nurbs->degree_v
         , nurbs->knot_v, nurbs->knot_length_v
         );
 
     /* Set the intervals where the basis functions are defined */
-    iu0 = knotU - nurbs->degree_u - 1;
-    if (iu0 < 0){
-        iu0 = 0;
-    }
-
-    iu1 = knotU;
-    /* This is already checked  */ 
-    if (iu1 > nurbs->cp_length_u - 1){
-        iu1 = nurbs->cp_length_u - 1;
-    }
-    if (iu1 < 0){
-        iu1 = 0;
-    }
-
-    iv0 = knotV - nurbs->degree_v - 1;
-    if (iv0 < 0){
-        iv0 = 0;
-    }
-
-    iv1 = knotV;
-    /* This is already checked  */ 
-    if (iv1 > nurbs->cp_length_v - 1){
-        iv1 = nurbs->cp_length_v - 1;
-    }
-    if (iv1 < 0){
-        iv1 = 0;
-    }
-
-    for (i = iu0; i <= iu1; i++){
-        nu = nurbs->basis_u[i];
-        dnu = nurbs->d_basis_u[i];
-        for (j = iv0; j <= iv1; j++){
-            nv = nurbs->basis_v[j];
-            dnv = nurbs->d_basis_v[j];
-            cp = nurbs->cp[i][j];
-            gw = nu * nv * cp.w; 
-            guw = dnu * nv * cp.w; 
-            gvw = nu * dnv * cp.w; 
-
-            fpoint.x += gw * cp.x;
-            fpoint.y += gw * cp.y;
-            fpoint.z += gw * cp.z;
-            fpoint.w += gw;
-            fderiv_u.x += guw * cp.x;
-            fderiv_u.y += guw * cp.y;
-            fderiv_u.z += guw * cp.z;
-            fderiv_u.w += guw;
-            fderiv_v.x += gvw * cp.x;
-            fderiv_v.y += gvw * cp.y;
-            fderiv_v.z += gvw * cp.z;
-            fderiv_v.w += gvw;
+    local_basis_range(&iu0, &iu1, first_u, nurbs->degree_u, nurbs->cp_length_u);
+    local_basis_range(&iv0, &iv1, first_v, nurbs->degree_v, nurbs->cp_length_v);
+
+    h = nurbs_surface_get_homogeneous(nurbs);
+    if (h != nullptr){
+        /* Pre-weighted control points, contiguous in v */
+        for (i = iu0; i <= iu1; i++){
+            nu = basis_u[i];
+            dnu = d_basis_u[i];
+            k = (first_u + i) * h->stride + first_v;
+            for (j = iv0; j <= iv1; j++){
+                nv = basis_v[j];
+                dnv = d_basis_v[j];
+                cp.x = h->wx[k + j];
+                cp.y = h->wy[k + j];
+                cp.z = h->wz[k + j];
+                cp.w = h->w[k + j];
+                gw = nu * nv; 
+                guw = dnu * nv; 
+                gvw = nu * dnv; 
+
+                fpoint.x += gw * cp.x;
+                fpoint.y += gw * cp.y;
+                fpoint.z += gw * cp.z;
+                fpoint.w += gw * cp.w;
+                fderiv_u.x += guw * cp.x;
+                fderiv_u.y += guw * cp.y;
+                fderiv_u.z += guw * cp.z;
+                fderiv_u.w += guw * cp.w;
+                fderiv_v.x += gvw * cp.x;
+                fderiv_v.y += gvw * cp.y;
+                fderiv_v.z += gvw * cp.z;
+                fderiv_v.w += gvw * cp.w;
+            }
+        }
+    }
+    else{
+        for (i = iu0; i <= iu1; i++){
+            nu = basis_u[i];
+            dnu = d_basis_u[i];
+            for (j = iv0; j <= iv1; j++){
+                nv = basis_v[j];
+                dnv = d_basis_v[j];
+                cp = nurbs->cp[first_u + i][first_v + j];
+                gw = nu * nv * cp.w; 
+                guw = dnu * nv * cp.w; 
+                gvw = nu * dnv * cp.w; 
+
+                fpoint.x += gw * cp.x;
+                fpoint.y += gw * cp.y;
+                fpoint.z += gw * cp.z;
+                fpoint.w += gw;
+                fderiv_u.x += guw * cp.x;
+                fderiv_u.y += guw * cp.y;
+                fderiv_u.z += guw * cp.z;
+                fderiv_u.w += guw;
+                fderiv_v.x += gvw * cp.x;
+                fderiv_v.y += gvw * cp.y;
+                fderiv_v.z += gvw * cp.z;
+                fderiv_v.w += gvw;
+            }
         }
     }
 
@@ -434,17 +488,20 @@ void nurbs_surface_get_derivatives
     point->y = fpoint.y / fpoint.w;
     point->z = fpoint.z / fpoint.w;
 
-    deriv_u->x = (fderiv_u.x - fderiv_u.w * fpoint.x) / fpoint.w;
-    deriv_u->y = (fderiv_u.y - fderiv_u.w * fpoint.y) / fpoint.w;
-    deriv_u->z = (fderiv_u.z - fderiv_u.w * fpoint.z) / fpoint.w;
+    /* Derivative of a quotient: S' = (A' - w' S) / w */
+    deriv_u->x = (fderiv_u.x - fderiv_u.w * point->x) / fpoint.w;
+    deriv_u->y = (fderiv_u.y - fderiv_u.w * point->y) / fpoint.w;
+    deriv_u->z = (fderiv_u.z - fderiv_u.w * point->z) / fpoint.w;
 
-    deriv_v->x = (fderiv_v.x - fderiv_v.w * fpoint.x) / fpoint.w;
-    deriv_v->y = (fderiv_v.y - fderiv_v.w * fpoint.y) / fpoint.w;
-    deriv_v->z = (fderiv_v.z - fderiv_v.w * fpoint.z) / fpoint.w;
+    deriv_v->x = (fderiv_v.x - fderiv_v.w * point->x) / fpoint.w;
+    deriv_v->y = (fderiv_v.y - fderiv_v.w * point->y) / fpoint.w;
+    deriv_v->z = (fderiv_v.z - fderiv_v.w * point->z) / fpoint.w;
 }
 
 
-/* Gets the derivate of the nurbs surface */
+/* Gets the point, the first and the second derivatives of the nurbs surface.
+ * The three basis are calculated with a single recursion in each direction
+ * and everything is accumulated in one pass over the control points. */
 void nurbs_surface_get_second_derivatives
     ( NurbsVector3 *deriv_uu  /* (out) Second derivative Suu */
     , NurbsVector3 *deriv_uv  /* (out) Second derivative Suv */
@@ -465,29 +522,28 @@ void nurbs_surface_get_second_derivatives
     register NurbsVector4 fderiv_uu = {0};
     register NurbsVector4 fderiv_uv = {0};
     register NurbsVector4 fderiv_vv = {0};
+    register NurbsFloat g, gu, gv, guu, guv, gvv;
     NurbsFloat nu, nv, du, dv, d2u, d2v;
-    int iKnotU;  /* Lower knot index of the knot interval where t belongs */
-    int iKnotV;  /* Lower knot index of the knot interval where t belongs */
+    int first_u;  /* Control point of the first non zero basis */
+    int first_v;  /* Control point of the first non zero basis */
     int iu0, iv0, iu1, iv1;  
     NurbsFloat uL, vL, uL1, vL1;
-
-    NurbsFloat *d2_basis_u = nullptr;
-    NurbsFloat *d2_basis_v = nullptr;
-
-    _check_(d2_basis_u = (NurbsFloat*)_malloc_
-        (sizeof(NurbsFloat)*nurbs->knot_length_u));
-
-    _check_( d2_basis_v = (NurbsFloat*)_malloc_
-        (sizeof(NurbsFloat)*nurbs->knot_length_v));
-
-    if (d2_basis_u == nullptr || d2_basis_u == nullptr){
-        /* Out of memory */
-        if (d2_basis_u != nullptr){
-            free(d2_basis_u);
-        }
-        if (d2_basis_v != nullptr){
-            free(d2_basis_v);
-        }
+    NurbsFloat basis_u[NURBS_MAX_DEGREE + 2];
+    NurbsFloat basis_v[NURBS_MAX_DEGREE + 2];
+    NurbsFloat d_basis_u[NURBS_MAX_DEGREE + 2];
+    NurbsFloat d_basis_v[NURBS_MAX_DEGREE + 2];
+    NurbsFloat d2_basis_u[NURBS_MAX_DEGREE + 2];
+    NurbsFloat d2_basis_v[NURBS_MAX_DEGREE + 2];
+    const NurbsSurfaceHomogeneous* h;
+    int k;
+
+    if (!check_degree(nurbs)){
+        point->x = point->y = point->z = NURBS_ERROR_VALUE;
+        deriv_u->x = deriv_u->y = deriv_u->z = NURBS_ERROR_VALUE;
+        deriv_v->x = deriv_v->y = deriv_v->z = NURBS_ERROR_VALUE;
+        deriv_uu->x = deriv_uu->y = deriv_uu->z = NURBS_ERROR_VALUE;
+        deriv_uv->x = deriv_uv->y = deriv_uv->z = NURBS_ERROR_VALUE;
+        deriv_vv->x = deriv_vv->y = deriv_vv->z = NURBS_ERROR_VALUE;
         return;
     }
 
@@ -506,99 +562,116 @@ void nurbs_surface_get_second_derivatives
         v = vL - (vL - vL1) / 256;
     }
 
-    iKnotU = nurbs_basis_second_derivate_function
-        ( d2_basis_u, nurbs->d_basis_u, nurbs->basis_u, u, nurbs->degree_u
+    first_u = nurbs_basis_local_second_derivate_function
+        ( d2_basis_u, d_basis_u, basis_u, u, nurbs->degree_u
         , nurbs->knot_u, nurbs->knot_length_u
         );
 
-    iKnotV = nurbs_basis_second_derivate_function
-        ( d2_basis_v, nurbs->d_basis_v, nurbs->basis_v, v, nurbs->degree_v
+    first_v = nurbs_basis_local_second_derivate_function
+        ( d2_basis_v, d_basis_v, basis_v, v, nurbs->degree_v
         , nurbs->knot_v, nurbs->knot_length_v
         );
 
-    fpoint.x = 0;
-    fpoint.y = 0;
-    fpoint.z = 0;
-
-    fderiv_u.x = 0;
-    fderiv_u.y = 0;
-    fderiv_u.z = 0;
-    fderiv_v.x = 0;
-    fderiv_v.y = 0;
-    fderiv_v.z = 0;
-
-    fderiv_uu.x = 0;
-    fderiv_uu.y = 0;
-    fderiv_uu.z = 0;
-    fderiv_uv.x = 0;
-    fderiv_uv.y = 0;
-    fderiv_uv.z = 0;
-    fderiv_vv.x = 0;
-    fderiv_vv.y = 0;
-    fderiv_vv.z = 0;
-
-    fpoint.w = 0;
-    fderiv_u.w = 0;
-    fderiv_v.w = 0;
-    fderiv_uu.w  = 0;
-    fderiv_uv.w  = 0;
-    fderiv_vv.w  = 0;
-
     /* Set the intervals where the basis functions are defined */
-    iu0 = iKnotU - nurbs->degree_u - 1;
-    if (iu0 < 0){
-        iu0 = 0;
-    }
-    iu1 = iKnotU;
-    if (iu1 < 0){
-        iu1 = 0;
-    }
-
-    iv0 = iKnotV - nurbs->degree_v - 1;
-    if (iv0 < 0){ 
-        iv0 = 0;
-    }
-    iv1 = iKnotV;
-    if (iv1 < 0){
-        iv1 = 0;
-    }
-
-    for (i = iu0; i <= iu1; i++){
-        nu = nurbs->basis_u[i];
-        du = nurbs->d_basis_u[i];
-        d2u = d2_basis_u[i];
-        for (j = iv0; j <= iv1; j++){
-            nv = nurbs->basis_v[j];
-            dv = nurbs->d_basis_v[j];
-            d2v = d2_basis_v[j];
-            cp = nurbs->cp[i][j];
-            fpoint.x += nu * nv * cp.x * cp.w;
-            fpoint.y += nu * nv * cp.y * cp.w;
-            fpoint.z += nu * nv * cp.z * cp.w;
-
-            fderiv_u.x += du * nv * cp.x * cp.w;
-            fderiv_u.y += du * nv * cp.y * cp.w;
-            fderiv_u.z += du * nv * cp.z * cp.w;
-            fderiv_v.x += dv * nu * cp.x * cp.w;
-            fderiv_v.y += dv * nu * cp.y * cp.w;
-            fderiv_v.z += dv * nu * cp.z * cp.w;
-
-            fderiv_uu.x += d2u * nv * cp.x * cp.w;
-            fderiv_uu.y += d2u * nv * cp.y * cp.w;
-            fderiv_uu.z += d2u * nv * cp.z * cp.w;
-            fderiv_uv.x += du * dv * cp.x * cp.w;
-            fderiv_uv.y += du * dv * cp.y * cp.w;
-            fderiv_uv.z += du * dv * cp.z * cp.w;
-            fderiv_vv.x += nu * d2v * cp.x * cp.w;
-            fderiv_vv.y += nu * d2v * cp.y * cp.w;
-            fderiv_vv.z += nu * d2v * cp.z * cp.w;
-
-            fpoint.w += nu * nv * cp.w;
-            fderiv_u.w += du * nv * cp.w;
-            fderiv_v.w += nu * dv * cp.w;
-            fderiv_uu.w += d2u * nv * cp.w;
-            fderiv_uv.w += du * dv * cp.w;
-            fderiv_vv.w += nu * d2v * cp.w;
+    local_basis_range(&iu0, &iu1, first_u, nurbs->degree_u, nurbs->cp_length_u);
+    local_basis_range(&iv0, &iv1, first_v, nurbs->degree_v, nurbs->cp_length_v);
+
+    h = nurbs_surface_get_homogeneous(nurbs);
+    if (h != nullptr){
+        /* Pre-weighted control points, contiguous in v */
+        for (i = iu0; i <= iu1; i++){
+            nu = basis_u[i];
+            du = d_basis_u[i];
+            d2u = d2_basis_u[i];
+            k = (first_u + i) * h->stride + first_v;
+            for (j = iv0; j <= iv1; j++){
+                nv = basis_v[j];
+                dv = d_basis_v[j];
+                d2v = d2_basis_v[j];
+                cp.x = h->wx[k + j];
+                cp.y = h->wy[k + j];
+                cp.z = h->wz[k + j];
+                cp.w = h->w[k + j];
+                g = nu * nv;
+                gu = du * nv;
+                gv = nu * dv;
+                guu = d2u * nv;
+                guv = du * dv;
+                gvv = nu * d2v;
+
+                fpoint.x += g * cp.x;
+                fpoint.y += g * cp.y;
+                fpoint.z += g * cp.z;
+                fpoint.w += g * cp.w;
+
+                fderiv_u.x += gu * cp.x;
+                fderiv_u.y += gu * cp.y;
+                fderiv_u.z += gu * cp.z;
+                fderiv_u.w += gu * cp.w;
+                fderiv_v.x += gv * cp.x;
+                fderiv_v.y += gv * cp.y;
+                fderiv_v.z += gv * cp.z;
+                fderiv_v.w += gv * cp.w;
+
+                fderiv_uu.x += guu * cp.x;
+                fderiv_uu.y += guu * cp.y;
+                fderiv_uu.z += guu * cp.z;
+                fderiv_uu.w += guu * cp.w;
+                fderiv_uv.x += guv * cp.x;
+                fderiv_uv.y += guv * cp.y;
+                fderiv_uv.z += guv * cp.z;
+                fderiv_uv.w += guv * cp.w;
+                fderiv_vv.x += gvv * cp.x;
+                fderiv_vv.y += gvv * cp.y;
+                fderiv_vv.z += gvv * cp.z;
+                fderiv_vv.w += gvv * cp.w;
+            }
+        }
+    }
+    else{
+        for (i = iu0; i <= iu1; i++){
+            nu = basis_u[i];
+            du = d_basis_u[i];
+            d2u = d2_basis_u[i];
+            for (j = iv0; j <= iv1; j++){
+                nv = basis_v[j];
+                dv = d_basis_v[j];
+                d2v = d2_basis_v[j];
+                cp = nurbs->cp[first_u + i][first_v + j];
+                g = nu * nv * cp.w;
+                gu = du * nv * cp.w;
+                gv = nu * dv * cp.w;
+                guu = d2u * nv * cp.w;
+                guv = du * dv * cp.w;
+                gvv = nu * d2v * cp.w;
+
+                fpoint.x += g * cp.x;
+                fpoint.y += g * cp.y;
+                fpoint.z += g * cp.z;
+                fpoint.w += g;
+
+                fderiv_u.x += gu * cp.x;
+                fderiv_u.y += gu * cp.y;
+                fderiv_u.z += gu * cp.z;
+                fderiv_u.w += gu;
+                fderiv_v.x += gv * cp.x;
+                fderiv_v.y += gv * cp.y;
+                fderiv_v.z += gv * cp.z;
+                fderiv_v.w += gv;
+
+                fderiv_uu.x += guu * cp.x;
+                fderiv_uu.y += guu * cp.y;
+                fderiv_uu.z += guu * cp.z;
+                fderiv_uu.w += guu;
+                fderiv_uv.x += guv * cp.x;
+                fderiv_uv.y += guv * cp.y;
+                fderiv_uv.z += guv * cp.z;
+                fderiv_uv.w += guv;
+                fderiv_vv.x += gvv * cp.x;
+                fderiv_vv.y += gvv * cp.y;
+                fderiv_vv.z += gvv * cp.z;
+                fderiv_vv.w += gvv;
+            }
         }
     }
 
@@ -606,39 +679,104 @@ void nurbs_surface_get_second_derivatives
     point->y = fpoint.y / fpoint.w;
     point->z = fpoint.z / fpoint.w;
 
-    deriv_u->x = (fderiv_u.x - fderiv_u.w * fpoint.x) / fpoint.w;
-    deriv_u->y = (fderiv_u.y - fderiv_u.w * fpoint.y) / fpoint.w;
-    deriv_u->z = (fderiv_u.z - fderiv_u.w * fpoint.z) / fpoint.w;
+    /* Derivative of a quotient: S' = (A' - w' S) / w */
+    deriv_u->x = (fderiv_u.x - fderiv_u.w * point->x) / fpoint.w;
+    deriv_u->y = (fderiv_u.y - fderiv_u.w * point->y) / fpoint.w;
+    deriv_u->z = (fderiv_u.z - fderiv_u.w * point->z) / fpoint.w;
 
-    deriv_v->x = (fderiv_v.x - fderiv_v.w * fpoint.x) / fpoint.w;
-    deriv_v->y = (fderiv_v.y - fderiv_v.w * fpoint.y) / fpoint.w;
-    deriv_v->z = (fderiv_v.z - fderiv_v.w * fpoint.z) / fpoint.w;
+    deriv_v->x = (fderiv_v.x - fderiv_v.w * point->x) / fpoint.w;
+    deriv_v->y = (fderiv_v.y - fderiv_v.w * point->y) / fpoint.w;
+    deriv_v->z = (fderiv_v.z - fderiv_v.w * point->z) / fpoint.w;
 
-    deriv_uu->x = fderiv_uu.x - 2*fderiv_u.x*fderiv_u.w - fpoint.x*fderiv_uu.w;
+    /* S'' = (A'' - 2 w' S' - w'' S) / w */
+    deriv_uu->x = fderiv_uu.x - 2*deriv_u->x*fderiv_u.w - point->x*fderiv_uu.w;
     deriv_uu->x /= fpoint.w;
-    deriv_uu->y = fderiv_uu.y - 2*fderiv_u.y*fderiv_u.w - fpoint.y*fderiv_uu.w;
+    deriv_uu->y = fderiv_uu.y - 2*deriv_u->y*fderiv_u.w - point->y*fderiv_uu.w;
     deriv_uu->y /= fpoint.w;
-    deriv_uu->z = fderiv_uu.z - 2*fderiv_u.z*fderiv_u.w - fpoint.z*fderiv_uu.w;
+    deriv_uu->z = fderiv_uu.z - 2*deriv_u->z*fderiv_u.w - point->z*fderiv_uu.w;
     deriv_uu->z /= fpoint.w;
 
-    deriv_uv->x = fderiv_uv.x - fderiv_u.x*fderiv_v.w 
-        - fderiv_v.x*fderiv_u.w - fpoint.x*fderiv_uv.w;
+    deriv_uv->x = fderiv_uv.x - deriv_u->x*fderiv_v.w 
+        - deriv_v->x*fderiv_u.w - point->x*fderiv_uv.w;
     deriv_uv->x /= fpoint.w;
-    deriv_uv->y = fderiv_uv.y - fderiv_u.y*fderiv_v.w 
-        - fderiv_v.y*fderiv_u.w - fpoint.y*fderiv_uv.w;
+    deriv_uv->y = fderiv_uv.y - deriv_u->y*fderiv_v.w 
+        - deriv_v->y*fderiv_u.w - point->y*fderiv_uv.w;
     deriv_uv->y /= fpoint.w;
-    deriv_uv->z = fderiv_uv.z - fderiv_u.z*fderiv_v.w 
-        - fderiv_v.z*fderiv_u.w - fpoint.z*fderiv_uv.w;
+    deriv_uv->z = fderiv_uv.z - deriv_u->z*fderiv_v.w 
+        - deriv_v->z*fderiv_u.w - point->z*fderiv_uv.w;
     deriv_uv->z /= fpoint.w;
 
-    deriv_vv->x = fderiv_vv.x - 2*fderiv_v.x*fderiv_v.w - fpoint.x*fderiv_vv.w;
+    deriv_vv->x = fderiv_vv.x - 2*deriv_v->x*fderiv_v.w - point->x*fderiv_vv.w;
     deriv_vv->x /= fpoint.w;
-    deriv_vv->y = fderiv_vv.y - 2*fderiv_v.y*fderiv_v.w - fpoint.y*fderiv_vv.w;
+    deriv_vv->y = fderiv_vv.y - 2*deriv_v->y*fderiv_v.w - point->y*fderiv_vv.w;
     deriv_vv->y /= fpoint.w;
-    deriv_vv->z = fderiv_vv.z - 2*fderiv_v.z*fderiv_v.w - fpoint.z*fderiv_vv.w;
+    deriv_vv->z = fderiv_vv.z - 2*deriv_v->z*fderiv_v.w - point->z*fderiv_vv.w;
     deriv_vv->z /= fpoint.w;
 }
 
+
+/* Replaces a first derivative that vanishes (e.g. on a degenerated edge)
+ * by the derivative a small step h inside of the parametric interval, 
+ * D(t + h) ~ D(t) + D2(t) h, where h goes backwards at the upper end. */
+static void regular_derivative
+    ( NurbsVector3 *deriv
+    , const NurbsVector3 *deriv2
+    , const NurbsFloat t
+    , const NurbsFloat knot[]
+    , const int knot_length
+    , const int degree
+    )
+{
+    NurbsFloat h, mod, min, max;
+
+    mod = deriv->x * deriv->x + deriv->y * deriv->y + deriv->z * deriv->z;
+    if (mod >= NURBS_DEGENERATE_EPSILON){
+        return;
+    }
+
+    nurbs_basis_get_parameter_interval( &min, &max, knot, knot_length, degree );
+    h = (max - min) / 2000;
+    if (t > (min + max) / 2){
+        h = -h;
+    }
+
+    deriv->x += deriv2->x * h;
+    deriv->y += deriv2->y * h;
+    deriv->z += deriv2->z * h;
+}
+
+
+/* Gets the point, the first and the second derivatives for the iterative
+ * methods (inversion and intersection). The point is exact also at the last
+ * knot, and the first derivatives are never zero on degenerated edges. */
+void nurbs_surface_get_regular_derivatives
+    ( NurbsVector3 *deriv_uu  /* (out) Second derivative Suu */
+    , NurbsVector3 *deriv_uv  /* (out) Second derivative Suv */
+    , NurbsVector3 *deriv_vv  /* (out) Second derivative Svv */
+    , NurbsVector3 *deriv_u   /* (out) First derivative Su */
+    , NurbsVector3 *deriv_v   /* (out) First derivative Sv */
+    , NurbsVector3 *point     /* (out) Point coordinates {x, y, z} */
+    , const NurbsSurface *nurbs
+    , const NurbsFloat u
+    , const NurbsFloat v
+    )
+{
+    nurbs_surface_get_second_derivatives
+        ( deriv_uu, deriv_uv, deriv_vv, deriv_u, deriv_v, point, nurbs, u, v );
+
+    /* The derivatives are calculated a bit before the last knot */
+    if (u >= nurbs->knot_u[nurbs->knot_length_u - nurbs->degree_u - 1]
+        || v >= nurbs->knot_v[nurbs->knot_length_v - nurbs->degree_v - 1])
+    {
+        *point = nurbs_surface_get_point( nurbs, u, v );
+    }
+
+    regular_derivative( deriv_u, deriv_uu, u
+        , nurbs->knot_u, nurbs->knot_length_u, nurbs->degree_u );
+    regular_derivative( deriv_v, deriv_vv, v
+        , nurbs->knot_v, nurbs->knot_length_v, nurbs->degree_v );
+}
+
 /* Calculates the normal by finite diferences.  */
 NurbsVector3 nurbs_surface_get_normal_by_FD
     ( const NurbsSurface *nurbs
@@ -759,6 +897,10 @@ NurbsSurface* nurbs_surface_reduce_order2
     }
 
     nurbs2 = nurbs_surface_copy(nurbs2, surface);
+    if (nurbs2 == nullptr){
+        /* Out of memory */
+        return nullptr;
+    }
 
     /* Reduce the original nurbs to order 2 */
     for (i = 0; i < surface->degree_u - 1; i++){
@@ -110,6 +110,8 @@ NurbsSurface* nurbs_surface_copy
 /*******************************************************************************
 *  Description:
 *    Gets the space coordinates {x,y,z} of a point with parameters {u,v}.
+*    The surface is not modified (the basis are stored in the stack), so
+*    it can be evaluated from several threads at the same time.
 *  Return Values:
 *    Returns point coordinates {x, y, z}
 *******************************************************************************/
@@ -123,6 +125,7 @@ NurbsVector3 nurbs_surface_get_point
 /*******************************************************************************
 *  Description:
 *    Gets the derivates of the nurbs surface on {u,v}.
+*    It is reentrant; the surface is not modified.
 *  Return Values:
 *    void
 *******************************************************************************/
@@ -139,7 +142,9 @@ void nurbs_surface_get_derivatives
 
 /*******************************************************************************
 *  Description:
-*    Gets the second derivates of the nurbs surface on (u,v).
+*    Gets the point, the first and the second derivates of the nurbs surface
+*    on (u,v) in a single pass. It does not allocate memory and it is 
+*    reentrant; the surface is not modified.
 *  Return Values:
 *    void
 *******************************************************************************/
@@ -157,6 +162,101 @@ void nurbs_surface_get_second_derivatives
     );
 #endif
 
+/*******************************************************************************
+*  Description:
+*    Gets the space coordinates of an array of points with parameters 
+*    {u[i],v[i]}. The points are grouped by knot span and evaluated in 
+*    blocks that share the knots and the control points, so the basis 
+*    recursion and the sums run across the points of a block (SIMD). 
+*    The blocks are evaluated in parallel if OpenMP is enabled. 
+*    The operations are the same as in nurbs_surface_get_point().
+*  Return Values:
+*    integer
+*  @return 1 on success; 0 if the memory is exhausted.
+*******************************************************************************/
+#ifndef SWIG 
+int nurbs_surface_get_points
+    ( NurbsVector3 points[]         /** (out) space coordinates {x,y,z} */
+    , const NurbsSurface* surface   /** nurbs surface pointer */
+    , const NurbsFloat u[]          /** first parametric coordinates */
+    , const NurbsFloat v[]          /** second parametric coordinates */
+    , const int length              /** number of points */
+    );
+#endif
+
+/*******************************************************************************
+*  Description:
+*    Gets the derivatives of an array of points with parameters {u[i],v[i]}.
+*    Same as nurbs_surface_get_derivatives(), but evaluated in blocks as 
+*    nurbs_surface_get_points().
+*  Return Values:
+*    integer
+*  @return 1 on success; 0 if the memory is exhausted.
+*******************************************************************************/
+#ifndef SWIG 
+int nurbs_surface_get_points_derivatives
+    ( NurbsVector3 deriv_u[]        /** (out) first derivative vectors */
+    , NurbsVector3 deriv_v[]        /** (out) second derivative vectors */
+    , NurbsVector3 points[]         /** (out) space coordinates {x,y,z} */
+    , const NurbsSurface* surface   /** nurbs surface pointer */
+    , const NurbsFloat u[]          /** first parametric coordinates */
+    , const NurbsFloat v[]          /** second parametric coordinates */
+    , const int length              /** number of points */
+    );
+#endif
+
+/*******************************************************************************
+*  Description:
+*    Gets the unit normals and the principal curvatures of an array of points
+*    with parameters {u[i],v[i]}. The point, the first and the second 
+*    derivatives are calculated in a single pass, as 
+*    nurbs_surface_get_second_derivatives(), and evaluated in blocks as 
+*    nurbs_surface_get_points(). The curvatures are positive where the 
+*    surface bends towards the normal (Su x Sv), and k1[i] >= k2[i].
+*    On kinks and degenerated edges the normal and the curvatures are zero.
+*    The normals and the points are optional (pass nullptr to skip them).
+*  Return Values:
+*    integer
+*  @return 1 on success; 0 if the memory is exhausted.
+*******************************************************************************/
+#ifndef SWIG 
+int nurbs_surface_get_points_curvatures
+    ( NurbsFloat k1[]               /** (out) maximum principal curvatures */
+    , NurbsFloat k2[]               /** (out) minimum principal curvatures */
+    , NurbsVector3 normals[]        /** (out) unit normals (or nullptr) */
+    , NurbsVector3 points[]         /** (out) space coordinates (or nullptr) */
+    , const NurbsSurface* surface   /** nurbs surface pointer */
+    , const NurbsFloat u[]          /** first parametric coordinates */
+    , const NurbsFloat v[]          /** second parametric coordinates */
+    , const int length              /** number of points */
+    );
+#endif
+
+/*******************************************************************************
+*  Description:
+*    Evaluates a structured grid of points {u[i], v[j]}, stored as
+*    points[i*length_v + j]. The basis of each u and v parameter are 
+*    calculated only once. Each u parameter is contracted first with the 
+*    control net (a row of homogeneous points), and then each v parameter 
+*    with the row, so the cost per point is degree_v + 1 products. 
+*    Optionally calculates the unit normals (pass nullptr to skip them).
+*    The rows are evaluated in parallel if OpenMP is enabled.
+*  Return Values:
+*    integer
+*  @return 1 on success; 0 if the memory is exhausted.
+*******************************************************************************/
+#ifndef SWIG 
+int nurbs_surface_get_grid
+    ( NurbsVector3 points[]         /** (out) space coordinates {x,y,z} */
+    , NurbsVector3 normals[]        /** (out) unit normals (or nullptr) */
+    , const NurbsSurface* surface   /** nurbs surface pointer */
+    , const NurbsFloat u[]          /** first parametric coordinates */
+    , const int length_u            /** number of u parameters */
+    , const NurbsFloat v[]          /** second parametric coordinates */
+    , const int length_v            /** number of v parameters */
+    );
+#endif
+
 /*******************************************************************************
 *  Description:
 *    Calculates the inversion point using a first order method. 
@@ -210,7 +310,7 @@ int nurbs_surface_estimation_normal
     ( NurbsFloat *pu    /* returned solution */
     , NurbsFloat *pv    /* returned solution */
     , const NurbsSurface *surface_orig   /* non reduced NURBS surface */
-    , const NurbsSurface *surface_order2 /* second order NURBS surface */
+    , const NurbsSurface *surface_order2 /* second order NURBS surface (nullptr: cached in the surface) */
     , const NurbsVector3 *point  /* coordinates of the point {x, y, z} */
     , const NurbsVector3 *normal /* surface normal (should be normalized) */
     , const NurbsFloat gamma     /* relaxing factor used by the estimation */
@@ -229,7 +329,7 @@ int nurbs_surface_inversion_normal
     ( NurbsFloat *pu    /** (in) initial quest (out) solution of the inversion*/
     , NurbsFloat *pv    /** (in) initial quest (out) solution of the inversion*/
     , const NurbsSurface *surface_orig   /** non reduced nurbs surface pointer*/
-    , const NurbsSurface *surface_order2 /**second order nurbs surface pointer*/
+    , const NurbsSurface *surface_order2 /**second order nurbs surface pointer (nullptr: cached in the surface)*/
     , const NurbsVector3 *point /** space coordinates of the point {x, y, z}  */
     , const NurbsVector3 *surface_normal /**surface normal direction {x, y, z}*/
     , const NurbsFloat epsilon           /**stop condition iterative (eg 1e-6)*/
@@ -283,7 +383,7 @@ int nurbs_surface_estimation_min_distance
     ( NurbsFloat *pu                     /** returned value */
     , NurbsFloat *pv                     /** returned value */
     , const NurbsSurface *surface_orig   /** non reduced NURBS surface */
-    , const NurbsSurface *surface_order2 /** second order NURBS surface */
+    , const NurbsSurface *surface_order2 /** second order NURBS surface (nullptr: cached in the surface) */
     , const NurbsVector3 *point  /** coordinates of the point {x, y, z} */
     , const NurbsFloat gamma     /** relaxing factor (eg 0, 0.25, 0.50) */
     );
@@ -303,12 +403,253 @@ int nurbs_surface_estimation_min_distance
 int nurbs_surface_inversion_min_distance
      ( NurbsFloat *pu, NurbsFloat *pv
      , const NurbsSurface *surface_orig 	/** non reduced NURBS */
-     , const NurbsSurface *surface_order2 	/**second order NURBS */
+     , const NurbsSurface *surface_order2 	/**second order NURBS (nullptr: cached in the surface) */
      , const NurbsVector3 *point /** coordinates of the point {x, y, z} */
      , const NurbsFloat epsilon  /** stop condition (eg 1e-6) */
      , const NurbsFloat gamma    /** relaxing factor (eg 0, 0.25, 0.50) */
      );
 
+/*******************************************************************************
+*  Description:
+*    Equivalent to a C++ default constructor for the hierarchy of patches.
+*******************************************************************************/
+void nurbs_surface_bvh_init( NurbsSurfaceBVH* bvh );
+
+/*******************************************************************************
+*  Description:
+*    Releases the memory of the hierarchy of patches (but not the structure).
+*******************************************************************************/
+void nurbs_surface_bvh_dispose( NurbsSurfaceBVH* bvh );
+
+/*******************************************************************************
+*  Description:
+*    Builds a bounding volume hierarchy over the patches (non empty knot 
+*    spans) of the surface, with the bounding boxes of the control points 
+*    of each patch. It must be built again if the control points change.
+*  Return Values:
+*    integer
+*  @return 1 on success; 0 if the memory is exhausted or the surface is empty.
+*******************************************************************************/
+int nurbs_surface_bvh_build
+    ( NurbsSurfaceBVH* bvh          /** (out) hierarchy of the patches */
+    , const NurbsSurface* surface   /** nurbs surface pointer */
+    );
+
+/*******************************************************************************
+*  Description:
+*    Finds the patches that may contain the closest point of the surface to
+*    the given point, sorted by the distance to their bounding boxes.
+*    Only the nearest max_patches are returned.
+*  Return Values:
+*    integer
+*  @return the number of patches found; -1 if the memory is exhausted.
+*******************************************************************************/
+#ifndef SWIG 
+int nurbs_surface_bvh_closest
+    ( int span_u[]              /** (out) knot interval in u of the patches */
+    , int span_v[]              /** (out) knot interval in v of the patches */
+    , NurbsFloat lower[]        /** (out) distance to the bounding boxes */
+    , const int max_patches     /** size of the arrays */
+    , const NurbsSurfaceBVH* bvh    /** hierarchy of the patches */
+    , const NurbsVector3* point     /** coordinates of the point {x, y, z} */
+    );
+#endif
+
+/*******************************************************************************
+*  Description:
+*    Builds a bounding volume hierarchy over the bilinear patches of a second
+*    order surface (see nurbs_surface_reduce_order2), in homogeneous 
+*    coordinates. Each patch is extended by the relaxation factor, as in 
+*    nurbs_surface_intersection_fast.
+*  Return Values:
+*    integer
+*  @return 1 on success; 0 if the memory is exhausted or the surface is not
+*    of second order.
+*******************************************************************************/
+int nurbs_surface_bvh_build_order2
+    ( NurbsSurfaceBVH* bvh          /** (out) hierarchy of the patches */
+    , const NurbsSurface* order2    /** second order nurbs surface */
+    , const NurbsFloat relaxation   /** extension of the patches (eg 0.1) */
+    );
+
+/*******************************************************************************
+*  Description:
+*    Finds the pairs of patches of two hierarchies whose bounding boxes 
+*    overlap. The pairs are stored as {span_u_a, span_v_a, span_u_b, span_v_b}
+*    in a new array, that must be released with free().
+*  Return Values:
+*    integer
+*  @return the number of pairs; -1 if the memory is exhausted.
+*******************************************************************************/
+#ifndef SWIG 
+int nurbs_surface_bvh_overlap
+    ( int** pairs                   /** (out) new array of pairs */
+    , const NurbsSurfaceBVH* bvh_a  /** hierarchy of the first surface */
+    , const NurbsSurfaceBVH* bvh_b  /** hierarchy of the second surface */
+    );
+#endif
+
+/*******************************************************************************
+*  Description:
+*   Same as nurbs_surface_estimation_subgrid, but the subgrid is evaluated
+*   only on the patches that may contain the closest point.
+*   Always gives a solution.
+*  Return Values:
+*    void
+*******************************************************************************/
+#ifndef SWIG 
+void nurbs_surface_bvh_estimation(NurbsFloat *pu, NurbsFloat *pv
+    , const NurbsSurfaceBVH *bvh  /** hierarchy of the patches of the surface */
+    , const NurbsSurface *surface /** non reduced NURBS surface pointer       */
+    , const NurbsVector3 *point   /** coordinates of the point {x, y, z} */
+    , const int grid_density   /** number of subgrid divisions (1, 5,... 100) */
+    );
+#endif
+
+/*******************************************************************************
+*  Description:
+*   Same as nurbs_surface_inversion_subgrid, but the subgrid is evaluated
+*   only on the patches that may contain the closest point.
+*   Always gives a solution.
+*  Return Values:
+*    void
+*******************************************************************************/
+#ifndef SWIG 
+void nurbs_surface_bvh_inversion(NurbsFloat *pu, NurbsFloat *pv
+    , const NurbsSurfaceBVH *bvh  /** hierarchy of the patches of the surface */
+    , const NurbsSurface *surface /** non reduced NURBS surface pointer       */
+    , const NurbsVector3 *point   /** coordinates of the point {x, y, z} */
+    , const NurbsFloat epsilon    /** stop condition for iterative (eg: 1e-6) */
+    , const int grid_density   /** number of subgrid divisions (1, 5,... 100) */
+    );
+#endif
+
+/*******************************************************************************
+*  Description:
+*   Projects the point onto the surface, looking only for solutions closer 
+*   than the given bound: the patches farther than it are skipped. The 
+*   subgrid of the remaining patches gives the initial value of the 
+*   iterative methods.
+*  Return Values:
+*    integer
+*  @return 1 if a solution closer than the bound is found (pu, pv and pdist 
+*    are updated); 0 otherwise (they are not modified).
+*******************************************************************************/
+#ifndef SWIG 
+int nurbs_surface_bvh_projection
+    ( NurbsFloat *pu    /** (out) solution of the inversion */
+    , NurbsFloat *pv    /** (out) solution of the inversion */
+    , NurbsFloat *pdist /** (in) bound (< 0 for none) (out) distance */
+    , const NurbsSurfaceBVH *bvh  /** hierarchy of the patches of the surface */
+    , const NurbsSurface *surface /** non reduced NURBS surface pointer       */
+    , const NurbsVector3 *point   /** coordinates of the point {x, y, z} */
+    , const NurbsFloat epsilon    /** stop condition for iterative (eg: 1e-6) */
+    , const int grid_density   /** number of subgrid divisions (1, 5,... 100) */
+    );
+#endif
+
+/*******************************************************************************
+*  Description:
+*    Same as nurbs_surface_inversion_min_distance, but only the cells of the
+*    second order nurbs that overlap the patches that may contain the 
+*    closest point are solved. The hierarchy is built with surface_orig.
+*  Return Values:
+*    integer
+*  @return 0 if at least one solution is found.
+*******************************************************************************/
+#ifndef SWIG 
+int nurbs_surface_bvh_inversion_min_distance
+     ( NurbsFloat *pu, NurbsFloat *pv
+     , const NurbsSurfaceBVH *bvh         /** hierarchy of surface_orig */
+     , const NurbsSurface *surface_orig   /** non reduced NURBS */
+     , const NurbsSurface *surface_order2 /** second order NURBS (nullptr: cached in the surface) */
+     , const NurbsVector3 *point /** coordinates of the point {x, y, z} */
+     , const NurbsFloat epsilon  /** stop condition (eg 1e-6) */
+     , const NurbsFloat gamma    /** relaxing factor (eg 0, 0.25, 0.50) */
+     );
+#endif
+
+/*******************************************************************************
+*  Description:
+*    Same as nurbs_surface_inversion_normal, but only the cells of the 
+*    second order nurbs that overlap the patches close to the point are 
+*    tested (all of them if none gives a solution). The hierarchy is built
+*    with surface_orig.
+*  Return Values:
+*    integer
+*  @return greater than zero is at least one solution is found.
+*******************************************************************************/
+#ifndef SWIG 
+int nurbs_surface_bvh_inversion_normal
+    ( NurbsFloat *pu    /** (out) solution of the inversion */
+    , NurbsFloat *pv    /** (out) solution of the inversion */
+    , const NurbsSurfaceBVH *bvh         /** hierarchy of surface_orig */
+    , const NurbsSurface *surface_orig   /** non reduced nurbs surface pointer*/
+    , const NurbsSurface *surface_order2 /**second order nurbs surface pointer (nullptr: cached in the surface)*/
+    , const NurbsVector3 *point /** space coordinates of the point {x, y, z}  */
+    , const NurbsVector3 *surface_normal /**surface normal direction {x, y, z}*/
+    , const NurbsFloat epsilon           /**stop condition iterative (eg 1e-6)*/
+    , const NurbsFloat gamma             /** relaxing factor (eg 0, 0.25, 0.5)*/
+    );
+#endif
+
+/*******************************************************************************
+*  Description:
+*    Equivalent to a C++ default constructor for the projection engine.
+*******************************************************************************/
+void nurbs_model_projection_init( NurbsModelProjection* model );
+
+/*******************************************************************************
+*  Description:
+*    Releases the memory of the projection engine (but not the structure).
+*    The surfaces are not released.
+*******************************************************************************/
+void nurbs_model_projection_dispose( NurbsModelProjection* model );
+
+/*******************************************************************************
+*  Description:
+*    Builds the projection engine of a model with many surfaces (e.g. the 
+*    array returned by nurbs_import_iges): a hierarchy of the patches of 
+*    each surface, and a hierarchy of the surfaces on top of them.
+*    The surfaces are not copied, so they must not be released or modified
+*    while the engine is used (build it again if they change).
+*  Return Values:
+*    integer
+*  @return 1 on success; 0 if the memory is exhausted.
+*******************************************************************************/
+#ifndef SWIG 
+int nurbs_model_projection_build
+    ( NurbsModelProjection* model   /** (out) projection engine */
+    , const NurbsSurface surfaces[] /** surfaces of the model */
+    , const int num_surfaces        /** number of surfaces */
+    );
+
+/*******************************************************************************
+*  Description:
+*    Projects a set of points onto the closest surface of the model, in 
+*    parallel. The surfaces are visited from the closest bounding box, and 
+*    those farther than the best solution are skipped.
+*    If use_cache is not zero and the previous call had the same number 
+*    of points, the previous solution of each point is used as the initial
+*    value (e.g. the points of a mesh that moves slightly), and only the 
+*    patches closer than that solution are tested. The solutions are 
+*    stored in the cache for the next call (if there is memory for it).
+*  Return Values:
+*    integer
+*  @return 1 on success; 0 on error (e.g. the memory is exhausted while
+*    projecting; without memory for the cache the points are still projected).
+*******************************************************************************/
+int nurbs_model_projection_points
+    ( NurbsModelProjectionPoint result[] /** (out) projection of each point */
+    , NurbsModelProjection* model   /** projection engine */
+    , const NurbsVector3 points[]   /** coordinates of the points {x, y, z} */
+    , const int num_points          /** number of points */
+    , const NurbsFloat epsilon      /** stop condition for iterative (eg 1e-6) */
+    , const int grid_density        /** number of subgrid divisions (1, 5,...) */
+    , const int use_cache           /** start from the previous solutions */
+    );
+#endif
+
 /*******************************************************************************
 *  Description:
 *    Calculates the normal to the nurbs surface.
@@ -349,10 +690,257 @@ NurbsSurface* nurbs_surface_reduce_order2
     , const NurbsSurface* surface   /* Original NURBS */
     );
 
+/*******************************************************************************
+*  Description:
+*    Gives a new version to the surface and releases the data derived 
+*    from it (Bezier extraction, second order surface, ...), which is built
+*    again when it is needed. It must be called after changing the control 
+*    points or the knots, and not while other threads read the surface.
+*  Return Values:
+*    void
+*******************************************************************************/
+void nurbs_surface_modified( NurbsSurface* surface );
+
+/*******************************************************************************
+*  Description:
+*    Returns the Bezier extraction kept in the surface. It is built the 
+*    first time it is needed (only one thread builds it), and it is kept 
+*    until nurbs_surface_modified() or nurbs_surface_dispose().
+*  Return Values:
+*    NurbsSurfaceBezier pointer
+*  @return pointer to the extraction (do not release it); nullptr if the 
+*    memory is exhausted or the surface is not valid.
+*******************************************************************************/
+#ifndef SWIG 
+const NurbsSurfaceBezier* nurbs_surface_get_bezier( const NurbsSurface* surface );
+#endif
+
+/*******************************************************************************
+*  Description:
+*    Returns the second order surface (see nurbs_surface_reduce_order2) kept
+*    in the surface, which the inversion and intersection routines use when
+*    no second order surface is given. It is built and kept as the Bezier 
+*    extraction.
+*  Return Values:
+*    NurbsSurface pointer
+*  @return pointer to the second order surface (do not release it); nullptr 
+*    if the memory is exhausted or the surface is not valid.
+*******************************************************************************/
+const NurbsSurface* nurbs_surface_get_order2( const NurbsSurface* surface );
+
+/*******************************************************************************
+*  Description:
+*    Equivalent to a default constructor of the Bezier extraction, and the
+*    release of its memory (but not the structure).
+*******************************************************************************/
+#ifndef SWIG 
+void nurbs_surface_bezier_init( NurbsSurfaceBezier* bezier );
+void nurbs_surface_bezier_dispose( NurbsSurfaceBezier* bezier );
+#endif
+
+/*******************************************************************************
+*  Description:
+*    Calculates the Bezier extraction of the surface (the polynomial 
+*    coefficients of each knot span) in a copy owned by the caller, which 
+*    does not follow the changes of the surface; it must be built again 
+*    after changing the control points or the knots.
+*  Return Values:
+*    integer
+*  @return 1 on success; 0 if the memory is exhausted or the surface is not
+*    valid.
+*******************************************************************************/
+#ifndef SWIG 
+int nurbs_surface_bezier_build
+    ( NurbsSurfaceBezier* bezier    /** (out) Bezier extraction */
+    , const NurbsSurface* surface   /** nurbs surface pointer */
+    );
+#endif
+
+/*******************************************************************************
+*  Description:
+*    Selects the layout of the control points used by the evaluation 
+*    routines (single point, batch and grid). With NURBS_LAYOUT_HOMOGENEOUS
+*    they read the rows of a copy of the control points, pre-multiplied by
+*    the weights, in aligned arrays {x*w}, {y*w}, {z*w}, {w}. The copy is 
+*    kept in the surface until nurbs_surface_modified() is called. 
+*    NURBS_LAYOUT_CP is the default.
+*  Return Values:
+*    integer
+*  @return 1 on success; 0 if the layout is not valid.
+*******************************************************************************/
+int nurbs_surface_set_layout
+    ( NurbsSurface* surface         /** nurbs surface pointer */
+    , const int layout              /** NURBS_LAYOUT_CP or NURBS_LAYOUT_HOMOGENEOUS */
+    );
+
+/*******************************************************************************
+*  Description:
+*    Copies the control points of the surface in homogeneous coordinates, 
+*    and releases the copy. The copy does not follow the changes of the 
+*    surface.
+*  Return Values:
+*    NurbsSurfaceHomogeneous pointer
+*  @return pointer to the copy (release it with 
+*    nurbs_surface_homogeneous_free); nullptr if the layout of the surface 
+*    is NURBS_LAYOUT_CP or the memory is exhausted.
+*******************************************************************************/
+#ifndef SWIG 
+NurbsSurfaceHomogeneous* nurbs_surface_homogeneous_create
+    ( const NurbsSurface* surface   /** nurbs surface pointer */
+    );
+void nurbs_surface_homogeneous_free( NurbsSurfaceHomogeneous* h );
+#endif
+
+/*******************************************************************************
+*  Description:
+*    Returns the homogeneous control points kept in the surface. They are 
+*    copied the first time they are needed (only one thread copies them), 
+*    and kept until nurbs_surface_modified() or nurbs_surface_dispose().
+*  Return Values:
+*    NurbsSurfaceHomogeneous pointer
+*  @return pointer to the copy (do not release it); nullptr if the layout 
+*    of the surface is NURBS_LAYOUT_CP or the memory is exhausted.
+*******************************************************************************/
+#ifndef SWIG 
+const NurbsSurfaceHomogeneous* nurbs_surface_get_homogeneous
+    ( const NurbsSurface* surface   /** nurbs surface pointer */
+    );
+#endif
+
+/*******************************************************************************
+*  Description:
+*    Same as nurbs_surface_get_point, but evaluates the polynomial of the
+*    knot span of the Bezier extraction with the Horner method.
+*  Return Values:
+*    NurbsVector3 
+*  @return the coordinates of the point; NURBS_ERROR_VALUE if the extraction
+*    does not match the degrees and knot spans of the surface.
+*******************************************************************************/
+#ifndef SWIG 
+NurbsVector3 nurbs_surface_get_point_bezier
+    ( const NurbsSurfaceBezier* bezier /** Bezier extraction of the surface */
+    , const NurbsSurface *surface   /** nurbs surface pointer */
+    , const NurbsFloat u            /** parametric coordinate (etha) */
+    , const NurbsFloat v            /** parametric coordinate (chi) */
+    );
+#endif
+
+/*******************************************************************************
+*  Description:
+*    Copies the surface in single (or double) precision for the kernels of
+*    nurbs_precision.c. The copy does not follow the changes of the surface;
+*    it must be created again. Dispose releases the memory of the copy.
+*  Return Values:
+*    integer
+*  @return 1 on success; 0 if the memory is exhausted or the surface is not
+*    valid.
+*******************************************************************************/
+#ifndef SWIG 
+void nurbs_surface_single_init( NurbsSurfaceSingle* s );
+void nurbs_surface_single_dispose( NurbsSurfaceSingle* s );
+int nurbs_surface_single_create
+    ( NurbsSurfaceSingle* s         /** (out) copy in single precision */
+    , const NurbsSurface* surface   /** nurbs surface pointer */
+    );
+
+void nurbs_surface_double_init( NurbsSurfaceDouble* s );
+void nurbs_surface_double_dispose( NurbsSurfaceDouble* s );
+int nurbs_surface_double_create
+    ( NurbsSurfaceDouble* s         /** (out) copy in double precision */
+    , const NurbsSurface* surface   /** nurbs surface pointer */
+    );
+#endif
+
+/*******************************************************************************
+*  Description:
+*    Gets the points, and optionally the unit normals, of a set of parameters
+*    in single (or double) precision. The coordinates are stored as 
+*    points[3*i + {0,1,2}].
+*  Return Values:
+*    integer
+*  @return 1 on success; 0 if the copy of the surface is empty.
+*******************************************************************************/
+#ifndef SWIG 
+int nurbs_surface_single_get_points
+    ( float points[]                /** (out) coordinates of the points */
+    , float normals[]               /** (out) normals (or nullptr) */
+    , const NurbsSurfaceSingle* s   /** copy in single precision */
+    , const float u[]               /** parametric coordinates (etha) */
+    , const float v[]               /** parametric coordinates (chi) */
+    , const int length              /** number of points */
+    );
+
+int nurbs_surface_double_get_points
+    ( double points[]               /** (out) coordinates of the points */
+    , double normals[]              /** (out) normals (or nullptr) */
+    , const NurbsSurfaceDouble* s   /** copy in double precision */
+    , const double u[]              /** parametric coordinates (etha) */
+    , const double v[]              /** parametric coordinates (chi) */
+    , const int length              /** number of points */
+    );
+#endif
+
+/*******************************************************************************
+*  Description:
+*    Inversion of a set of points, points[3*i + {0,1,2}], in single (or 
+*    double) precision. The initial guess is the closest point of a grid of
+*    samples of the surface, followed by Gauss-Newton iterations.
+*  Return Values:
+*    integer
+*  @return 1 on success; 0 if the copy of the surface is empty or the memory
+*    is exhausted.
+*******************************************************************************/
+#ifndef SWIG 
+int nurbs_surface_single_inversion
+    ( float u[]                     /** (out) parametric coordinates */
+    , float v[]                     /** (out) parametric coordinates */
+    , float dist[]                  /** (out) distances (or nullptr) */
+    , const NurbsSurfaceSingle* s   /** copy in single precision */
+    , const float points[]          /** coordinates of the points */
+    , const int length              /** number of points */
+    , const float epsilon           /** stop condition e.g. epsilon = 1e-5 */
+    );
+
+int nurbs_surface_double_inversion
+    ( double u[]                    /** (out) parametric coordinates */
+    , double v[]                    /** (out) parametric coordinates */
+    , double dist[]                 /** (out) distances (or nullptr) */
+    , const NurbsSurfaceDouble* s   /** copy in double precision */
+    , const double points[]         /** coordinates of the points */
+    , const int length              /** number of points */
+    , const double epsilon          /** stop condition e.g. epsilon = 1e-6 */
+    );
+#endif
+
+/*******************************************************************************
+*  Description:
+*    Inversion of a set of points with the initial guess in single precision
+*    (see nurbs_surface_single_inversion) and the last iterations with 
+*    nurbs_surface_inversion_proj on the original surface.
+*  Return Values:
+*    integer
+*  @return 1 on success; 0 if the copy does not match the surface or the 
+*    memory is exhausted.
+*******************************************************************************/
+#ifndef SWIG 
+int nurbs_surface_inversion_mixed
+    ( NurbsFloat u[]                /** (out) parametric coordinates */
+    , NurbsFloat v[]                /** (out) parametric coordinates */
+    , NurbsFloat dist[]             /** (out) distances (or nullptr) */
+    , const NurbsSurface* surface   /** nurbs surface pointer */
+    , const NurbsSurfaceSingle* s   /** copy of the surface in single precision */
+    , const NurbsVector3 points[]   /** coordinates of the points */
+    , const int length              /** number of points */
+    , const NurbsFloat epsilon      /** stop condition e.g. epsilon = 1e-6 */
+    );
+#endif
+
 /**  
 * A fast (and potentially low accurate) calculation of the intersection 
 * between two nurbs. (EXPERIMENTAL; use at your own risk)
-* Returns 1 if an intersection is detected or 0 if not
+* If the second order surfaces are nullptr, the cached ones are used.
+* Returns 1 if an intersection is detected, 0 if not, or -1 if the memory
+* is exhausted
 */
 #ifndef SWIG 
 int nurbs_surface_intersection_fast
@@ -367,6 +955,24 @@ int nurbs_surface_intersection_fast
     );
 #endif
 
+/**  
+* Same as nurbs_surface_intersection_fast, but it solves every pair of
+* segments in serial (without pruning). It is the reference used to 
+* check the fast version. 
+*/
+#ifndef SWIG 
+int nurbs_surface_intersection_fast_all_pairs
+    ( NurbsIntersection* buffer
+    , size_t* p_num_sol
+    , const size_t max_sol
+    , const NurbsSurface* nurbs_a
+    , const NurbsSurface* nurbs_b
+    , NurbsSurface* nurbs_2order_a
+    , NurbsSurface* nurbs_2order_b
+    , const NurbsFloat relaxation
+    );
+#endif
+
 /**  Refines the intersection with an iterative method */
 #ifndef SWIG 
 void nurbs_surface_intersection_iterative
@@ -377,6 +983,116 @@ void nurbs_surface_intersection_iterative
     );
 #endif
 
+/*******************************************************************************
+*  Description:
+*    Equivalent to a default constructor of the mesh, and the release of its
+*    memory (but not the structure).
+*******************************************************************************/
+void nurbs_mesh_init( NurbsMesh* mesh );
+void nurbs_mesh_dispose( NurbsMesh* mesh );
+
+/*******************************************************************************
+*  Description:
+*    Tessellates a set of surfaces (e.g. the array returned by 
+*    nurbs_import_iges) into one indexed triangle mesh. Each knot span is 
+*    subdivided until the distance from the surface to the triangles is 
+*    lower than the chord height and the normals turn less than the given 
+*    angle, up to max_depth subdivisions. The surfaces are tessellated in 
+*    parallel. The vertices are not merged between surfaces: each vertex 
+*    keeps the parameters and the normal of its own surface, and the edges 
+*    shared by two surfaces are subdivided independently, so the mesh is 
+*    not watertight across them (there may be T-junctions).
+*  Return Values:
+*    integer
+*  @return 1 on success; 0 if the memory is exhausted.
+*******************************************************************************/
+int nurbs_surface_tessellate
+    ( NurbsMesh* mesh               /** (out) triangle mesh */
+    , const NurbsSurface surfaces[] /** surfaces of the model */
+    , const int num_surfaces        /** number of surfaces */
+    , const NurbsFloat chord_height /** maximum distance to the surface */
+    , const NurbsFloat normal_angle /** maximum angle of the normals (radians) */
+    , const int max_depth           /** maximum subdivisions of a knot span */
+    );
+
+
+/*******************************************************************************
+*  Description:
+*    Concatenates meshes in one mesh. The vertices and triangles of parts[i]
+*    are assigned to the surface i. The null parts are skipped.
+*  Return Values:
+*    integer
+*  @return 1 on success; 0 if the memory is exhausted.
+*******************************************************************************/
+#ifndef SWIG 
+int nurbs_mesh_merge
+    ( NurbsMesh* mesh               /** (out) merged mesh */
+    , const NurbsMesh* const parts[]/** meshes to merge */
+    , const int num_parts           /** number of meshes */
+    );
+#endif
+
+/*******************************************************************************
+*  Description:
+*    Equivalent to a default constructor of the cache of tessellations, with
+*    the maximum memory of the meshes in bytes (0 means no limit), and the
+*    release of all the meshes and the memory (but not the structure).
+*******************************************************************************/
+void nurbs_mesh_cache_init( NurbsMeshCache* cache, const size_t budget );
+void nurbs_mesh_cache_dispose( NurbsMeshCache* cache );
+
+/*******************************************************************************
+*  Description:
+*    Releases the meshes of a surface (e.g. before releasing the surface), or
+*    all the meshes if the surface is nullptr. It is not needed after 
+*    nurbs_surface_modified(); the older meshes of the surface are released
+*    when it is tessellated again.
+*******************************************************************************/
+void nurbs_mesh_cache_invalidate
+    ( NurbsMeshCache* cache         /** cache of tessellations */
+    , const NurbsSurface* surface   /** surface, or nullptr for all */
+    );
+
+/*******************************************************************************
+*  Description:
+*    Returns the tessellation of the surface (see nurbs_surface_tessellate)
+*    from the cache, or tessellates it if it is missing, its version has
+*    changed (see nurbs_surface_modified) or the tolerances are different.
+*    A surface edited without nurbs_surface_modified() gets its old mesh.
+*    The cache is not thread safe.
+*  Return Values:
+*    NurbsMesh pointer
+*  @return pointer to the cached mesh (do not release it), which is valid
+*    until the next call with this cache; nullptr if the memory is exhausted.
+*******************************************************************************/
+const NurbsMesh* nurbs_mesh_cache_get
+    ( NurbsMeshCache* cache         /** cache of tessellations */
+    , const NurbsSurface* surface   /** nurbs surface pointer */
+    , const NurbsFloat chord_height /** maximum distance to the surface */
+    , const NurbsFloat normal_angle /** maximum angle of the normals (radians) */
+    , const int max_depth           /** maximum subdivisions of a knot span */
+    );
+
+/*******************************************************************************
+*  Description:
+*    Same as nurbs_surface_tessellate, but the surfaces found in the cache
+*    are not tessellated again. The missing ones are tessellated in parallel
+*    and added to the cache.
+*  Return Values:
+*    integer
+*  @return 1 on success; 0 if the memory is exhausted.
+*******************************************************************************/
+int nurbs_mesh_cache_tessellate
+    ( NurbsMesh* mesh               /** (out) triangle mesh */
+    , NurbsMeshCache* cache         /** cache of tessellations */
+    , const NurbsSurface surfaces[] /** surfaces of the model */
+    , const int num_surfaces        /** number of surfaces */
+    , const NurbsFloat chord_height /** maximum distance to the surface */
+    , const NurbsFloat normal_angle /** maximum angle of the normals (radians) */
+    , const int max_depth           /** maximum subdivisions of a knot span */
+    );
+
+
 #ifdef  __cplusplus
   }
 #endif
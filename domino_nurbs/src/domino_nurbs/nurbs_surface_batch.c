@@ -0,0 +1,1213 @@
+ /***
+    Author: Mario J. Martin <dominonurbs$gmail.com>
+
+    Evaluation of many points of a NURBS surface at once
+
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "common/check_malloc.h"
+#include "common/log.h"
+
+#include "nurbs_internal.h"
+#include "nurbs_basis.h"
+#include "nurbs_surface.h"
+
+/* Number of points that are evaluated together (one per SIMD lane) */
+#define NURBS_BATCH_LANES 8
+
+/* Points that belong to the same knot span are grouped in blocks */
+typedef struct
+{
+    int* index;     /* Points sorted by knot span */
+    int* block;     /* First position in index of each block (+1 at the end) */
+    int* span_u;    /* Knot interval in u of each block */
+    int* span_v;    /* Knot interval in v of each block */
+    int num_blocks;
+    const NurbsSurfaceHomogeneous* h; /* Control points kept in the surface
+                                       * (nullptr with NURBS_LAYOUT_CP) */
+}NurbsBatchBlocks;
+
+
+/* Control point {i, j} for the block kernels, which accumulate
+ *     g = basis * scale;  f.{xyz} += g * cp.{xyz};  f.w += g * cp.w
+ * With cp[u][v], scale is the weight and cp.w is one, so the operations 
+ * are the same as in the single point routines. With the homogeneous 
+ * layout, cp.{xyz} are already multiplied by the weight, scale is one and
+ * cp.w is the weight. */
+static inline NurbsVector4 block_cp
+    ( NurbsFloat* scale
+    , const NurbsSurface* surface
+    , const NurbsSurfaceHomogeneous* h
+    , const int i
+    , const int j
+    )
+{
+    NurbsVector4 cp;
+
+    if (h != nullptr){
+        const int k = i * h->stride + j;
+        cp.x = h->wx[k];
+        cp.y = h->wy[k];
+        cp.z = h->wz[k];
+        cp.w = h->w[k];
+        *scale = 1;
+    }
+    else{
+        cp = surface->cp[i][j];
+        *scale = cp.w;
+        cp.w = 1;
+    }
+
+    return cp;
+}
+
+
+static void batch_blocks_dispose(NurbsBatchBlocks* blocks)
+{
+    free(blocks->index);
+    free(blocks->block);
+    free(blocks->span_u);
+    free(blocks->span_v);
+    blocks->index = nullptr;
+    blocks->block = nullptr;
+    blocks->span_u = nullptr;
+    blocks->span_v = nullptr;
+    blocks->num_blocks = 0;
+    blocks->h = nullptr;
+}
+
+
+/* Sorts the points by knot span (counting sort) and splits the sorted list
+ * in blocks of NURBS_BATCH_LANES points of the same knot span. The 
+ * homogeneous layout is taken here, once for all the blocks.
+ * Returns 0 if there is not enough memory */
+static int batch_blocks_create
+    ( NurbsBatchBlocks* blocks
+    , const NurbsSurface* surface
+    , const NurbsFloat u[]
+    , const NurbsFloat v[]
+    , const int length
+    )
+{
+    int i, k;
+    const int ku = surface->knot_length_u + 1;
+    const int kv = surface->knot_length_v + 1;
+    int* key = nullptr;
+    int* count = nullptr;
+
+    blocks->index = nullptr;
+    blocks->block = nullptr;
+    blocks->span_u = nullptr;
+    blocks->span_v = nullptr;
+    blocks->num_blocks = 0;
+    blocks->h = nullptr;
+
+    _check_(key = (int*)_malloc_(sizeof(int)*length));
+    _check_(count = (int*)_calloc_(ku*kv + 1, sizeof(int)));
+    _check_(blocks->index = (int*)_malloc_(sizeof(int)*length));
+    _check_(blocks->block = (int*)_malloc_(sizeof(int)*(length + 1)));
+    _check_(blocks->span_u = (int*)_malloc_(sizeof(int)*length));
+    _check_(blocks->span_v = (int*)_malloc_(sizeof(int)*length));
+
+    if (key == nullptr || count == nullptr
+        || blocks->index == nullptr || blocks->block == nullptr
+        || blocks->span_u == nullptr || blocks->span_v == nullptr){
+        /* Out of memory */
+        free(key);
+        free(count);
+        batch_blocks_dispose(blocks);
+        return 0;
+    }
+
+    /* The knot index is in [-1, knot_length-1] */
+    for (i = 0; i < length; i++){
+        key[i] = (nurbs_basis_knot_index(u[i], surface->knot_u, surface->knot_length_u) + 1) * kv
+               + (nurbs_basis_knot_index(v[i], surface->knot_v, surface->knot_length_v) + 1);
+        count[key[i] + 1]++;
+    }
+    for (k = 0; k < ku*kv; k++){
+        count[k + 1] += count[k];
+    }
+    for (i = 0; i < length; i++){
+        blocks->index[count[key[i]]++] = i;
+    }
+
+    /* Blocks of the same knot span (at most NURBS_BATCH_LANES points) */
+    for (i = 0; i < length; i++){
+        k = key[blocks->index[i]];
+        if (i == 0 || k != key[blocks->index[i-1]]
+            || i - blocks->block[blocks->num_blocks - 1] == NURBS_BATCH_LANES){
+
+            blocks->span_u[blocks->num_blocks] = k / kv - 1;
+            blocks->span_v[blocks->num_blocks] = k % kv - 1;
+            blocks->block[blocks->num_blocks++] = i;
+        }
+    }
+    blocks->block[blocks->num_blocks] = length;
+
+    free(key);
+    free(count);
+
+    if (surface->layout == NURBS_LAYOUT_HOMOGENEOUS){
+        blocks->h = nurbs_surface_get_homogeneous(surface);
+        if (blocks->h == nullptr){
+            batch_blocks_dispose(blocks);
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+
+/* Same as nurbs_basis_local_function() for the parameters of one block, 
+ * which share the knot interval. Since the knots are the same, all the 
+ * branches are the same for all lanes and the loops across lanes vectorize.
+ * Returns the index of the first basis */
+static int batch_basis
+    ( NurbsFloat basis[][NURBS_BATCH_LANES]   /* (out) Non zero basis */
+    , const NurbsFloat t[]      /* Parameters (one per lane) */
+    , const int iknot           /* Knot interval shared by all the lanes */
+    , const int degree          /* Degree */
+    , const NurbsFloat x[]      /* Knot vector */
+    , const int knots_length    /* Knot vector length */
+    )
+{
+    int i, k, l, ib, ik0, first;
+    const int n = knots_length - 1;
+    NurbsFloat bi_1[NURBS_BATCH_LANES];
+    NurbsFloat xik1, xi1;
+
+    memset(basis, 0, sizeof(NurbsFloat)*(degree + 2)*NURBS_BATCH_LANES);
+
+    if (iknot < 0 || iknot >= n){
+        for (l = 0; l < NURBS_BATCH_LANES; l++){
+            basis[0][l] = 1;
+        }
+        return iknot < 0 ? 0 : n - degree - 1;
+    }
+
+    first = iknot - degree;
+    for (l = 0; l < NURBS_BATCH_LANES; l++){
+        basis[degree][l] = 1;
+    }
+
+    for (k = 1; k <= degree; k++){
+        ik0 = iknot - k;
+        if (ik0 < 0){
+            ik0 = 0;
+        }
+
+        for (l = 0; l < NURBS_BATCH_LANES; l++){
+            bi_1[l] = 0;
+        }
+
+        for (i = ik0; i <= iknot; i++){
+            ib = i - first;
+            xik1 = x[i + 1 + k];
+            xi1 = x[i + 1];
+
+            if (xik1 > xi1){
+                #pragma omp simd
+                for (l = 0; l < NURBS_BATCH_LANES; l++){
+                    NurbsFloat nl = bi_1[l] * basis[ib][l];
+                    NurbsFloat c = (xik1 - t[l]) / (xik1 - xi1);
+                    bi_1[l] = 1 - c;
+                    basis[ib][l] = nl + c * basis[ib + 1][l];
+                }
+            }
+            else{
+                #pragma omp simd
+                for (l = 0; l < NURBS_BATCH_LANES; l++){
+                    basis[ib][l] = bi_1[l] * basis[ib][l];
+                    bi_1[l] = 0;
+                }
+            }
+        }
+    }
+
+    return first;
+}
+
+
+/* Same as nurbs_basis_local_derivate_function() for the parameters of one 
+ * block (see batch_basis). Returns the index of the first basis */
+static int batch_derivate_basis
+    ( NurbsFloat d_basis[][NURBS_BATCH_LANES] /* (out) Derivative of the basis */
+    , NurbsFloat basis[][NURBS_BATCH_LANES]   /* (out) Non zero basis */
+    , const NurbsFloat t[]      /* Parameters (one per lane) */
+    , const int iknot           /* Knot interval shared by all the lanes */
+    , const int degree          /* Degree */
+    , const NurbsFloat x[]      /* Knot vector */
+    , const int knots_length    /* Knot vector length */
+    )
+{
+    int i, k, l, ib, ik0, first;
+    const int n = knots_length - 1;
+    NurbsFloat bi_1[NURBS_BATCH_LANES];
+    NurbsFloat nl[NURBS_BATCH_LANES], dnl[NURBS_BATCH_LANES];
+    NurbsFloat xki, xi;
+
+    memset(basis, 0, sizeof(NurbsFloat)*(degree + 2)*NURBS_BATCH_LANES);
+    memset(d_basis, 0, sizeof(NurbsFloat)*(degree + 2)*NURBS_BATCH_LANES);
+
+    if (iknot < 0 || iknot >= n){
+        for (l = 0; l < NURBS_BATCH_LANES; l++){
+            basis[0][l] = 1;
+        }
+        return iknot < 0 ? 0 : n - degree - 1;
+    }
+
+    first = iknot - degree;
+    for (l = 0; l < NURBS_BATCH_LANES; l++){
+        basis[degree][l] = 1;
+    }
+
+    for (k = 1; k <= degree; k++){
+        ik0 = iknot - k;
+        if (ik0 < 0){
+            ik0 = 0;
+        }
+
+        for (l = 0; l < NURBS_BATCH_LANES; l++){
+            bi_1[l] = 0;
+        }
+
+        for (i = ik0; i <= iknot; i++){
+            ib = i - first;
+
+            /* Left basis term */
+            xki = x[k + i];
+            xi = x[i];
+            if (xki > xi){
+                #pragma omp simd
+                for (l = 0; l < NURBS_BATCH_LANES; l++){
+                    nl[l] = bi_1[l] * basis[ib][l];
+                    dnl[l] = bi_1[l] * d_basis[ib][l] + basis[ib][l] / (xki - xi);
+                }
+            }
+            else{
+                for (l = 0; l < NURBS_BATCH_LANES; l++){
+                    nl[l] = 0;
+                    dnl[l] = 0;
+                }
+            }
+
+            /* Right basis term */
+            xki = x[i + k + 1];
+            xi = x[i + 1];
+            if (xki > xi){
+                #pragma omp simd
+                for (l = 0; l < NURBS_BATCH_LANES; l++){
+                    NurbsFloat c = xki - t[l];
+                    NurbsFloat d = xki - xi;
+                    NurbsFloat cd = c / d;
+                    NurbsFloat nr = cd * basis[ib + 1][l];
+                    NurbsFloat dnr = (c * d_basis[ib + 1][l] - basis[ib + 1][l]) / d;
+                    bi_1[l] = 1 - cd;
+                    basis[ib][l] = nl[l] + nr;
+                    d_basis[ib][l] = dnl[l] + dnr;
+                }
+            }
+            else{
+                #pragma omp simd
+                for (l = 0; l < NURBS_BATCH_LANES; l++){
+                    bi_1[l] = 0;
+                    basis[ib][l] = nl[l];
+                    d_basis[ib][l] = dnl[l];
+                }
+            }
+        }
+    }
+
+    return first;
+}
+
+
+/* Same as nurbs_basis_local_second_derivate_function() for the parameters 
+ * of one block (see batch_basis). Returns the index of the first basis */
+static int batch_second_derivate_basis
+    ( NurbsFloat d2_basis[][NURBS_BATCH_LANES] /* (out) Second derivative */
+    , NurbsFloat d_basis[][NURBS_BATCH_LANES]  /* (out) Derivative of the basis */
+    , NurbsFloat basis[][NURBS_BATCH_LANES]    /* (out) Non zero basis */
+    , const NurbsFloat t[]      /* Parameters (one per lane) */
+    , const int iknot           /* Knot interval shared by all the lanes */
+    , const int degree          /* Degree */
+    , const NurbsFloat x[]      /* Knot vector */
+    , const int knots_length    /* Knot vector length */
+    )
+{
+    int i, k, l, ib, ik0, first;
+    const int n = knots_length - 1;
+    NurbsFloat nl[NURBS_BATCH_LANES], dnl[NURBS_BATCH_LANES], d2nl[NURBS_BATCH_LANES];
+    NurbsFloat xki, xi;
+
+    memset(basis, 0, sizeof(NurbsFloat)*(degree + 2)*NURBS_BATCH_LANES);
+    memset(d_basis, 0, sizeof(NurbsFloat)*(degree + 2)*NURBS_BATCH_LANES);
+    memset(d2_basis, 0, sizeof(NurbsFloat)*(degree + 2)*NURBS_BATCH_LANES);
+
+    if (iknot < 0 || iknot >= n){
+        for (l = 0; l < NURBS_BATCH_LANES; l++){
+            basis[0][l] = 1;
+        }
+        return iknot < 0 ? 0 : n - degree - 1;
+    }
+
+    first = iknot - degree;
+    for (l = 0; l < NURBS_BATCH_LANES; l++){
+        basis[degree][l] = 1;
+    }
+
+    for (k = 1; k <= degree; k++){
+        ik0 = iknot - k;
+        if (ik0 < 0){
+            ik0 = 0;
+        }
+
+        for (i = ik0; i <= iknot; i++){
+            ib = i - first;
+
+            /* Left basis term */
+            xki = x[k + i];
+            xi = x[i];
+            if (xki > xi){
+                #pragma omp simd
+                for (l = 0; l < NURBS_BATCH_LANES; l++){
+                    NurbsFloat a = t[l] - xi;
+                    NurbsFloat b = xki - xi;
+                    nl[l] = (a / b) * basis[ib][l];
+                    dnl[l] = (a * d_basis[ib][l] + basis[ib][l]) / b;
+                    d2nl[l] = (a * d2_basis[ib][l] + 2 * d_basis[ib][l]) / b;
+                }
+            }
+            else{
+                for (l = 0; l < NURBS_BATCH_LANES; l++){
+                    nl[l] = 0;
+                    dnl[l] = 0;
+                    d2nl[l] = 0;
+                }
+            }
+
+            /* Right basis term */
+            xki = x[i + k + 1];
+            xi = x[i + 1];
+            if (xki > xi){
+                #pragma omp simd
+                for (l = 0; l < NURBS_BATCH_LANES; l++){
+                    NurbsFloat c = xki - t[l];
+                    NurbsFloat d = xki - xi;
+                    NurbsFloat nr = (c / d) * basis[ib + 1][l];
+                    NurbsFloat dnr = (c * d_basis[ib + 1][l] - basis[ib + 1][l]) / d;
+                    NurbsFloat d2nr = (c * d2_basis[ib + 1][l] - 2 * d_basis[ib + 1][l]) / d;
+                    basis[ib][l] = nl[l] + nr;
+                    d_basis[ib][l] = dnl[l] + dnr;
+                    d2_basis[ib][l] = d2nl[l] + d2nr;
+                }
+            }
+            else{
+                #pragma omp simd
+                for (l = 0; l < NURBS_BATCH_LANES; l++){
+                    basis[ib][l] = nl[l];
+                    d_basis[ib][l] = dnl[l];
+                    d2_basis[ib][l] = d2nl[l];
+                }
+            }
+        }
+    }
+
+    return first;
+}
+
+
+/* Evaluates a block of points of the same knot span. The inner loops 
+ * run across the points of the block, which share the control points */
+static void batch_points
+    ( NurbsVector3 points[]
+    , const NurbsSurface* surface
+    , const NurbsSurfaceHomogeneous* h
+    , const NurbsFloat u[]
+    , const NurbsFloat v[]
+    , const int index[]
+    , const int lanes
+    , const int span_u
+    , const int span_v
+    )
+{
+    int i, j, l;
+    int first_u, first_v;
+    int iu0, iu1, iv0, iv1;
+    NurbsVector4 cp;
+    NurbsFloat scale;
+    NurbsFloat tu[NURBS_BATCH_LANES], tv[NURBS_BATCH_LANES];
+    NurbsFloat basis_u[NURBS_MAX_DEGREE + 2][NURBS_BATCH_LANES];
+    NurbsFloat basis_v[NURBS_MAX_DEGREE + 2][NURBS_BATCH_LANES];
+    NurbsFloat px[NURBS_BATCH_LANES] = {0};
+    NurbsFloat py[NURBS_BATCH_LANES] = {0};
+    NurbsFloat pz[NURBS_BATCH_LANES] = {0};
+    NurbsFloat norm[NURBS_BATCH_LANES] = {0};
+
+    /* The empty lanes repeat the first point */
+    for (l = 0; l < NURBS_BATCH_LANES; l++){
+        tu[l] = u[index[l < lanes ? l : 0]];
+        tv[l] = v[index[l < lanes ? l : 0]];
+    }
+
+    first_u = batch_basis(basis_u, tu, span_u
+        , surface->degree_u, surface->knot_u, surface->knot_length_u);
+    first_v = batch_basis(basis_v, tv, span_v
+        , surface->degree_v, surface->knot_v, surface->knot_length_v);
+
+    local_basis_range(&iu0, &iu1, first_u, surface->degree_u, surface->cp_length_u);
+    local_basis_range(&iv0, &iv1, first_v, surface->degree_v, surface->cp_length_v);
+
+    for (i = iu0; i <= iu1; i++){
+        for (j = iv0; j <= iv1; j++){
+            cp = block_cp(&scale, surface, h, first_u + i, first_v + j);
+
+            #pragma omp simd
+            for (l = 0; l < NURBS_BATCH_LANES; l++){
+                NurbsFloat gw = basis_u[i][l] * basis_v[j][l] * scale;
+
+                px[l] += gw * cp.x;
+                py[l] += gw * cp.y;
+                pz[l] += gw * cp.z;
+                norm[l] += gw * cp.w;
+            }
+        }
+    }
+
+    for (l = 0; l < lanes; l++){
+        points[index[l]].x = px[l] / norm[l];
+        points[index[l]].y = py[l] / norm[l];
+        points[index[l]].z = pz[l] / norm[l];
+    }
+}
+
+
+/* Same as nurbs_surface_get_derivatives() for a block of the same knot span.
+ * The parameters are already moved away from the last knot. */
+static void batch_derivatives
+    ( NurbsVector3 deriv_u[]
+    , NurbsVector3 deriv_v[]
+    , NurbsVector3 points[]
+    , const NurbsSurface* surface
+    , const NurbsSurfaceHomogeneous* h
+    , const NurbsFloat u[]
+    , const NurbsFloat v[]
+    , const int index[]
+    , const int lanes
+    , const int span_u
+    , const int span_v
+    )
+{
+    int i, j, l;
+    int first_u, first_v;
+    int iu0, iu1, iv0, iv1;
+    NurbsVector4 cp;
+    NurbsFloat scale;
+    NurbsFloat tu[NURBS_BATCH_LANES], tv[NURBS_BATCH_LANES];
+    NurbsFloat basis_u[NURBS_MAX_DEGREE + 2][NURBS_BATCH_LANES];
+    NurbsFloat basis_v[NURBS_MAX_DEGREE + 2][NURBS_BATCH_LANES];
+    NurbsFloat d_basis_u[NURBS_MAX_DEGREE + 2][NURBS_BATCH_LANES];
+    NurbsFloat d_basis_v[NURBS_MAX_DEGREE + 2][NURBS_BATCH_LANES];
+    NurbsFloat f[12][NURBS_BATCH_LANES];
+
+    memset(f, 0, sizeof(f));
+
+    for (l = 0; l < NURBS_BATCH_LANES; l++){
+        tu[l] = u[index[l < lanes ? l : 0]];
+        tv[l] = v[index[l < lanes ? l : 0]];
+    }
+
+    first_u = batch_derivate_basis(d_basis_u, basis_u, tu, span_u
+        , surface->degree_u, surface->knot_u, surface->knot_length_u);
+    first_v = batch_derivate_basis(d_basis_v, basis_v, tv, span_v
+        , surface->degree_v, surface->knot_v, surface->knot_length_v);
+
+    local_basis_range(&iu0, &iu1, first_u, surface->degree_u, surface->cp_length_u);
+    local_basis_range(&iv0, &iv1, first_v, surface->degree_v, surface->cp_length_v);
+
+    for (i = iu0; i <= iu1; i++){
+        for (j = iv0; j <= iv1; j++){
+            cp = block_cp(&scale, surface, h, first_u + i, first_v + j);
+
+            #pragma omp simd
+            for (l = 0; l < NURBS_BATCH_LANES; l++){
+                NurbsFloat gw = basis_u[i][l] * basis_v[j][l] * scale;
+                NurbsFloat guw = d_basis_u[i][l] * basis_v[j][l] * scale;
+                NurbsFloat gvw = basis_u[i][l] * d_basis_v[j][l] * scale;
+
+                f[0][l] += gw * cp.x;
+                f[1][l] += gw * cp.y;
+                f[2][l] += gw * cp.z;
+                f[3][l] += gw * cp.w;
+                f[4][l] += guw * cp.x;
+                f[5][l] += guw * cp.y;
+                f[6][l] += guw * cp.z;
+                f[7][l] += guw * cp.w;
+                f[8][l] += gvw * cp.x;
+                f[9][l] += gvw * cp.y;
+                f[10][l] += gvw * cp.z;
+                f[11][l] += gvw * cp.w;
+            }
+        }
+    }
+
+    for (l = 0; l < lanes; l++){
+        const int k = index[l];
+        points[k].x = f[0][l] / f[3][l];
+        points[k].y = f[1][l] / f[3][l];
+        points[k].z = f[2][l] / f[3][l];
+
+        deriv_u[k].x = (f[4][l] - f[7][l] * points[k].x) / f[3][l];
+        deriv_u[k].y = (f[5][l] - f[7][l] * points[k].y) / f[3][l];
+        deriv_u[k].z = (f[6][l] - f[7][l] * points[k].z) / f[3][l];
+
+        deriv_v[k].x = (f[8][l] - f[11][l] * points[k].x) / f[3][l];
+        deriv_v[k].y = (f[9][l] - f[11][l] * points[k].y) / f[3][l];
+        deriv_v[k].z = (f[10][l] - f[11][l] * points[k].z) / f[3][l];
+    }
+}
+
+
+/* Unit normal and principal curvatures from the first and the second 
+ * derivatives (first and second fundamental forms). The curvatures are 
+ * positive if the surface bends towards the normal Su x Sv. */
+static void principal_curvatures
+    ( NurbsFloat* k1            /* (out) Maximum curvature */
+    , NurbsFloat* k2            /* (out) Minimum curvature */
+    , NurbsVector3* normal      /* (out) Unit normal */
+    , const NurbsVector3 du
+    , const NurbsVector3 dv
+    , const NurbsVector3 duu
+    , const NurbsVector3 duv
+    , const NurbsVector3 dvv
+    )
+{
+    NurbsVector3 n;
+    NurbsFloat e, f, g, l, m, o, det, mod, h, k, r;
+
+    n.x = du.y * dv.z - dv.y * du.z;
+    n.y = du.z * dv.x - dv.z * du.x;
+    n.z = du.x * dv.y - dv.x * du.y;
+
+    /* On kinks and edges there is no normal */
+    mod = n.x*n.x + n.y*n.y + n.z*n.z;
+    if (!(mod > 0)){
+        normal->x = normal->y = normal->z = 0;
+        *k1 = 0;
+        *k2 = 0;
+        return;
+    }
+
+    mod = (NurbsFloat)sqrt(mod);
+    n.x /= mod;
+    n.y /= mod;
+    n.z /= mod;
+    *normal = n;
+
+    e = du.x*du.x + du.y*du.y + du.z*du.z;
+    f = du.x*dv.x + du.y*dv.y + du.z*dv.z;
+    g = dv.x*dv.x + dv.y*dv.y + dv.z*dv.z;
+
+    l = duu.x*n.x + duu.y*n.y + duu.z*n.z;
+    m = duv.x*n.x + duv.y*n.y + duv.z*n.z;
+    o = dvv.x*n.x + dvv.y*n.y + dvv.z*n.z;
+
+    /* E*G - F*F = |Su x Sv|^2 */
+    det = mod * mod;
+
+    /* Gaussian and mean curvatures */
+    k = (l*o - m*m) / det;
+    h = (e*o - 2*f*m + g*l) / (2*det);
+
+    r = h*h - k;
+    r = (r > 0) ? (NurbsFloat)sqrt(r) : 0;
+
+    *k1 = h + r;
+    *k2 = h - r;
+}
+
+
+/* Same as nurbs_surface_get_second_derivatives() for a block of the same 
+ * knot span, followed by the normals and the principal curvatures.
+ * The parameters are already moved away from the last knot. */
+static void batch_curvatures
+    ( NurbsFloat k1[]
+    , NurbsFloat k2[]
+    , NurbsVector3 normals[]
+    , NurbsVector3 points[]
+    , const NurbsSurface* surface
+    , const NurbsSurfaceHomogeneous* h
+    , const NurbsFloat u[]
+    , const NurbsFloat v[]
+    , const int index[]
+    , const int lanes
+    , const int span_u
+    , const int span_v
+    )
+{
+    int i, j, l;
+    int first_u, first_v;
+    int iu0, iu1, iv0, iv1;
+    NurbsVector4 cp;
+    NurbsFloat scale;
+    NurbsFloat tu[NURBS_BATCH_LANES], tv[NURBS_BATCH_LANES];
+    NurbsFloat basis_u[NURBS_MAX_DEGREE + 2][NURBS_BATCH_LANES];
+    NurbsFloat basis_v[NURBS_MAX_DEGREE + 2][NURBS_BATCH_LANES];
+    NurbsFloat d_basis_u[NURBS_MAX_DEGREE + 2][NURBS_BATCH_LANES];
+    NurbsFloat d_basis_v[NURBS_MAX_DEGREE + 2][NURBS_BATCH_LANES];
+    NurbsFloat d2_basis_u[NURBS_MAX_DEGREE + 2][NURBS_BATCH_LANES];
+    NurbsFloat d2_basis_v[NURBS_MAX_DEGREE + 2][NURBS_BATCH_LANES];
+    NurbsFloat f[24][NURBS_BATCH_LANES];
+    NurbsVector3 p, du, dv, duu, duv, dvv, n;
+    NurbsFloat w;
+
+    memset(f, 0, sizeof(f));
+
+    for (l = 0; l < NURBS_BATCH_LANES; l++){
+        tu[l] = u[index[l < lanes ? l : 0]];
+        tv[l] = v[index[l < lanes ? l : 0]];
+    }
+
+    first_u = batch_second_derivate_basis(d2_basis_u, d_basis_u, basis_u, tu
+        , span_u, surface->degree_u, surface->knot_u, surface->knot_length_u);
+    first_v = batch_second_derivate_basis(d2_basis_v, d_basis_v, basis_v, tv
+        , span_v, surface->degree_v, surface->knot_v, surface->knot_length_v);
+
+    local_basis_range(&iu0, &iu1, first_u, surface->degree_u, surface->cp_length_u);
+    local_basis_range(&iv0, &iv1, first_v, surface->degree_v, surface->cp_length_v);
+
+    for (i = iu0; i <= iu1; i++){
+        for (j = iv0; j <= iv1; j++){
+            cp = block_cp(&scale, surface, h, first_u + i, first_v + j);
+
+            #pragma omp simd
+            for (l = 0; l < NURBS_BATCH_LANES; l++){
+                NurbsFloat gw = basis_u[i][l] * basis_v[j][l] * scale;
+                NurbsFloat guw = d_basis_u[i][l] * basis_v[j][l] * scale;
+                NurbsFloat gvw = basis_u[i][l] * d_basis_v[j][l] * scale;
+                NurbsFloat guuw = d2_basis_u[i][l] * basis_v[j][l] * scale;
+                NurbsFloat guvw = d_basis_u[i][l] * d_basis_v[j][l] * scale;
+                NurbsFloat gvvw = basis_u[i][l] * d2_basis_v[j][l] * scale;
+
+                f[0][l] += gw * cp.x;
+                f[1][l] += gw * cp.y;
+                f[2][l] += gw * cp.z;
+                f[3][l] += gw * cp.w;
+                f[4][l] += guw * cp.x;
+                f[5][l] += guw * cp.y;
+                f[6][l] += guw * cp.z;
+                f[7][l] += guw * cp.w;
+                f[8][l] += gvw * cp.x;
+                f[9][l] += gvw * cp.y;
+                f[10][l] += gvw * cp.z;
+                f[11][l] += gvw * cp.w;
+                f[12][l] += guuw * cp.x;
+                f[13][l] += guuw * cp.y;
+                f[14][l] += guuw * cp.z;
+                f[15][l] += guuw * cp.w;
+                f[16][l] += guvw * cp.x;
+                f[17][l] += guvw * cp.y;
+                f[18][l] += guvw * cp.z;
+                f[19][l] += guvw * cp.w;
+                f[20][l] += gvvw * cp.x;
+                f[21][l] += gvvw * cp.y;
+                f[22][l] += gvvw * cp.z;
+                f[23][l] += gvvw * cp.w;
+            }
+        }
+    }
+
+    for (l = 0; l < lanes; l++){
+        const int k = index[l];
+        w = f[3][l];
+
+        p.x = f[0][l] / w;
+        p.y = f[1][l] / w;
+        p.z = f[2][l] / w;
+
+        /* Derivative of a quotient: S' = (A' - w' S) / w */
+        du.x = (f[4][l] - f[7][l] * p.x) / w;
+        du.y = (f[5][l] - f[7][l] * p.y) / w;
+        du.z = (f[6][l] - f[7][l] * p.z) / w;
+
+        dv.x = (f[8][l] - f[11][l] * p.x) / w;
+        dv.y = (f[9][l] - f[11][l] * p.y) / w;
+        dv.z = (f[10][l] - f[11][l] * p.z) / w;
+
+        /* S'' = (A'' - 2 w' S' - w'' S) / w */
+        duu.x = (f[12][l] - 2*f[7][l]*du.x - f[15][l]*p.x) / w;
+        duu.y = (f[13][l] - 2*f[7][l]*du.y - f[15][l]*p.y) / w;
+        duu.z = (f[14][l] - 2*f[7][l]*du.z - f[15][l]*p.z) / w;
+
+        duv.x = (f[16][l] - f[11][l]*du.x - f[7][l]*dv.x - f[19][l]*p.x) / w;
+        duv.y = (f[17][l] - f[11][l]*du.y - f[7][l]*dv.y - f[19][l]*p.y) / w;
+        duv.z = (f[18][l] - f[11][l]*du.z - f[7][l]*dv.z - f[19][l]*p.z) / w;
+
+        dvv.x = (f[20][l] - 2*f[11][l]*dv.x - f[23][l]*p.x) / w;
+        dvv.y = (f[21][l] - 2*f[11][l]*dv.y - f[23][l]*p.y) / w;
+        dvv.z = (f[22][l] - 2*f[11][l]*dv.z - f[23][l]*p.z) / w;
+
+        principal_curvatures(&k1[k], &k2[k], &n, du, dv, duu, duv, dvv);
+
+        if (normals != nullptr){
+            normals[k] = n;
+        }
+        if (points != nullptr){
+            points[k] = p;
+        }
+    }
+}
+
+
+/* Moves the parameters away from the last knot, the same as in
+ * nurbs_surface_get_derivatives(). The blocks are made with the moved
+ * parameters since they may change the knot span. Returns an array with
+ * the u parameters followed by the v parameters (or nullptr) */
+static NurbsFloat* derivative_parameters
+    ( const NurbsSurface* surface
+    , const NurbsFloat u[]
+    , const NurbsFloat v[]
+    , const int length
+    )
+{
+    int i;
+    NurbsFloat uL, vL, ut, vt;
+    NurbsFloat* t = nullptr;
+
+    _check_(t = (NurbsFloat*)_malloc_(sizeof(NurbsFloat) * 2 * length));
+    if (t == nullptr){
+        return nullptr;
+    }
+
+    uL = surface->knot_u[ surface->knot_length_u - surface->degree_u - 1 ];
+    ut = uL - (uL - surface->knot_u[surface->knot_length_u - surface->degree_u - 2]) / 256;
+    vL = surface->knot_v[ surface->knot_length_v - surface->degree_v - 1 ];
+    vt = vL - (vL - surface->knot_v[surface->knot_length_v - surface->degree_v - 2]) / 256;
+
+    for (i = 0; i < length; i++){
+        t[i] = u[i] >= uL ? ut : u[i];
+        t[length + i] = v[i] >= vL ? vt : v[i];
+    }
+
+    return t;
+}
+
+
+/* Evaluates an array of points of a nurbs surface */
+int nurbs_surface_get_points
+    ( NurbsVector3 points[]         /* (out) Point coordinates */
+    , const NurbsSurface* surface   /* NURBS surface */
+    , const NurbsFloat u[]          /* u parameters */
+    , const NurbsFloat v[]          /* v parameters */
+    , const int length              /* Number of points */
+    )
+{
+    int b;
+    NurbsBatchBlocks blocks;
+
+    if (surface->degree_u > NURBS_MAX_DEGREE || surface->degree_v > NURBS_MAX_DEGREE){
+        _handle_error_("NURBS surface degree is greater than NURBS_MAX_DEGREE");
+        return 0;
+    }
+
+    if (length < 1){
+        return 1;
+    }
+
+    if (!batch_blocks_create(&blocks, surface, u, v, length)){
+        return 0;
+    }
+
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (b = 0; b < blocks.num_blocks; b++){
+        batch_points(points, surface, blocks.h, u, v
+            , &blocks.index[blocks.block[b]], blocks.block[b+1] - blocks.block[b]
+            , blocks.span_u[b], blocks.span_v[b]);
+    }
+
+    batch_blocks_dispose(&blocks);
+
+    return 1;
+}
+
+
+/* Evaluates the derivatives of an array of points of a nurbs surface */
+int nurbs_surface_get_points_derivatives
+    ( NurbsVector3 deriv_u[]        /* (out) Derivatives in u */
+    , NurbsVector3 deriv_v[]        /* (out) Derivatives in v */
+    , NurbsVector3 points[]         /* (out) Point coordinates */
+    , const NurbsSurface* surface   /* NURBS surface */
+    , const NurbsFloat u[]          /* u parameters */
+    , const NurbsFloat v[]          /* v parameters */
+    , const int length              /* Number of points */
+    )
+{
+    int b;
+    NurbsFloat* t = nullptr;
+    NurbsBatchBlocks blocks;
+
+    if (surface->degree_u > NURBS_MAX_DEGREE || surface->degree_v > NURBS_MAX_DEGREE){
+        _handle_error_("NURBS surface degree is greater than NURBS_MAX_DEGREE");
+        return 0;
+    }
+
+    if (length < 1){
+        return 1;
+    }
+
+    t = derivative_parameters(surface, u, v, length);
+    if (t == nullptr){
+        /* Out of memory */
+        return 0;
+    }
+
+    if (!batch_blocks_create(&blocks, surface, t, &t[length], length)){
+        free(t);
+        return 0;
+    }
+
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (b = 0; b < blocks.num_blocks; b++){
+        batch_derivatives(deriv_u, deriv_v, points, surface, blocks.h, t, &t[length]
+            , &blocks.index[blocks.block[b]], blocks.block[b+1] - blocks.block[b]
+            , blocks.span_u[b], blocks.span_v[b]);
+    }
+
+    batch_blocks_dispose(&blocks);
+    free(t);
+
+    return 1;
+}
+
+
+/* Evaluates the normals and the principal curvatures of an array of points
+ * of a nurbs surface */
+int nurbs_surface_get_points_curvatures
+    ( NurbsFloat k1[]               /* (out) Maximum curvatures */
+    , NurbsFloat k2[]               /* (out) Minimum curvatures */
+    , NurbsVector3 normals[]        /* (out) Unit normals (optional) */
+    , NurbsVector3 points[]         /* (out) Point coordinates (optional) */
+    , const NurbsSurface* surface   /* NURBS surface */
+    , const NurbsFloat u[]          /* u parameters */
+    , const NurbsFloat v[]          /* v parameters */
+    , const int length              /* Number of points */
+    )
+{
+    int b;
+    NurbsFloat* t = nullptr;
+    NurbsBatchBlocks blocks;
+
+    if (surface->degree_u > NURBS_MAX_DEGREE || surface->degree_v > NURBS_MAX_DEGREE){
+        _handle_error_("NURBS surface degree is greater than NURBS_MAX_DEGREE");
+        return 0;
+    }
+
+    if (length < 1){
+        return 1;
+    }
+
+    t = derivative_parameters(surface, u, v, length);
+    if (t == nullptr){
+        /* Out of memory */
+        return 0;
+    }
+
+    if (!batch_blocks_create(&blocks, surface, t, &t[length], length)){
+        free(t);
+        return 0;
+    }
+
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (b = 0; b < blocks.num_blocks; b++){
+        batch_curvatures(k1, k2, normals, points, surface, blocks.h, t, &t[length]
+            , &blocks.index[blocks.block[b]], blocks.block[b+1] - blocks.block[b]
+            , blocks.span_u[b], blocks.span_v[b]);
+    }
+
+    batch_blocks_dispose(&blocks);
+    free(t);
+
+    return 1;
+}
+
+
+/* Basis of the parameters of one direction of the grid, stored as
+ * basis[i*(degree+1) + a] for the parameter i and the local basis a */
+static void grid_basis
+    ( int first[]               /* (out) First control point of each basis */
+    , NurbsFloat basis[]        /* (out) Basis for the points */
+    , int first_t[]             /* (out) First control point of the derivatives */
+    , NurbsFloat basis_t[]      /* (out) Basis for the derivatives (or nullptr) */
+    , NurbsFloat d_basis_t[]    /* (out) Derivatives of the basis (or nullptr) */
+    , const NurbsFloat t[]      /* Parameters */
+    , const int length          /* Number of parameters */
+    , const int degree          /* Degree */
+    , const NurbsFloat knots[]  /* Knot vector */
+    , const int knots_length    /* Knot vector length */
+    )
+{
+    int i, a;
+    NurbsFloat tL, tt;
+    NurbsFloat b[NURBS_MAX_DEGREE + 2];
+    NurbsFloat db[NURBS_MAX_DEGREE + 2];
+
+    /* The derivatives are moved away from the last knot, 
+     * as in nurbs_surface_get_derivatives() */
+    tL = knots[knots_length - degree - 1];
+
+    for (i = 0; i < length; i++){
+        first[i] = nurbs_basis_local_function(b, t[i], degree, knots, knots_length);
+        for (a = 0; a <= degree; a++){
+            basis[i*(degree + 1) + a] = b[a];
+        }
+
+        if (basis_t != nullptr){
+            tt = t[i];
+            if (tt >= tL){
+                tt = tL - (tL - knots[knots_length - degree - 2]) / 256;
+            }
+
+            first_t[i] = nurbs_basis_local_derivate_function
+                (db, b, tt, degree, knots, knots_length);
+            for (a = 0; a <= degree; a++){
+                basis_t[i*(degree + 1) + a] = b[a];
+                d_basis_t[i*(degree + 1) + a] = db[a];
+            }
+        }
+    }
+}
+
+
+/* Contracts the local basis of a u parameter with the rows of the control 
+ * net: row[j] = Sum_i( basis_u[i] * {w*x, w*y, w*z, w}_ij ) */
+static void grid_row
+    ( NurbsVector4 row[]
+    , const NurbsSurface* surface
+    , const NurbsSurfaceHomogeneous* h
+    , const NurbsFloat basis_u[]
+    , const int first_u
+    )
+{
+    int i, j, iu0, iu1;
+    NurbsVector4 cp;
+    NurbsFloat nu;
+
+    memset(row, 0, sizeof(NurbsVector4)*surface->cp_length_v);
+    local_basis_range(&iu0, &iu1, first_u, surface->degree_u, surface->cp_length_u);
+
+    for (i = iu0; i <= iu1; i++){
+        nu = basis_u[i];
+
+        if (h != nullptr){
+            /* Contiguous rows of the homogeneous layout */
+            const NurbsFloat* wx = &h->wx[(first_u + i) * h->stride];
+            const NurbsFloat* wy = &h->wy[(first_u + i) * h->stride];
+            const NurbsFloat* wz = &h->wz[(first_u + i) * h->stride];
+            const NurbsFloat* w = &h->w[(first_u + i) * h->stride];
+
+            for (j = 0; j < surface->cp_length_v; j++){
+                row[j].x += nu * wx[j];
+                row[j].y += nu * wy[j];
+                row[j].z += nu * wz[j];
+                row[j].w += nu * w[j];
+            }
+        }
+        else{
+            const NurbsVector4* cp_row = surface->cp[first_u + i];
+            for (j = 0; j < surface->cp_length_v; j++){
+                cp = cp_row[j];
+                row[j].x += nu * cp.w * cp.x;
+                row[j].y += nu * cp.w * cp.y;
+                row[j].z += nu * cp.w * cp.z;
+                row[j].w += nu * cp.w;
+            }
+        }
+    }
+}
+
+
+/* Contracts the row with the local basis of a v parameter */
+static NurbsVector4 grid_column
+    ( const NurbsVector4 row[]
+    , const NurbsSurface* surface
+    , const NurbsFloat basis_v[]
+    , const int first_v
+    )
+{
+    int j, iv0, iv1;
+    NurbsFloat nv;
+    NurbsVector4 f = {0};
+
+    local_basis_range(&iv0, &iv1, first_v, surface->degree_v, surface->cp_length_v);
+
+    for (j = iv0; j <= iv1; j++){
+        nv = basis_v[j];
+        f.x += nv * row[first_v + j].x;
+        f.y += nv * row[first_v + j].y;
+        f.z += nv * row[first_v + j].z;
+        f.w += nv * row[first_v + j].w;
+    }
+
+    return f;
+}
+
+
+/* Evaluates a structured grid of points of a nurbs surface */
+int nurbs_surface_get_grid
+    ( NurbsVector3 points[]         /* (out) Points, points[i*length_v + j] */
+    , NurbsVector3 normals[]        /* (out) Normals (optional) */
+    , const NurbsSurface* surface   /* NURBS surface */
+    , const NurbsFloat u[]          /* u parameters */
+    , const int length_u            /* Number of u parameters */
+    , const NurbsFloat v[]          /* v parameters */
+    , const int length_v            /* Number of v parameters */
+    )
+{
+    int i, status = 1;
+    const int nbv = surface->degree_v + 1;
+    int* first_v = nullptr;
+    int* first_vt = nullptr;
+    NurbsFloat* basis_v = nullptr;
+    NurbsFloat* basis_vt = nullptr;
+    NurbsFloat* d_basis_vt = nullptr;
+    const NurbsSurfaceHomogeneous* h = nullptr;
+
+    if (surface->degree_u > NURBS_MAX_DEGREE || surface->degree_v > NURBS_MAX_DEGREE){
+        _handle_error_("NURBS surface degree is greater than NURBS_MAX_DEGREE");
+        return 0;
+    }
+
+    if (length_u < 1 || length_v < 1){
+        return 1;
+    }
+
+    /* The basis in v are the same for all the rows */
+    _check_(first_v = (int*)_malloc_(sizeof(int)*length_v*2));
+    _check_(basis_v = (NurbsFloat*)_malloc_(sizeof(NurbsFloat)*length_v*nbv*3));
+    if (surface->layout == NURBS_LAYOUT_HOMOGENEOUS){
+        h = nurbs_surface_get_homogeneous(surface);
+    }
+    if (first_v == nullptr || basis_v == nullptr
+        || (surface->layout == NURBS_LAYOUT_HOMOGENEOUS && h == nullptr)){
+        /* Out of memory */
+        free(first_v);
+        free(basis_v);
+        return 0;
+    }
+    if (normals != nullptr){
+        first_vt = &first_v[length_v];
+        basis_vt = &basis_v[length_v*nbv];
+        d_basis_vt = &basis_v[2*length_v*nbv];
+    }
+
+    grid_basis(first_v, basis_v, first_vt, basis_vt, d_basis_vt
+        , v, length_v, surface->degree_v, surface->knot_v, surface->knot_length_v);
+
+    /* A thread without memory clears its copy of the flag */
+    #pragma omp parallel reduction(&:status)
+    {
+        int j, first_u, first_ut;
+        NurbsFloat tu;
+        NurbsFloat bu[NURBS_MAX_DEGREE + 2];
+        NurbsFloat but[NURBS_MAX_DEGREE + 2];
+        NurbsFloat dbut[NURBS_MAX_DEGREE + 2];
+        NurbsFloat uL;
+        NurbsVector4 f, ft, fu, fv;
+        NurbsVector3 p, du, dv, n;
+        NurbsFloat mod;
+        NurbsVector4* row = nullptr;
+        NurbsVector4* row_t = nullptr;
+        NurbsVector4* row_u = nullptr;
+
+        _check_(row = (NurbsVector4*)_malloc_(sizeof(NurbsVector4)*surface->cp_length_v*3));
+        if (row == nullptr){
+            status = 0;
+        }
+        else{
+            row_t = &row[surface->cp_length_v];
+            row_u = &row[2*surface->cp_length_v];
+        }
+
+        uL = surface->knot_u[surface->knot_length_u - surface->degree_u - 1];
+
+        #pragma omp for schedule(dynamic)
+        for (i = 0; i < length_u; i++){
+            if (row == nullptr){
+                continue;
+            }
+
+            first_u = nurbs_basis_local_function(bu, u[i]
+                , surface->degree_u, surface->knot_u, surface->knot_length_u);
+            grid_row(row, surface, h, bu, first_u);
+
+            if (normals != nullptr){
+                tu = u[i];
+                if (tu >= uL){
+                    tu = uL - (uL - surface->knot_u[surface->knot_length_u - surface->degree_u - 2]) / 256;
+                }
+                first_ut = nurbs_basis_local_derivate_function(dbut, but, tu
+                    , surface->degree_u, surface->knot_u, surface->knot_length_u);
+                grid_row(row_t, surface, h, but, first_ut);
+                grid_row(row_u, surface, h, dbut, first_ut);
+            }
+
+            for (j = 0; j < length_v; j++){
+                f = grid_column(row, surface, &basis_v[j*nbv], first_v[j]);
+
+                points[i*length_v + j].x = f.x / f.w;
+                points[i*length_v + j].y = f.y / f.w;
+                points[i*length_v + j].z = f.z / f.w;
+
+                if (normals == nullptr){
+                    continue;
+                }
+
+                ft = grid_column(row_t, surface, &basis_vt[j*nbv], first_vt[j]);
+                fu = grid_column(row_u, surface, &basis_vt[j*nbv], first_vt[j]);
+                fv = grid_column(row_t, surface, &d_basis_vt[j*nbv], first_vt[j]);
+
+                p.x = ft.x / ft.w;
+                p.y = ft.y / ft.w;
+                p.z = ft.z / ft.w;
+
+                du.x = (fu.x - fu.w * p.x) / ft.w;
+                du.y = (fu.y - fu.w * p.y) / ft.w;
+                du.z = (fu.z - fu.w * p.z) / ft.w;
+
+                dv.x = (fv.x - fv.w * p.x) / ft.w;
+                dv.y = (fv.y - fv.w * p.y) / ft.w;
+                dv.z = (fv.z - fv.w * p.z) / ft.w;
+
+                n.x = du.y * dv.z - dv.y * du.z;
+                n.y = du.z * dv.x - dv.z * du.x;
+                n.z = du.x * dv.y - dv.x * du.y;
+
+                /* On kinks and edges there is no normal */
+                mod = n.x*n.x + n.y*n.y + n.z*n.z;
+                if (mod > 0){
+                    mod = (NurbsFloat)sqrt(mod);
+                    n.x /= mod;
+                    n.y /= mod;
+                    n.z /= mod;
+                }
+                normals[i*length_v + j] = n;
+            }
+        }
+
+        free(row);
+    }
+
+    free(first_v);
+    free(basis_v);
+
+    return status;
+}
+
+
+/**/
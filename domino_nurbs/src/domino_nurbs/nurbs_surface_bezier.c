@@ -0,0 +1,474 @@
+ /***
+    Author: Mario J. Martin <dominonurbs$gmail.com>
+
+    Bezier extraction of NURBS surfaces.
+    Inside a knot span, the basis functions are polynomials, so the surface
+    (in homogeneous coordinates) is a polynomial patch. The coefficients of
+    all the patches are calculated once and kept in the surface, together
+    with the reduced second order surface used by the inversion and the
+    intersection, until nurbs_surface_modified() releases them. The caller
+    can also build its own copy of the extraction.
+
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/check_malloc.h"
+#include "common/log.h"
+
+#include "nurbs_internal.h"
+#include "nurbs_surface.h"
+
+
+/* Polynomial coefficients, in the local parameter t = (x - x[i]) / h of the
+ * knot span i, of the degree + 1 non zero basis functions in the span.
+ * coef[k][m] is the term t^m of the basis of the control point
+ * i - degree + k. It is the Cox-de Boor recursion applied to polynomials. */
+static void span_basis_polynomials
+    ( NurbsFloat coef[][NURBS_MAX_DEGREE + 1]
+    , const NurbsFloat x[]
+    , const int i
+    , const int degree
+    )
+{
+    NurbsFloat prev[NURBS_MAX_DEGREE + 1][NURBS_MAX_DEGREE + 1];
+    NurbsFloat h = x[i + 1] - x[i];
+    NurbsFloat den, a, b;
+    int d, k, m, j;
+
+    for (k = 0; k <= degree; k++){
+        for (m = 0; m <= degree; m++){
+            coef[k][m] = 0;
+        }
+    }
+    coef[0][0] = 1;
+
+    for (d = 1; d <= degree; d++){
+        memcpy( prev, coef, sizeof(prev) );
+
+        for (k = 0; k <= d; k++){
+            /* Basis of the control point j = i - d + k */
+            j = i - d + k;
+
+            for (m = 0; m <= d; m++){
+                coef[k][m] = 0;
+            }
+
+            /* (x - x[j]) / (x[j+d] - x[j]) * N(j, d-1) */
+            den = x[j + d] - x[j];
+            if (k > 0 && den > 0){
+                a = (x[i] - x[j]) / den;
+                b = h / den;
+                for (m = 0; m < d; m++){
+                    coef[k][m] += a * prev[k - 1][m];
+                    coef[k][m + 1] += b * prev[k - 1][m];
+                }
+            }
+
+            /* (x[j+d+1] - x) / (x[j+d+1] - x[j+1]) * N(j+1, d-1) */
+            den = x[j + d + 1] - x[j + 1];
+            if (k < d && den > 0){
+                a = (x[j + d + 1] - x[i]) / den;
+                b = -h / den;
+                for (m = 0; m < d; m++){
+                    coef[k][m] += a * prev[k][m];
+                    coef[k][m + 1] += b * prev[k][m];
+                }
+            }
+        }
+    }
+}
+
+
+/* Calculates the coefficients of the patch of the knot spans {i, j} */
+static void patch_coefficients
+    ( NurbsVector4 coef[]
+    , const NurbsSurface* surface
+    , const int i
+    , const int j
+    )
+{
+    NurbsFloat bu[NURBS_MAX_DEGREE + 1][NURBS_MAX_DEGREE + 1];
+    NurbsFloat bv[NURBS_MAX_DEGREE + 1][NURBS_MAX_DEGREE + 1];
+    NurbsVector4 row[NURBS_MAX_DEGREE + 1];
+    NurbsVector4 cp;
+    const int p = surface->degree_u;
+    const int q = surface->degree_v;
+    int k, l, m, n;
+    NurbsFloat b;
+
+    memset( coef, 0, sizeof(NurbsVector4) * (p + 1) * (q + 1) );
+
+    if (!(surface->knot_u[i] < surface->knot_u[i + 1])
+        || !(surface->knot_v[j] < surface->knot_v[j + 1]))
+    {
+        return;
+    }
+
+    span_basis_polynomials( bu, surface->knot_u, i, p );
+    span_basis_polynomials( bv, surface->knot_v, j, q );
+
+    for (k = 0; k <= p; k++){
+        /* Polynomial in v of the row of control points */
+        for (n = 0; n <= q; n++){
+            row[n].x = row[n].y = row[n].z = row[n].w = 0;
+        }
+        for (l = 0; l <= q; l++){
+            cp = surface->cp[i - p + k][j - q + l];
+            cp.x *= cp.w;
+            cp.y *= cp.w;
+            cp.z *= cp.w;
+            for (n = 0; n <= q; n++){
+                b = bv[l][n];
+                row[n].x += b * cp.x;
+                row[n].y += b * cp.y;
+                row[n].z += b * cp.z;
+                row[n].w += b * cp.w;
+            }
+        }
+
+        for (m = 0; m <= p; m++){
+            b = bu[k][m];
+            if (b == 0){
+                continue;
+            }
+            for (n = 0; n <= q; n++){
+                coef[m * (q + 1) + n].x += b * row[n].x;
+                coef[m * (q + 1) + n].y += b * row[n].y;
+                coef[m * (q + 1) + n].z += b * row[n].z;
+                coef[m * (q + 1) + n].w += b * row[n].w;
+            }
+        }
+    }
+}
+
+
+/* Equivalent to a default constructor */
+void nurbs_surface_bezier_init( NurbsSurfaceBezier* bezier )
+{
+    bezier->degree_u = 0;
+    bezier->degree_v = 0;
+    bezier->num_spans_u = 0;
+    bezier->num_spans_v = 0;
+    bezier->coef = nullptr;
+}
+
+
+/* Releases the memory of the extraction (but not the structure) */
+void nurbs_surface_bezier_dispose( NurbsSurfaceBezier* bezier )
+{
+    if (bezier == nullptr){
+        return;
+    }
+
+    if (bezier->coef != nullptr){
+        free( bezier->coef );
+    }
+
+    nurbs_surface_bezier_init( bezier );
+}
+
+
+/* Checks that the surface can be extracted */
+static int check_surface( const NurbsSurface* surface )
+{
+    if (surface == nullptr || surface->cp == nullptr
+        || surface->degree_u < 1 || surface->degree_v < 1
+        || surface->degree_u > NURBS_MAX_DEGREE
+        || surface->degree_v > NURBS_MAX_DEGREE
+        || surface->cp_length_u <= surface->degree_u
+        || surface->cp_length_v <= surface->degree_v)
+    {
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/* Knot span (from 0 to num_spans - 1) of the parameter and the local
+ * parameter in the span. The parameter is clamped to the knot interval. */
+static int bezier_span
+    ( NurbsFloat* t
+    , const NurbsFloat x[]
+    , const int degree
+    , const int num_spans
+    , const NurbsFloat s
+    )
+{
+    int low = degree, high = degree + num_spans, mid;
+    NurbsFloat u = s;
+
+    if (u < x[low]){
+        u = x[low];
+    }
+    else if (u > x[high]){
+        u = x[high];
+    }
+
+    /* Last non empty span with x[low] <= u */
+    while (high - low > 1){
+        mid = (low + high) / 2;
+        if (u < x[mid]){
+            high = mid;
+        }
+        else{
+            low = mid;
+        }
+    }
+    while (low > degree && !(x[low] < x[low + 1])){
+        low--;
+    }
+
+    *t = (x[low + 1] > x[low]) ? (u - x[low]) / (x[low + 1] - x[low]) : 0;
+
+    return low - degree;
+}
+
+
+/* Calculates the extraction of all patches of the surface */
+int nurbs_surface_bezier_build
+    ( NurbsSurfaceBezier* bezier
+    , const NurbsSurface* surface
+    )
+{
+    int i, j, stride;
+
+    nurbs_surface_bezier_dispose( bezier );
+
+    if (!check_surface( surface )){
+        return 0;
+    }
+
+    stride = (surface->degree_u + 1) * (surface->degree_v + 1);
+
+    _check_(bezier->coef = (NurbsVector4*)_malloc_(sizeof(NurbsVector4)
+        * (surface->cp_length_u - surface->degree_u)
+        * (surface->cp_length_v - surface->degree_v) * stride));
+    if (bezier->coef == nullptr){
+        return 0;
+    }
+
+    bezier->degree_u = surface->degree_u;
+    bezier->degree_v = surface->degree_v;
+    bezier->num_spans_u = surface->cp_length_u - surface->degree_u;
+    bezier->num_spans_v = surface->cp_length_v - surface->degree_v;
+
+    #pragma omp parallel for private(j) schedule(static) if (bezier->num_spans_u > 16)
+    for (i = 0; i < bezier->num_spans_u; i++){
+        for (j = 0; j < bezier->num_spans_v; j++){
+            patch_coefficients
+                ( &(bezier->coef[(i * bezier->num_spans_v + j) * stride])
+                , surface, i + surface->degree_u, j + surface->degree_v );
+        }
+    }
+
+    return 1;
+}
+
+
+/* Gets the point coordinates on a nurbs surface with parameters [u,v]
+ * using its Bezier extraction */
+NurbsVector3 nurbs_surface_get_point_bezier
+    ( const NurbsSurfaceBezier* bezier
+    , const NurbsSurface *surface
+    , const NurbsFloat u
+    , const NurbsFloat v
+    )
+{
+    const NurbsVector4* coef;
+    NurbsVector4 f, g;
+    NurbsVector3 point;
+    NurbsFloat t, s;
+    int i, j, m, n, p, q;
+
+    if (bezier == nullptr || bezier->coef == nullptr
+        || bezier->degree_u != surface->degree_u 
+        || bezier->degree_v != surface->degree_v
+        || bezier->num_spans_u != surface->cp_length_u - surface->degree_u
+        || bezier->num_spans_v != surface->cp_length_v - surface->degree_v)
+    {
+        point.x = point.y = point.z = NURBS_ERROR_VALUE;
+        return point;
+    }
+
+    p = bezier->degree_u;
+    q = bezier->degree_v;
+
+    i = bezier_span( &t, surface->knot_u, p, bezier->num_spans_u, u );
+    j = bezier_span( &s, surface->knot_v, q, bezier->num_spans_v, v );
+
+    coef = &(bezier->coef[(i * bezier->num_spans_v + j) * (p + 1) * (q + 1)]);
+
+    /* Horner in both directions */
+    f.x = f.y = f.z = f.w = 0;
+    for (m = p; m >= 0; m--){
+        g.x = g.y = g.z = g.w = 0;
+        for (n = q; n >= 0; n--){
+            g.x = g.x * s + coef[m * (q + 1) + n].x;
+            g.y = g.y * s + coef[m * (q + 1) + n].y;
+            g.z = g.z * s + coef[m * (q + 1) + n].z;
+            g.w = g.w * s + coef[m * (q + 1) + n].w;
+        }
+        f.x = f.x * t + g.x;
+        f.y = f.y * t + g.y;
+        f.z = f.z * t + g.z;
+        f.w = f.w * t + g.w;
+    }
+
+    if (f.w == 0){
+        point.x = point.y = point.z = NURBS_ERROR_VALUE;
+        return point;
+    }
+
+    point.x = f.x / f.w;
+    point.y = f.y / f.w;
+    point.z = f.z / f.w;
+
+    return point;
+}
+
+/* Releases the data kept in the surface */
+void nurbs_surface_cache_release( NurbsSurface* surface )
+{
+    if (surface->bezier != nullptr){
+        nurbs_surface_bezier_dispose( surface->bezier );
+        free( surface->bezier );
+        surface->bezier = nullptr;
+    }
+    if (surface->order2 != nullptr){
+        nurbs_surface_free( surface->order2, 1 );
+        surface->order2 = nullptr;
+    }
+    if (surface->homogeneous != nullptr){
+        nurbs_surface_homogeneous_free( surface->homogeneous );
+        surface->homogeneous = nullptr;
+    }
+}
+
+
+/* Returns a version that no other surface has (zero is never returned) */
+unsigned int nurbs_surface_new_version()
+{
+    static unsigned int last_version = 0;
+    unsigned int version;
+
+    #pragma omp critical (nurbs_surface_version)
+    {
+        last_version++;
+        if (last_version == 0){
+            last_version++;
+        }
+        version = last_version;
+    }
+
+    return version;
+}
+
+
+/* Gives a new version to the surface and releases the data kept in it */
+void nurbs_surface_modified( NurbsSurface* surface )
+{
+    if (surface == nullptr){
+        return;
+    }
+
+    nurbs_surface_cache_release( surface );
+    surface->version = nurbs_surface_new_version();
+}
+
+
+/* Calculates the extraction of all patches in a new structure */
+static NurbsSurfaceBezier* bezier_create( const NurbsSurface* surface )
+{
+    NurbsSurfaceBezier* bezier;
+
+    _check_(bezier = (NurbsSurfaceBezier*)_malloc_(sizeof(NurbsSurfaceBezier)));
+    if (bezier == nullptr){
+        return nullptr;
+    }
+
+    nurbs_surface_bezier_init( bezier );
+    if (!nurbs_surface_bezier_build( bezier, surface )){
+        free( bezier );
+        return nullptr;
+    }
+
+    return bezier;
+}
+
+
+/* Returns the Bezier extraction kept in the surface, building it if needed */
+const NurbsSurfaceBezier* nurbs_surface_get_bezier( const NurbsSurface* surface )
+{
+    NurbsSurfaceBezier* bezier;
+    NurbsSurface* owner;
+
+    if (surface == nullptr){
+        return nullptr;
+    }
+
+    /* Once it is built, the pointer does not change until the surface is
+     * modified; the flush makes its data visible in this thread */
+    bezier = surface->bezier;
+    #pragma omp flush
+    if (bezier != nullptr){
+        return bezier;
+    }
+
+    /* The cache is not part of the data of the surface */
+    owner = (NurbsSurface*)surface;
+
+    #pragma omp critical (nurbs_surface_cache)
+    {
+        if (owner->bezier == nullptr){
+            bezier = bezier_create( owner );
+
+            /* The data is written before the pointer */
+            #pragma omp flush
+            owner->bezier = bezier;
+            #pragma omp flush
+        }
+        bezier = owner->bezier;
+    }
+
+    return bezier;
+}
+
+
+/* Returns the second order surface kept in the surface, building it if 
+ * needed */
+const NurbsSurface* nurbs_surface_get_order2( const NurbsSurface* surface )
+{
+    NurbsSurface* order2;
+    NurbsSurface* owner;
+
+    if (surface == nullptr || surface->cp == nullptr){
+        return nullptr;
+    }
+
+    order2 = surface->order2;
+    #pragma omp flush
+    if (order2 != nullptr){
+        return order2;
+    }
+
+    owner = (NurbsSurface*)surface;
+
+    #pragma omp critical (nurbs_surface_cache)
+    {
+        if (owner->order2 == nullptr){
+            order2 = nurbs_surface_reduce_order2( nullptr, owner );
+
+            #pragma omp flush
+            owner->order2 = order2;
+            #pragma omp flush
+        }
+        order2 = owner->order2;
+    }
+
+    return order2;
+}
+
+/**/
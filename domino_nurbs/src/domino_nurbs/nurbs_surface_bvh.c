@@ -0,0 +1,961 @@
+ /***
+    Author: Mario J. Martin <dominonurbs$gmail.com>
+
+    Bounding volume hierarchy over the patches of a NURBS surface.
+    Each patch (a non empty knot span) is inside the convex hull of its
+    control points, so the bounding box of those control points gives a
+    lower bound of the distance from any point to the patch. The closest
+    patch query only visits the patches that may contain the closest point,
+    instead of evaluating the whole surface.
+    The projection onto models with many surfaces adds a second hierarchy
+    on top, whose leaves are the surfaces.
+    The intersection between surfaces uses the hierarchies of their second
+    order patches to find the pairs of patches that may intersect.
+
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "common/check_malloc.h"
+#include "common/log.h"
+
+#include "nurbs_internal.h"
+#include "nurbs_surface.h"
+
+/* Size of the stack of the traversal before it is moved to the heap */
+#define BVH_STACK_SIZE 64
+
+/* Relative enlargement of the boxes of the second order patches */
+#define BVH_ORDER2_MARGIN 1e-6
+
+/* Stack of nodes of the traversal of the hierarchy. It starts in the local 
+ * array and grows in the heap for unbalanced or very deep hierarchies. */
+typedef struct
+{
+    int* item;
+    int top;
+    int size;
+    int local[BVH_STACK_SIZE];
+}BVHStack;
+
+static inline void stack_init( BVHStack* stack )
+{
+    stack->item = stack->local;
+    stack->top = 0;
+    stack->size = BVH_STACK_SIZE;
+}
+
+static inline void stack_dispose( BVHStack* stack )
+{
+    if (stack->item != stack->local){
+        free( stack->item );
+    }
+    stack_init( stack );
+}
+
+/* Makes room for n more items. Returns 0 if the memory is exhausted. */
+static int stack_reserve( BVHStack* stack, const int n )
+{
+    int size;
+    int* item = nullptr;
+
+    if (stack->top + n <= stack->size){
+        return 1;
+    }
+
+    size = 2 * (stack->size + n);
+    _check_(item = (int*)_malloc_(sizeof(int) * size));
+    if (item == nullptr){
+        return 0;
+    }
+    memcpy( item, stack->item, sizeof(int) * stack->top );
+    if (stack->item != stack->local){
+        free( stack->item );
+    }
+    stack->item = item;
+    stack->size = size;
+
+    return 1;
+}
+
+
+/* Expands the bounding box with a point */
+static inline void bounds_add
+    ( NurbsVector3* pmin, NurbsVector3* pmax, const NurbsVector3 p )
+{
+    if (p.x < pmin->x) pmin->x = p.x;
+    if (p.y < pmin->y) pmin->y = p.y;
+    if (p.z < pmin->z) pmin->z = p.z;
+    if (p.x > pmax->x) pmax->x = p.x;
+    if (p.y > pmax->y) pmax->y = p.y;
+    if (p.z > pmax->z) pmax->z = p.z;
+}
+
+
+/* Square of the distance from the point to the bounding box */
+static inline NurbsFloat bounds_distance2
+    ( const NurbsVector3* pmin, const NurbsVector3* pmax, const NurbsVector3* p )
+{
+    NurbsFloat d, dist = 0;
+
+    d = (p->x < pmin->x) ? pmin->x - p->x : ((p->x > pmax->x) ? p->x - pmax->x : 0);
+    dist += d * d;
+    d = (p->y < pmin->y) ? pmin->y - p->y : ((p->y > pmax->y) ? p->y - pmax->y : 0);
+    dist += d * d;
+    d = (p->z < pmin->z) ? pmin->z - p->z : ((p->z > pmax->z) ? p->z - pmax->z : 0);
+    dist += d * d;
+
+    return dist;
+}
+
+
+/* Square of the distance between two points */
+static inline NurbsFloat distance2( const NurbsVector3* a, const NurbsVector3* b )
+{
+    return (a->x - b->x) * (a->x - b->x)
+        + (a->y - b->y) * (a->y - b->y)
+        + (a->z - b->z) * (a->z - b->z);
+}
+
+
+/* Center of the bounding box in the given axis */
+static inline NurbsFloat node_centroid
+    ( const NurbsSurfaceBVHNode* node, const int axis )
+{
+    if (axis == 0){
+        return node->pmin.x + node->pmax.x;
+    }
+    else if (axis == 1){
+        return node->pmin.y + node->pmax.y;
+    }
+    else{
+        return node->pmin.z + node->pmax.z;
+    }
+}
+
+static int compare_x( const void* a, const void* b )
+{
+    NurbsFloat ca = node_centroid( (const NurbsSurfaceBVHNode*)a, 0 );
+    NurbsFloat cb = node_centroid( (const NurbsSurfaceBVHNode*)b, 0 );
+    return (ca > cb) - (ca < cb);
+}
+
+static int compare_y( const void* a, const void* b )
+{
+    NurbsFloat ca = node_centroid( (const NurbsSurfaceBVHNode*)a, 1 );
+    NurbsFloat cb = node_centroid( (const NurbsSurfaceBVHNode*)b, 1 );
+    return (ca > cb) - (ca < cb);
+}
+
+static int compare_z( const void* a, const void* b )
+{
+    NurbsFloat ca = node_centroid( (const NurbsSurfaceBVHNode*)a, 2 );
+    NurbsFloat cb = node_centroid( (const NurbsSurfaceBVHNode*)b, 2 );
+    return (ca > cb) - (ca < cb);
+}
+
+
+/* Calculates the leaf of the patch {i, j}.
+ * Returns 0 if the knot span is empty. */
+static int patch_leaf
+    ( NurbsSurfaceBVHNode* leaf
+    , const NurbsSurface* surface
+    , const int i
+    , const int j
+    )
+{
+    int iu, iv, iu0, iu1, iv0, iv1;
+    NurbsVector3 p;
+    const NurbsVector4* cp;
+
+    if (!(surface->knot_u[i] < surface->knot_u[i + 1])
+        || !(surface->knot_v[j] < surface->knot_v[j + 1]))
+    {
+        return 0;
+    }
+
+    /* Control points with non zero basis in the knot span */
+    iu0 = i - surface->degree_u;
+    iu1 = i;
+    iv0 = j - surface->degree_v;
+    iv1 = j;
+
+    if (iu0 < 0) iu0 = 0;
+    if (iv0 < 0) iv0 = 0;
+    if (iu1 > surface->cp_length_u - 1) iu1 = surface->cp_length_u - 1;
+    if (iv1 > surface->cp_length_v - 1) iv1 = surface->cp_length_v - 1;
+
+    if (iu0 > iu1 || iv0 > iv1){
+        return 0;
+    }
+
+    for (iu = iu0; iu <= iu1; iu++){
+        for (iv = iv0; iv <= iv1; iv++){
+            /* The weights are not applied to the coordinates */
+            cp = &(surface->cp[iu][iv]);
+            p.x = cp->x;
+            p.y = cp->y;
+            p.z = cp->z;
+
+            if (iu == iu0 && iv == iv0){
+                leaf->pmin = p;
+                leaf->pmax = p;
+            }
+            else{
+                bounds_add( &(leaf->pmin), &(leaf->pmax), p );
+            }
+        }
+    }
+
+    leaf->left = -1;
+    leaf->right = -1;
+    leaf->span_u = i;
+    leaf->span_v = j;
+    leaf->center = nurbs_surface_get_point
+        ( surface
+        , (surface->knot_u[i] + surface->knot_u[i + 1]) / 2
+        , (surface->knot_v[j] + surface->knot_v[j + 1]) / 2
+        );
+
+    return 1;
+}
+
+
+/* Calculates the leaf of the bilinear patch {i, j} of a second order
+ * surface, in homogeneous coordinates, as used by the intersection.
+ * The patch is extended by the relaxation factor on each side of the knot
+ * span, and the extended patch is inside the box of its four corners.
+ * Returns 0 if the knot span is empty. */
+static int order2_leaf
+    ( NurbsSurfaceBVHNode* leaf
+    , const NurbsSurface* surface
+    , const int i
+    , const int j
+    , const NurbsFloat relaxation
+    )
+{
+    int k;
+    NurbsFloat a, b, margin;
+    NurbsVector3 g[4], p;
+    const NurbsVector4* cp;
+
+    if (!(surface->knot_u[i] < surface->knot_u[i + 1])
+        || !(surface->knot_v[j] < surface->knot_v[j + 1]))
+    {
+        return 0;
+    }
+
+    /* Homogeneous control points of the patch: 00, 01, 10, 11 */
+    for (k = 0; k < 4; k++){
+        cp = &(surface->cp[i - 1 + k / 2][j - 1 + k % 2]);
+        g[k].x = cp->x * cp->w;
+        g[k].y = cp->y * cp->w;
+        g[k].z = cp->z * cp->w;
+    }
+
+    /* Corners of the extended patch */
+    for (k = 0; k < 4; k++){
+        a = (k / 2 == 0) ? -relaxation : 1 + relaxation;
+        b = (k % 2 == 0) ? -relaxation : 1 + relaxation;
+
+        p.x = (1 - a) * ((1 - b) * g[0].x + b * g[1].x) + a * ((1 - b) * g[2].x + b * g[3].x);
+        p.y = (1 - a) * ((1 - b) * g[0].y + b * g[1].y) + a * ((1 - b) * g[2].y + b * g[3].y);
+        p.z = (1 - a) * ((1 - b) * g[0].z + b * g[1].z) + a * ((1 - b) * g[2].z + b * g[3].z);
+
+        if (k == 0){
+            leaf->pmin = p;
+            leaf->pmax = p;
+        }
+        else{
+            bounds_add( &(leaf->pmin), &(leaf->pmax), p );
+        }
+    }
+
+    /* Some room for the round off errors */
+    margin = leaf->pmax.x - leaf->pmin.x;
+    if (leaf->pmax.y - leaf->pmin.y > margin) margin = leaf->pmax.y - leaf->pmin.y;
+    if (leaf->pmax.z - leaf->pmin.z > margin) margin = leaf->pmax.z - leaf->pmin.z;
+    margin *= BVH_ORDER2_MARGIN;
+
+    leaf->pmin.x -= margin;
+    leaf->pmin.y -= margin;
+    leaf->pmin.z -= margin;
+    leaf->pmax.x += margin;
+    leaf->pmax.y += margin;
+    leaf->pmax.z += margin;
+
+    leaf->left = -1;
+    leaf->right = -1;
+    leaf->span_u = i;
+    leaf->span_v = j;
+    leaf->center.x = (g[0].x + g[1].x + g[2].x + g[3].x) / 4;
+    leaf->center.y = (g[0].y + g[1].y + g[2].y + g[3].y) / 4;
+    leaf->center.z = (g[0].z + g[1].z + g[2].z + g[3].z) / 4;
+
+    return 1;
+}
+
+
+/* Builds the node of the leaves [first, last) recursively, splitting by
+ * the median of the longest direction. Returns the next free node. */
+static int build_node
+    ( NurbsSurfaceBVH* bvh
+    , NurbsSurfaceBVHNode leaves[]
+    , const int inode
+    , const int first
+    , const int last
+    )
+{
+    NurbsSurfaceBVHNode* node = &(bvh->node[inode]);
+    NurbsVector3 cmin, cmax, c;
+    NurbsFloat dx, dy, dz;
+    int k, mid, next = inode + 1;
+
+    if (last - first == 1){
+        *node = leaves[first];
+        return next;
+    }
+
+    /* Bounding box of the centers */
+    cmin.x = cmax.x = node_centroid( &(leaves[first]), 0 );
+    cmin.y = cmax.y = node_centroid( &(leaves[first]), 1 );
+    cmin.z = cmax.z = node_centroid( &(leaves[first]), 2 );
+    for (k = first + 1; k < last; k++){
+        c.x = node_centroid( &(leaves[k]), 0 );
+        c.y = node_centroid( &(leaves[k]), 1 );
+        c.z = node_centroid( &(leaves[k]), 2 );
+        bounds_add( &cmin, &cmax, c );
+    }
+
+    dx = cmax.x - cmin.x;
+    dy = cmax.y - cmin.y;
+    dz = cmax.z - cmin.z;
+
+    if (dx >= dy && dx >= dz){
+        qsort( &(leaves[first]), last - first, sizeof(NurbsSurfaceBVHNode), compare_x );
+    }
+    else if (dy >= dz){
+        qsort( &(leaves[first]), last - first, sizeof(NurbsSurfaceBVHNode), compare_y );
+    }
+    else{
+        qsort( &(leaves[first]), last - first, sizeof(NurbsSurfaceBVHNode), compare_z );
+    }
+
+    mid = first + (last - first) / 2;
+
+    node->span_u = -1;
+    node->span_v = -1;
+
+    node->left = next;
+    next = build_node( bvh, leaves, next, first, mid );
+
+    node->right = next;
+    next = build_node( bvh, leaves, next, mid, last );
+
+    node->pmin = bvh->node[node->left].pmin;
+    node->pmax = bvh->node[node->left].pmax;
+    bounds_add( &(node->pmin), &(node->pmax), bvh->node[node->right].pmin );
+    bounds_add( &(node->pmin), &(node->pmax), bvh->node[node->right].pmax );
+    node->center = bvh->node[node->left].center;
+
+    return next;
+}
+
+
+/* Equivalent to a default constructor */
+void nurbs_surface_bvh_init( NurbsSurfaceBVH* bvh )
+{
+    bvh->num_patches = 0;
+    bvh->num_nodes = 0;
+    bvh->node = nullptr;
+}
+
+
+/* Releases the memory of the hierarchy (but not the structure) */
+void nurbs_surface_bvh_dispose( NurbsSurfaceBVH* bvh )
+{
+    if (bvh == nullptr){
+        return;
+    }
+
+    if (bvh->node != nullptr){
+        free( bvh->node );
+    }
+
+    nurbs_surface_bvh_init( bvh );
+}
+
+
+/* Builds the hierarchy of the patches of the surface */
+int nurbs_surface_bvh_build
+    ( NurbsSurfaceBVH* bvh
+    , const NurbsSurface* surface
+    )
+{
+    int i, j, num_spans, num_patches = 0;
+    NurbsSurfaceBVHNode* leaves = nullptr;
+
+    nurbs_surface_bvh_dispose( bvh );
+
+    if (surface == nullptr || surface->cp == nullptr
+        || surface->knot_length_u < 2 || surface->knot_length_v < 2)
+    {
+        return 0;
+    }
+
+    num_spans = (surface->knot_length_u - 1) * (surface->knot_length_v - 1);
+
+    _check_(leaves = (NurbsSurfaceBVHNode*)_malloc_
+        (sizeof(NurbsSurfaceBVHNode) * num_spans));
+    _check_(bvh->node = (NurbsSurfaceBVHNode*)_malloc_
+        (sizeof(NurbsSurfaceBVHNode) * 2 * num_spans));
+
+    if (leaves == nullptr || bvh->node == nullptr){
+        if (leaves != nullptr){
+            free( leaves );
+        }
+        nurbs_surface_bvh_dispose( bvh );
+        return 0;
+    }
+
+    for (i = 0; i < surface->knot_length_u - 1; i++){
+        for (j = 0; j < surface->knot_length_v - 1; j++){
+            num_patches += patch_leaf( &(leaves[num_patches]), surface, i, j );
+        }
+    }
+
+    if (num_patches == 0){
+        free( leaves );
+        nurbs_surface_bvh_dispose( bvh );
+        return 0;
+    }
+
+    bvh->num_patches = num_patches;
+    bvh->num_nodes = build_node( bvh, leaves, 0, 0, num_patches );
+
+    free( leaves );
+
+    return 1;
+}
+
+
+/* Builds the hierarchy of the bilinear patches of a second order surface */
+int nurbs_surface_bvh_build_order2
+    ( NurbsSurfaceBVH* bvh
+    , const NurbsSurface* order2
+    , const NurbsFloat relaxation
+    )
+{
+    int i, j, num_spans, num_patches = 0;
+    NurbsSurfaceBVHNode* leaves = nullptr;
+
+    nurbs_surface_bvh_dispose( bvh );
+
+    if (order2 == nullptr || order2->cp == nullptr
+        || order2->degree_u != 1 || order2->degree_v != 1
+        || order2->knot_length_u < 4 || order2->knot_length_v < 4)
+    {
+        return 0;
+    }
+
+    num_spans = (order2->knot_length_u - 3) * (order2->knot_length_v - 3);
+
+    _check_(leaves = (NurbsSurfaceBVHNode*)_malloc_
+        (sizeof(NurbsSurfaceBVHNode) * num_spans));
+    _check_(bvh->node = (NurbsSurfaceBVHNode*)_malloc_
+        (sizeof(NurbsSurfaceBVHNode) * 2 * num_spans));
+
+    if (leaves == nullptr || bvh->node == nullptr){
+        if (leaves != nullptr){
+            free( leaves );
+        }
+        nurbs_surface_bvh_dispose( bvh );
+        return 0;
+    }
+
+    /* Same spans as nurbs_surface_intersection_fast */
+    for (i = 1; i < order2->knot_length_u - 2; i++){
+        for (j = 1; j < order2->knot_length_v - 2; j++){
+            num_patches += order2_leaf
+                ( &(leaves[num_patches]), order2, i, j, relaxation );
+        }
+    }
+
+    if (num_patches == 0){
+        free( leaves );
+        nurbs_surface_bvh_dispose( bvh );
+        return 0;
+    }
+
+    bvh->num_patches = num_patches;
+    bvh->num_nodes = build_node( bvh, leaves, 0, 0, num_patches );
+
+    free( leaves );
+
+    return 1;
+}
+
+
+/* True if the bounding boxes of both nodes overlap */
+static inline int nodes_overlap
+    ( const NurbsSurfaceBVHNode* a, const NurbsSurfaceBVHNode* b )
+{
+    return a->pmin.x <= b->pmax.x && b->pmin.x <= a->pmax.x
+        && a->pmin.y <= b->pmax.y && b->pmin.y <= a->pmax.y
+        && a->pmin.z <= b->pmax.z && b->pmin.z <= a->pmax.z;
+}
+
+
+/* Finds the pairs of patches of two hierarchies whose boxes overlap */
+int nurbs_surface_bvh_overlap
+    ( int** pairs
+    , const NurbsSurfaceBVH* bvh_a
+    , const NurbsSurfaceBVH* bvh_b
+    )
+{
+    BVHStack stack;
+    int ia, ib, count = 0, max_pairs = 0;
+    int* buffer = nullptr;
+    int* p;
+    const NurbsSurfaceBVHNode* a;
+    const NurbsSurfaceBVHNode* b;
+
+    *pairs = nullptr;
+
+    if (bvh_a == nullptr || bvh_b == nullptr
+        || bvh_a->num_nodes == 0 || bvh_b->num_nodes == 0)
+    {
+        return 0;
+    }
+
+    stack_init( &stack );
+    stack.item[stack.top++] = 0;
+    stack.item[stack.top++] = 0;
+    while (stack.top > 0){
+        ib = stack.item[--stack.top];
+        ia = stack.item[--stack.top];
+        a = &(bvh_a->node[ia]);
+        b = &(bvh_b->node[ib]);
+
+        if (!nodes_overlap( a, b )){
+            continue;
+        }
+
+        if (a->left < 0 && b->left < 0){
+            if (count == max_pairs){
+                max_pairs = (max_pairs > 0) ? 2 * max_pairs : 256;
+                _check_(p = (int*)_realloc_(buffer, sizeof(int) * 4 * max_pairs));
+                if (p == nullptr){
+                    free( buffer );
+                    stack_dispose( &stack );
+                    return -1;
+                }
+                buffer = p;
+            }
+            buffer[4*count + 0] = a->span_u;
+            buffer[4*count + 1] = a->span_v;
+            buffer[4*count + 2] = b->span_u;
+            buffer[4*count + 3] = b->span_v;
+            count++;
+        }
+        else if (!stack_reserve( &stack, 4 )){
+            free( buffer );
+            stack_dispose( &stack );
+            return -1;
+        }
+        else if (b->left < 0 || (a->left >= 0 && (a->pmax.x - a->pmin.x
+            + a->pmax.y - a->pmin.y + a->pmax.z - a->pmin.z >= b->pmax.x - b->pmin.x
+            + b->pmax.y - b->pmin.y + b->pmax.z - b->pmin.z)))
+        {
+            /* Descend the largest node */
+            stack.item[stack.top++] = a->right;
+            stack.item[stack.top++] = ib;
+            stack.item[stack.top++] = a->left;
+            stack.item[stack.top++] = ib;
+        }
+        else{
+            stack.item[stack.top++] = ia;
+            stack.item[stack.top++] = b->right;
+            stack.item[stack.top++] = ia;
+            stack.item[stack.top++] = b->left;
+        }
+    }
+
+    stack_dispose( &stack );
+
+    *pairs = buffer;
+
+    return count;
+}
+
+
+/* Finds the patches that may contain the closest point of the surface */
+int nurbs_surface_bvh_closest
+    ( int span_u[]
+    , int span_v[]
+    , NurbsFloat lower[]
+    , const int max_patches
+    , const NurbsSurfaceBVH* bvh
+    , const NurbsVector3* point
+    )
+{
+    BVHStack stack;
+    int k, count = 0;
+    NurbsFloat d, upper;
+    const NurbsSurfaceBVHNode* node;
+
+    if (bvh == nullptr || bvh->num_nodes == 0 || max_patches <= 0){
+        return 0;
+    }
+
+    /* The distance to any point of the surface is an upper bound.
+     * Descend to the closest leaf first to have a good one. */
+    upper = distance2( &(bvh->node[0].center), point );
+    stack_init( &stack );
+    stack.item[stack.top++] = 0;
+    while (stack.top > 0){
+        node = &(bvh->node[stack.item[--stack.top]]);
+
+        if (bounds_distance2( &(node->pmin), &(node->pmax), point ) > upper){
+            continue;
+        }
+
+        if (node->left < 0){
+            d = distance2( &(node->center), point );
+            if (d < upper){
+                upper = d;
+            }
+        }
+        else if (!stack_reserve( &stack, 2 )){
+            stack_dispose( &stack );
+            return -1;
+        }
+        else{
+            if (bounds_distance2( &(bvh->node[node->left].pmin)
+                    , &(bvh->node[node->left].pmax), point )
+                < bounds_distance2( &(bvh->node[node->right].pmin)
+                    , &(bvh->node[node->right].pmax), point ))
+            {
+                stack.item[stack.top++] = node->right;
+                stack.item[stack.top++] = node->left;
+            }
+            else{
+                stack.item[stack.top++] = node->left;
+                stack.item[stack.top++] = node->right;
+            }
+        }
+    }
+
+    /* The closest point is in a patch whose box is closer than the bound.
+     * Keep the nearest boxes sorted by their distance. */
+    stack.item[stack.top++] = 0;
+    while (stack.top > 0){
+        node = &(bvh->node[stack.item[--stack.top]]);
+
+        d = bounds_distance2( &(node->pmin), &(node->pmax), point );
+        if (d > upper){
+            continue;
+        }
+
+        if (node->left < 0){
+            if (count == max_patches && d >= lower[count - 1]){
+                continue;
+            }
+
+            k = (count < max_patches) ? count++ : count - 1;
+            while (k > 0 && lower[k - 1] > d){
+                span_u[k] = span_u[k - 1];
+                span_v[k] = span_v[k - 1];
+                lower[k] = lower[k - 1];
+                k--;
+            }
+            span_u[k] = node->span_u;
+            span_v[k] = node->span_v;
+            lower[k] = d;
+        }
+        else if (!stack_reserve( &stack, 2 )){
+            stack_dispose( &stack );
+            return -1;
+        }
+        else{
+            stack.item[stack.top++] = node->right;
+            stack.item[stack.top++] = node->left;
+        }
+    }
+
+    stack_dispose( &stack );
+
+    for (k = 0; k < count; k++){
+        lower[k] = sqrt( lower[k] );
+    }
+
+    return count;
+}
+
+/* Equivalent to a default constructor */
+void nurbs_model_projection_init( NurbsModelProjection* model )
+{
+    model->num_surfaces = 0;
+    model->surface = nullptr;
+    model->patches = nullptr;
+    nurbs_surface_bvh_init( &(model->surfaces) );
+
+    model->num_cache = 0;
+    model->cache = nullptr;
+}
+
+
+/* Releases the memory of the projection engine (but not the surfaces) */
+void nurbs_model_projection_dispose( NurbsModelProjection* model )
+{
+    int i;
+
+    if (model == nullptr){
+        return;
+    }
+
+    if (model->patches != nullptr){
+        for (i = 0; i < model->num_surfaces; i++){
+            nurbs_surface_bvh_dispose( &(model->patches[i]) );
+        }
+        free( model->patches );
+    }
+
+    nurbs_surface_bvh_dispose( &(model->surfaces) );
+
+    if (model->cache != nullptr){
+        free( model->cache );
+    }
+
+    nurbs_model_projection_init( model );
+}
+
+
+/* Builds the hierarchy of the patches of each surface, and the hierarchy
+ * of the surfaces */
+int nurbs_model_projection_build
+    ( NurbsModelProjection* model
+    , const NurbsSurface surfaces[]
+    , const int num_surfaces
+    )
+{
+    int i, num_leaves = 0;
+    NurbsSurfaceBVHNode* leaves = nullptr;
+
+    nurbs_model_projection_dispose( model );
+
+    if (surfaces == nullptr || num_surfaces <= 0){
+        return 0;
+    }
+
+    _check_(model->patches = (NurbsSurfaceBVH*)_malloc_
+        (sizeof(NurbsSurfaceBVH) * num_surfaces));
+    _check_(leaves = (NurbsSurfaceBVHNode*)_malloc_
+        (sizeof(NurbsSurfaceBVHNode) * num_surfaces));
+    _check_(model->surfaces.node = (NurbsSurfaceBVHNode*)_malloc_
+        (sizeof(NurbsSurfaceBVHNode) * 2 * num_surfaces));
+
+    if (model->patches == nullptr || leaves == nullptr 
+        || model->surfaces.node == nullptr)
+    {
+        if (leaves != nullptr){
+            free( leaves );
+        }
+        nurbs_model_projection_dispose( model );
+        return 0;
+    }
+
+    model->num_surfaces = num_surfaces;
+    model->surface = surfaces;
+
+    for (i = 0; i < num_surfaces; i++){
+        nurbs_surface_bvh_init( &(model->patches[i]) );
+    }
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (i = 0; i < num_surfaces; i++){
+        nurbs_surface_bvh_build( &(model->patches[i]), &(surfaces[i]) );
+    }
+
+    /* The leaves are the root of each surface. Empty surfaces (or without 
+     * memory for their hierarchy) are skipped. */
+    for (i = 0; i < num_surfaces; i++){
+        if (model->patches[i].num_nodes > 0){
+            leaves[num_leaves] = model->patches[i].node[0];
+            leaves[num_leaves].left = -1;
+            leaves[num_leaves].right = -1;
+            leaves[num_leaves].span_u = i;
+            leaves[num_leaves].span_v = -1;
+            num_leaves++;
+        }
+    }
+
+    if (num_leaves > 0){
+        model->surfaces.num_patches = num_leaves;
+        model->surfaces.num_nodes = build_node
+            ( &(model->surfaces), leaves, 0, 0, num_leaves );
+    }
+
+    free( leaves );
+
+    return (num_leaves > 0);
+}
+
+
+/* Projects one point onto the closest surface. If warm is not nullptr,
+ * it is the initial value. Returns 0 if the memory is exhausted. */
+static int model_projection_point
+    ( NurbsModelProjectionPoint* result
+    , const NurbsModelProjection* model
+    , const NurbsVector3* point
+    , const NurbsModelProjectionPoint* warm
+    , const NurbsFloat epsilon
+    , const int grid_density
+    )
+{
+    BVHStack stack;
+    int s, near_child, far_child, warm_surface = -1;
+    NurbsFloat u, v, dist;
+    NurbsVector3 q;
+    const NurbsSurfaceBVHNode* node;
+    const NurbsSurface* surface;
+
+    result->surface = -1;
+    result->u = -1;
+    result->v = -1;
+    result->dist = -1;
+
+    /* The iterative method from the previous solution gives a bound */
+    if (warm != nullptr && warm->surface >= 0 && warm->surface < model->num_surfaces
+        && model->patches[warm->surface].num_nodes > 0)
+    {
+        surface = &(model->surface[warm->surface]);
+        u = warm->u;
+        v = warm->v;
+        nurbs_surface_inversion_proj( &u, &v, point, surface, epsilon );
+        q = nurbs_surface_get_point( surface, u, v );
+
+        result->surface = warm->surface;
+        result->u = u;
+        result->v = v;
+        result->dist = sqrt( distance2( &q, point ) );
+
+        /* If the point is on the surface, the solution cannot be improved */
+        if (result->dist < epsilon){
+            warm_surface = warm->surface;
+        }
+    }
+
+    if (model->surfaces.num_nodes == 0){
+        return 1;
+    }
+
+    /* Visit the closest surfaces first */
+    stack_init( &stack );
+    stack.item[stack.top++] = 0;
+    while (stack.top > 0){
+        node = &(model->surfaces.node[stack.item[--stack.top]]);
+
+        if (result->dist >= 0 && bounds_distance2
+            ( &(node->pmin), &(node->pmax), point ) > result->dist * result->dist)
+        {
+            continue;
+        }
+
+        if (node->left < 0){
+            s = node->span_u;
+            if (s == warm_surface){
+                continue;
+            }
+            dist = result->dist;
+            if (nurbs_surface_bvh_projection
+                ( &u, &v, &dist, &(model->patches[s]), &(model->surface[s])
+                , point, epsilon, grid_density ))
+            {
+                result->surface = s;
+                result->u = u;
+                result->v = v;
+                result->dist = dist;
+            }
+        }
+        else if (!stack_reserve( &stack, 2 )){
+            stack_dispose( &stack );
+            return 0;
+        }
+        else{
+            near_child = node->left;
+            far_child = node->right;
+            if (bounds_distance2( &(model->surfaces.node[far_child].pmin)
+                    , &(model->surfaces.node[far_child].pmax), point )
+                < bounds_distance2( &(model->surfaces.node[near_child].pmin)
+                    , &(model->surfaces.node[near_child].pmax), point ))
+            {
+                near_child = node->right;
+                far_child = node->left;
+            }
+            stack.item[stack.top++] = far_child;
+            stack.item[stack.top++] = near_child;
+        }
+    }
+
+    stack_dispose( &stack );
+
+    return 1;
+}
+
+
+/* Projects a set of points onto the closest surface of the model */
+int nurbs_model_projection_points
+    ( NurbsModelProjectionPoint result[]
+    , NurbsModelProjection* model
+    , const NurbsVector3 points[]
+    , const int num_points
+    , const NurbsFloat epsilon
+    , const int grid_density
+    , const int use_cache
+    )
+{
+    int i, warm, status = 1;
+    NurbsModelProjectionPoint* cache;
+
+    if (model == nullptr || num_points < 0){
+        return 0;
+    }
+
+    warm = (use_cache && model->cache != nullptr && model->num_cache == num_points);
+
+    #pragma omp parallel for schedule(dynamic, 64) reduction(&:status)
+    for (i = 0; i < num_points; i++){
+        status &= model_projection_point
+            ( &(result[i]), model, &(points[i])
+            , warm ? &(model->cache[i]) : nullptr
+            , epsilon, grid_density );
+    }
+
+    /* Keep the solutions for the next call */
+    if (model->num_cache != num_points){
+        if (model->cache != nullptr){
+            free( model->cache );
+        }
+        model->cache = nullptr;
+        model->num_cache = 0;
+
+        _check_(cache = (NurbsModelProjectionPoint*)_malloc_
+            (sizeof(NurbsModelProjectionPoint) * (num_points + 1)));
+
+        if (cache == nullptr){
+            /* The points are projected; only the next call is slower */
+            return status;
+        }
+        model->cache = cache;
+        model->num_cache = num_points;
+    }
+
+    memcpy( model->cache, result, sizeof(NurbsModelProjectionPoint) * num_points );
+
+    return status;
+}
+
+/**/
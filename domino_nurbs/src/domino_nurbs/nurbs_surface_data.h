@@ -8,6 +8,9 @@
 #ifndef _NURBS_SURFACE_H_
 #define _NURBS_SURFACE_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include "nurbs_definitions.h"
 
 /** Data structure for NURBS surfaces */
@@ -49,7 +52,10 @@ typedef struct NurbsSurface_
 
     NurbsFloat *basis_u;  /**< Array of basis in the u direction.
     * The length of the basis arrays are the same as the knot vector.
-    * Actually there is the same number of basis as control points */
+    * Actually there is the same number of basis as control points.
+    * The evaluation routines do not use these buffers anymore (they use 
+    * buffers in the stack to be thread safe), but they are still kept 
+    * as a scratch space for the user. */
 
     NurbsFloat *basis_v;  /**< Array of basis in the v direction.
     * The length of the basis arrays are the same as the knot vector.
@@ -62,8 +68,261 @@ typedef struct NurbsSurface_
     /** In the case of an array, pointers the next item. */
     struct NurbsSurface_* next;
 
+    /** Layout of the control points used by the evaluation routines
+      * (NURBS_LAYOUT_CP by default, see nurbs_surface_set_layout). */
+    int layout;
+
+    /** Version of the control points and the knots. Each surface takes a
+      * new one, and nurbs_surface_modified() (which must be called after 
+      * editing them) takes another, so the data derived from the surface
+      * is calculated again. */
+    unsigned int version;
+
+    /** Bezier extraction of the surface, built on demand 
+      * (see nurbs_surface_get_bezier). */
+    struct NurbsSurfaceBezier_* bezier;
+
+    /** Second order surface, built on demand (see nurbs_surface_get_order2). */
+    struct NurbsSurface_* order2;
+
+    /** Homogeneous control points, built on demand with 
+      * NURBS_LAYOUT_HOMOGENEOUS (see nurbs_surface_get_homogeneous). */
+    struct NurbsSurfaceHomogeneous_* homogeneous;
+
 }NurbsSurface;
 
+/** The evaluation routines read the control points from cp[u][v]. */
+#define NURBS_LAYOUT_CP 0
+
+/** The evaluation routines read a copy of the control points kept in the
+  * surface, pre-multiplied by the weights and stored as a structure of 
+  * arrays. The copy is released by nurbs_surface_modified(), which must 
+  * be called after changing cp[u][v]. */
+#define NURBS_LAYOUT_HOMOGENEOUS 1
+
+/** Control points in homogeneous coordinates {x*w, y*w, z*w, w} stored as
+  * a structure of arrays. Each row (constant u) starts at an address 
+  * aligned to NURBS_LAYOUT_ALIGN bytes, so the loops in v can use aligned
+  * vector loads.
+  */
+typedef struct NurbsSurfaceHomogeneous_
+{
+    int cp_length_u;    /**< Number of control points in u. */
+    int cp_length_v;    /**< Number of control points in v. */
+    int stride;         /**< Length of each row (cp_length_v plus padding). */
+
+    NurbsFloat* wx;     /**< x*w of the control point {i, j} at [i*stride + j]. */
+    NurbsFloat* wy;     /**< y*w of the control points. */
+    NurbsFloat* wz;     /**< z*w of the control points. */
+    NurbsFloat* w;      /**< Weights of the control points. */
+
+    void* memory;       /**< Allocated block (the arrays are aligned in it). */
+
+}NurbsSurfaceHomogeneous;
+
+/** Bezier extraction of a NURBS surface: the polynomial coefficients of each
+  * knot span, in homogeneous coordinates {x*w, y*w, z*w, w} and in the local
+  * parameters {0, 1} of the span. Any point is evaluated with the Horner 
+  * method with a fixed number of operations. The surface keeps one (see
+  * nurbs_surface_get_bezier); a copy built by nurbs_surface_bezier_build
+  * must be built again after changing the control points or the knots.
+  */
+typedef struct NurbsSurfaceBezier_
+{
+    int degree_u;       /**< Degree of the surface in u. */
+    int degree_v;       /**< Degree of the surface in v. */
+
+    int num_spans_u;    /**< Number of knot intervals in u (cp_length_u - degree_u). */
+    int num_spans_v;    /**< Number of knot intervals in v (cp_length_v - degree_v). */
+
+    /** Coefficients of the span {i, j} (i = knot interval - degree_u), 
+      * for the term t^m * s^n, are stored at
+      * coef[((i * num_spans_v + j) * (degree_u + 1) + m) * (degree_v + 1) + n]
+      * Empty spans are set to zero. */
+    NurbsVector4* coef;
+
+}NurbsSurfaceBezier;
+
+/** Copy of a NURBS surface in single precision for the kernels of
+  * nurbs_precision.c (e.g. for visualization or initial guesses). The
+  * control points are homogeneous {x*w, y*w, z*w, w} and stored as a
+  * structure of arrays, as in NurbsSurfaceHomogeneous. The knots keep the
+  * precision of the library.
+  */
+typedef struct NurbsSurfaceSingle_
+{
+    int degree_u;       /**< Degree in u. */
+    int degree_v;       /**< Degree in v. */
+    int cp_length_u;    /**< Number of control points in u. */
+    int cp_length_v;    /**< Number of control points in v. */
+    int knot_length_u;  /**< Length of the knot vector in u. */
+    int knot_length_v;  /**< Length of the knot vector in v. */
+    int stride;         /**< Length of each row of control points. */
+
+    NurbsFloat* knot_u; /**< Knots in u (for the basis of nurbs_basis.c). */
+    NurbsFloat* knot_v; /**< Knots in v. */
+    float* wx;          /**< x*w of the control point {i, j} at [i*stride + j]. */
+    float* wy;          /**< y*w of the control points. */
+    float* wz;          /**< z*w of the control points. */
+    float* w;           /**< Weights of the control points. */
+
+    void* memory;       /**< Allocated block (the arrays are aligned in it). */
+
+}NurbsSurfaceSingle;
+
+/** The same as NurbsSurfaceSingle in double precision. */
+typedef struct NurbsSurfaceDouble_
+{
+    int degree_u;       /**< Degree in u. */
+    int degree_v;       /**< Degree in v. */
+    int cp_length_u;    /**< Number of control points in u. */
+    int cp_length_v;    /**< Number of control points in v. */
+    int knot_length_u;  /**< Length of the knot vector in u. */
+    int knot_length_v;  /**< Length of the knot vector in v. */
+    int stride;         /**< Length of each row of control points. */
+
+    NurbsFloat* knot_u; /**< Knots in u (for the basis of nurbs_basis.c). */
+    NurbsFloat* knot_v; /**< Knots in v. */
+    double* wx;         /**< x*w of the control point {i, j} at [i*stride + j]. */
+    double* wy;         /**< y*w of the control points. */
+    double* wz;         /**< z*w of the control points. */
+    double* w;          /**< Weights of the control points. */
+
+    void* memory;       /**< Allocated block (the arrays are aligned in it). */
+
+}NurbsSurfaceDouble;
+
+/** Node of a bounding volume hierarchy over the patches (non empty knot 
+  * spans) of a NURBS surface. The bounding boxes contain the control points
+  * of each patch, so by the convex hull property they contain the surface.
+  */
+typedef struct NurbsSurfaceBVHNode_
+{
+    NurbsVector3 pmin;  /**< Lower corner of the bounding box. */
+    NurbsVector3 pmax;  /**< Upper corner of the bounding box. */
+
+    int left;       /**< First child, -1 for the leaves (a single patch). */
+    int right;      /**< Second child, -1 for the leaves. */
+
+    int span_u;     /**< Knot interval of the patch in u (only leaves). */
+    int span_v;     /**< Knot interval of the patch in v (only leaves). */
+
+    NurbsVector3 center; /**< Surface point at the middle of the patch. */
+
+}NurbsSurfaceBVHNode;
+
+
+/** Bounding volume hierarchy over the patches of a NURBS surface. */
+typedef struct NurbsSurfaceBVH_
+{
+    int num_patches;    /**< Number of patches (leaves). */
+    int num_nodes;      /**< Number of nodes, the root is the first one. */
+    NurbsSurfaceBVHNode* node; /**< Nodes of the hierarchy. */
+
+}NurbsSurfaceBVH;
+
+
+/** Projection of a point onto a model with many surfaces. */
+typedef struct NurbsModelProjectionPoint_
+{
+    int surface;    /**< Index of the closest surface (-1 if none). */
+    NurbsFloat u;   /**< First parametric coordinate on the surface. */
+    NurbsFloat v;   /**< Second parametric coordinate on the surface. */
+    NurbsFloat dist;/**< Distance from the point to the surface. */
+
+}NurbsModelProjectionPoint;
+
+
+/** Projection engine of a model with many surfaces (e.g. an IGES file).
+  * It is a two level hierarchy: the leaves of the hierarchy of surfaces 
+  * are the surfaces (span_u is the index of the surface), and each surface
+  * has its own hierarchy of patches.
+  */
+typedef struct NurbsModelProjection_
+{
+    int num_surfaces;               /**< Number of surfaces. */
+    const NurbsSurface* surface;    /**< Surfaces of the model (not copied). */
+
+    NurbsSurfaceBVH* patches;       /**< Hierarchy of patches of each surface. */
+    NurbsSurfaceBVH surfaces;       /**< Hierarchy of the surfaces. */
+
+    int num_cache;                  /**< Number of points in the cache. */
+    NurbsModelProjectionPoint* cache; /**< Solutions of the last projection. */
+
+}NurbsModelProjection;
+
+
+/** Indexed triangle mesh of a set of NURBS surfaces (see 
+  * nurbs_surface_tessellate). The vertices are shared by the triangles of
+  * the same surface, but not between surfaces (a vertex has the parameters
+  * and the normal of one surface).
+  */
+typedef struct NurbsMesh_
+{
+    int num_vertices;       /**< Number of vertices. */
+    int num_triangles;      /**< Number of triangles. */
+
+    NurbsVector3* vertex;   /**< Coordinates of the vertices. */
+    NurbsVector3* normal;   /**< Unit normals of the surface at the vertices. */
+    NurbsFloat* param;      /**< Parameters {u, v} of the vertices, param[2*i]. */
+    int* vertex_surface;    /**< Index of the surface of each vertex. */
+
+    int* triangle;          /**< Vertices of the triangles, triangle[3*i]. 
+                              * Counterclockwise in the parametric space. */
+    int* triangle_surface;  /**< Index of the surface of each triangle. */
+
+}NurbsMesh;
+
+
+/** Tessellation kept in a NurbsMeshCache. */
+typedef struct NurbsMeshCacheEntry_
+{
+    const NurbsSurface* surface; /**< Surface (nullptr if the entry is free). */
+    int id;                 /**< Id of the surface. */
+    unsigned int version;   /**< Version of the surface. */
+
+    NurbsFloat chord_height;/**< Tolerances of the tessellation. */
+    NurbsFloat normal_angle;
+    int max_depth;
+
+    NurbsMesh mesh;         /**< Tessellation of the surface. */
+    size_t size;            /**< Memory of the mesh in bytes. */
+
+    int prev;               /**< More recently used entry (-1 if none). */
+    int next;               /**< Less recently used entry, or the next free
+                              * entry (-1 if none). */
+    int next_in_bucket;     /**< Next entry of the same bucket. */
+
+}NurbsMeshCacheEntry;
+
+
+/** Cache of tessellations of surfaces (see nurbs_mesh_cache_get). The 
+  * entries are keyed by the id and the version of the surface, and the 
+  * tolerances. The least recently used ones are
+  * released when the memory of the meshes is over the budget.
+  */
+typedef struct NurbsMeshCache_
+{
+    size_t budget;          /**< Maximum memory of the meshes (0, no limit). */
+    size_t size;            /**< Memory of the meshes in bytes. */
+
+    int num_entries;        /**< Number of used entries. */
+    int max_entries;        /**< Allocated entries. */
+    NurbsMeshCacheEntry* entry; /**< Entries. */
+
+    int first;              /**< Most recently used entry (-1 if empty). */
+    int last;               /**< Least recently used entry (-1 if empty). */
+    int free_entry;         /**< First free entry (-1 if none). */
+
+    int num_buckets;        /**< Number of buckets of the keys (power of two). */
+    int* bucket;            /**< First entry of each bucket (-1 if empty). */
+
+    int hits;               /**< Number of meshes found in the cache. */
+    int misses;             /**< Number of meshes tessellated. */
+
+}NurbsMeshCache;
+
+
 #endif /*_NURBS_SURFACE_H_ */
 
 
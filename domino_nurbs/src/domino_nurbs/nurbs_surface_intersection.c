@@ -2,6 +2,8 @@
     Author: Mario J. Martin <dominonurbs$gmail.com>
 
     Algorithms to calculate the intersection between NURBS surface.
+    The fast intersection only solves the pairs of second order patches whose
+    bounding boxes overlap, and the pairs are solved in parallel.
 
 *******************************************************************************/ 
 
@@ -11,6 +13,9 @@
 #include <string.h>
 #include <float.h>
 
+#include "common/check_malloc.h"
+#include "common/log.h"
+
 #include "nurbs_internal.h"
 
 #include "nurbs_basis.h"
@@ -83,68 +88,6 @@ static int solve_hiperbolic_three(NurbsFloat* u, NurbsFloat* v
     return 0;
 }
 
-/* Gets the first nurbs derivative using finite differences */
-static void get_nurbs_derivates_byfd_u
-    ( NurbsVector3 *du      /* (out) Derivative */
-    , const NurbsFloat u  /* First parameter */
-    , const NurbsFloat v  /* Second parameter */
-    , const NurbsSurface *surface /* NURBS surface data pointer */
-    )
-{
-    NurbsVector3 p0, p1;
-    NurbsFloat epsilon, epsilon2;
-    NurbsFloat min, max;
-
-    nurbs_basis_get_parameter_interval( &min, &max
-        , surface->knot_u, surface->knot_length_u, surface->degree_u);
-    epsilon = (max - min)/1000;
-
-    p0 = nurbs_surface_get_point(surface, u-epsilon, v);
-    p1 = nurbs_surface_get_point(surface, u+epsilon, v);
-
-    if (u-epsilon < min || u+epsilon > max){
-        epsilon2 = epsilon;
-    }
-    else{
-        epsilon2 = 2 * epsilon;
-    }
-
-    du->x = (p1.x - p0.x) / (epsilon2);
-    du->y = (p1.y - p0.y) / (epsilon2);
-    du->z = (p1.z - p0.z) / (epsilon2);
-}
-
-/* Gets the first nurbs derivative using finite differences */
-static void get_nurbs_derivates_byfd_v
-    ( NurbsVector3 *dv     /* (out) Derivative */
-    , const NurbsFloat u  /* First parameter */
-    , const NurbsFloat v  /* Second parameter */
-    , const NurbsSurface *surface /* NURBS surface data pointer */
-    )
-{
-    NurbsVector3 p0, p1;
-    NurbsFloat epsilon, epsilon2;
-    NurbsFloat min, max;
-
-    nurbs_basis_get_parameter_interval( &min, &max
-        , surface->knot_v, surface->knot_length_v, surface->degree_v);
-    epsilon = (max - min)/1000;
-
-    p0 = nurbs_surface_get_point(surface, u, v-epsilon);
-    p1 = nurbs_surface_get_point(surface, u, v+epsilon);
-
-    if (v-epsilon < min || v+epsilon > max){
-        epsilon2 = epsilon;
-    }
-    else{
-        epsilon2 = 2 * epsilon;
-    }
-
-    dv->x = (p1.x - p0.x) / (epsilon2);
-    dv->y = (p1.y - p0.y) / (epsilon2);
-    dv->z = (p1.z - p0.z) / (epsilon2);
-}
-
 /******************************************************************************/
 
 /* Local data structure that store the polinomials coefficients */
@@ -449,6 +392,7 @@ void nurbs_surface_intersection_iterative
     NurbsVector3 vec;
     NurbsVector3 du;
     NurbsVector3 dv;
+    NurbsVector3 duu, duv, dvv;
     NurbsFloat dist, dist1, dist2, dist3;
     NurbsFloat qpu, qpv, u2, v2, uv, d, u0, v0, m0, n0;
     NurbsFloat delta_u, delta_v;
@@ -466,19 +410,10 @@ void nurbs_surface_intersection_iterative
 
     while (dist > epsilon){
 
-        nurbs_surface_get_derivatives(&du, &dv, &point_a, nurbs_a, *u, *v);
-        /* If the derivative is zero, recalculate it using finite diferences */
+        nurbs_surface_get_regular_derivatives
+            (&duu, &duv, &dvv, &du, &dv, &point_a, nurbs_a, *u, *v);
         u2 = du.x * du.x + du.y * du.y + du.z * du.z;
-        if (u2 < FLT_EPSILON){
-            get_nurbs_derivates_byfd_u(&du, *u, *v,  nurbs_a);
-            u2 = du.x * du.x + du.y * du.y + du.z * du.z;
-        }
-
         v2 = dv.x * dv.x + dv.y * dv.y + dv.z * dv.z;
-        if (v2 < FLT_EPSILON){
-            get_nurbs_derivates_byfd_v(&dv, *u, *v, nurbs_a);
-            v2 = dv.x * dv.x + dv.y * dv.y + dv.z * dv.z;
-        }
 
         /* Calculate the proyection onto the derivatives */
         qpu = vec.x * du.x + vec.y * du.y + vec.z * du.z;
@@ -496,19 +431,10 @@ void nurbs_surface_intersection_iterative
 
         /*********/
 
-        nurbs_surface_get_derivatives(&du, &dv, &point_b, nurbs_b, *m, *n);
-        /* If the derivative is zero, recalculate it using finite diferences */
+        nurbs_surface_get_regular_derivatives
+            (&duu, &duv, &dvv, &du, &dv, &point_b, nurbs_b, *m, *n);
         u2 = du.x * du.x + du.y * du.y + du.z * du.z;
-        if (u2 < FLT_EPSILON){
-            get_nurbs_derivates_byfd_u(&du, *m, *n,  nurbs_b);
-            u2 = du.x * du.x + du.y * du.y + du.z * du.z;
-       }
-
         v2 = dv.x * dv.x + dv.y * dv.y + dv.z * dv.z;
-        if (v2 < FLT_EPSILON){
-            get_nurbs_derivates_byfd_v(&dv, *m, *n, nurbs_b);
-            v2 = dv.x * dv.x + dv.y * dv.y + dv.z * dv.z;
-        }
 
         /* Calculate the proyection onto the derivatives */
         qpu = vec.x * du.x + vec.y * du.y + vec.z * du.z;
@@ -583,12 +509,42 @@ void nurbs_surface_intersection_iterative
 }
 
 
+/* Number of pairs of patches of each parallel block */
+#define INTERSECTION_BLOCK_SIZE 32
+
+/* Solutions of a block of pairs, stored in the buffer of its thread */
+typedef struct
+{
+    NurbsIntersection** buffer;
+    size_t first, num;
+}IntersectionBlock;
+
+/* Sorts the pairs of patches in the same order as the loops through spans */
+static int compare_pairs( const void* a, const void* b )
+{
+    const int* pa = (const int*)a;
+    const int* pb = (const int*)b;
+    int k;
+
+    for (k = 0; k < 4; k++){
+        if (pa[k] != pb[k]){
+            return (pa[k] > pb[k]) - (pa[k] < pb[k]);
+        }
+    }
+
+    return 0;
+}
+
 /** Calculates an estimation of intersection between nurbs. 
   * This is a fast (and potentialy low accurate) algorithm. 
   * It only checks the middle point of each nurbs segment.
   * It performs a raster through all 4 possibilities.
   * Usually, the raster that provides more solutions is the best one.
-  * Return 1 if these two nurbs may intersec or 0 if not */
+  * Only the pairs of segments whose extended bounding boxes overlap 
+  * may intersect, so the others are not checked.
+  * Return 1 if these two nurbs may intersec, 0 if not, 
+  * or -1 if the memory is exhausted (or the second order surfaces are
+  * not valid) */
 int nurbs_surface_intersection_fast
     ( NurbsIntersection* buffer
     , size_t* num_sol
@@ -600,27 +556,185 @@ int nurbs_surface_intersection_fast
     , const NurbsFloat relaxation
     )
 {
-    NurbsSurface* sa = nullptr;
-    NurbsSurface* sb = nullptr;
-    Nurbs2Coef a, b;
-    int i, j, k, s;
+    const NurbsSurface* sa;
+    const NurbsSurface* sb;
+    NurbsSurfaceBVH bvh_a, bvh_b;
+    IntersectionBlock* blocks = nullptr;
+    int* pairs = nullptr;
+    int num_pairs, num_blocks, ib, status = 1;
+    size_t k, max_store;
 
-    /* reduce both nurbs to second order */
+    *num_sol = 0;
+
+    /* second order nurbs (kept in the surfaces if not given) */
     if (nurbs_2order_a == nullptr){
-        sa = nurbs_surface_reduce_order2(nullptr, nurbs_a);
+        sa = nurbs_surface_get_order2(nurbs_a);
     }
     else{
         sa = nurbs_2order_a;
     }
     if (nurbs_2order_b == nullptr){
-        sb = nurbs_surface_reduce_order2(nullptr, nurbs_b);
+        sb = nurbs_surface_get_order2(nurbs_b);
     }
     else{
         sb = nurbs_2order_b;
     }
 
+    /* The last position of the buffer is never used */
+    max_store = (max_sol > 0) ? max_sol - 1 : 0;
+
+    /* Broad phase: pairs of segments that may intersect */
+    nurbs_surface_bvh_init(&bvh_a);
+    nurbs_surface_bvh_init(&bvh_b);
+    num_pairs = 0;
+    if (sa == nullptr || sb == nullptr){
+        /* Out of memory */
+        status = 0;
+    }
+    else if (max_store > 0){
+        if (nurbs_surface_bvh_build_order2(&bvh_a, sa, relaxation)
+            && nurbs_surface_bvh_build_order2(&bvh_b, sb, relaxation))
+        {
+            num_pairs = nurbs_surface_bvh_overlap(&pairs, &bvh_a, &bvh_b);
+        }
+        else{
+            status = 0;
+        }
+    }
+    nurbs_surface_bvh_dispose(&bvh_a);
+    nurbs_surface_bvh_dispose(&bvh_b);
+
+    num_blocks = 0;
+    if (num_pairs < 0){
+        status = 0;
+    }
+    else if (num_pairs > 0){
+        qsort(pairs, num_pairs, 4 * sizeof(int), compare_pairs);
+
+        num_blocks = (num_pairs + INTERSECTION_BLOCK_SIZE - 1) / INTERSECTION_BLOCK_SIZE;
+        _check_(blocks = (IntersectionBlock*)_malloc_
+            (sizeof(IntersectionBlock) * num_blocks));
+        if (blocks == nullptr){
+            status = 0;
+            num_blocks = 0;
+        }
+    }
+
+    /* Narrow phase: each thread stores the solutions in its own buffer */
+    #pragma omp parallel if (num_blocks > 1)
+    {
+        NurbsIntersection* sol = nullptr;
+        NurbsIntersection* p;
+        size_t n = 0, max_n = 0, num;
+        int ip, ia = -1, ja = -1;
+        Nurbs2Coef a, b;
+        const int* pair;
+
+        #pragma omp for schedule(dynamic)
+        for (ib = 0; ib < num_blocks; ib++){
+            blocks[ib].buffer = &sol;
+            blocks[ib].first = n;
+
+            for (ip = ib * INTERSECTION_BLOCK_SIZE
+                ; ip < num_pairs && ip < (ib + 1) * INTERSECTION_BLOCK_SIZE
+                ; ip++)
+            {
+                /* Up to 4 solutions for each pair */
+                if (n + 4 > max_n){
+                    _check_(p = (NurbsIntersection*)_realloc_
+                        (sol, sizeof(NurbsIntersection) * 2 * (max_n + 4)));
+                    if (p == nullptr){
+                        /* Threads can only clear the flag */
+                        status = 0;
+                        #pragma omp flush (status)
+                        break;
+                    }
+                    sol = p;
+                    max_n = 2 * (max_n + 4);
+                }
+
+                pair = &(pairs[4 * ip]);
+                if (pair[0] != ia || pair[1] != ja){
+                    ia = pair[0];
+                    ja = pair[1];
+                    a = nurbs_polinomial_coef(sa, ia, ja);
+                }
+                b = nurbs_polinomial_coef(sb, pair[2], pair[3]);
+
+                nurbs_surface_intersec_fast_u(&a, &b, sol, &n, max_n + 1, relaxation);
+                nurbs_surface_intersec_fast_v(&a, &b, sol, &n, max_n + 1, relaxation);
+                nurbs_surface_intersec_fast_m(&a, &b, sol, &n, max_n + 1, relaxation);
+                nurbs_surface_intersec_fast_n(&a, &b, sol, &n, max_n + 1, relaxation);
+            }
+
+            blocks[ib].num = n - blocks[ib].first;
+        }
+
+        /* Merge the buffers in the order of the pairs */
+        #pragma omp single
+        for (ib = 0; ib < num_blocks; ib++){
+            num = blocks[ib].num;
+            if (*num_sol + num > max_store){
+                num = max_store - *num_sol;
+            }
+            for (k = 0; k < num; k++){
+                buffer[*num_sol + k] = (*blocks[ib].buffer)[blocks[ib].first + k];
+            }
+            *num_sol += num;
+        }
+
+        if (sol != nullptr){
+            free(sol);
+        }
+    }
+
+    if (blocks != nullptr){
+        free(blocks);
+    }
+    if (pairs != nullptr){
+        free(pairs);
+    }
+
+    if (status == 0){
+        return -1;
+    }
+    if (*num_sol > 0){
+        return 1;
+    }
+    else{
+        return 0;
+    }
+}
+
+
+/** Same as nurbs_surface_intersection_fast, but it solves every pair of
+  * segments in serial, in the order of the loops. It is the reference of 
+  * the pruned and parallel version. */
+int nurbs_surface_intersection_fast_all_pairs
+    ( NurbsIntersection* buffer
+    , size_t* num_sol
+    , const size_t max_sol
+    , const NurbsSurface* nurbs_a
+    , const NurbsSurface* nurbs_b
+    , NurbsSurface* nurbs_2order_a
+    , NurbsSurface* nurbs_2order_b
+    , const NurbsFloat relaxation
+    )
+{
+    const NurbsSurface* sa;
+    const NurbsSurface* sb;
+    Nurbs2Coef a, b;
+    int i, j, k, s;
+
     *num_sol = 0;
 
+    sa = (nurbs_2order_a != nullptr) ? nurbs_2order_a : nurbs_surface_get_order2(nurbs_a);
+    sb = (nurbs_2order_b != nullptr) ? nurbs_2order_b : nurbs_surface_get_order2(nurbs_b);
+    if (sa == nullptr || sb == nullptr){
+        /* Out of memory */
+        return -1;
+    }
+
     /* Huge loop through all segments to see which may intersec */
     for (i = sa->degree_u; i < sa->knot_length_u - sa->degree_u - 1; i++){
         for (j = sa->degree_v; j < sa->knot_length_v - sa->degree_v - 1; j++){
@@ -628,7 +742,6 @@ int nurbs_surface_intersection_fast
 
             for (k = sb->degree_u; k < sb->knot_length_u - sb->degree_u - 1; k++){
                 for (s = sb->degree_v; s < sb->knot_length_v - sb->degree_v - 1; s++){
-
                     b = nurbs_polinomial_coef(sb, k, s);
                 
                     nurbs_surface_intersec_fast_u(&a, &b, buffer, num_sol, max_sol, relaxation);
@@ -648,3 +761,4 @@ int nurbs_surface_intersection_fast
     }
 }
 
+/**/
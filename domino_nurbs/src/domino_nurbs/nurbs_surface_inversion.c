@@ -26,68 +26,6 @@ static inline NurbsFloat absf( const NurbsFloat a )
 }
 
 
-/* Gets the first nurbs derivative using finite differences */
-static void get_nurbs_derivates_byfd_u
-    ( NurbsVector3 *du    /* (out) Derivative */
-    , const NurbsFloat u  /* First parameter */
-    , const NurbsFloat v  /* Second parameter */
-    , const NurbsSurface *surface /* NURBS surface data pointer */
-    )
-{
-    NurbsVector3 p0, p1;
-    NurbsFloat epsilon, epsilon2;
-    NurbsFloat min, max;
-
-    nurbs_basis_get_parameter_interval( &min, &max
-        , surface->knot_u, surface->knot_length_u, surface->degree_u);
-    epsilon = (max - min)/1000;
-
-    p0 = nurbs_surface_get_point(surface, u-epsilon, v);
-    p1 = nurbs_surface_get_point(surface, u+epsilon, v);
-
-    if (u-epsilon < min || u+epsilon > max){
-        epsilon2 = epsilon;
-    }
-    else{
-        epsilon2 = 2 * epsilon;
-    }
-
-    du->x = (p1.x - p0.x) / (epsilon2);
-    du->y = (p1.y - p0.y) / (epsilon2);
-    du->z = (p1.z - p0.z) / (epsilon2);
-}
-
-/* Gets the first nurbs derivative using finite differences */
-static void get_nurbs_derivates_byfd_v
-    ( NurbsVector3 *dv    /* (out) Derivative */
-    , const NurbsFloat u  /* First parameter */
-    , const NurbsFloat v  /* Second parameter */
-    , const NurbsSurface *surface /* NURBS surface data pointer */
-    )
-{
-    NurbsVector3 p0, p1;
-    NurbsFloat epsilon, epsilon2;
-    NurbsFloat min, max;
-
-    nurbs_basis_get_parameter_interval( &min, &max
-        , surface->knot_v, surface->knot_length_v, surface->degree_v);
-    epsilon = (max - min)/1000;
-
-    p0 = nurbs_surface_get_point(surface, u, v-epsilon);
-    p1 = nurbs_surface_get_point(surface, u, v+epsilon);
-
-    if (v-epsilon < min || v+epsilon > max){
-        epsilon2 = epsilon;
-    }
-    else{
-        epsilon2 = 2 * epsilon;
-    }
-
-    dv->x = (p1.x - p0.x) / (epsilon2);
-    dv->y = (p1.y - p0.y) / (epsilon2);
-    dv->z = (p1.z - p0.z) / (epsilon2);
-}
-
 /* Calculates the inversion point using an iterative first order method. 
  * Basically is a Newton-Raphson that projects PQ onto the derivative */
 int nurbs_surface_inversion_proj_alt
@@ -98,8 +36,8 @@ int nurbs_surface_inversion_proj_alt
     , const NurbsFloat epsilon    /* Stop condition (eg 1e-6) */
     )
 {
-    NurbsFloat dist, dist1, err, mod, delta_u, delta_v, bg = 1;
-    NurbsVector3 p0, p1, p, du, dv, q;
+    NurbsFloat dist, dist1, err, delta_u, delta_v, bg = 1;
+    NurbsVector3 p0, p1, p, du, dv, duu, duv, dvv, q;
     NurbsFloat qpv, qpu, u2, v2, uv, d, uf, vf, u, v, best_u, best_v;
     NurbsFloat umin, vmin, umax, vmax;
     int adder;
@@ -135,22 +73,12 @@ int nurbs_surface_inversion_proj_alt
     v = vf;
 
     /* Calculate derivatives */
-    nurbs_surface_get_derivatives(&du, &dv, &p1, surface, uf, vf);
+    nurbs_surface_get_regular_derivatives
+        (&duu, &duv, &dvv, &du, &dv, &p1, surface, uf, vf);
     p0.x = q.x;
     p0.y = q.y;
     p0.z = q.z;
 
-    /* If the derivative is zero, recalculate it using finite diferences */
-    mod = du.x * du.x + du.y * du.y + du.z * du.z;
-    if (mod < FLT_EPSILON){
-        get_nurbs_derivates_byfd_u(&du, uf, vf,  surface);
-    }
-
-    mod = dv.x * dv.x + dv.y * dv.y + dv.z * dv.z;
-    if (mod < FLT_EPSILON){
-        get_nurbs_derivates_byfd_v(&dv, uf, vf, surface);
-    }
-
     /* Initial error */
     dist = (p1.x - q.x) * (p1.x - q.x) 
         + (p1.y - q.y) * (p1.y - q.y) 
@@ -272,7 +200,8 @@ int nurbs_surface_inversion_proj_alt
         }
 
         /* Calculate derivative vectors */
-        nurbs_surface_get_derivatives(&du, &dv, &p, surface, uf, vf);
+        nurbs_surface_get_regular_derivatives
+            (&duu, &duv, &dvv, &du, &dv, &p, surface, uf, vf);
 
         if (adder == 1){
             /* Reduce the movement each iteration the solution is not improved */
@@ -284,17 +213,6 @@ int nurbs_surface_inversion_proj_alt
             p0.z = p1.z;
         }
 
-        /* If the derivatives is zero, recalculate it using finite diferences */
-        mod = du.x * du.x + du.y * du.y + du.z * du.z;
-        if (mod < NURBS_EPSILON){
-            get_nurbs_derivates_byfd_u(&du, uf, vf,  surface);
-        }
-
-        mod = dv.x * dv.x + dv.y * dv.y + dv.z * dv.z;
-        if (mod < NURBS_EPSILON){
-            get_nurbs_derivates_byfd_v(&dv, uf, vf,  surface);
-        }
-
         it += 1;
     }
 
@@ -304,8 +222,10 @@ int nurbs_surface_inversion_proj_alt
 }
 
 
-/* Calculates the inversion point using an iterative first order method. 
- * Basically is a Newton-Raphson that projects PQ onto the derivative */
+/* Calculates the inversion point using the Newton-Raphson method on the 
+ * distance function, with the analytic first and second derivatives. 
+ * Each step only requires one evaluation of the surface. If the hessian is
+ * not positive definite, uses the projection of PQ onto the derivatives. */
 int nurbs_surface_inversion_proj
     ( NurbsFloat *pu  /* (in) Quest estimation (out) first parameter solution */
     , NurbsFloat *pv  /* (in) Quest estimation (out) second parameter solution */
@@ -314,12 +234,13 @@ int nurbs_surface_inversion_proj
     , const NurbsFloat epsilon    /* Stop condition (eg 1e-6) */
     )
 {
-    NurbsFloat qpv = 0, qpu = 0, u2 = 0, v2 = 0, uv = 0, d = 0, bg = 1;
+    NurbsFloat qpv, qpu, a11, a12, a22, d, bg;
     NurbsFloat uf, vf, u, v;
-    NurbsFloat dist, dist1, mod, delta_u = 0, delta_v = 0;
-    NurbsVector3 p, du, dv, q;
+    NurbsFloat dist, dist1, step, delta_u, delta_v;
+    NurbsVector3 p, du, dv, duu, duv, dvv, r, q;
+    NurbsVector3 p1, du1, dv1, duu1, duv1, dvv1;
     NurbsFloat umin, vmin, umax, vmax;
-    int fail = 0;
+    int it = 0;
     int it_not_improved = 0;
 
     q.x = point->x;
@@ -348,137 +269,119 @@ int nurbs_surface_inversion_proj
 
     uf = *pu;
     vf = *pv;
-    u = uf;
-    v = vf;
 
-    /* Calculate derivatives */
-    p = nurbs_surface_get_point( surface, uf, vf );
+    nurbs_surface_get_regular_derivatives
+        (&duu, &duv, &dvv, &du, &dv, &p, surface, uf, vf);
 
     /* Initial error */
     dist = (p.x - q.x) * (p.x - q.x) 
         + (p.y - q.y) * (p.y - q.y) 
         + (p.z - q.z) * (p.z - q.z);
-    
-    while (it_not_improved < 16)
-    {
-        if (fail == 0){
-            /* Calculate derivative vectors */
-            nurbs_surface_get_derivatives(&du, &dv, &p, surface, uf, vf);
-
-            /* If the derivatives is zero, recalculate it using finite diferences */
-            mod = du.x * du.x + du.y * du.y + du.z * du.z;
-            if (mod < NURBS_EPSILON){
-                get_nurbs_derivates_byfd_u(&du, uf, vf,  surface);
-            }
 
-            mod = dv.x * dv.x + dv.y * dv.y + dv.z * dv.z;
-            if (mod < NURBS_EPSILON){
-                get_nurbs_derivates_byfd_v(&dv, uf, vf,  surface);
-            }
-
-            /* Calculate the proyection onto the derivatives */
-            qpu = (q.x - p.x) * du.x 
-                + (q.y - p.y) * du.y 
-                + (q.z - p.z) * du.z;
-
-            qpv = (q.x - p.x) * dv.x 
-                + (q.y - p.y) * dv.y 
-                + (q.z - p.z) * dv.z;
-
-            u2 = du.x * du.x + du.y * du.y + du.z * du.z;
-            v2 = dv.x * dv.x + dv.y * dv.y + dv.z * dv.z;
-            uv = du.x * dv.x + du.y * dv.y + du.z * dv.z;
+    while (it < 100 && it_not_improved < 16){
+        if (sqrt(dist) < epsilon){
+            /* Ok, this is a good solution; stop */
+            return 0;
+        }
 
-            d = u2 * v2 - uv * uv;
+        r.x = q.x - p.x;
+        r.y = q.y - p.y;
+        r.z = q.z - p.z;
+
+        /* Gradient of the distance */
+        qpu = r.x * du.x + r.y * du.y + r.z * du.z;
+        qpv = r.x * dv.x + r.y * dv.y + r.z * dv.z;
+
+        /* Hessian of the distance */
+        a11 = du.x * du.x + du.y * du.y + du.z * du.z 
+            - (r.x * duu.x + r.y * duu.y + r.z * duu.z);
+        a12 = du.x * dv.x + du.y * dv.y + du.z * dv.z 
+            - (r.x * duv.x + r.y * duv.y + r.z * duv.z);
+        a22 = dv.x * dv.x + dv.y * dv.y + dv.z * dv.z 
+            - (r.x * dvv.x + r.y * dvv.y + r.z * dvv.z);
+        d = a11 * a22 - a12 * a12;
+
+        if (!(a11 > 0 && d > 0)){
+            /* Far from the solution: only first derivatives */
+            a11 = du.x * du.x + du.y * du.y + du.z * du.z;
+            a12 = du.x * dv.x + du.y * dv.y + du.z * dv.z;
+            a22 = dv.x * dv.x + dv.y * dv.y + dv.z * dv.z;
+            d = a11 * a22 - a12 * a12;
 
             if (!(d<0 || d>0)){
                 /* Probably the point is on the vertical of the NURBS  */
                 return 0;
-            }        
-            delta_u = (qpu * v2 - qpv * uv) / d;
-            delta_v = (qpv * u2 - qpu * uv) / d;
+            }
         }
 
-        fail = 1;
+        delta_u = (qpu * a22 - qpv * a12) / d;
+        delta_v = (qpv * a11 - qpu * a12) / d;
 
-        u = uf + delta_u * bg;
-        v = vf + delta_v * bg;
+        /* Reduce the step until the distance is improved */
+        bg = 1;
+        while (it_not_improved < 16){
+            u = uf + delta_u * bg;
+            v = vf + delta_v * bg;
 
-        /* Check boundaries */
-        if (u < umin){
-            u = umin;
-        }
-        if (u > umax){
-            u = umax;
-        }
-        if (v < vmin){
-            v = vmin;
-        }
-        if (v > vmax){
-            v = vmax;
-        }
+            /* Check boundaries */
+            if (u < umin){
+                u = umin;
+            }
+            if (u > umax){
+                u = umax;
+            }
+            if (v < vmin){
+                v = vmin;
+            }
+            if (v > vmax){
+                v = vmax;
+            }
 
-        /* Move through u projection */
-        p = nurbs_surface_get_point(surface, u, vf);
-        dist1 = (p.x - q.x) * (p.x - q.x) 
-            + (p.y - q.y) * (p.y - q.y) 
-            + (p.z - q.z) * (p.z - q.z);
+            /* The displacement on the surface is negligible */
+            step = (u - uf) * (u - uf) * (du.x * du.x + du.y * du.y + du.z * du.z)
+                + (v - vf) * (v - vf) * (dv.x * dv.x + dv.y * dv.y + dv.z * dv.z);
+            if (step < epsilon * epsilon * NURBS_EPSILON){
+                *pu = uf;
+                *pv = vf;
+                return 1;
+            }
 
-        /* Check if there is an improvement */
-        if (dist > dist1){
-            *pu = u;
-            *pv = vf;
-            dist = dist1;
-            fail = 0;
-        }
+            nurbs_surface_get_regular_derivatives
+                (&duu1, &duv1, &dvv1, &du1, &dv1, &p1, surface, u, v);
+            dist1 = (p1.x - q.x) * (p1.x - q.x) 
+                + (p1.y - q.y) * (p1.y - q.y) 
+                + (p1.z - q.z) * (p1.z - q.z);
 
-        /* Move through v projection */
-        p = nurbs_surface_get_point(surface, uf, v);
-        dist1 = (p.x - q.x) * (p.x - q.x) 
-            + (p.y - q.y) * (p.y - q.y) 
-            + (p.z - q.z) * (p.z - q.z);
+            if (dist1 < dist){
+                break;
+            }
 
-        /* Check if there is an improvement */
-        if (dist > dist1){
-            *pu = uf;
-            *pv = v;
-            dist = dist1;
-            fail = 0;
+            bg *= 0.5f;
+            it_not_improved += 1;
         }
 
-        /* Move through uv projection */
-        p = nurbs_surface_get_point(surface, u, v);
-        dist1 = (p.x - q.x) * (p.x - q.x) 
-            + (p.y - q.y) * (p.y - q.y) 
-            + (p.z - q.z) * (p.z - q.z);
-
-        /* Check if there is an improvement */
-        if (dist > dist1){
-            *pu = u;
-            *pv = v;
-            dist = dist1;
-            fail = 0;
+        if (it_not_improved >= 16){
+            break;
         }
 
-        if (sqrt(dist) < epsilon){
-            /* Ok, this is a good solution; stop */
-            return 0;
-        }
-        //if (sqrt(qpu*qpu + qpv*qpv) < eps2){
-            /* The projection is almost vertical. The point is not exactly on the NURBS */
-            //return 0;
-        //}
+        uf = u;
+        vf = v;
+        dist = dist1;
+        p = p1;
+        du = du1;
+        dv = dv1;
+        duu = duu1;
+        duv = duv1;
+        dvv = dvv1;
 
-        if (fail == 1){
-            /* Reduce the movement when the solution is not improved */
-            bg *= 0.5f;
-            it_not_improved += 1;
-        }
-        else{
-            bg = 1;
-            uf = *pu;
-            vf = *pv;
-        }
+        *pu = uf;
+        *pv = vf;
+
+        it++;
+    }
+
+    if (sqrt(dist) < epsilon){
+        return 0;
     }
 
     /* Maybe no solution is found, maybe there are problems with the convergence, or who knows... */
@@ -1193,6 +1096,14 @@ int nurbs_surface_estimation_normal
     NurbsFloat mod;
     int fail_inversion = 1;
 
+    if (surface_order2 == nullptr){
+        /* Kept in the surface */
+        surface_order2 = nurbs_surface_get_order2(surface_orig);
+        if (surface_order2 == nullptr){
+            return 0;
+        }
+    }
+
     /* Check the greatest component of the normal 
     * and shift the three equations to maximize precision */
     mod = absf(normal->x);
@@ -1282,6 +1193,14 @@ int nurbs_surface_inversion_normal
     NurbsFloat mod;
     int fail_inversion = 1;
 
+    if (surface_order2 == nullptr){
+        /* Kept in the surface */
+        surface_order2 = nurbs_surface_get_order2(surface_orig);
+        if (surface_order2 == nullptr){
+            return 0;
+        }
+    }
+
     /* Check the greatest component of the normal 
     * and shift the three equations to maximize precision */
     mod = absf(normal->x);
@@ -1492,6 +1411,14 @@ int nurbs_surface_estimation_min_distance
 
     int status, num_solutions = 0;
 
+    if (surface_order2 == nullptr){
+        /* Kept in the surface */
+        surface_order2 = nurbs_surface_get_order2(surface_orig);
+        if (surface_order2 == nullptr){
+            return 0;
+        }
+    }
+
     point.x = ppoint->x;
     point.y = ppoint->y;
     point.z = ppoint->z;
@@ -1669,6 +1596,14 @@ int nurbs_surface_inversion_min_distance
 
     int status = 1, num_solutions = 0;
 
+    if (surface_order2 == nullptr){
+        /* Kept in the surface */
+        surface_order2 = nurbs_surface_get_order2(surface_orig);
+        if (surface_order2 == nullptr){
+            return 1;
+        }
+    }
+
     *pu = -1;
     *pv = -1;
 
@@ -1708,3 +1643,474 @@ int nurbs_surface_inversion_min_distance
     return (num_solutions > 0 ? 0 : 1);
 }
 
+
+/* Maximum number of patches tested by the inversion with the hierarchy */
+#define NURBS_BVH_CANDIDATES 32
+
+/* Compares the distance with a subgrid of values of the patch {i, j} */
+static void estimation_patch
+    ( NurbsFloat *pu            /* Returned value */
+    , NurbsFloat *pv            /* Returned value */
+    , NurbsFloat *best_dist     /* Distance of the best value (< 0 if none) */
+    , const NurbsSurface *surface /* Non reduced NURBS surface */
+    , const NurbsVector3 *point   /* Coordinates of the point {x, y, z} */
+    , const int i               /* Knot interval in u */
+    , const int j               /* Knot interval in v */
+    , const int grid_density    /* Number of divisions of the patch */
+    )
+{
+    int ri, rj, n;
+    NurbsFloat u, v, dist;
+    NurbsVector3 q;
+
+    n = (grid_density > 1) ? grid_density : 1;
+
+    for (ri = 0; ri <= n; ri++){
+        for (rj = 0; rj <= n; rj++){
+            u = surface->knot_u[i] 
+                + (surface->knot_u[i+1] - surface->knot_u[i]) * ri / n;
+            v = surface->knot_v[j] 
+                + (surface->knot_v[j+1] - surface->knot_v[j]) * rj / n;
+            q = nurbs_surface_get_point(surface, u, v);
+            dist = (point->x - q.x) * (point->x - q.x) 
+                + (point->y - q.y) * (point->y - q.y) 
+                + (point->z - q.z) * (point->z - q.z);
+
+            if (dist < *best_dist || *best_dist < 0){
+                *pu = u;
+                *pv = v;
+                *best_dist = dist;
+            }
+        }
+    }
+}
+
+
+/* Compares the distances with a subgrid of the patches that may contain 
+ * the closest point. The patches farther than the best value, or than the 
+ * bound (if it is not negative), are skipped.
+ * Returns 1 if any value is found. */
+static int bvh_estimation
+    ( NurbsFloat *pu            /* Returned value */
+    , NurbsFloat *pv            /* Returned value */
+    , NurbsFloat *best_dist     /* (out) Square of the distance of the value */
+    , const NurbsFloat bound    /* Square of the bound of the distance */
+    , const NurbsSurfaceBVH *bvh  /* Hierarchy of the patches of the surface */
+    , const NurbsSurface *surface /* Non reduced NURBS surface        */
+    , const NurbsVector3 *point   /* Coordinates of the point {x, y, z} */
+    , const int grid_density      /* Set the number of divisions used (min: 1) */
+    )
+{
+    int span_u[NURBS_BVH_CANDIDATES];
+    int span_v[NURBS_BVH_CANDIDATES];
+    NurbsFloat lower[NURBS_BVH_CANDIDATES];
+    NurbsFloat limit;
+    int k, n;
+
+    *best_dist = -1;
+
+    n = nurbs_surface_bvh_closest
+        ( span_u, span_v, lower, NURBS_BVH_CANDIDATES, bvh, point );
+
+    /* The patches are sorted by the distance to their boxes */
+    for (k = 0; k < n; k++){
+        limit = *best_dist;
+        if (bound >= 0 && (limit < 0 || bound < limit)){
+            limit = bound;
+        }
+        if (limit >= 0 && lower[k] * lower[k] > limit){
+            break;
+        }
+
+        estimation_patch
+            ( pu, pv, best_dist, surface, point
+            , span_u[k], span_v[k], grid_density );
+    }
+
+    return (*best_dist >= 0);
+}
+
+
+/* Estimates the nurbs parameters by comparing distances with a subgrid, 
+ * but only on the patches that may contain the closest point. */
+void nurbs_surface_bvh_estimation
+    ( NurbsFloat *pu    /* Returned value */
+    , NurbsFloat *pv    /* Returned value */
+    , const NurbsSurfaceBVH *bvh  /* Hierarchy of the patches of the surface */
+    , const NurbsSurface *surface /* Non reduced NURBS surface        */
+    , const NurbsVector3 *point   /* Coordinates of the point {x, y, z} */
+    , const int grid_density      /* Set the number of divisions used (min: 1) */
+    )
+{
+    NurbsFloat best_dist;
+
+    if (!bvh_estimation
+        ( pu, pv, &best_dist, -1, bvh, surface, point, grid_density ))
+    {
+        nurbs_surface_estimation_subgrid( pu, pv, surface, point, grid_density );
+    }
+}
+
+
+/* Projects the point onto the surface, looking only for solutions closer 
+ * than *pdist. Returns 1 if one is found (pu, pv and pdist are updated). */
+int nurbs_surface_bvh_projection
+    ( NurbsFloat *pu    /* (out) First parameter of the solution */
+    , NurbsFloat *pv    /* (out) Second parameter of the solution */
+    , NurbsFloat *pdist /* (in) Bound (< 0 for none) (out) Distance */
+    , const NurbsSurfaceBVH *bvh  /* Hierarchy of the patches of the surface */
+    , const NurbsSurface *surface /* Non reduced NURBS surface        */
+    , const NurbsVector3 *point   /* Coordinates of the point {x, y, z} */
+    , const NurbsFloat epsilon    /* Stop condition for the iterative methods */
+    , const int grid_density      /* Set the number of divisions used (min: 1) */
+    )
+{
+    NurbsFloat u, v, us, vs;
+    NurbsFloat best_u, best_v;
+    NurbsVector3 q;
+    NurbsFloat dist, best_dist, bound;
+
+    bound = (*pdist >= 0) ? (*pdist) * (*pdist) : -1;
+
+    if (!bvh_estimation
+        ( &us, &vs, &best_dist, bound, bvh, surface, point, grid_density ))
+    {
+        return 0;
+    }
+
+    best_u = us;
+    best_v = vs;
+
+    /* Perform the first iterative method */
+    u = us;
+    v = vs;
+    nurbs_surface_inversion_quad(&u, &v, point, surface, epsilon);
+    q = nurbs_surface_get_point(surface, u, v);
+    dist = (q.x - point->x) * (q.x - point->x) 
+        + (q.y - point->y) * (q.y - point->y) 
+        + (q.z - point->z) * (q.z - point->z);
+
+    if (dist < best_dist){
+        best_dist = dist;
+        best_u = u;
+        best_v = v;
+    }
+
+    /* Perform the second iterative method */
+    u = us;
+    v = vs;
+    nurbs_surface_inversion_proj(&u, &v, point, surface, epsilon);
+    q = nurbs_surface_get_point(surface, u, v);
+    dist = (q.x - point->x) * (q.x - point->x) 
+        + (q.y - point->y) * (q.y - point->y) 
+        + (q.z - point->z) * (q.z - point->z);
+
+    if (dist < best_dist){
+        best_dist = dist;
+        best_u = u;
+        best_v = v;
+    }
+
+    if (bound >= 0 && !(best_dist < bound)){
+        return 0;
+    }
+
+    *pu = best_u;
+    *pv = best_v;
+    *pdist = sqrt(best_dist);
+
+    return 1;
+}
+
+
+/* Estimates the nurbs parameters with the hierarchy of the patches, 
+ * and then performs the iterative methods. It always found one solution. */
+void nurbs_surface_bvh_inversion
+    ( NurbsFloat *pu    /* Returned value */
+    , NurbsFloat *pv    /* Returned value */
+    , const NurbsSurfaceBVH *bvh  /* Hierarchy of the patches of the surface */
+    , const NurbsSurface *surface /* Non reduced NURBS surface        */
+    , const NurbsVector3 *point   /* Coordinates of the point {x, y, z} */
+    , const NurbsFloat epsilon    /* Stop condition for the iterative methods */
+    , const int grid_density      /* Set the number of divisions used (min: 1) */
+    )
+{
+    NurbsFloat u, v, us, vs;
+    NurbsVector3 q;
+    NurbsFloat dist, best_dist;
+
+    nurbs_surface_bvh_estimation( pu, pv, bvh, surface, point, grid_density );
+
+    us = *pu;
+    vs = *pv;
+    q = nurbs_surface_get_point(surface, us, vs);
+    best_dist = (q.x - point->x) * (q.x - point->x) 
+        + (q.y - point->y) * (q.y - point->y) 
+        + (q.z - point->z) * (q.z - point->z);
+
+    /* Perform the first iterative method */
+    u = us;
+    v = vs;
+    nurbs_surface_inversion_quad(&u, &v, point, surface, epsilon);
+    q = nurbs_surface_get_point(surface, u, v);
+    dist = (q.x - point->x) * (q.x - point->x) 
+        + (q.y - point->y) * (q.y - point->y) 
+        + (q.z - point->z) * (q.z - point->z);
+
+    if (dist < best_dist){
+        best_dist = dist;
+        *pu = u;
+        *pv = v;
+    }
+
+    /* Perform the second iterative method */
+    u = us;
+    v = vs;
+    nurbs_surface_inversion_proj(&u, &v, point, surface, epsilon);
+    q = nurbs_surface_get_point(surface, u, v);
+    dist = (q.x - point->x) * (q.x - point->x) 
+        + (q.y - point->y) * (q.y - point->y) 
+        + (q.z - point->z) * (q.z - point->z);
+
+    if (dist < best_dist){
+        best_dist = dist;
+        *pu = u;
+        *pv = v;
+    }
+}
+
+
+/* Finds the cells [i0, i1] of the second order nurbs that overlap the 
+ * parametric interval (t0, t1). The cell i is {knot[i], knot[i+1]}. */
+static void order2_cells
+    ( int *i0, int *i1
+    , const NurbsFloat knot[]
+    , const int cp_length
+    , const NurbsFloat t0
+    , const NurbsFloat t1
+    )
+{
+    int i;
+
+    *i0 = cp_length;
+    *i1 = 0;
+    for (i = 1; i < cp_length; i++){
+        if (knot[i] < t1 && knot[i + 1] > t0){
+            if (i < *i0){
+                *i0 = i;
+            }
+            *i1 = i;
+        }
+    }
+}
+
+
+/* Calculates the inversion by the surface minimun distance of the second 
+ * order nurbs, but only on the cells that overlap the patches that may 
+ * contain the closest point. */
+int nurbs_surface_bvh_inversion_min_distance
+    ( NurbsFloat *pu                     /* Returned value */
+    , NurbsFloat *pv                     /* Returned value */
+    , const NurbsSurfaceBVH *bvh         /* Hierarchy of the original nurbs */
+    , const NurbsSurface *surface_orig   /* Non reduced NURBS surface        */
+    , const NurbsSurface *surface_order2 /* Second order NURBS surface        */
+    , const NurbsVector3 *point  /* Coordinates of the point {x, y, z} */
+    , const NurbsFloat epsilon   /* Stop condition iterative methods (eg 1e-6) */
+    , const NurbsFloat rgamma    /* Relaxing factor (eg 0, 0.25, 0.50) */
+    )
+{
+    int span_u[NURBS_BVH_CANDIDATES];
+    int span_v[NURBS_BVH_CANDIDATES];
+    NurbsFloat lower[NURBS_BVH_CANDIDATES];
+    int i, j, k, n, i0, i1, j0, j1;
+    NurbsVector3 q;
+    NurbsFloat dist;
+    NurbsFloat best_dist = -1;
+    NurbsFloat u, v;
+
+    int status = 1, num_solutions = 0;
+
+    if (surface_order2 == nullptr){
+        /* Kept in the surface */
+        surface_order2 = nurbs_surface_get_order2(surface_orig);
+        if (surface_order2 == nullptr){
+            return 1;
+        }
+    }
+
+    *pu = -1;
+    *pv = -1;
+
+    n = nurbs_surface_bvh_closest
+        ( span_u, span_v, lower, NURBS_BVH_CANDIDATES, bvh, point );
+
+    for (k = 0; k < n; k++){
+        if (best_dist >= 0 && lower[k] * lower[k] > best_dist){
+            break;
+        }
+
+        order2_cells( &i0, &i1, surface_order2->knot_u
+            , surface_order2->cp_length_u
+            , surface_orig->knot_u[span_u[k]], surface_orig->knot_u[span_u[k] + 1] );
+
+        order2_cells( &j0, &j1, surface_order2->knot_v
+            , surface_order2->cp_length_v
+            , surface_orig->knot_v[span_v[k]], surface_orig->knot_v[span_v[k] + 1] );
+
+        for (i = i0; i <= i1; i++){
+            for (j = j0; j <= j1; j++){
+                /* Calculate the local estimation */
+                status = solve_local_inversion_min_dist_order2
+                    (&u, &v, surface_order2, i, j, point, rgamma);
+
+                if (status == 0){
+                    /* Perform the iterative method */
+                    num_solutions++;
+                    if (surface_orig->degree_u > 1 || surface_orig->degree_v > 1){
+                        status = nurbs_surface_inversion_proj
+                            (&u, &v, point, surface_orig, epsilon);
+                    }
+                    /* Check the error */
+                    q = nurbs_surface_get_point(surface_orig, u, v);
+                    dist = (q.x - point->x) * (q.x - point->x) 
+                        + (q.y - point->y) * (q.y - point->y) 
+                        + (q.z - point->z) * (q.z - point->z);
+
+                    if (dist < best_dist || best_dist < 0){
+                        *pu = u;
+                        *pv = v;
+                        best_dist = dist;
+                    }
+
+                    if (sqrt(dist) < epsilon){
+                        return 0;
+                    }
+                }
+            }
+        }
+    }
+
+    /* The closest patches did not give any solution, try all of them */
+    if (num_solutions == 0){
+        return nurbs_surface_inversion_min_distance
+            ( pu, pv, surface_orig, surface_order2, point, epsilon, rgamma );
+    }
+
+    return 0;
+}
+
+
+/* Calculates the inversion by the intersection of the normal with the 
+ * second order nurbs, starting with the cells that overlap the patches
+ * closest to the point. Returns the number of estimations found. */
+int nurbs_surface_bvh_inversion_normal
+    ( NurbsFloat *pu    /* Returned solution */
+    , NurbsFloat *pv    /* Returned solution */
+    , const NurbsSurfaceBVH *bvh         /* Hierarchy of the original nurbs */
+    , const NurbsSurface *surface_orig   /* Non reduced NURBS surface        */
+    , const NurbsSurface *surface_order2 /* Second order NURBS surface        */
+    , const NurbsVector3 *point  /* Coordinates of the point {x, y, z} */
+    , const NurbsVector3 *normal /* Surface normal (should be normalized) */
+    , const NurbsFloat epsilon   /* Stop condition for the iterative methods  */
+    , const NurbsFloat rgamma    /* Relaxing factor used by the estimation */
+    )
+{
+    int span_u[NURBS_BVH_CANDIDATES];
+    int span_v[NURBS_BVH_CANDIDATES];
+    NurbsFloat lower[NURBS_BVH_CANDIDATES];
+    int i, j, k, n, i0, i1, j0, j1;
+    NurbsVector3 q;
+    NurbsFloat dist;
+    NurbsFloat best_dist = -1;
+    NurbsFloat u, v;
+    int num_solutions = 0;
+    int shift = 0, status;
+    NurbsFloat mod;
+
+    if (surface_order2 == nullptr){
+        /* Kept in the surface */
+        surface_order2 = nurbs_surface_get_order2(surface_orig);
+        if (surface_order2 == nullptr){
+            return 0;
+        }
+    }
+
+    /* Check the greatest component of the normal 
+    * and shift the three equations to maximize precision */
+    mod = absf(normal->x);
+    if (absf(normal->y) > mod){
+        shift = 1;
+        mod = absf(normal->y);
+    }
+    if (absf(normal->z) > mod){
+        shift = 2;
+    }
+
+    *pu = -1;
+    *pv = -1;
+
+    n = nurbs_surface_bvh_closest
+        ( span_u, span_v, lower, NURBS_BVH_CANDIDATES, bvh, point );
+
+    for (k = 0; k < n; k++){
+        order2_cells( &i0, &i1, surface_order2->knot_u
+            , surface_order2->cp_length_u
+            , surface_orig->knot_u[span_u[k]], surface_orig->knot_u[span_u[k] + 1] );
+
+        order2_cells( &j0, &j1, surface_order2->knot_v
+            , surface_order2->cp_length_v
+            , surface_orig->knot_v[span_v[k]], surface_orig->knot_v[span_v[k] + 1] );
+
+        for (i = i0; i <= i1; i++){
+            for (j = j0; j <= j1; j++){
+                /* Calculate the local intersection */
+                status = solve_local_inversion_normal_order2
+                    ( &u, &v, surface_order2, normal, i, j
+                    , point, shift, rgamma, epsilon);
+
+                if (status == 0){
+                    /* Perform the iterative method */
+                    nurbs_surface_inversion_proj
+                        (&u, &v, point, surface_orig, epsilon);
+
+                    q = nurbs_surface_get_point(surface_orig, u, v);
+                    dist = (q.x - point->x) * (q.x - point->x) 
+                        + (q.y - point->y) * (q.y - point->y) 
+                        + (q.z - point->z) * (q.z - point->z);
+
+                    if (dist < best_dist || best_dist < 0){
+                        *pu = u;
+                        *pv = v;
+                        best_dist = dist;
+                    }
+
+                    num_solutions++;
+                }
+            }
+        }
+    }
+
+    /* The normal may cross a patch that is not close to the point */
+    if (num_solutions == 0){
+        return nurbs_surface_inversion_normal
+            ( pu, pv, surface_orig, surface_order2, point, normal
+            , epsilon, rgamma );
+    }
+
+    /* Check that the final value is not outside of the knot interval */
+    if (*pu < surface_orig->knot_u[0]){
+        *pu = surface_orig->knot_u[0];
+    }
+    if (*pu > surface_orig->knot_u[surface_orig->knot_length_u-1]){
+        *pu = surface_orig->knot_u[surface_orig->knot_length_u-1];
+    }
+    if (*pv < surface_orig->knot_v[0]){
+        *pv = surface_orig->knot_v[0];
+    }
+    if (*pv > surface_orig->knot_v[surface_orig->knot_length_v-1]){
+        *pv = surface_orig->knot_v[surface_orig->knot_length_v-1];
+    }
+
+    return num_solutions;
+}
+
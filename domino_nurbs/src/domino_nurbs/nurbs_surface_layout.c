@@ -0,0 +1,168 @@
+ /***
+    Author: Mario J. Martin <dominonurbs$gmail.com>
+
+    Homogeneous layout of the control points of NURBS surfaces.
+    The evaluation routines need the control points multiplied by their
+    weights. Instead of reading the structures {x, y, z, w} through the
+    pointers of cp[u][v] and multiplying them each time, the surface can
+    keep a copy of {x*w, y*w, z*w, w} as four aligned arrays. The copy is
+    made the first time it is needed and kept until the surface is 
+    modified, as the Bezier extraction.
+
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "common/check_malloc.h"
+#include "common/log.h"
+
+#include "nurbs_internal.h"
+#include "nurbs_surface.h"
+
+/* Alignment of the rows in bytes (AVX) */
+#define NURBS_LAYOUT_ALIGN 32
+
+
+/* Releases the homogeneous control points */
+void nurbs_surface_homogeneous_free( NurbsSurfaceHomogeneous* h )
+{
+    if (h == nullptr){
+        return;
+    }
+
+    if (h->memory != nullptr){
+        free( h->memory );
+    }
+
+    free( h );
+}
+
+
+/* Copies the control points of the surface in homogeneous coordinates,
+ * if the layout of the surface is homogeneous */
+NurbsSurfaceHomogeneous* nurbs_surface_homogeneous_create
+    ( const NurbsSurface* surface )
+{
+    NurbsSurfaceHomogeneous* h = nullptr;
+    const int lanes = NURBS_LAYOUT_ALIGN / sizeof(NurbsFloat);
+    size_t size;
+    uintptr_t p;
+    NurbsVector4 cp;
+    int i, j;
+
+    if (surface == nullptr || surface->layout != NURBS_LAYOUT_HOMOGENEOUS
+        || surface->cp == nullptr)
+    {
+        return nullptr;
+    }
+
+    _check_(h = (NurbsSurfaceHomogeneous*)_malloc_(sizeof(NurbsSurfaceHomogeneous)));
+    if (h == nullptr){
+        return nullptr;
+    }
+
+    h->cp_length_u = surface->cp_length_u;
+    h->cp_length_v = surface->cp_length_v;
+    h->stride = ((surface->cp_length_v + lanes - 1) / lanes) * lanes;
+
+    /* Four arrays plus the room to align the first one */
+    size = sizeof(NurbsFloat) * h->cp_length_u * h->stride;
+    _check_(h->memory = _malloc_(4 * size + NURBS_LAYOUT_ALIGN));
+    if (h->memory == nullptr){
+        nurbs_surface_homogeneous_free( h );
+        return nullptr;
+    }
+
+    p = (uintptr_t)h->memory;
+    p = (p + NURBS_LAYOUT_ALIGN - 1) & ~(uintptr_t)(NURBS_LAYOUT_ALIGN - 1);
+
+    h->wx = (NurbsFloat*)p;
+    h->wy = (NurbsFloat*)(p + size);
+    h->wz = (NurbsFloat*)(p + 2 * size);
+    h->w = (NurbsFloat*)(p + 3 * size);
+
+    for (i = 0; i < h->cp_length_u; i++){
+        for (j = 0; j < h->stride; j++){
+            if (j < h->cp_length_v){
+                cp = surface->cp[i][j];
+            }
+            else{
+                /* Padding */
+                cp.x = cp.y = cp.z = cp.w = 0;
+            }
+
+            h->wx[i * h->stride + j] = cp.x * cp.w;
+            h->wy[i * h->stride + j] = cp.y * cp.w;
+            h->wz[i * h->stride + j] = cp.z * cp.w;
+            h->w[i * h->stride + j] = cp.w;
+        }
+    }
+
+    return h;
+}
+
+
+/* Returns the homogeneous control points kept in the surface, copying them
+ * if needed */
+const NurbsSurfaceHomogeneous* nurbs_surface_get_homogeneous
+    ( const NurbsSurface* surface )
+{
+    NurbsSurfaceHomogeneous* h;
+    NurbsSurface* owner;
+
+    if (surface == nullptr || surface->layout != NURBS_LAYOUT_HOMOGENEOUS){
+        return nullptr;
+    }
+
+    /* Once it is copied, the pointer does not change until the surface is
+     * modified; the flush makes its data visible in this thread */
+    h = surface->homogeneous;
+    #pragma omp flush
+    if (h != nullptr){
+        return h;
+    }
+
+    /* The cache is not part of the data of the surface */
+    owner = (NurbsSurface*)surface;
+
+    #pragma omp critical (nurbs_surface_cache)
+    {
+        if (owner->homogeneous == nullptr){
+            h = nurbs_surface_homogeneous_create( owner );
+
+            /* The data is written before the pointer */
+            #pragma omp flush
+            owner->homogeneous = h;
+            #pragma omp flush
+        }
+        h = owner->homogeneous;
+    }
+
+    return h;
+}
+
+
+/* Selects the layout of the control points used by the evaluation routines */
+int nurbs_surface_set_layout( NurbsSurface* surface, const int layout )
+{
+    if (surface == nullptr){
+        return 0;
+    }
+
+    if (layout != NURBS_LAYOUT_CP && layout != NURBS_LAYOUT_HOMOGENEOUS){
+        _handle_error_("Unknown layout of the control points");
+        return 0;
+    }
+
+    if (layout != surface->layout && surface->homogeneous != nullptr){
+        nurbs_surface_homogeneous_free( surface->homogeneous );
+        surface->homogeneous = nullptr;
+    }
+    surface->layout = layout;
+
+    return 1;
+}
+
+/**/
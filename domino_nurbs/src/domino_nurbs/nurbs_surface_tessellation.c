@@ -0,0 +1,977 @@
+ /***
+    Author: Mario J. Martin <dominonurbs$gmail.com>
+
+    Adaptive tessellation of NURBS surfaces to indexed triangle meshes.
+    Each non empty knot span is the root of a quadtree in the parametric
+    space. The cells are split while the surface deviates from the bilinear
+    interpolation of the corners more than the chord height, or the normals
+    turn more than the given angle. Then the quadtree is balanced (the
+    neighbours differ at most one level), so the edge of a cell has at most
+    one vertex of the finer neighbour on it, and the cells with such
+    vertices are triangulated as a fan from the center without cracks.
+    The surfaces are tessellated in parallel and merged at the end.
+
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "common/check_malloc.h"
+#include "common/log.h"
+
+#include "nurbs_internal.h"
+#include "nurbs_surface.h"
+
+/* Maximum depth of the quadtree of each knot span */
+#define TESS_MAX_DEPTH 12
+
+/* Empty slot of the hash tables */
+#define TESS_EMPTY_KEY UINT64_MAX
+
+
+/* Open addressing hash table of integer keys */
+typedef struct
+{
+    size_t capacity;    /* Power of two */
+    size_t count;
+    uint64_t* key;
+    int* value;
+}TessHash;
+
+
+/* Cell of the quadtree: level and position in the lattice of that level */
+typedef struct
+{
+    int level;
+    int i;
+    int j;
+}TessCell;
+
+
+/* Tessellation of one surface */
+typedef struct
+{
+    const NurbsSurface* surface;
+    int depth;
+    NurbsFloat chord_height;
+    NurbsFloat cos_angle;
+
+    int num_spans_u;
+    int num_spans_v;
+    int* span_u;            /* Knot index of each non empty span */
+    int* span_v;
+
+    int num_cells;
+    int max_cells;
+    TessCell* cell;         /* Cells, the dead ones have level -1 */
+    TessHash leaves;        /* Index of the cell of each leaf */
+
+    TessHash vertices;      /* Index of the vertex of each lattice point */
+    int num_vertices;
+    int max_vertices;
+    NurbsVector3* vertex;
+    NurbsVector3* normal;
+    NurbsFloat* param;
+
+    int num_triangles;
+    int max_triangles;
+    int* triangle;
+
+    int failed;             /* Memory exhausted */
+}TessSurface;
+
+
+/* Mixes the bits of the key (splitmix64) */
+static inline size_t hash_slot( const uint64_t key, const size_t capacity )
+{
+    uint64_t x = key;
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+
+    return (size_t)x & (capacity - 1);
+}
+
+
+static void hash_free( TessHash* h )
+{
+    if (h->key != nullptr){
+        free( h->key );
+    }
+    if (h->value != nullptr){
+        free( h->value );
+    }
+    h->key = nullptr;
+    h->value = nullptr;
+    h->capacity = 0;
+    h->count = 0;
+}
+
+
+static int hash_alloc( TessHash* h, const size_t capacity )
+{
+    size_t k;
+
+    h->capacity = capacity;
+    h->count = 0;
+    _check_(h->key = (uint64_t*)_malloc_(sizeof(uint64_t) * capacity));
+    _check_(h->value = (int*)_malloc_(sizeof(int) * capacity));
+    if (h->key == nullptr || h->value == nullptr){
+        hash_free( h );
+        return 0;
+    }
+
+    for (k = 0; k < capacity; k++){
+        h->key[k] = TESS_EMPTY_KEY;
+    }
+
+    return 1;
+}
+
+
+/* Returns the value of the key, or -1 if it is not in the table */
+static int hash_find( const TessHash* h, const uint64_t key )
+{
+    size_t k = hash_slot( key, h->capacity );
+
+    while (h->key[k] != TESS_EMPTY_KEY){
+        if (h->key[k] == key){
+            return h->value[k];
+        }
+        k = (k + 1) & (h->capacity - 1);
+    }
+
+    return -1;
+}
+
+
+/* Inserts or replaces the value of the key. Returns 0 if the memory is
+ * exhausted. */
+static int hash_set( TessHash* h, const uint64_t key, const int value )
+{
+    TessHash g;
+    size_t k;
+
+    /* Keeps the load under one half */
+    if (2 * (h->count + 1) > h->capacity){
+        if (!hash_alloc( &g, 2 * h->capacity )){
+            return 0;
+        }
+        for (k = 0; k < h->capacity; k++){
+            if (h->key[k] != TESS_EMPTY_KEY){
+                hash_set( &g, h->key[k], h->value[k] );
+            }
+        }
+        hash_free( h );
+        *h = g;
+    }
+
+    k = hash_slot( key, h->capacity );
+    while (h->key[k] != TESS_EMPTY_KEY){
+        if (h->key[k] == key){
+            h->value[k] = value;
+            return 1;
+        }
+        k = (k + 1) & (h->capacity - 1);
+    }
+
+    h->key[k] = key;
+    h->value[k] = value;
+    h->count++;
+
+    return 1;
+}
+
+
+static inline uint64_t cell_key( const int level, const int i, const int j )
+{
+    return ((uint64_t)level << 58) | ((uint64_t)i << 29) | (uint64_t)j;
+}
+
+
+static inline uint64_t lattice_key( const int I, const int J )
+{
+    return ((uint64_t)I << 32) | (uint64_t)J;
+}
+
+
+/* Parameter of the point I of the lattice of the deepest level */
+static NurbsFloat lattice_param
+    ( const NurbsFloat knot[]
+    , const int span[]
+    , const int num_spans
+    , const int depth
+    , const int I
+    )
+{
+    const int s = I >> depth;
+    const int offset = I & ((1 << depth) - 1);
+    int k;
+
+    if (s >= num_spans){
+        return knot[span[num_spans - 1] + 1];
+    }
+
+    k = span[s];
+
+    return knot[k] + (knot[k + 1] - knot[k]) * offset / (NurbsFloat)(1 << depth);
+}
+
+
+/* Lists the non empty knot spans. Returns the number of spans. */
+static int non_empty_spans
+    ( int span[]
+    , const NurbsFloat knot[]
+    , const int degree
+    , const int cp_length
+    )
+{
+    int i, n = 0;
+
+    for (i = degree; i < cp_length; i++){
+        if (knot[i] < knot[i + 1]){
+            if (span != nullptr){
+                span[n] = i;
+            }
+            n++;
+        }
+    }
+
+    return n;
+}
+
+
+static inline NurbsFloat distance2( const NurbsVector3 a, const NurbsVector3 b )
+{
+    return (a.x - b.x) * (a.x - b.x) + (a.y - b.y) * (a.y - b.y)
+        + (a.z - b.z) * (a.z - b.z);
+}
+
+
+/* Deviation of the midpoint of the segment from the surface */
+static inline int chord_exceeded
+    ( const NurbsVector3 a
+    , const NurbsVector3 b
+    , const NurbsVector3 m
+    , const NurbsFloat chord_height
+    )
+{
+    NurbsVector3 c;
+
+    c.x = (a.x + b.x) / 2;
+    c.y = (a.y + b.y) / 2;
+    c.z = (a.z + b.z) / 2;
+
+    return distance2( c, m ) > chord_height * chord_height;
+}
+
+
+/* Angle between two normals, skipping the singular points */
+static inline int angle_exceeded
+    ( const NurbsVector3 a
+    , const NurbsVector3 b
+    , const NurbsFloat cos_angle
+    )
+{
+    NurbsFloat d = a.x * b.x + a.y * b.y + a.z * b.z;
+
+    if (a.x == 0 && a.y == 0 && a.z == 0){
+        return 0;
+    }
+    if (b.x == 0 && b.y == 0 && b.z == 0){
+        return 0;
+    }
+
+    return d < cos_angle;
+}
+
+
+/* Checks if the cell must be split */
+static int cell_must_split( const TessSurface* ts, const TessCell* c )
+{
+    const NurbsSurface* surface = ts->surface;
+    const int size = 1 << (ts->depth - c->level);
+    NurbsFloat u0, u1, um, v0, v1, vm;
+    NurbsVector3 p00, p10, p01, p11, pm, n00, n10, n01, n11, nm, q;
+
+    if (c->level >= ts->depth){
+        return 0;
+    }
+
+    u0 = lattice_param( surface->knot_u, ts->span_u, ts->num_spans_u
+        , ts->depth, c->i * size );
+    u1 = lattice_param( surface->knot_u, ts->span_u, ts->num_spans_u
+        , ts->depth, (c->i + 1) * size );
+    v0 = lattice_param( surface->knot_v, ts->span_v, ts->num_spans_v
+        , ts->depth, c->j * size );
+    v1 = lattice_param( surface->knot_v, ts->span_v, ts->num_spans_v
+        , ts->depth, (c->j + 1) * size );
+    um = (u0 + u1) / 2;
+    vm = (v0 + v1) / 2;
+
+    p00 = nurbs_surface_get_point( surface, u0, v0 );
+    p10 = nurbs_surface_get_point( surface, u1, v0 );
+    p01 = nurbs_surface_get_point( surface, u0, v1 );
+    p11 = nurbs_surface_get_point( surface, u1, v1 );
+    pm = nurbs_surface_get_point( surface, um, vm );
+
+    /* Chord height of the edges and the diagonals */
+    q = nurbs_surface_get_point( surface, um, v0 );
+    if (chord_exceeded( p00, p10, q, ts->chord_height )){
+        return 1;
+    }
+    q = nurbs_surface_get_point( surface, um, v1 );
+    if (chord_exceeded( p01, p11, q, ts->chord_height )){
+        return 1;
+    }
+    q = nurbs_surface_get_point( surface, u0, vm );
+    if (chord_exceeded( p00, p01, q, ts->chord_height )){
+        return 1;
+    }
+    q = nurbs_surface_get_point( surface, u1, vm );
+    if (chord_exceeded( p10, p11, q, ts->chord_height )){
+        return 1;
+    }
+    if (chord_exceeded( p00, p11, pm, ts->chord_height )
+        || chord_exceeded( p10, p01, pm, ts->chord_height ))
+    {
+        return 1;
+    }
+
+    /* Deviation of the normals from the center */
+    nm = nurbs_surface_get_normal( surface, um, vm );
+    n00 = nurbs_surface_get_normal( surface, u0, v0 );
+    n10 = nurbs_surface_get_normal( surface, u1, v0 );
+    n01 = nurbs_surface_get_normal( surface, u0, v1 );
+    n11 = nurbs_surface_get_normal( surface, u1, v1 );
+
+    if (angle_exceeded( nm, n00, ts->cos_angle )
+        || angle_exceeded( nm, n10, ts->cos_angle )
+        || angle_exceeded( nm, n01, ts->cos_angle )
+        || angle_exceeded( nm, n11, ts->cos_angle ))
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
+
+/* Appends a cell as a leaf. Returns its index, or -1 if the memory is
+ * exhausted. */
+static int add_leaf( TessSurface* ts, const int level, const int i, const int j )
+{
+    TessCell* p;
+
+    if (ts->num_cells == ts->max_cells){
+        ts->max_cells = (ts->max_cells > 0) ? 2 * ts->max_cells : 256;
+        _check_(p = (TessCell*)_realloc_(ts->cell, sizeof(TessCell) * ts->max_cells));
+        if (p == nullptr){
+            ts->failed = 1;
+            return -1;
+        }
+        ts->cell = p;
+    }
+
+    if (!hash_set( &(ts->leaves), cell_key( level, i, j ), ts->num_cells )){
+        ts->failed = 1;
+        return -1;
+    }
+
+    ts->cell[ts->num_cells].level = level;
+    ts->cell[ts->num_cells].i = i;
+    ts->cell[ts->num_cells].j = j;
+
+    return ts->num_cells++;
+}
+
+
+/* Replaces the leaf by its four children */
+static void split_leaf( TessSurface* ts, const int index )
+{
+    const TessCell c = ts->cell[index];
+
+    hash_set( &(ts->leaves), cell_key( c.level, c.i, c.j ), -1 );
+    ts->cell[index].level = -1;
+
+    add_leaf( ts, c.level + 1, 2 * c.i, 2 * c.j );
+    add_leaf( ts, c.level + 1, 2 * c.i + 1, 2 * c.j );
+    add_leaf( ts, c.level + 1, 2 * c.i, 2 * c.j + 1 );
+    add_leaf( ts, c.level + 1, 2 * c.i + 1, 2 * c.j + 1 );
+}
+
+
+/* Finds the leaf that contains the cell {level, i, j} or one of its
+ * ancestors. Returns -1 if the cell is outside or it is split. */
+static int find_leaf( const TessSurface* ts, const int level, const int i, const int j )
+{
+    int k, index;
+
+    if (i < 0 || j < 0 || i >= (ts->num_spans_u << level)
+        || j >= (ts->num_spans_v << level))
+    {
+        return -1;
+    }
+
+    for (k = 0; k <= level; k++){
+        index = hash_find( &(ts->leaves), cell_key( level - k, i >> k, j >> k ) );
+        if (index >= 0){
+            return index;
+        }
+    }
+
+    return -1;
+}
+
+
+/* Splits the cells until the tolerances are met, and then balances the
+ * quadtree */
+static void refine( TessSurface* ts )
+{
+    const int di[4] = {1, -1, 0, 0};
+    const int dj[4] = {0, 0, 1, -1};
+    int i, j, k, n;
+    TessCell c;
+
+    for (i = 0; i < ts->num_spans_u && !ts->failed; i++){
+        for (j = 0; j < ts->num_spans_v && !ts->failed; j++){
+            add_leaf( ts, 0, i, j );
+        }
+    }
+
+    /* The new cells are appended, so this loop visits them too */
+    for (k = 0; k < ts->num_cells && !ts->failed; k++){
+        if (ts->cell[k].level >= 0 && cell_must_split( ts, &(ts->cell[k]) )){
+            split_leaf( ts, k );
+        }
+    }
+
+    /* The neighbours of a leaf cannot be more than one level coarser */
+    for (k = 0; k < ts->num_cells && !ts->failed; k++){
+        c = ts->cell[k];
+        if (c.level < 2){
+            continue;
+        }
+        for (i = 0; i < 4 && !ts->failed; i++){
+            n = find_leaf( ts, c.level, c.i + di[i], c.j + dj[i] );
+            while (n >= 0 && ts->cell[n].level < c.level - 1 && !ts->failed){
+                split_leaf( ts, n );
+                n = find_leaf( ts, c.level, c.i + di[i], c.j + dj[i] );
+            }
+        }
+    }
+}
+
+
+/* Appends a vertex. Returns its index, or -1 if the memory is exhausted. */
+static int add_vertex( TessSurface* ts, const NurbsFloat u, const NurbsFloat v )
+{
+    NurbsVector3* p;
+    NurbsVector3* n;
+    NurbsFloat* t;
+    int max;
+
+    if (ts->num_vertices == ts->max_vertices){
+        max = (ts->max_vertices > 0) ? 2 * ts->max_vertices : 256;
+        _check_(p = (NurbsVector3*)_realloc_(ts->vertex, sizeof(NurbsVector3) * max));
+        if (p != nullptr){
+            ts->vertex = p;
+        }
+        _check_(n = (NurbsVector3*)_realloc_(ts->normal, sizeof(NurbsVector3) * max));
+        if (n != nullptr){
+            ts->normal = n;
+        }
+        _check_(t = (NurbsFloat*)_realloc_(ts->param, sizeof(NurbsFloat) * 2 * max));
+        if (t != nullptr){
+            ts->param = t;
+        }
+        if (p == nullptr || n == nullptr || t == nullptr){
+            ts->failed = 1;
+            return -1;
+        }
+        ts->max_vertices = max;
+    }
+
+    ts->vertex[ts->num_vertices] = nurbs_surface_get_point( ts->surface, u, v );
+    ts->normal[ts->num_vertices] = nurbs_surface_get_normal( ts->surface, u, v );
+    ts->param[2 * ts->num_vertices] = u;
+    ts->param[2 * ts->num_vertices + 1] = v;
+
+    return ts->num_vertices++;
+}
+
+
+/* Returns the vertex of the lattice point, creating it if needed (create)
+ * Returns -1 if it does not exist. */
+static int lattice_vertex( TessSurface* ts, const int I, const int J, const int create )
+{
+    const uint64_t key = lattice_key( I, J );
+    int index = hash_find( &(ts->vertices), key );
+    NurbsFloat u, v;
+
+    if (index >= 0 || !create){
+        return index;
+    }
+
+    u = lattice_param( ts->surface->knot_u, ts->span_u, ts->num_spans_u
+        , ts->depth, I );
+    v = lattice_param( ts->surface->knot_v, ts->span_v, ts->num_spans_v
+        , ts->depth, J );
+
+    index = add_vertex( ts, u, v );
+    if (index >= 0 && !hash_set( &(ts->vertices), key, index )){
+        ts->failed = 1;
+        return -1;
+    }
+
+    return index;
+}
+
+
+static void add_triangle( TessSurface* ts, const int a, const int b, const int c )
+{
+    int* p;
+
+    if (ts->num_triangles == ts->max_triangles){
+        ts->max_triangles = (ts->max_triangles > 0) ? 2 * ts->max_triangles : 256;
+        _check_(p = (int*)_realloc_(ts->triangle, sizeof(int) * 3 * ts->max_triangles));
+        if (p == nullptr){
+            ts->failed = 1;
+            return;
+        }
+        ts->triangle = p;
+    }
+
+    ts->triangle[3 * ts->num_triangles] = a;
+    ts->triangle[3 * ts->num_triangles + 1] = b;
+    ts->triangle[3 * ts->num_triangles + 2] = c;
+    ts->num_triangles++;
+}
+
+
+/* Triangulates the leaves */
+static void triangulate( TessSurface* ts )
+{
+    int k, m, n, size, I0, I1, J0, J1, center;
+    int loop[8];
+    const TessCell* c;
+
+    /* The corners of the leaves are the vertices of the mesh */
+    for (k = 0; k < ts->num_cells && !ts->failed; k++){
+        c = &(ts->cell[k]);
+        if (c->level < 0){
+            continue;
+        }
+        size = 1 << (ts->depth - c->level);
+        lattice_vertex( ts, c->i * size, c->j * size, 1 );
+        lattice_vertex( ts, (c->i + 1) * size, c->j * size, 1 );
+        lattice_vertex( ts, c->i * size, (c->j + 1) * size, 1 );
+        lattice_vertex( ts, (c->i + 1) * size, (c->j + 1) * size, 1 );
+    }
+
+    for (k = 0; k < ts->num_cells && !ts->failed; k++){
+        c = &(ts->cell[k]);
+        if (c->level < 0){
+            continue;
+        }
+        size = 1 << (ts->depth - c->level);
+        I0 = c->i * size;
+        I1 = I0 + size;
+        J0 = c->j * size;
+        J1 = J0 + size;
+
+        /* Counterclockwise boundary, with the vertices of the finer
+         * neighbours at the middle of the edges */
+        n = 0;
+        loop[n++] = lattice_vertex( ts, I0, J0, 0 );
+        m = (size > 1) ? lattice_vertex( ts, I0 + size / 2, J0, 0 ) : -1;
+        if (m >= 0) loop[n++] = m;
+        loop[n++] = lattice_vertex( ts, I1, J0, 0 );
+        m = (size > 1) ? lattice_vertex( ts, I1, J0 + size / 2, 0 ) : -1;
+        if (m >= 0) loop[n++] = m;
+        loop[n++] = lattice_vertex( ts, I1, J1, 0 );
+        m = (size > 1) ? lattice_vertex( ts, I0 + size / 2, J1, 0 ) : -1;
+        if (m >= 0) loop[n++] = m;
+        loop[n++] = lattice_vertex( ts, I0, J1, 0 );
+        m = (size > 1) ? lattice_vertex( ts, I0, J0 + size / 2, 0 ) : -1;
+        if (m >= 0) loop[n++] = m;
+
+        if (n == 4){
+            /* Two triangles, split by the shortest diagonal */
+            if (distance2( ts->vertex[loop[0]], ts->vertex[loop[2]])
+                <= distance2( ts->vertex[loop[1]], ts->vertex[loop[3]]))
+            {
+                add_triangle( ts, loop[0], loop[1], loop[2] );
+                add_triangle( ts, loop[0], loop[2], loop[3] );
+            }
+            else{
+                add_triangle( ts, loop[0], loop[1], loop[3] );
+                add_triangle( ts, loop[1], loop[2], loop[3] );
+            }
+            continue;
+        }
+
+        /* The center is not shared with other cells */
+        center = add_vertex( ts
+            , lattice_param( ts->surface->knot_u, ts->span_u, ts->num_spans_u
+                , ts->depth, I0 + size / 2 )
+            , lattice_param( ts->surface->knot_v, ts->span_v, ts->num_spans_v
+                , ts->depth, J0 + size / 2 ) );
+        if (center < 0){
+            break;
+        }
+        for (m = 0; m < n; m++){
+            add_triangle( ts, center, loop[m], loop[(m + 1) % n] );
+        }
+    }
+}
+
+
+static void tess_dispose( TessSurface* ts )
+{
+    if (ts->span_u != nullptr){
+        free( ts->span_u );
+    }
+    if (ts->span_v != nullptr){
+        free( ts->span_v );
+    }
+    if (ts->cell != nullptr){
+        free( ts->cell );
+    }
+    if (ts->vertex != nullptr){
+        free( ts->vertex );
+    }
+    if (ts->normal != nullptr){
+        free( ts->normal );
+    }
+    if (ts->param != nullptr){
+        free( ts->param );
+    }
+    if (ts->triangle != nullptr){
+        free( ts->triangle );
+    }
+    hash_free( &(ts->leaves) );
+    hash_free( &(ts->vertices) );
+
+    memset( ts, 0, sizeof(TessSurface) );
+}
+
+
+/* Tessellation of one surface */
+static void tess_surface
+    ( TessSurface* ts
+    , const NurbsSurface* surface
+    , const NurbsFloat chord_height
+    , const NurbsFloat cos_angle
+    , const int depth
+    )
+{
+    memset( ts, 0, sizeof(TessSurface) );
+    ts->surface = surface;
+    ts->chord_height = chord_height;
+    ts->cos_angle = cos_angle;
+    ts->depth = depth;
+
+    if (surface->cp == nullptr || surface->degree_u < 1 || surface->degree_v < 1){
+        return;
+    }
+
+    ts->num_spans_u = non_empty_spans( nullptr, surface->knot_u
+        , surface->degree_u, surface->cp_length_u );
+    ts->num_spans_v = non_empty_spans( nullptr, surface->knot_v
+        , surface->degree_v, surface->cp_length_v );
+
+    if (ts->num_spans_u == 0 || ts->num_spans_v == 0){
+        return;
+    }
+
+    /* The lattice coordinates must fit in the keys of the hash tables */
+    while (ts->depth > 0 && ((int64_t)ts->num_spans_u << ts->depth) >= (1 << 28)){
+        ts->depth--;
+    }
+    while (ts->depth > 0 && ((int64_t)ts->num_spans_v << ts->depth) >= (1 << 28)){
+        ts->depth--;
+    }
+
+    _check_(ts->span_u = (int*)_malloc_(sizeof(int) * ts->num_spans_u));
+    _check_(ts->span_v = (int*)_malloc_(sizeof(int) * ts->num_spans_v));
+    if (ts->span_u == nullptr || ts->span_v == nullptr
+        || !hash_alloc( &(ts->leaves), 1024 )
+        || !hash_alloc( &(ts->vertices), 1024 ))
+    {
+        ts->failed = 1;
+        return;
+    }
+
+    non_empty_spans( ts->span_u, surface->knot_u, surface->degree_u
+        , surface->cp_length_u );
+    non_empty_spans( ts->span_v, surface->knot_v, surface->degree_v
+        , surface->cp_length_v );
+
+    refine( ts );
+    if (!ts->failed){
+        triangulate( ts );
+    }
+}
+
+
+/* Equivalent to a default constructor */
+void nurbs_mesh_init( NurbsMesh* mesh )
+{
+    mesh->num_vertices = 0;
+    mesh->num_triangles = 0;
+    mesh->vertex = nullptr;
+    mesh->normal = nullptr;
+    mesh->param = nullptr;
+    mesh->vertex_surface = nullptr;
+    mesh->triangle = nullptr;
+    mesh->triangle_surface = nullptr;
+}
+
+
+/* Releases the memory of the mesh (but not the structure) */
+void nurbs_mesh_dispose( NurbsMesh* mesh )
+{
+    if (mesh == nullptr){
+        return;
+    }
+
+    if (mesh->vertex != nullptr){
+        free( mesh->vertex );
+    }
+    if (mesh->normal != nullptr){
+        free( mesh->normal );
+    }
+    if (mesh->param != nullptr){
+        free( mesh->param );
+    }
+    if (mesh->vertex_surface != nullptr){
+        free( mesh->vertex_surface );
+    }
+    if (mesh->triangle != nullptr){
+        free( mesh->triangle );
+    }
+    if (mesh->triangle_surface != nullptr){
+        free( mesh->triangle_surface );
+    }
+
+    nurbs_mesh_init( mesh );
+}
+
+
+/* Concatenates meshes; the surface of the vertices and triangles of the
+ * part i is i */
+int nurbs_mesh_merge
+    ( NurbsMesh* mesh
+    , const NurbsMesh* const parts[]
+    , const int num_parts
+    )
+{
+    int* vertex_offset = nullptr;
+    int* triangle_offset = nullptr;
+    int i, k, failed;
+
+    nurbs_mesh_dispose( mesh );
+
+    if (parts == nullptr || num_parts <= 0){
+        return 0;
+    }
+
+    _check_(vertex_offset = (int*)_malloc_(sizeof(int) * (num_parts + 1)));
+    _check_(triangle_offset = (int*)_malloc_(sizeof(int) * (num_parts + 1)));
+    if (vertex_offset == nullptr || triangle_offset == nullptr){
+        if (vertex_offset != nullptr) free( vertex_offset );
+        if (triangle_offset != nullptr) free( triangle_offset );
+        return 0;
+    }
+
+    vertex_offset[0] = 0;
+    triangle_offset[0] = 0;
+    for (i = 0; i < num_parts; i++){
+        vertex_offset[i + 1] = vertex_offset[i]
+            + ((parts[i] != nullptr) ? parts[i]->num_vertices : 0);
+        triangle_offset[i + 1] = triangle_offset[i]
+            + ((parts[i] != nullptr) ? parts[i]->num_triangles : 0);
+    }
+
+    mesh->num_vertices = vertex_offset[num_parts];
+    mesh->num_triangles = triangle_offset[num_parts];
+
+    _check_(mesh->vertex = (NurbsVector3*)_malloc_
+        (sizeof(NurbsVector3) * (mesh->num_vertices + 1)));
+    _check_(mesh->normal = (NurbsVector3*)_malloc_
+        (sizeof(NurbsVector3) * (mesh->num_vertices + 1)));
+    _check_(mesh->param = (NurbsFloat*)_malloc_
+        (sizeof(NurbsFloat) * 2 * (mesh->num_vertices + 1)));
+    _check_(mesh->vertex_surface = (int*)_malloc_
+        (sizeof(int) * (mesh->num_vertices + 1)));
+    _check_(mesh->triangle = (int*)_malloc_
+        (sizeof(int) * 3 * (mesh->num_triangles + 1)));
+    _check_(mesh->triangle_surface = (int*)_malloc_
+        (sizeof(int) * (mesh->num_triangles + 1)));
+
+    failed = (mesh->vertex == nullptr || mesh->normal == nullptr
+        || mesh->param == nullptr || mesh->vertex_surface == nullptr
+        || mesh->triangle == nullptr || mesh->triangle_surface == nullptr);
+
+    if (!failed){
+        #pragma omp parallel for private(k) schedule(static)
+        for (i = 0; i < num_parts; i++){
+            const NurbsMesh* part = parts[i];
+            const int v0 = vertex_offset[i];
+            const int t0 = triangle_offset[i];
+
+            if (part == nullptr){
+                continue;
+            }
+            if (part->num_vertices > 0){
+                memcpy( &(mesh->vertex[v0]), part->vertex
+                    , sizeof(NurbsVector3) * part->num_vertices );
+                memcpy( &(mesh->normal[v0]), part->normal
+                    , sizeof(NurbsVector3) * part->num_vertices );
+                memcpy( &(mesh->param[2 * v0]), part->param
+                    , sizeof(NurbsFloat) * 2 * part->num_vertices );
+            }
+            for (k = 0; k < part->num_vertices; k++){
+                mesh->vertex_surface[v0 + k] = i;
+            }
+            for (k = 0; k < 3 * part->num_triangles; k++){
+                mesh->triangle[3 * t0 + k] = part->triangle[k] + v0;
+            }
+            for (k = 0; k < part->num_triangles; k++){
+                mesh->triangle_surface[t0 + k] = i;
+            }
+        }
+    }
+
+    free( vertex_offset );
+    free( triangle_offset );
+
+    if (failed){
+        nurbs_mesh_dispose( mesh );
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/* Tessellates a set of surfaces into one indexed triangle mesh */
+int nurbs_surface_tessellate
+    ( NurbsMesh* mesh
+    , const NurbsSurface surfaces[]
+    , const int num_surfaces
+    , const NurbsFloat chord_height
+    , const NurbsFloat normal_angle
+    , const int max_depth
+    )
+{
+    TessSurface* ts = nullptr;
+    int* vertex_offset = nullptr;
+    int* triangle_offset = nullptr;
+    int i, k, failed = 0;
+    const int depth = (max_depth < 0) ? 0
+        : ((max_depth > TESS_MAX_DEPTH) ? TESS_MAX_DEPTH : max_depth);
+    const NurbsFloat cos_angle = (normal_angle > 0) ? cos( normal_angle ) : -2;
+
+    nurbs_mesh_dispose( mesh );
+
+    if (surfaces == nullptr || num_surfaces <= 0){
+        return 0;
+    }
+
+    _check_(ts = (TessSurface*)_malloc_(sizeof(TessSurface) * num_surfaces));
+    _check_(vertex_offset = (int*)_malloc_(sizeof(int) * (num_surfaces + 1)));
+    _check_(triangle_offset = (int*)_malloc_(sizeof(int) * (num_surfaces + 1)));
+    if (ts == nullptr || vertex_offset == nullptr || triangle_offset == nullptr){
+        if (ts != nullptr) free( ts );
+        if (vertex_offset != nullptr) free( vertex_offset );
+        if (triangle_offset != nullptr) free( triangle_offset );
+        return 0;
+    }
+
+    /* The cost of each surface is very different */
+    #pragma omp parallel for schedule(dynamic)
+    for (i = 0; i < num_surfaces; i++){
+        tess_surface( &(ts[i]), &(surfaces[i]), chord_height, cos_angle, depth );
+    }
+
+    vertex_offset[0] = 0;
+    triangle_offset[0] = 0;
+    for (i = 0; i < num_surfaces; i++){
+        failed |= ts[i].failed;
+        vertex_offset[i + 1] = vertex_offset[i] + ts[i].num_vertices;
+        triangle_offset[i + 1] = triangle_offset[i] + ts[i].num_triangles;
+    }
+
+    if (failed){
+        _handle_error_("Not enough memory to tessellate the surfaces");
+    }
+    else{
+        mesh->num_vertices = vertex_offset[num_surfaces];
+        mesh->num_triangles = triangle_offset[num_surfaces];
+
+        _check_(mesh->vertex = (NurbsVector3*)_malloc_
+            (sizeof(NurbsVector3) * (mesh->num_vertices + 1)));
+        _check_(mesh->normal = (NurbsVector3*)_malloc_
+            (sizeof(NurbsVector3) * (mesh->num_vertices + 1)));
+        _check_(mesh->param = (NurbsFloat*)_malloc_
+            (sizeof(NurbsFloat) * 2 * (mesh->num_vertices + 1)));
+        _check_(mesh->vertex_surface = (int*)_malloc_
+            (sizeof(int) * (mesh->num_vertices + 1)));
+        _check_(mesh->triangle = (int*)_malloc_
+            (sizeof(int) * 3 * (mesh->num_triangles + 1)));
+        _check_(mesh->triangle_surface = (int*)_malloc_
+            (sizeof(int) * (mesh->num_triangles + 1)));
+
+        failed = (mesh->vertex == nullptr || mesh->normal == nullptr
+            || mesh->param == nullptr || mesh->vertex_surface == nullptr
+            || mesh->triangle == nullptr || mesh->triangle_surface == nullptr);
+    }
+
+    if (!failed){
+        #pragma omp parallel for private(k) schedule(static)
+        for (i = 0; i < num_surfaces; i++){
+            const int v0 = vertex_offset[i];
+            const int t0 = triangle_offset[i];
+
+            if (ts[i].num_vertices > 0){
+                memcpy( &(mesh->vertex[v0]), ts[i].vertex
+                    , sizeof(NurbsVector3) * ts[i].num_vertices );
+                memcpy( &(mesh->normal[v0]), ts[i].normal
+                    , sizeof(NurbsVector3) * ts[i].num_vertices );
+                memcpy( &(mesh->param[2 * v0]), ts[i].param
+                    , sizeof(NurbsFloat) * 2 * ts[i].num_vertices );
+            }
+            for (k = 0; k < ts[i].num_vertices; k++){
+                mesh->vertex_surface[v0 + k] = i;
+            }
+            for (k = 0; k < 3 * ts[i].num_triangles; k++){
+                mesh->triangle[3 * t0 + k] = ts[i].triangle[k] + v0;
+            }
+            for (k = 0; k < ts[i].num_triangles; k++){
+                mesh->triangle_surface[t0 + k] = i;
+            }
+        }
+    }
+
+    for (i = 0; i < num_surfaces; i++){
+        tess_dispose( &(ts[i]) );
+    }
+    free( ts );
+    free( vertex_offset );
+    free( triangle_offset );
+
+    if (failed){
+        nurbs_mesh_dispose( mesh );
+        return 0;
+    }
+
+    return 1;
+}
+
+/**/
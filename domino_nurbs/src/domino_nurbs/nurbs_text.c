@@ -0,0 +1,661 @@
+ /***
+    Author: Mario J. Martin <dominonurbs$gmail.com>
+
+    Conversion of numbers from and to text, independent of the locale.
+    sscanf() and strtod() are slow and use the decimal point of the locale,
+    so a file written in one country may not be read in another one.
+    Most numbers have less than 16 significant digits and a small exponent;
+    then the mantissa and the power of ten are exact doubles, and one
+    multiplication or division gives the correctly rounded result. The other
+    numbers are passed to strtod() with the decimal point of the locale.
+
+    The numbers are written with the shortest digits that are read back to
+    the same double (Grisu2, by Florian Loitsch): the digits are calculated
+    with 64 bit integers and a table of powers of ten, which is several
+    times faster than printf("%.17g"). The text is stored in a buffer that
+    grows as needed, and it is written to the file in one call.
+
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <locale.h>
+
+#include "common/check_malloc.h"
+
+#include "nurbs_internal.h"
+#include "nurbs_text.h"
+
+/* Maximum number of significant digits stored in the mantissa */
+#define TEXT_MAX_DIGITS 19
+
+/* Size of the first block of memory of a text */
+#define TEXT_BLOCK 65536
+
+/* Maximum length of a number as text */
+#define TEXT_MAX_NUMBER 32
+
+/* Maximum mantissa that is an exact double (2^53) */
+#define TEXT_MAX_EXACT 9007199254740992ULL
+
+/* Exact powers of ten in double precision */
+static const double exact_power10[23] =
+    { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11
+    , 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+
+/* Slow path: strtod() with the decimal point of the locale. The numbers 
+ * that do not fit in the buffer of the stack (many digits) are copied to 
+ * the heap, so that they are not truncated. */
+static double text_to_double_libc( const char* start, const char* end )
+{
+    char stack_buffer[64];
+    char* buffer = stack_buffer;
+    const char point = localeconv()->decimal_point[0];
+    const int n = (int)(end - start);
+    double value;
+    int i;
+
+    if (n >= (int)sizeof(stack_buffer)){
+        _check_(buffer = (char*)_malloc_(n + 1));
+        if (buffer == nullptr){
+            return NURBS_ERROR_VALUE;
+        }
+    }
+
+    for (i = 0; i < n; i++){
+        char c = start[i];
+        if (c == '.'){
+            c = point;
+        }
+        else if (c == 'D' || c == 'd'){
+            c = 'E';
+        }
+        buffer[i] = c;
+    }
+    buffer[n] = '\0';
+
+    value = strtod( buffer, NULL );
+
+    if (buffer != stack_buffer){
+        free( buffer );
+    }
+
+    return value;
+}
+
+
+/* Reads a real number */
+NurbsFloat nurbs_text_to_float( const char* str, const char** end )
+{
+    const char* p = str;
+    const char* start;
+    unsigned long long mantissa = 0;
+    int digits = 0;         /* Significant digits in the mantissa */
+    int exponent = 0;       /* Decimal exponent of the mantissa */
+    int any_digit = 0;
+    int truncated = 0;
+    int negative = 0;
+    int e, e_negative;
+    double value;
+
+    while (*p == ' ' || *p == '\t'){
+        p++;
+    }
+    start = p;
+
+    if (*p == '-' || *p == '+'){
+        negative = (*p == '-');
+        p++;
+    }
+
+    /* Integer part */
+    while (*p >= '0' && *p <= '9'){
+        any_digit = 1;
+        if (digits < TEXT_MAX_DIGITS){
+            if (mantissa > 0 || *p != '0'){
+                mantissa = mantissa * 10 + (unsigned long long)(*p - '0');
+                digits += (mantissa > 0);
+            }
+        }
+        else{
+            exponent++;
+            truncated |= (*p != '0');
+        }
+        p++;
+    }
+
+    /* Fraction */
+    if (*p == '.'){
+        p++;
+        while (*p >= '0' && *p <= '9'){
+            any_digit = 1;
+            if (digits < TEXT_MAX_DIGITS){
+                if (mantissa > 0 || *p != '0'){
+                    mantissa = mantissa * 10 + (unsigned long long)(*p - '0');
+                    digits += (mantissa > 0);
+                }
+                exponent--;
+            }
+            else{
+                truncated |= (*p != '0');
+            }
+            p++;
+        }
+    }
+
+    if (!any_digit){
+        if (end != nullptr){
+            *end = str;
+        }
+        return 0;
+    }
+
+    /* Exponent (E or D) */
+    if (*p == 'E' || *p == 'e' || *p == 'D' || *p == 'd'){
+        const char* q = p + 1;
+
+        e = 0;
+        e_negative = 0;
+        if (*q == '-' || *q == '+'){
+            e_negative = (*q == '-');
+            q++;
+        }
+        if (*q >= '0' && *q <= '9'){
+            while (*q >= '0' && *q <= '9'){
+                if (e < 100000){
+                    e = e * 10 + (*q - '0');
+                }
+                q++;
+            }
+            exponent += e_negative ? -e : e;
+            p = q;
+        }
+    }
+
+    if (end != nullptr){
+        *end = p;
+    }
+
+    if (mantissa == 0){
+        return negative ? -0.0 : 0.0;
+    }
+
+    if (!truncated && mantissa <= TEXT_MAX_EXACT
+        && exponent >= -22 && exponent <= 22)
+    {
+        /* Both values are exact, so the result is correctly rounded */
+        value = (double)mantissa;
+        if (exponent < 0){
+            value /= exact_power10[-exponent];
+        }
+        else{
+            value *= exact_power10[exponent];
+        }
+        if (negative){
+            value = -value;
+        }
+    }
+    else{
+        /* With the sign */
+        value = text_to_double_libc( start, p );
+    }
+
+    return (NurbsFloat)value;
+}
+
+
+/******************************************************************************/
+
+/* Cached powers of ten for the conversion of numbers to text (Grisu2):
+ * 10^k = f * 2^e, with k = -348 + 8 i and f normalized (highest bit set) */
+static const unsigned long long cached_power_f[87] =
+    { 0xFA8FD5A0081C0288ULL, 0xBAAEE17FA23EBF76ULL, 0x8B16FB203055AC76ULL
+    , 0xCF42894A5DCE35EAULL, 0x9A6BB0AA55653B2DULL, 0xE61ACF033D1A45DFULL
+    , 0xAB70FE17C79AC6CAULL, 0xFF77B1FCBEBCDC4FULL, 0xBE5691EF416BD60CULL
+    , 0x8DD01FAD907FFC3CULL, 0xD3515C2831559A83ULL, 0x9D71AC8FADA6C9B5ULL
+    , 0xEA9C227723EE8BCBULL, 0xAECC49914078536DULL, 0x823C12795DB6CE57ULL
+    , 0xC21094364DFB5637ULL, 0x9096EA6F3848984FULL, 0xD77485CB25823AC7ULL
+    , 0xA086CFCD97BF97F4ULL, 0xEF340A98172AACE5ULL, 0xB23867FB2A35B28EULL
+    , 0x84C8D4DFD2C63F3BULL, 0xC5DD44271AD3CDBAULL, 0x936B9FCEBB25C996ULL
+    , 0xDBAC6C247D62A584ULL, 0xA3AB66580D5FDAF6ULL, 0xF3E2F893DEC3F126ULL
+    , 0xB5B5ADA8AAFF80B8ULL, 0x87625F056C7C4A8BULL, 0xC9BCFF6034C13053ULL
+    , 0x964E858C91BA2655ULL, 0xDFF9772470297EBDULL, 0xA6DFBD9FB8E5B88FULL
+    , 0xF8A95FCF88747D94ULL, 0xB94470938FA89BCFULL, 0x8A08F0F8BF0F156BULL
+    , 0xCDB02555653131B6ULL, 0x993FE2C6D07B7FACULL, 0xE45C10C42A2B3B06ULL
+    , 0xAA242499697392D3ULL, 0xFD87B5F28300CA0EULL, 0xBCE5086492111AEBULL
+    , 0x8CBCCC096F5088CCULL, 0xD1B71758E219652CULL, 0x9C40000000000000ULL
+    , 0xE8D4A51000000000ULL, 0xAD78EBC5AC620000ULL, 0x813F3978F8940984ULL
+    , 0xC097CE7BC90715B3ULL, 0x8F7E32CE7BEA5C70ULL, 0xD5D238A4ABE98068ULL
+    , 0x9F4F2726179A2245ULL, 0xED63A231D4C4FB27ULL, 0xB0DE65388CC8ADA8ULL
+    , 0x83C7088E1AAB65DBULL, 0xC45D1DF942711D9AULL, 0x924D692CA61BE758ULL
+    , 0xDA01EE641A708DEAULL, 0xA26DA3999AEF774AULL, 0xF209787BB47D6B85ULL
+    , 0xB454E4A179DD1877ULL, 0x865B86925B9BC5C2ULL, 0xC83553C5C8965D3DULL
+    , 0x952AB45CFA97A0B3ULL, 0xDE469FBD99A05FE3ULL, 0xA59BC234DB398C25ULL
+    , 0xF6C69A72A3989F5CULL, 0xB7DCBF5354E9BECEULL, 0x88FCF317F22241E2ULL
+    , 0xCC20CE9BD35C78A5ULL, 0x98165AF37B2153DFULL, 0xE2A0B5DC971F303AULL
+    , 0xA8D9D1535CE3B396ULL, 0xFB9B7CD9A4A7443CULL, 0xBB764C4CA7A44410ULL
+    , 0x8BAB8EEFB6409C1AULL, 0xD01FEF10A657842CULL, 0x9B10A4E5E9913129ULL
+    , 0xE7109BFBA19C0C9DULL, 0xAC2820D9623BF429ULL, 0x80444B5E7AA7CF85ULL
+    , 0xBF21E44003ACDD2DULL, 0x8E679C2F5E44FF8FULL, 0xD433179D9C8CB841ULL
+    , 0x9E19DB92B4E31BA9ULL, 0xEB96BF6EBADF77D9ULL, 0xAF87023B9BF0EE6BULL
+    };
+
+static const short cached_power_e[87] =
+    { -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927
+    , -901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608
+    , -582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289
+    , -263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30
+    , 56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348
+    , 375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667
+    , 694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986
+    , 1013, 1039, 1066
+    };
+
+/* Powers of ten that fit in 64 bits */
+static const unsigned long long power10[20] =
+    { 1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL
+    , 10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL
+    , 100000000000ULL, 1000000000000ULL, 10000000000000ULL
+    , 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL
+    , 100000000000000000ULL, 1000000000000000000ULL
+    , 10000000000000000000ULL
+    };
+
+/* Floating point number with a 64 bit significand: f * 2^e */
+typedef struct
+{
+    unsigned long long f;
+    int e;
+}DiyFp;
+
+
+/* Product, rounded to the upper 64 bits */
+static DiyFp diy_multiply( const DiyFp x, const DiyFp y )
+{
+    const unsigned long long M32 = 0xFFFFFFFFULL;
+    const unsigned long long a = x.f >> 32, b = x.f & M32;
+    const unsigned long long c = y.f >> 32, d = y.f & M32;
+    const unsigned long long ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    unsigned long long tmp = (bd >> 32) + (ad & M32) + (bc & M32);
+    DiyFp r;
+
+    tmp += 1ULL << 31;  /* Round */
+    r.f = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32);
+    r.e = x.e + y.e + 64;
+
+    return r;
+}
+
+
+/* Shifts the significand until its highest bit is set */
+static DiyFp diy_normalize( DiyFp x )
+{
+    while ((x.f & 0x8000000000000000ULL) == 0){
+        x.f <<= 1;
+        x.e--;
+    }
+    return x;
+}
+
+
+/* Adjusts the last digit, so the number is the closest one to the value
+ * inside the interval */
+static void grisu_round
+    ( char* buffer
+    , const int length
+    , const unsigned long long delta
+    , unsigned long long rest
+    , const unsigned long long ten_kappa
+    , const unsigned long long wp_w
+    )
+{
+    while (rest < wp_w && delta - rest >= ten_kappa
+        && (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w))
+    {
+        buffer[length - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+
+/* Generates the digits of the shortest number in the interval (mp - delta,
+ * mp). The value is digits * 10^k. Returns the number of digits. */
+static int grisu_digits
+    ( char* buffer
+    , const DiyFp w
+    , const DiyFp mp
+    , unsigned long long delta
+    , int* k
+    )
+{
+    const int shift = -mp.e;
+    const unsigned long long one = 1ULL << shift;
+    const unsigned long long wp_w = mp.f - w.f;
+    unsigned int p1 = (unsigned int)(mp.f >> shift);
+    unsigned long long p2 = mp.f & (one - 1);
+    unsigned long long tmp;
+    int kappa = 1, length = 0;
+    unsigned int d;
+
+    while (kappa < 10 && p1 >= power10[kappa]){
+        kappa++;
+    }
+
+    /* Integer part */
+    while (kappa > 0){
+        d = (unsigned int)(p1 / power10[kappa - 1]);
+        p1 = (unsigned int)(p1 % power10[kappa - 1]);
+        if (d > 0 || length > 0){
+            buffer[length++] = (char)('0' + d);
+        }
+        kappa--;
+
+        tmp = ((unsigned long long)p1 << shift) + p2;
+        if (tmp <= delta){
+            *k += kappa;
+            grisu_round( buffer, length, delta, tmp
+                , power10[kappa] << shift, wp_w );
+            return length;
+        }
+    }
+
+    /* Fraction */
+    for (;;){
+        p2 *= 10;
+        delta *= 10;
+        d = (unsigned int)(p2 >> shift);
+        if (d > 0 || length > 0){
+            buffer[length++] = (char)('0' + d);
+        }
+        p2 &= one - 1;
+        kappa--;
+
+        if (p2 < delta){
+            *k += kappa;
+            grisu_round( buffer, length, delta, p2, one
+                , (-kappa < 20) ? wp_w * power10[-kappa] : 0 );
+            return length;
+        }
+    }
+}
+
+
+/* Shortest digits of a positive value (Grisu2). The value is 
+ * digits * 10^k. Returns the number of digits. */
+static int grisu2( char* buffer, const double value, int* k )
+{
+    union{ double d; unsigned long long u; } bits;
+    const unsigned long long hidden = 0x0010000000000000ULL;
+    DiyFp v, plus, minus, c;
+    int biased, index;
+    double dk;
+
+    bits.d = value;
+    biased = (int)((bits.u >> 52) & 0x7FF);
+    v.f = bits.u & (hidden - 1);
+    if (biased != 0){
+        v.f += hidden;
+        v.e = biased - 1075;
+    }
+    else{
+        v.e = -1074;
+    }
+
+    /* Boundaries of the values that are rounded to this one */
+    plus.f = (v.f << 1) + 1;
+    plus.e = v.e - 1;
+    plus = diy_normalize( plus );
+    if (v.f == hidden){
+        minus.f = (v.f << 2) - 1;
+        minus.e = v.e - 2;
+    }
+    else{
+        minus.f = (v.f << 1) - 1;
+        minus.e = v.e - 1;
+    }
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+
+    /* Power of ten that takes the upper boundary to [2^-60, 2^-32] */
+    dk = (-61 - plus.e) * 0.30102999566398114 + 347;
+    index = (int)dk;
+    if (dk - index > 0.0){
+        index++;
+    }
+    index = (index >> 3) + 1;
+    *k = -(-348 + index * 8);
+    c.f = cached_power_f[index];
+    c.e = cached_power_e[index];
+
+    v = diy_multiply( diy_normalize( v ), c );
+    plus = diy_multiply( plus, c );
+    minus = diy_multiply( minus, c );
+    minus.f++;
+    plus.f--;
+
+    return grisu_digits( buffer, v, plus, plus.f - minus.f, k );
+}
+
+
+/* Writes the exponent of the scientific notation */
+static int text_exponent( char* buffer, int e )
+{
+    int n = 0;
+
+    buffer[n++] = 'E';
+    if (e < 0){
+        buffer[n++] = '-';
+        e = -e;
+    }
+    else{
+        buffer[n++] = '+';
+    }
+    if (e >= 100){
+        buffer[n++] = (char)('0' + e / 100);
+        e %= 100;
+    }
+    buffer[n++] = (char)('0' + e / 10);
+    buffer[n++] = (char)('0' + e % 10);
+
+    return n;
+}
+
+
+/* Writes a real number with the shortest text that is read back exactly */
+int nurbs_float_to_text( char* buffer, const NurbsFloat value )
+{
+    const double x = (double)value;
+    char digits[32];
+    int n = 0, length, k, point, i;
+
+    if (x != x || x - x != 0){
+        /* Not a number or infinite */
+        return sprintf( buffer, "%g", x );
+    }
+
+    if (x < 0 || (x == 0 && 1 / x < 0)){
+        buffer[n++] = '-';
+    }
+    if (x == 0){
+        buffer[n++] = '0';
+        buffer[n++] = '.';
+        buffer[n++] = '0';
+        buffer[n] = '\0';
+        return n;
+    }
+
+    length = grisu2( digits, (x < 0) ? -x : x, &k );
+    point = length + k;     /* Position of the decimal point */
+
+    if (k >= 0 && point <= 21){
+        /* Integer: 1234000.0 */
+        memcpy( buffer + n, digits, length );
+        n += length;
+        for (i = 0; i < k; i++){
+            buffer[n++] = '0';
+        }
+        buffer[n++] = '.';
+        buffer[n++] = '0';
+    }
+    else if (point > 0 && point <= 21){
+        /* 1234.5678 */
+        memcpy( buffer + n, digits, point );
+        n += point;
+        buffer[n++] = '.';
+        memcpy( buffer + n, digits + point, length - point );
+        n += length - point;
+    }
+    else if (point > -6 && point <= 0){
+        /* 0.0001234 */
+        buffer[n++] = '0';
+        buffer[n++] = '.';
+        for (i = point; i < 0; i++){
+            buffer[n++] = '0';
+        }
+        memcpy( buffer + n, digits, length );
+        n += length;
+    }
+    else{
+        /* 1.234E-56 */
+        buffer[n++] = digits[0];
+        buffer[n++] = '.';
+        if (length > 1){
+            memcpy( buffer + n, digits + 1, length - 1 );
+            n += length - 1;
+        }
+        else{
+            buffer[n++] = '0';
+        }
+        n += text_exponent( buffer + n, point - 1 );
+    }
+
+    buffer[n] = '\0';
+    return n;
+}
+
+
+/* Writes an integer */
+int nurbs_int_to_text( char* buffer, const int value )
+{
+    char digits[16];
+    unsigned int u = (value < 0) ? 0U - (unsigned int)value : (unsigned int)value;
+    int n = 0, length = 0;
+
+    do{
+        digits[length++] = (char)('0' + u % 10);
+        u /= 10;
+    }while (u > 0);
+
+    if (value < 0){
+        buffer[n++] = '-';
+    }
+    while (length > 0){
+        buffer[n++] = digits[--length];
+    }
+    buffer[n] = '\0';
+
+    return n;
+}
+
+
+/******************************************************************************/
+
+/* Equivalent to a default constructor */
+void nurbs_text_init( NurbsText* text )
+{
+    text->data = nullptr;
+    text->length = 0;
+    text->capacity = 0;
+    text->error = 0;
+}
+
+
+/* Makes room for more characters. Returns 0 if the memory is exhausted. */
+static int text_reserve( NurbsText* text, const size_t length )
+{
+    char* data;
+    size_t capacity;
+
+    if (text->error){
+        return 0;
+    }
+    if (text->length + length + 1 <= text->capacity){
+        return 1;
+    }
+
+    capacity = (text->capacity > 0) ? 2 * text->capacity : TEXT_BLOCK;
+    while (capacity < text->length + length + 1){
+        capacity *= 2;
+    }
+
+    _check_(data = (char*)_realloc_(text->data, capacity));
+    if (data == nullptr){
+        text->error = 1;
+        return 0;
+    }
+    text->data = data;
+    text->capacity = capacity;
+
+    return 1;
+}
+
+
+/* Appends a string */
+void nurbs_text_add( NurbsText* text, const char* str )
+{
+    const size_t length = strlen( str );
+
+    if (text_reserve( text, length )){
+        memcpy( text->data + text->length, str, length + 1 );
+        text->length += length;
+    }
+}
+
+
+/* Appends a real number (shortest text that is read back exactly) */
+void nurbs_text_add_float( NurbsText* text, const NurbsFloat value )
+{
+    if (text_reserve( text, TEXT_MAX_NUMBER )){
+        text->length += nurbs_float_to_text( text->data + text->length, value );
+    }
+}
+
+
+/* Appends an integer */
+void nurbs_text_add_int( NurbsText* text, const int value )
+{
+    if (text_reserve( text, TEXT_MAX_NUMBER )){
+        text->length += nurbs_int_to_text( text->data + text->length, value );
+    }
+}
+
+
+/* Writes the text to the file and empties it. */
+int nurbs_text_write( NurbsText* text, FILE* fd )
+{
+    int status = !text->error;
+
+    if (text->length > 0 
+        && fwrite( text->data, 1, text->length, fd ) != text->length)
+    {
+        status = 0;
+    }
+    text->length = 0;
+
+    return status;
+}
+
+
+/* Releases the memory */
+void nurbs_text_dispose( NurbsText* text )
+{
+    if (text->data != nullptr){
+        free( text->data );
+    }
+    nurbs_text_init( text );
+}
+
+/**/
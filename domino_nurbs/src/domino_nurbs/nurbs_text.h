@@ -0,0 +1,93 @@
+ /***
+    Author: Mario J. Martin <dominonurbs$gmail.com>
+
+    Conversion of numbers from and to text, independent of the locale.
+    It is only used by the readers and writers; it is not part of the 
+    public interface.
+
+*******************************************************************************/
+
+
+#ifndef _NURBS_TEXT_H
+#define _NURBS_TEXT_H
+
+#include <stdio.h>
+
+#include "nurbs_definitions.h"
+
+#ifdef  __cplusplus
+  extern "C" {
+#endif
+
+/* Text that grows as needed */
+typedef struct
+{
+    char* data;         /* Text, terminated with '\0' */
+    size_t length;      /* Length of the text */
+    size_t capacity;    /* Size of the allocated memory */
+    int error;          /* The memory was exhausted; the text is not valid */
+}NurbsText;
+
+/*******************************************************************************
+*  Description:
+*     Reads a real number, e.g. "-1.25", "3", ".5E-3", or "1.0D+02" (Fortran
+*     exponent, used in IGES files). The decimal point is always '.',
+*     whatever the locale. The leading spaces are skipped. The result is
+*     correctly rounded: the common cases are calculated exactly in double
+*     precision, and the rest by the C library.
+*  Return Values:
+*    NurbsFloat
+*    @return the value; 0 if there is no number (and then end = str).
+*
+*******************************************************************************/
+NurbsFloat nurbs_text_to_float
+    ( const char* str       /** Text */
+    , const char** end      /** (out) First character after the number
+                              * (or nullptr) */
+    );
+
+/*******************************************************************************
+*  Description:
+*     Writes a real number with the shortest text that is read back to the
+*     same value, e.g. "0.1", "-2.5", "3.0", "1.0E-10". The text always has
+*     a decimal point, and the decimal point is always '.'. The buffer 
+*     requires 32 characters.
+*  Return Values:
+*    int
+*    @return the length of the text.
+*
+*******************************************************************************/
+int nurbs_float_to_text
+    ( char* buffer          /** (out) Text */
+    , const NurbsFloat value/** Value */
+    );
+
+/* Writes an integer. Returns the length of the text. */
+int nurbs_int_to_text( char* buffer, const int value );
+
+/* Equivalent to a default constructor */
+void nurbs_text_init( NurbsText* text );
+
+/* Appends a string */
+void nurbs_text_add( NurbsText* text, const char* str );
+
+/* Appends a real number (see nurbs_float_to_text) */
+void nurbs_text_add_float( NurbsText* text, const NurbsFloat value );
+
+/* Appends an integer */
+void nurbs_text_add_int( NurbsText* text, const int value );
+
+/* Writes the text to the file and empties it. Returns 0 if the memory was
+ * exhausted or the file cannot be written. */
+int nurbs_text_write( NurbsText* text, FILE* fd );
+
+/* Releases the memory */
+void nurbs_text_dispose( NurbsText* text );
+
+#ifdef  __cplusplus
+  }
+#endif
+
+#endif /* _NURBS_TEXT_H */
+
+/**/